@@ -0,0 +1,456 @@
+// On-device helper for adb_insight: keeps sysfs/procfs files open and
+// serves their contents over an abstract unix socket, so a sample costs
+// one pread per file instead of a shell spawn. It also scans /proc for
+// per-process counters and sends only what changed since the previous
+// scan. See agent_protocol.hpp for the wire format.
+//
+// Usage: adb_insight_agent [--daemon] [--socket=<name>] [--idle-exit=<seconds>]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <poll.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "agent_protocol.hpp"
+
+namespace {
+
+using namespace agent::protocol;
+
+std::atomic<int> g_connections{0};
+
+struct File {
+    int fd;
+    uint8_t group;
+    std::string path;
+};
+
+// Only kernel state files; the helper runs as shell and must not become
+// a way to read anything else the shell user can
+bool allowed(const std::string& path) {
+    return (path.compare(0, 5, "/sys/") == 0 || path.compare(0, 6, "/proc/") == 0) &&
+           path.find("/../") == std::string::npos;
+}
+
+bool write_all(int fd, const std::string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = send(fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool read_exact(int fd, char* buf, size_t n) {
+    while (n > 0) {
+        ssize_t got = recv(fd, buf, n, 0);
+        if (got == 0) return false;
+        if (got < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        buf += got;
+        n -= static_cast<size_t>(got);
+    }
+    return true;
+}
+
+// Append the whole file to out from offset 0; false if it cannot be read
+// (e.g. scaling_cur_freq of an offline core)
+bool read_file(int fd, std::string& out) {
+    size_t start = out.size();
+    size_t chunk = 4096;
+    off_t offset = 0;
+    while (true) {
+        out.resize(start + static_cast<size_t>(offset) + chunk);
+        ssize_t n = pread(fd, &out[start + static_cast<size_t>(offset)], chunk, offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            out.resize(start);
+            return false;
+        }
+        offset += n;
+        if (n == 0) break;
+        if (static_cast<size_t>(n) == chunk && chunk < (1u << 20)) chunk *= 2;
+    }
+    out.resize(start + static_cast<size_t>(offset));
+    return true;
+}
+
+uint64_t monotonic_ns() {
+    timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+// Clock of /proc/<pid>/stat start times, so scans can be compared with them
+uint64_t boottime_ns() {
+    timespec ts{};
+    clock_gettime(CLOCK_BOOTTIME, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+void close_all(std::vector<File>& files) {
+    for (auto& file : files) close(file.fd);
+    files.clear();
+}
+
+std::string open_files(Cursor& request, std::vector<File>& files) {
+    close_all(files);
+    while (!request.done()) {
+        uint8_t group = request.u8();
+        std::string pattern = request.str(request.u16());
+
+        glob_t matches{};
+        if (glob(pattern.c_str(), 0, nullptr, &matches) == 0) {
+            for (size_t i = 0; i < matches.gl_pathc; ++i) {
+                std::string path = matches.gl_pathv[i];
+                if (!allowed(path)) continue;
+                int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+                if (fd >= 0) files.push_back({fd, group, std::move(path)});
+            }
+        }
+        globfree(&matches);
+    }
+
+    std::string body;
+    put_u32(body, static_cast<uint32_t>(files.size()));
+    for (const auto& file : files) {
+        put_u8(body, file.group);
+        put_u16(body, static_cast<uint16_t>(file.path.size()));
+        body += file.path;
+    }
+    return frame(Open, body);
+}
+
+void read_files(Cursor& request, const std::vector<File>& files, std::string& reply) {
+    uint64_t mask = request.u64();
+
+    reply.clear();
+    put_u32(reply, 0);  // length, patched below
+    put_u8(reply, Read);
+    put_u64(reply, monotonic_ns());
+    size_t count_pos = reply.size();
+    put_u32(reply, 0);
+
+    uint32_t count = 0;
+    for (size_t id = 0; id < files.size(); ++id) {
+        if (files[id].group >= 64 || !(mask & (1ull << files[id].group))) continue;
+        put_u32(reply, static_cast<uint32_t>(id));
+        size_t length_pos = reply.size();
+        put_u32(reply, 0);
+        size_t start = reply.size();
+        bool ok = read_file(files[id].fd, reply);
+        patch_u32(reply, length_pos, ok ? static_cast<uint32_t>(reply.size() - start) : 0xffffffffu);
+        ++count;
+    }
+    patch_u32(reply, count_pos, count);
+    patch_u32(reply, 0, static_cast<uint32_t>(reply.size() - 4));
+}
+
+// Counters of one process, compared against what was last sent
+struct ProcessState {
+    uint32_t ppid = 0;
+    uint64_t start = 0;
+    uint64_t cpu = 0;
+    uint64_t rss = 0;
+    int32_t oom = 0;
+    uint32_t threads = 0;
+    char state = '?';
+
+    bool operator!=(const ProcessState& o) const {
+        return ppid != o.ppid || start != o.start || cpu != o.cpu || rss != o.rss || oom != o.oom ||
+               threads != o.threads || state != o.state;
+    }
+};
+
+struct Seen {
+    ProcessState state;
+    uint32_t scan;  // last scan that found the pid
+};
+
+// /proc/<pid>/<file> into buf, NUL-terminated; false once the process is gone
+bool read_proc(uint32_t pid, const char* file, char* buf, size_t size) {
+    char path[64];
+    std::snprintf(path, sizeof(path), "/proc/%u/%s", pid, file);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    ssize_t n;
+    do {
+        n = read(fd, buf, size - 1);
+    } while (n < 0 && errno == EINTR);
+    close(fd);
+    if (n <= 0) return false;
+    buf[n] = '\0';
+    return true;
+}
+
+bool scan_process(uint32_t pid, ProcessState& out, std::string& name) {
+    char buf[1024];
+    if (!read_proc(pid, "stat", buf, sizeof(buf))) return false;
+
+    // The name may hold spaces and parentheses: it ends at the last ')'
+    char* open_paren = std::strchr(buf, '(');
+    char* close_paren = std::strrchr(buf, ')');
+    if (!open_paren || !close_paren || close_paren < open_paren) return false;
+    name.assign(open_paren + 1, close_paren);
+
+    // Fields after the name, numbered from 3 as in proc(5)
+    uint64_t fields[23] = {};
+    char* p = close_paren + 1;
+    for (int field = 3; field <= 22; ++field) {
+        while (*p == ' ') ++p;
+        if (!*p) return false;
+        if (field == 3) {
+            out.state = *p;
+            while (*p && *p != ' ') ++p;
+            continue;
+        }
+        char* end;
+        fields[field] = std::strtoull(p, &end, 10);  // priority and nice may wrap; unused
+        if (end == p) return false;
+        p = end;
+    }
+    out.ppid = static_cast<uint32_t>(fields[4]);
+    out.cpu = fields[14] + fields[15];
+    out.threads = static_cast<uint32_t>(fields[20]);
+    out.start = fields[22];
+
+    out.rss = 0;
+    if (read_proc(pid, "statm", buf, sizeof(buf))) {
+        char* end;
+        std::strtoull(buf, &end, 10);  // total size
+        out.rss = std::strtoull(end, nullptr, 10);
+    }
+    out.oom = read_proc(pid, "oom_score_adj", buf, sizeof(buf)) ? std::atoi(buf) : 0;
+    return true;
+}
+
+void scan_processes(std::unordered_map<uint32_t, Seen>& seen, uint32_t& scan, std::string& reply) {
+    DIR* dir = opendir("/proc");
+    if (!dir) throw std::runtime_error("cannot open /proc");
+
+    reply.clear();
+    put_u32(reply, 0);  // length, patched below
+    put_u8(reply, Processes);
+    put_u64(reply, boottime_ns());
+    put_u8(reply, scan == 0 ? 1 : 0);
+    put_u32(reply, static_cast<uint32_t>(sysconf(_SC_PAGESIZE)));
+    size_t count_pos = reply.size();
+    put_u32(reply, 0);
+    ++scan;
+
+    uint32_t count = 0;
+    std::string name;
+    while (dirent* entry = readdir(dir)) {
+        char* end;
+        unsigned long pid = std::strtoul(entry->d_name, &end, 10);
+        if (end == entry->d_name || *end != '\0') continue;
+
+        ProcessState state;
+        if (!scan_process(static_cast<uint32_t>(pid), state, name)) continue;
+        auto [it, inserted] = seen.try_emplace(static_cast<uint32_t>(pid));
+        bool changed = inserted || it->second.state != state;
+        it->second = {state, scan};
+        if (!changed) continue;
+
+        put_u32(reply, static_cast<uint32_t>(pid));
+        put_u32(reply, state.ppid);
+        put_u64(reply, state.start);
+        put_u64(reply, state.cpu);
+        put_u64(reply, state.rss);
+        put_u32(reply, static_cast<uint32_t>(state.oom));
+        put_u32(reply, state.threads);
+        put_u8(reply, static_cast<uint8_t>(state.state));
+        size_t length = std::min<size_t>(name.size(), 255);
+        put_u8(reply, static_cast<uint8_t>(length));
+        reply.append(name, 0, length);
+        ++count;
+    }
+    closedir(dir);
+    patch_u32(reply, count_pos, count);
+
+    size_t exited_pos = reply.size();
+    put_u32(reply, 0);
+    uint32_t exited = 0;
+    for (auto it = seen.begin(); it != seen.end();) {
+        if (it->second.scan == scan) {
+            ++it;
+            continue;
+        }
+        put_u32(reply, it->first);
+        ++exited;
+        it = seen.erase(it);
+    }
+    patch_u32(reply, exited_pos, exited);
+    patch_u32(reply, 0, static_cast<uint32_t>(reply.size() - 4));
+}
+
+// adbd forwards localabstract: connections as the shell user (or root)
+bool trusted_peer(int fd) {
+    ucred cred{};
+    socklen_t len = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) return false;
+    return cred.uid == 0 || cred.uid == getuid();
+}
+
+void serve(int fd) {
+    std::vector<File> files;
+    std::unordered_map<uint32_t, Seen> processes;
+    uint32_t scan = 0;
+    std::string body;
+    std::string reply;
+
+    while (true) {
+        char header[5];
+        if (!read_exact(fd, header, 4)) break;
+        uint32_t length = Cursor(header, 4).u32();
+        if (length == 0 || length > kMaxMessage) break;
+        body.resize(length);
+        if (!read_exact(fd, &body[0], length)) break;
+
+        Cursor request(body.data() + 1, length - 1);
+        uint8_t op = static_cast<uint8_t>(body[0]);
+        try {
+            if (op == Hello) {
+                std::string version;
+                put_u32(version, kVersion);
+                reply = frame(Hello, version);
+            } else if (op == Open) {
+                reply = open_files(request, files);
+            } else if (op == Read) {
+                read_files(request, files, reply);
+            } else if (op == Processes) {
+                scan_processes(processes, scan, reply);
+            } else if (op == Quit) {
+                std::_Exit(0);
+            } else {
+                reply = frame(Error, "unknown op " + std::to_string(op));
+            }
+        } catch (const std::exception& e) {
+            reply = frame(Error, e.what());
+        }
+        if (!write_all(fd, reply)) break;
+    }
+
+    close_all(files);
+    close(fd);
+    --g_connections;
+}
+
+void daemonize() {
+    pid_t pid = fork();
+    if (pid < 0) std::exit(1);
+    if (pid > 0) std::_Exit(0);
+    setsid();
+    // Second fork: never reacquire a controlling terminal, and let adbd
+    // reap the shell that launched us
+    pid = fork();
+    if (pid < 0) std::exit(1);
+    if (pid > 0) std::_Exit(0);
+
+    int null = open("/dev/null", O_RDWR);
+    if (null >= 0) {
+        dup2(null, STDIN_FILENO);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        if (null > STDERR_FILENO) close(null);
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    bool daemon = false;
+    std::string name = kSocketName;
+    int idle_exit_s = 600;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--daemon") {
+            daemon = true;
+        } else if (arg.compare(0, 9, "--socket=") == 0) {
+            name = arg.substr(9);
+        } else if (arg.compare(0, 12, "--idle-exit=") == 0) {
+            idle_exit_s = std::atoi(arg.c_str() + 12);
+        } else {
+            std::fprintf(stderr, "usage: %s [--daemon] [--socket=<name>] [--idle-exit=<seconds>]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    std::signal(SIGPIPE, SIG_IGN);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0) {
+        std::perror("socket");
+        return 1;
+    }
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (name.size() + 1 > sizeof(addr.sun_path)) {
+        std::fprintf(stderr, "socket name too long\n");
+        return 2;
+    }
+    // Abstract namespace: leading NUL, nothing on the filesystem to clean up
+    name.copy(addr.sun_path + 1, name.size());
+    socklen_t addr_len = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + 1 + name.size());
+    if (bind(listener, reinterpret_cast<sockaddr*>(&addr), addr_len) != 0) {
+        if (errno == EADDRINUSE) return 0;  // already running
+        std::perror("bind");
+        return 1;
+    }
+    if (listen(listener, 8) != 0) {
+        std::perror("listen");
+        return 1;
+    }
+
+    // Bound before forking, so the launching shell returns only once
+    // the socket accepts connections
+    if (daemon) daemonize();
+
+    auto idle_since = std::chrono::steady_clock::now();
+    while (true) {
+        pollfd pfd{listener, POLLIN, 0};
+        int ready = poll(&pfd, 1, 1000);
+        if (ready < 0 && errno != EINTR) return 1;
+
+        if (ready > 0) {
+            int fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0) continue;
+            if (!trusted_peer(fd)) {
+                close(fd);
+                continue;
+            }
+            ++g_connections;
+            std::thread(serve, fd).detach();
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (g_connections.load() > 0) {
+            idle_since = now;
+        } else if (idle_exit_s > 0 && now - idle_since > std::chrono::seconds(idle_exit_s)) {
+            return 0;
+        }
+    }
+}
@@ -0,0 +1,308 @@
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+#include "adb_utils.hpp"
+#include "builders.hpp"
+#include "capture.hpp"
+#include "collector.hpp"
+#include "delta.hpp"
+#include "parsers.hpp"
+#include "payload.hpp"
+#include "snapshot.hpp"
+#include "wire.hpp"
+
+// ============ ALLOCATION COUNTING ============
+
+namespace {
+
+std::atomic<uint64_t> g_allocations{0};
+std::atomic<uint64_t> g_allocated_bytes{0};
+
+void* counted_alloc(std::size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    g_allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* p = std::malloc(size == 0 ? 1 : size)) return p;
+    throw std::bad_alloc();
+}
+
+} // namespace
+
+void* operator new(std::size_t size) { return counted_alloc(size); }
+void* operator new[](std::size_t size) { return counted_alloc(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+namespace {
+
+// Run fn once per iteration and report allocs/op and bytes/op next to ns/op.
+// A capture that makes fn throw marks the benchmark as skipped.
+template <typename F>
+void measure(benchmark::State& state, F&& fn) {
+    try {
+        benchmark::DoNotOptimize(fn());
+    } catch (const std::exception& e) {
+        state.SkipWithError(e.what());
+        for (auto _ : state) {}
+        return;
+    }
+
+    uint64_t allocations = g_allocations.load(std::memory_order_relaxed);
+    uint64_t bytes = g_allocated_bytes.load(std::memory_order_relaxed);
+    for (auto _ : state) {
+        auto result = fn();
+        benchmark::DoNotOptimize(result);
+    }
+    using benchmark::Counter;
+    state.counters["allocs/op"] = Counter(
+        static_cast<double>(g_allocations.load(std::memory_order_relaxed) - allocations), Counter::kAvgIterations);
+    state.counters["bytes/op"] = Counter(
+        static_cast<double>(g_allocated_bytes.load(std::memory_order_relaxed) - bytes), Counter::kAvgIterations);
+}
+
+// ============ FIXTURES ============
+
+struct Fixture {
+    std::shared_ptr<const bench::Capture> capture;
+    std::shared_ptr<bench::ReplayTransport> transport;
+    std::unique_ptr<adb::Device> device;
+    snapshot::Snapshot snapshot;
+    std::string battery;
+    std::string thermal;
+    std::string df;
+};
+
+// Shares the transport so misses can be read back after the run
+class SharedTransport : public adb::Transport {
+public:
+    explicit SharedTransport(std::shared_ptr<adb::Transport> inner) : inner_(std::move(inner)) {}
+    adb::CommandResult run(const std::string& cmd, std::chrono::milliseconds timeout) override {
+        return inner_->run(cmd, timeout);
+    }
+
+private:
+    std::shared_ptr<adb::Transport> inner_;
+};
+
+std::vector<std::string> capture_files(const std::string& dir) {
+    std::vector<std::string> files;
+    if (DIR* d = opendir(dir.c_str())) {
+        while (dirent* entry = readdir(d)) {
+            std::string name = entry->d_name;
+            if (name.size() > 4 && name.compare(name.size() - 4, 4, ".txt") == 0) {
+                files.push_back(dir + "/" + name);
+            }
+        }
+        closedir(d);
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+std::unique_ptr<Fixture> load_fixture(const std::string& path) {
+    auto fixture = std::make_unique<Fixture>();
+    fixture->capture = std::make_shared<const bench::Capture>(bench::Capture::load(path));
+    fixture->transport = std::make_shared<bench::ReplayTransport>(fixture->capture);
+    fixture->device = std::make_unique<adb::Device>(
+        fixture->capture->name, std::make_unique<SharedTransport>(fixture->transport));
+
+    auto text = [&](const char* cmd) {
+        const std::string* output = fixture->capture->find(cmd);
+        return output ? *output : std::string();
+    };
+    fixture->snapshot = snapshot::capture(*fixture->device, snapshot::All);
+    fixture->battery = text("dumpsys battery");
+    fixture->thermal = text("dumpsys thermalservice");
+    fixture->df = text("df -k");
+    return fixture;
+}
+
+SystemInfo build_system(adb::Device& device) {
+    SystemInfo system;
+    system.device = collector::attempt([&] { return build_device_info(device); }, "device");
+    system.os = collector::attempt([&] { return build_os_info(device); }, "os");
+    system.cpu = collector::attempt([&] { return build_cpu_info(device); }, "cpu");
+    system.cpu_frequency = collector::attempt([&] { return build_cpu_frequency(device); }, "cpu_frequency");
+    system.cpu_governors = collector::attempt([&] { return build_cpu_governors(device); }, "cpu_governors");
+    system.cpu_idle = collector::attempt([&] { return build_cpu_idle_info(device); }, "cpu_idle");
+    system.memory = collector::attempt([&] { return build_memory_info(device); }, "memory");
+    system.storage = collector::attempt([&] { return build_storage_info(device); }, "storage");
+    system.mounts = collector::attempt([&] { return build_storage_mounts(device); }, "mounts");
+    system.battery = collector::attempt([&] { return build_battery_info(device); }, "battery");
+    system.power = collector::attempt([&] { return build_power_info(device); }, "power");
+    system.thermal = collector::attempt([&] { return build_thermal_info(device); }, "thermal");
+    system.core_temperatures = collector::attempt([&] { return build_core_temperatures(device); }, "core_temperatures");
+    system.network = collector::attempt([&] { return build_network_info(device); }, "network");
+    system.display = collector::attempt([&] { return build_display_info(device); }, "display");
+    system.timestamp = "2026-01-01T00:00:00.000Z";
+    return system;
+}
+
+// ============ REGISTRATION ============
+
+template <typename F>
+void add(const std::string& name, const Fixture& fixture, F fn) {
+    benchmark::RegisterBenchmark((name + "/" + fixture.capture->name).c_str(),
+                                 [fn](benchmark::State& state) { measure(state, fn); });
+}
+
+void register_parsers(const Fixture& f) {
+    using namespace parsers;
+    const snapshot::Snapshot& s = f.snapshot;
+    auto battery_map = parse_key_value_block(f.battery);
+
+    add("scan_key_value_block", f, [&f] { return scan_key_value_block(f.battery).size(); });
+    add("scan_cpu_freq", f, [&s] { return scan_cpu_freq(s.cpu_cur_freq).count(); });
+    add("scan_path_value_block", f, [&s] { return scan_path_value_block(s.cpu_governors).count(); });
+    add("scan_cpu_idle_output", f, [&s] { return scan_cpu_idle_output(s.cpu_idle).size(); });
+    add("scan_proc_stat", f, [&s] { return scan_proc_stat(s.proc_stat).count(); });
+    add("scan_time_in_state", f, [&s] { return scan_time_in_state(s.cpu_time_in_state).size(); });
+    add("parse_key_value_block", f, [&f] { return parse_key_value_block(f.battery); });
+    add("parse_cpu_freq", f, [&s] { return parse_cpu_freq(s.cpu_cur_freq); });
+    add("parse_cpu_frequencies_detailed", f, [&s] { return parse_cpu_frequencies_detailed(s.cpu_cur_freq).max_khz; });
+    add("parse_thermal_data", f, [&f] { return parse_thermal_data(f.thermal); });
+    add("parse_battery_level", f, [battery_map] { return parse_battery_level(battery_map).level; });
+    add("parse_df_output", f, [&f] { return parse_df_output(f.df); });
+    add("parse_cpu_idle_output", f, [&s] { return parse_cpu_idle_output(s.cpu_idle); });
+    add("parse_path_value_block", f, [&s] { return parse_path_value_block(s.cpu_governors); });
+    add("parse_power_info", f, [battery_map] { return parse_power_info(battery_map).current_ma; });
+    add("kb_to_mb", f, [] { return kb_to_mb("7834216 kB"); });
+    add("kb_to_gb", f, [] { return kb_to_gb(117212304); });
+}
+
+void register_builders(const Fixture& f) {
+    adb::Device& d = *f.device;
+    const snapshot::Snapshot& s = f.snapshot;
+
+    add("build_device_info", f, [&d] { return build_device_info(d); });
+    add("build_os_info", f, [&d] { return build_os_info(d); });
+    add("build_cpu_info", f, [&d] { return build_cpu_info(d); });
+    add("build_cpu_frequency", f, [&d] { return build_cpu_frequency(d); });
+    add("build_cpu_governors", f, [&d] { return build_cpu_governors(d); });
+    add("build_cpu_idle_info", f, [&d] { return build_cpu_idle_info(d); });
+    add("build_memory_info", f, [&d] { return build_memory_info(d); });
+    add("build_storage_info", f, [&d] { return build_storage_info(d); });
+    add("build_storage_mounts", f, [&d] { return build_storage_mounts(d); });
+    add("build_battery_info", f, [&d] { return build_battery_info(d); });
+    add("build_power_info", f, [&d] { return build_power_info(d); });
+    add("build_thermal_info", f, [&d] { return build_thermal_info(d); });
+    add("build_core_temperatures", f, [&d] { return build_core_temperatures(d); });
+    add("build_network_info", f, [&d] { return build_network_info(d); });
+    add("build_display_info", f, [&d] { return build_display_info(d); });
+    add("build_uptime_info", f, [&d] { return build_uptime_info(d); });
+    add("snapshot_capture", f, [&d] { return snapshot::capture(d, snapshot::All).proc_stat.size(); });
+
+    add("cpu_frequency_from", f, [&s] { return cpu_frequency_from(s); });
+    add("cpu_governors_from", f, [&s] { return cpu_governors_from(s); });
+    add("cpu_idle_info_from", f, [&s] { return cpu_idle_info_from(s); });
+    add("memory_info_from", f, [&s] { return memory_info_from(s); });
+    add("uptime_info_from", f, [&s] { return uptime_info_from(s); });
+}
+
+void register_serializers(const Fixture& f) {
+    auto system = std::make_shared<const SystemInfo>(build_system(*f.device));
+    auto document = std::make_shared<const nlohmann::json>(*system);
+
+    add("system_to_json_dom", f, [system] { return nlohmann::json(*system).size(); });
+    add("system_wire_json", f, [system] { return wire::to_string(*system).size(); });
+    add("system_dom_dump", f, [document] { return document->dump().size(); });
+    add("system_dom_pretty", f, [document] { return payload::encode(*document, payload::Format::PrettyJson).size(); });
+    add("system_dom_msgpack", f, [document] { return payload::encode(*document, payload::Format::MsgPack).size(); });
+    add("system_dom_cbor", f, [document] { return payload::encode(*document, payload::Format::Cbor).size(); });
+    add("system_gzip", f, [system] {
+        return payload::compress(wire::to_string(*system), payload::Encoding::Gzip).size();
+    });
+    add("system_sections", f, [system] { return delta::sections_of(*system).size(); });
+}
+
+// ============ RECORDING ============
+
+// Run every builder against a real device and save what it was asked
+int record(const std::string& path, const std::string& serial) {
+    bench::Capture capture;
+    size_t slash = path.find_last_of('/');
+    capture.name = path.substr(slash == std::string::npos ? 0 : slash + 1);
+    capture.name = capture.name.substr(0, capture.name.find_last_of('.'));
+
+    adb::Device device(serial, std::make_unique<bench::RecordingTransport>(
+        std::make_unique<adb::SessionPool>(serial, 1), capture));
+    build_system(device);
+    build_uptime_info(device);
+    collector::attempt([&] { return snapshot::capture(device, snapshot::All); }, "snapshot");
+
+    try {
+        capture.save(path);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    std::cout << "Recorded " << capture.outputs.size() << " commands to " << path << "\n";
+    return 0;
+}
+
+// Value of --name=value, removed from argv
+const char* take_flag(int& argc, char** argv, const char* name) {
+    size_t len = std::strlen(name);
+    for (int i = 1; i < argc; ++i) {
+        if (std::strncmp(argv[i], name, len) == 0 && argv[i][len] == '=') {
+            const char* value = argv[i] + len + 1;
+            std::copy(argv + i + 1, argv + argc, argv + i);
+            --argc;
+            return value;
+        }
+    }
+    return nullptr;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const char* record_path = take_flag(argc, argv, "--record");
+    const char* serial = take_flag(argc, argv, "--serial");
+    const char* captures_dir = take_flag(argc, argv, "--captures");
+
+    if (record_path) {
+        return record(record_path, serial ? serial : "");
+    }
+
+    std::vector<std::unique_ptr<Fixture>> fixtures;
+    for (const auto& path : capture_files(captures_dir ? captures_dir : ADB_INSIGHT_BENCH_CAPTURES)) {
+        try {
+            fixtures.push_back(load_fixture(path));
+        } catch (const std::exception& e) {
+            std::cerr << "Skipping capture " << path << ": " << e.what() << "\n";
+        }
+    }
+    if (fixtures.empty()) {
+        std::cerr << "No captures found\n";
+        return 1;
+    }
+
+    for (const auto& fixture : fixtures) {
+        register_parsers(*fixture);
+        register_builders(*fixture);
+        register_serializers(*fixture);
+    }
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+
+    // Commands the builders sent that a capture could not answer
+    for (const auto& fixture : fixtures) {
+        for (const auto& cmd : fixture->transport->misses()) {
+            std::cerr << "warning: " << fixture->capture->name << " has no output for: " << cmd << "\n";
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,200 @@
+#include "capture.hpp"
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+namespace bench {
+
+namespace {
+
+constexpr const char* kHeader = ">>> ";
+constexpr const char* kMarker = "echo __ADB_MULTI__";
+// Start of the cost probes Device::shell_multi puts around the commands
+constexpr const char* kProbe = "__p=; while read";
+// What Device::shell puts between a measured command and its closing probe
+constexpr const char* kProbedEnd = "; __rc=$?; ";
+
+// The script without its cost probes, which are not commands of their own
+std::string strip_probes(const std::string& script) {
+    const std::string probe = kProbe;
+    if (script.compare(0, probe.size(), probe) != 0) return script;
+    size_t begin = script.find(kMarker);
+    size_t end = script.rfind(probe);
+    if (begin == std::string::npos || end <= begin) return script;
+    return script.substr(begin, end - begin);
+}
+
+// The commands of a Device::shell_multi script
+// ("echo __ADB_MULTI__0; cmd0; echo __ADB_MULTI__1; cmd1; "), or nullopt
+std::optional<std::vector<std::string>> split_multi(const std::string& wrapped) {
+    const std::string script = strip_probes(wrapped);
+    const std::string marker = kMarker;
+    if (script.compare(0, marker.size(), marker) != 0) return std::nullopt;
+
+    std::vector<std::string> cmds;
+    size_t pos = 0;
+    while (pos < script.size()) {
+        size_t body = script.find("; ", pos);
+        if (script.compare(pos, marker.size(), marker) != 0 || body == std::string::npos) return std::nullopt;
+        body += 2;
+        size_t next = script.find("; " + marker, body);
+        size_t end = next == std::string::npos ? script.size() : next;
+        std::string cmd = script.substr(body, end - body);
+        if (cmd.size() >= 2 && cmd.compare(cmd.size() - 2, 2, "; ") == 0) cmd.resize(cmd.size() - 2);
+        cmds.push_back(std::move(cmd));
+        pos = next == std::string::npos ? script.size() : next + 2;
+    }
+    return cmds;
+}
+
+// The command of a Device::shell script measured with a cost, or nullopt
+std::optional<std::string> split_probed(const std::string& script) {
+    const std::string probe = kProbe;
+    if (script.compare(0, probe.size(), probe) != 0) return std::nullopt;
+    size_t begin = script.find("__ADB_COST__0");
+    if (begin == std::string::npos || (begin = script.find("; ", begin)) == std::string::npos) return std::nullopt;
+    begin += 2;
+    size_t end = script.find(kProbedEnd, begin);
+    if (end == std::string::npos || script.compare(end + std::char_traits<char>::length(kProbedEnd),
+                                                   probe.size(), probe) != 0) {
+        return std::nullopt;
+    }
+    return script.substr(begin, end - begin);
+}
+
+void append_section(std::string& out, size_t index, const std::string& output) {
+    out += "__ADB_MULTI__" + std::to_string(index) + "\n";
+    out += output;
+    if (!output.empty() && output.back() != '\n') out += '\n';
+}
+
+std::string strip_trailing_newlines(std::string s) {
+    while (!s.empty() && (s.back() == '\n' || s.back() == '\r')) s.pop_back();
+    return s;
+}
+
+} // namespace
+
+// ============ CAPTURE ============
+
+Capture Capture::load(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("Cannot read capture: " + path);
+    }
+
+    Capture capture;
+    size_t slash = path.find_last_of('/');
+    size_t dot = path.find_last_of('.');
+    size_t start = slash == std::string::npos ? 0 : slash + 1;
+    capture.name = path.substr(start, dot == std::string::npos || dot < start ? std::string::npos : dot - start);
+
+    std::string line;
+    std::string* current = nullptr;
+    const std::string header = kHeader;
+    while (std::getline(in, line)) {
+        if (line.compare(0, header.size(), header) == 0) {
+            if (current) *current = strip_trailing_newlines(std::move(*current));
+            current = &capture.outputs[line.substr(header.size())];
+            current->clear();
+        } else if (current) {
+            *current += line;
+            *current += '\n';
+        }
+    }
+    if (current) *current = strip_trailing_newlines(std::move(*current));
+
+    // Older captures have single properties only; the full list the
+    // property table reads is rebuilt from them
+    const std::string getprop = "getprop ";
+    if (!capture.outputs.count("getprop")) {
+        std::string list;
+        for (const auto& [cmd, output] : capture.outputs) {
+            if (cmd.compare(0, getprop.size(), getprop) != 0 || output.empty()) continue;
+            std::string name = cmd.substr(getprop.size());
+            if (name.find(' ') != std::string::npos) continue;
+            list += "[" + name + "]: [" + output + "]\n";
+        }
+        if (!list.empty()) capture.outputs["getprop"] = strip_trailing_newlines(std::move(list));
+    }
+    return capture;
+}
+
+void Capture::save(const std::string& path) const {
+    std::ofstream out(path);
+    if (!out) {
+        throw std::runtime_error("Cannot write capture: " + path);
+    }
+    out << "# adb_insight capture: " << name << "\n";
+    for (const auto& [cmd, output] : outputs) {
+        out << kHeader << cmd << "\n";
+        if (!output.empty()) out << output << "\n";
+    }
+}
+
+const std::string* Capture::find(const std::string& cmd) const {
+    auto it = outputs.find(cmd);
+    return it == outputs.end() ? nullptr : &it->second;
+}
+
+// ============ REPLAY ============
+
+ReplayTransport::ReplayTransport(std::shared_ptr<const Capture> capture) : capture_(std::move(capture)) {}
+
+adb::CommandResult ReplayTransport::run(const std::string& cmd, std::chrono::milliseconds) {
+    auto lookup = [this](const std::string& c) -> const std::string* {
+        const std::string* output = capture_->find(c);
+        if (!output) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            misses_.insert(c);
+        }
+        return output;
+    };
+
+    if (auto cmds = split_multi(cmd)) {
+        adb::CommandResult result{"", 0, ""};
+        for (size_t i = 0; i < cmds->size(); ++i) {
+            const std::string* output = lookup((*cmds)[i]);
+            append_section(result.output, i, output ? *output : "");
+        }
+        return result;
+    }
+
+    // Replayed without probe lines, so the command is simply not measured
+    const std::string* output = lookup(split_probed(cmd).value_or(cmd));
+    return output ? adb::CommandResult{*output, 0, ""} : adb::CommandResult{"", 127, ""};
+}
+
+std::set<std::string> ReplayTransport::misses() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return misses_;
+}
+
+// ============ RECORDING ============
+
+RecordingTransport::RecordingTransport(std::unique_ptr<adb::Transport> inner, Capture& capture)
+    : inner_(std::move(inner)), capture_(capture) {}
+
+adb::CommandResult RecordingTransport::record(const std::string& cmd, std::chrono::milliseconds timeout) {
+    adb::CommandResult result = inner_->run(cmd, timeout);
+    if (result.exit_code == 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        capture_.outputs[cmd] = strip_trailing_newlines(result.output);
+    }
+    return result;
+}
+
+adb::CommandResult RecordingTransport::run(const std::string& cmd, std::chrono::milliseconds timeout) {
+    auto cmds = split_multi(cmd);
+    if (!cmds) return record(split_probed(cmd).value_or(cmd), timeout);
+
+    adb::CommandResult combined{"", 0, ""};
+    for (size_t i = 0; i < cmds->size(); ++i) {
+        append_section(combined.output, i, record((*cmds)[i], timeout).output);
+    }
+    return combined;
+}
+
+} // namespace bench
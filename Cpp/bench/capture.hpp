@@ -0,0 +1,81 @@
+#ifndef BENCH_CAPTURE_HPP
+#define BENCH_CAPTURE_HPP
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include "adb_session.hpp"
+
+namespace bench {
+
+/**
+ * Recorded shell output of one device, keyed by the exact command.
+ *
+ * On disk a capture is a text file of blocks, each a ">>> <command>"
+ * line followed by the command's stdout:
+ *
+ *     >>> getprop ro.product.model
+ *     Pixel 7
+ *     >>> cat /proc/uptime
+ *     81234.56 612345.78
+ *
+ * Lines before the first block are comments. A capture without a bare
+ * "getprop" gets one listing its single "getprop <name>" outputs.
+ */
+struct Capture {
+    std::string name;
+    std::map<std::string, std::string> outputs;
+
+    // Throws std::runtime_error if the file cannot be read
+    static Capture load(const std::string& path);
+    void save(const std::string& path) const;
+
+    // Output for cmd, or nullptr if it was not recorded
+    const std::string* find(const std::string& cmd) const;
+};
+
+/**
+ * Answers commands from a Capture, including Device::shell_multi's
+ * combined scripts and commands run with a cost probe. Unrecorded
+ * commands fail with exit code 127 and are remembered in misses() so a
+ * stale capture is easy to spot.
+ */
+class ReplayTransport : public adb::Transport {
+public:
+    explicit ReplayTransport(std::shared_ptr<const Capture> capture);
+
+    adb::CommandResult run(const std::string& cmd, std::chrono::milliseconds timeout) override;
+
+    std::set<std::string> misses() const;
+
+private:
+    std::shared_ptr<const Capture> capture_;
+    mutable std::mutex mutex_;
+    std::set<std::string> misses_;
+};
+
+/**
+ * Passes commands through to inner and records each one's output.
+ * shell_multi scripts are run one command at a time, and probed commands
+ * without their probes, so the capture is keyed by the plain commands.
+ */
+class RecordingTransport : public adb::Transport {
+public:
+    RecordingTransport(std::unique_ptr<adb::Transport> inner, Capture& capture);
+
+    adb::CommandResult run(const std::string& cmd, std::chrono::milliseconds timeout) override;
+
+private:
+    adb::CommandResult record(const std::string& cmd, std::chrono::milliseconds timeout);
+
+    std::unique_ptr<adb::Transport> inner_;
+    Capture& capture_;
+    std::mutex mutex_;
+};
+
+} // namespace bench
+
+#endif // BENCH_CAPTURE_HPP
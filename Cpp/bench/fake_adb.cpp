@@ -0,0 +1,176 @@
+#include "fake_adb.hpp"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+
+namespace bench {
+
+namespace {
+
+constexpr const char* kShell = "shell,v2,raw:";
+// What SocketTransport puts before each command
+constexpr const char* kNoStdin = "exec </dev/null; ";
+constexpr size_t kMaxPacket = 64 * 1024;
+enum PacketId : unsigned char { Stdout = 1, Stderr = 2, Exit = 3 };
+
+bool read_exact(int fd, char* buf, size_t n) {
+    while (n > 0) {
+        ssize_t got = recv(fd, buf, n, 0);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        buf += got;
+        n -= static_cast<size_t>(got);
+    }
+    return true;
+}
+
+bool write_all(int fd, const std::string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = send(fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        written += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// "<4 hex digits><payload>", as adb clients send them
+bool read_request(int fd, std::string& payload) {
+    char length[5] = {};
+    if (!read_exact(fd, length, 4)) return false;
+    payload.assign(std::strtoul(length, nullptr, 16), '\0');
+    return payload.empty() || read_exact(fd, &payload[0], payload.size());
+}
+
+std::string prefixed(const char* status, const std::string& data) {
+    char length[5];
+    std::snprintf(length, sizeof(length), "%04zx", data.size());
+    return std::string(status) + std::string(length, 4) + data;
+}
+
+void append_packet(std::string& out, PacketId id, const char* data, size_t size) {
+    out += static_cast<char>(id);
+    for (int i = 0; i < 4; ++i) out += static_cast<char>((size >> (8 * i)) & 0xff);
+    out.append(data, size);
+}
+
+void append_stream(std::string& out, PacketId id, const std::string& data) {
+    for (size_t pos = 0; pos < data.size(); pos += kMaxPacket) {
+        append_packet(out, id, data.data() + pos, std::min(kMaxPacket, data.size() - pos));
+    }
+}
+
+} // namespace
+
+FakeAdbServer::FakeAdbServer(std::shared_ptr<ReplayTransport> replay, std::string serial,
+                             std::chrono::milliseconds latency)
+    : replay_(std::move(replay)), serial_(std::move(serial)), latency_(latency) {
+    listener_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener_ < 0) throw std::runtime_error("fake adb: cannot create a socket");
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+    socklen_t size = sizeof(address);
+    if (bind(listener_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listener_, 128) != 0 ||
+        getsockname(listener_, reinterpret_cast<sockaddr*>(&address), &size) != 0) {
+        close(listener_);
+        throw std::runtime_error("fake adb: cannot listen on 127.0.0.1");
+    }
+    port_ = ntohs(address.sin_port);
+    acceptor_ = std::thread([this] { accept_loop(); });
+}
+
+FakeAdbServer::~FakeAdbServer() {
+    stopping_ = true;
+    acceptor_.join();
+    close(listener_);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this] { return active_ == 0; });
+}
+
+FakeAdbServer::Stats FakeAdbServer::stats() const {
+    return {connections_.load(), shell_sessions_.load(), refused_.load()};
+}
+
+void FakeAdbServer::accept_loop() {
+    while (!stopping_) {
+        // Wakes up now and then to notice stopping_
+        pollfd pfd{listener_, POLLIN, 0};
+        if (poll(&pfd, 1, 100) <= 0) continue;
+        int fd = accept4(listener_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) continue;
+
+        ++connections_;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++active_;
+        }
+        std::thread([this, fd] {
+            serve(fd);
+            close(fd);
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--active_ == 0) idle_.notify_all();
+        }).detach();
+    }
+}
+
+void FakeAdbServer::serve(int fd) {
+    std::string request;
+    bool transport = false;  // switched to the device by host:transport
+
+    while (read_request(fd, request)) {
+        if (!transport) {
+            if (request == "host:devices") {
+                write_all(fd, prefixed("OKAY", serial_ + "\tdevice\n"));
+                return;
+            }
+            if (request == "host:features" || request == "host-serial:" + serial_ + ":features") {
+                write_all(fd, prefixed("OKAY", "shell_v2,cmd"));
+                return;
+            }
+            if (request == "host:transport-any" || request == "host:transport:" + serial_) {
+                transport = true;
+                if (!write_all(fd, "OKAY")) return;
+                continue;
+            }
+            ++refused_;
+            write_all(fd, prefixed("FAIL", "device '" + serial_ + "' has no service " + request));
+            return;
+        }
+
+        if (request.compare(0, std::char_traits<char>::length(kShell), kShell) != 0) {
+            ++refused_;
+            write_all(fd, prefixed("FAIL", "closed"));
+            return;
+        }
+        ++shell_sessions_;
+        if (latency_.count() > 0) std::this_thread::sleep_for(latency_);
+
+        std::string cmd = request.substr(std::char_traits<char>::length(kShell));
+        if (cmd.compare(0, std::char_traits<char>::length(kNoStdin), kNoStdin) == 0) {
+            cmd.erase(0, std::char_traits<char>::length(kNoStdin));
+        }
+        adb::CommandResult result = replay_->run(cmd, std::chrono::milliseconds(0));
+        std::string reply = "OKAY";
+        append_stream(reply, Stdout, result.output);
+        append_stream(reply, Stderr, result.error);
+        char code = static_cast<char>(result.exit_code & 0xff);
+        append_packet(reply, Exit, &code, 1);
+        write_all(fd, reply);
+        return;
+    }
+}
+
+} // namespace bench
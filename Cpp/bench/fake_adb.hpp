@@ -0,0 +1,72 @@
+#ifndef BENCH_FAKE_ADB_HPP
+#define BENCH_FAKE_ADB_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "capture.hpp"
+
+namespace bench {
+
+/**
+ * Just enough of an adb server on 127.0.0.1 for adb_insight's socket
+ * transport to run against a capture instead of a device:
+ *
+ *     host:devices            one device, serial, in "device" state
+ *     host:features           shell_v2
+ *     host:transport[-any]    then shell,v2,raw:<cmd>, answered by replay
+ *
+ * Any other service (the agent's localabstract:, sync: for a push) is
+ * refused, so the server falls back to the shell as it would on a device
+ * without the helper. Each shell session waits latency before answering,
+ * standing in for the USB round-trip.
+ */
+class FakeAdbServer {
+public:
+    struct Stats {
+        uint64_t connections = 0;
+        uint64_t shell_sessions = 0;
+        uint64_t refused = 0;  // services other than the shell
+    };
+
+    // Listens on an ephemeral port. Throws std::runtime_error if it cannot.
+    FakeAdbServer(std::shared_ptr<ReplayTransport> replay, std::string serial,
+                  std::chrono::milliseconds latency = std::chrono::milliseconds(0));
+    // Stops accepting and waits for open connections to finish
+    ~FakeAdbServer();
+
+    FakeAdbServer(const FakeAdbServer&) = delete;
+    FakeAdbServer& operator=(const FakeAdbServer&) = delete;
+
+    int port() const { return port_; }
+    Stats stats() const;
+
+private:
+    void accept_loop();
+    void serve(int fd);
+
+    std::shared_ptr<ReplayTransport> replay_;
+    std::string serial_;
+    std::chrono::milliseconds latency_;
+    int listener_ = -1;
+    int port_ = 0;
+
+    std::atomic<bool> stopping_{false};
+    std::atomic<uint64_t> connections_{0};
+    std::atomic<uint64_t> shell_sessions_{0};
+    std::atomic<uint64_t> refused_{0};
+
+    std::mutex mutex_;
+    std::condition_variable idle_;
+    size_t active_ = 0;
+    std::thread acceptor_;
+};
+
+} // namespace bench
+
+#endif // BENCH_FAKE_ADB_HPP
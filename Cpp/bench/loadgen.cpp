@@ -0,0 +1,654 @@
+#include <httplib.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "capture.hpp"
+#include "fake_adb.hpp"
+
+using json = nlohmann::json;
+
+namespace {
+
+using clock = std::chrono::steady_clock;
+
+// ============ OPTIONS ============
+
+struct Options {
+    std::string url = "http://127.0.0.1:8000";
+    size_t concurrency = 8;
+    std::chrono::seconds duration{30};
+    std::chrono::seconds warmup{2};
+    std::string mix;          // empty: every endpoint the server lists
+    std::string replay;       // capture to serve through the fake adb server
+    std::chrono::milliseconds adb_latency{0};
+    std::string server;       // adb_insight binary to start and stop
+    std::string server_log = "/dev/null";
+    std::string report;       // empty or "-": stdout
+    std::string compare;      // earlier report to check against
+    double tolerance = 0.25;
+};
+
+// Value of --name=value, removed from argv
+const char* take_flag(int& argc, char** argv, const char* name) {
+    size_t len = std::strlen(name);
+    for (int i = 1; i < argc; ++i) {
+        if (std::strncmp(argv[i], name, len) == 0 && argv[i][len] == '=') {
+            const char* value = argv[i] + len + 1;
+            std::copy(argv + i + 1, argv + argc, argv + i);
+            --argc;
+            return value;
+        }
+    }
+    return nullptr;
+}
+
+// Whole-string positive number, or nullopt
+std::optional<double> number(const std::string& text) {
+    char* end = nullptr;
+    double value = std::strtod(text.c_str(), &end);
+    if (text.empty() || *end != '\0' || !(value > 0)) return std::nullopt;
+    return value;
+}
+
+void usage() {
+    std::cerr <<
+        "usage: adb_insight_loadgen [--url=http://127.0.0.1:8000] [--concurrency=8] [--duration=30]\n"
+        "                           [--warmup=2] [--mix=health=5,system=1,/history/battery=1]\n"
+        "                           [--server=./build/adb_insight [--server-log=file]]\n"
+        "                           [--replay=pixel_7|capture.txt [--adb-latency=ms]]\n"
+        "                           [--report=report.json] [--compare=old.json [--tolerance=0.25]]\n";
+}
+
+std::optional<Options> parse_options(int argc, char** argv) {
+    Options options;
+    bool ok = true;
+    auto take = [&](const char* name, auto apply) {
+        if (const char* value = take_flag(argc, argv, name)) {
+            if (!apply(std::string(value))) {
+                std::cerr << "Invalid " << name << "=" << value << "\n";
+                ok = false;
+            }
+        }
+    };
+    auto seconds = [](std::chrono::seconds& out, bool zero_ok) {
+        return [&out, zero_ok](const std::string& v) {
+            if (zero_ok && v == "0") return out = std::chrono::seconds(0), true;
+            auto n = number(v);
+            return n ? (out = std::chrono::seconds(static_cast<long>(*n)), true) : false;
+        };
+    };
+    auto text = [](std::string& out) { return [&out](const std::string& v) { return out = v, true; }; };
+
+    take("--url", text(options.url));
+    take("--concurrency", [&](const std::string& v) {
+        auto n = number(v);
+        return n ? (options.concurrency = static_cast<size_t>(*n), true) : false;
+    });
+    take("--duration", seconds(options.duration, false));
+    take("--warmup", seconds(options.warmup, true));
+    take("--mix", text(options.mix));
+    take("--replay", text(options.replay));
+    take("--adb-latency", [&](const std::string& v) {
+        auto n = number(v);
+        if (v == "0") return true;
+        return n ? (options.adb_latency = std::chrono::milliseconds(static_cast<long>(*n)), true) : false;
+    });
+    take("--server", text(options.server));
+    take("--server-log", text(options.server_log));
+    take("--report", text(options.report));
+    take("--compare", text(options.compare));
+    take("--tolerance", [&](const std::string& v) {
+        auto n = number(v);
+        return n ? (options.tolerance = *n, true) : false;
+    });
+
+    if (argc > 1) {
+        std::cerr << "Unknown argument: " << argv[1] << "\n";
+        ok = false;
+    }
+    if (!options.replay.empty() && options.server.empty()) {
+        std::cerr << "--replay needs --server: the server must be started against the fake adb\n";
+        ok = false;
+    }
+    if (!ok) {
+        usage();
+        return std::nullopt;
+    }
+    return options;
+}
+
+// ============ MIX ============
+
+struct Target {
+    std::string name;
+    std::string path;
+    double weight;
+};
+
+// Templated entries of the root list, filled in with something cheap
+const std::map<std::string, std::string> kInstances = {
+    {"system_delta", "/system?since=0"},
+    {"history", "/history/battery"},
+    {"events", "/events?since=0"},
+    {"fleet", "/fleet/thermal?summary=1"},
+};
+
+// Not load: metrics is scraped around the run, stream never ends
+bool skipped(const std::string& name) {
+    return name == "metrics" || name == "stream" || name == "per_device";
+}
+
+std::vector<Target> build_mix(httplib::Client& client, const std::string& spec) {
+    std::map<std::string, std::string> endpoints;
+    if (auto res = client.Get("/")) {
+        if (res->status == 200) {
+            json root = json::parse(res->body, nullptr, false);
+            if (root.is_object() && root.contains("endpoints")) {
+                for (const auto& [name, path] : root["endpoints"].items()) {
+                    if (!path.is_string()) continue;
+                    auto instance = kInstances.find(name);
+                    if (instance != kInstances.end()) {
+                        endpoints[name] = instance->second;
+                    } else if (path.get<std::string>().find('{') == std::string::npos) {
+                        endpoints[name] = path.get<std::string>();
+                    }
+                }
+            }
+        }
+    }
+
+    std::vector<Target> mix;
+    if (spec.empty()) {
+        for (const auto& [name, path] : endpoints) {
+            if (!skipped(name)) mix.push_back({name, path, 1});
+        }
+        return mix;
+    }
+
+    // name[=weight] or /path[=weight]; a query's own '=' is not a weight
+    std::stringstream entries(spec);
+    std::string entry;
+    while (std::getline(entries, entry, ',')) {
+        if (entry.empty()) continue;
+        double weight = 1;
+        size_t eq = entry.rfind('=');
+        if (eq != std::string::npos) {
+            if (auto n = number(entry.substr(eq + 1))) {
+                weight = *n;
+                entry.resize(eq);
+            }
+        }
+        if (entry[0] == '/') {
+            mix.push_back({entry, entry, weight});
+        } else if (auto it = endpoints.find(entry); it != endpoints.end()) {
+            mix.push_back({entry, it->second, weight});
+        } else {
+            throw std::runtime_error("No endpoint named " + entry + " in the server's root list");
+        }
+    }
+    return mix;
+}
+
+// ============ LOAD ============
+
+/**
+ * What is wrong with a successful answer, or empty if nothing is: a 2xx
+ * must carry a body, and a JSON one must parse. A 304 has none by design.
+ */
+std::string body_problem(const httplib::Response& res) {
+    if (res.status < 200 || res.status >= 300) return "";
+    if (res.body.empty()) return "empty body";
+    if (res.get_header_value("Content-Type").find("json") != std::string::npos &&
+        json::parse(res.body, nullptr, false).is_discarded()) {
+        return "body is not valid JSON";
+    }
+    return "";
+}
+
+// One request per endpoint before any load, so a broken body fails the run outright
+bool check_bodies(httplib::Client& client, const std::vector<Target>& mix) {
+    bool ok = true;
+    for (const auto& target : mix) {
+        auto res = client.Get(target.path);
+        if (!res) continue;  // unreachable endpoints show up as errors in the run
+        std::string problem = body_problem(res.value());
+        if (!problem.empty()) {
+            std::cerr << "BROKEN: " << target.name << " (" << target.path << ") answered " << res->status
+                      << " with " << problem << "\n";
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+struct Tally {
+    std::vector<double> latencies_ms;
+    std::map<int, uint64_t> statuses;
+    uint64_t errors = 0;      // no response, 5xx, or a bad body
+    uint64_t bad_bodies = 0;  // 2xx with an empty or unparseable body
+    uint64_t body_bytes = 0;
+};
+
+using Tallies = std::vector<Tally>;  // indexed like the mix
+
+httplib::Client make_client(const std::string& url) {
+    httplib::Client client(url);
+    client.set_keep_alive(true);
+    client.set_connection_timeout(5);
+    client.set_read_timeout(60);
+    return client;
+}
+
+// Closed loop: each worker sends its next request when the last one is answered
+Tallies run_load(const Options& options, const std::vector<Target>& mix, std::chrono::seconds duration) {
+    std::vector<double> weights;
+    for (const auto& target : mix) weights.push_back(target.weight);
+    auto deadline = clock::now() + duration;
+
+    std::vector<Tallies> per_worker(options.concurrency, Tallies(mix.size()));
+    std::vector<std::thread> workers;
+    for (size_t w = 0; w < options.concurrency; ++w) {
+        workers.emplace_back([&, w] {
+            auto client = make_client(options.url);
+            std::mt19937 random(static_cast<unsigned>(w * 7919 + 17));
+            std::discrete_distribution<size_t> pick(weights.begin(), weights.end());
+            Tallies& tallies = per_worker[w];
+
+            while (clock::now() < deadline) {
+                size_t index = pick(random);
+                auto started = clock::now();
+                auto res = client.Get(mix[index].path);
+                double ms = std::chrono::duration<double, std::milli>(clock::now() - started).count();
+
+                Tally& tally = tallies[index];
+                tally.latencies_ms.push_back(ms);
+                if (!res) {
+                    ++tally.statuses[0];
+                    ++tally.errors;
+                    continue;
+                }
+                ++tally.statuses[res->status];
+                tally.body_bytes += res->body.size();
+                if (res->status >= 500) {
+                    ++tally.errors;
+                } else if (!body_problem(res.value()).empty()) {
+                    ++tally.bad_bodies;
+                    ++tally.errors;
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) worker.join();
+
+    Tallies merged(mix.size());
+    for (auto& tallies : per_worker) {
+        for (size_t i = 0; i < mix.size(); ++i) {
+            auto& into = merged[i];
+            auto& from = tallies[i];
+            into.latencies_ms.insert(into.latencies_ms.end(), from.latencies_ms.begin(), from.latencies_ms.end());
+            for (const auto& [status, count] : from.statuses) into.statuses[status] += count;
+            into.errors += from.errors;
+            into.bad_bodies += from.bad_bodies;
+            into.body_bytes += from.body_bytes;
+        }
+    }
+    return merged;
+}
+
+// ============ SERVER COUNTERS ============
+
+struct Counters {
+    double adb_commands = 0;      // adb round-trips
+    double device_processes = 0;  // processes spawned on the device
+    double cache_hit = 0;
+    double cache_stale = 0;
+    double cache_miss = 0;
+    double shed = 0;
+};
+
+// Sums the series of interest from /metrics; all zero if it cannot be read
+Counters scrape(httplib::Client& client) {
+    Counters counters;
+    auto res = client.Get("/metrics");
+    if (!res || res->status != 200) {
+        std::cerr << "warning: cannot read /metrics, adb and cache figures will be zero\n";
+        return counters;
+    }
+
+    std::istringstream lines(res->body);
+    std::string line;
+    while (std::getline(lines, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        size_t name_end = line.find_first_of("{ ");
+        size_t space = line.rfind(' ');
+        if (name_end == std::string::npos || space == std::string::npos) continue;
+        std::string name = line.substr(0, name_end);
+        std::string labels = line[name_end] == '{' ? line.substr(name_end, line.find('}') - name_end) : "";
+        double value = std::atof(line.c_str() + space + 1);
+
+        if (name == "adb_insight_adb_command_seconds_count") {
+            counters.adb_commands += value;
+        } else if (name == "adb_insight_device_processes_total") {
+            counters.device_processes += value;
+        } else if (name == "adb_insight_http_shed_total") {
+            counters.shed += value;
+        } else if (name == "adb_insight_cache_requests_total") {
+            if (labels.find("result=\"hit\"") != std::string::npos) counters.cache_hit += value;
+            if (labels.find("result=\"stale\"") != std::string::npos) counters.cache_stale += value;
+            if (labels.find("result=\"miss\"") != std::string::npos) counters.cache_miss += value;
+        }
+    }
+    return counters;
+}
+
+// ============ REPORT ============
+
+// Nearest-rank percentile of sorted values
+double percentile(const std::vector<double>& sorted, double p) {
+    size_t rank = static_cast<size_t>(std::ceil(p / 100 * sorted.size()));
+    return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+}
+
+double round3(double value) {
+    return std::round(value * 1000) / 1000;
+}
+
+json latency(std::vector<double> values) {
+    if (values.empty()) return nullptr;
+    std::sort(values.begin(), values.end());
+    double sum = 0;
+    for (double v : values) sum += v;
+    return {
+        {"p50", round3(percentile(values, 50))},
+        {"p90", round3(percentile(values, 90))},
+        {"p99", round3(percentile(values, 99))},
+        {"max", round3(values.back())},
+        {"mean", round3(sum / values.size())}
+    };
+}
+
+json build_report(const Options& options, const std::vector<Target>& mix, const Tallies& tallies,
+                  double elapsed_s, const Counters& before, const Counters& after) {
+    json endpoints = json::object();
+    std::vector<double> all;
+    uint64_t requests = 0, errors = 0;
+    for (size_t i = 0; i < mix.size(); ++i) {
+        const Tally& tally = tallies[i];
+        json statuses = json::object();
+        for (const auto& [status, count] : tally.statuses) {
+            statuses[status == 0 ? "no_response" : std::to_string(status)] = count;
+        }
+        endpoints[mix[i].name] = {
+            {"path", mix[i].path},
+            {"requests", tally.latencies_ms.size()},
+            {"errors", tally.errors},
+            {"bad_bodies", tally.bad_bodies},
+            {"status", statuses},
+            {"body_bytes_mean", tally.latencies_ms.empty() ? 0.0
+                                : round3(static_cast<double>(tally.body_bytes) / tally.latencies_ms.size())},
+            {"rps", round3(tally.latencies_ms.size() / elapsed_s)},
+            {"latency_ms", latency(tally.latencies_ms)}
+        };
+        all.insert(all.end(), tally.latencies_ms.begin(), tally.latencies_ms.end());
+        requests += tally.latencies_ms.size();
+        errors += tally.errors;
+    }
+
+    auto per_request = [&](double delta) { return requests ? round3(delta / requests) : 0.0; };
+    double hits = after.cache_hit - before.cache_hit;
+    double stale = after.cache_stale - before.cache_stale;
+    double misses = after.cache_miss - before.cache_miss;
+    double lookups = hits + stale + misses;
+
+    return {
+        {"url", options.url},
+        {"backend", options.replay.empty() ? "device" : "replay:" + options.replay},
+        {"concurrency", options.concurrency},
+        {"duration_s", round3(elapsed_s)},
+        {"requests", requests},
+        {"errors", errors},
+        {"throughput_rps", round3(requests / elapsed_s)},
+        {"latency_ms", latency(all)},
+        {"endpoints", endpoints},
+        {"adb", {
+            {"commands", after.adb_commands - before.adb_commands},
+            {"commands_per_request", per_request(after.adb_commands - before.adb_commands)},
+            {"device_processes", after.device_processes - before.device_processes},
+            {"device_processes_per_request", per_request(after.device_processes - before.device_processes)}
+        }},
+        {"cache", {
+            {"hit", hits},
+            {"stale", stale},
+            {"miss", misses},
+            {"hit_ratio", lookups > 0 ? round3((hits + stale) / lookups) : 0.0}
+        }},
+        {"shed", after.shed - before.shed}
+    };
+}
+
+void print_summary(const json& report) {
+    std::cerr << "\n" << report["requests"] << " requests in " << report["duration_s"] << " s ("
+              << report["throughput_rps"] << " req/s), " << report["errors"] << " errors\n";
+    std::fprintf(stderr, "%-20s %8s %7s %9s %9s %9s %9s\n", "endpoint", "requests", "errors", "p50 ms", "p90 ms",
+                 "p99 ms", "max ms");
+    for (const auto& [name, e] : report["endpoints"].items()) {
+        const json& l = e["latency_ms"];
+        auto at = [&](const char* key) { return l.is_null() ? 0.0 : l[key].get<double>(); };
+        std::fprintf(stderr, "%-20s %8llu %7llu %9.2f %9.2f %9.2f %9.2f\n", name.c_str(),
+                     static_cast<unsigned long long>(e["requests"].get<uint64_t>()),
+                     static_cast<unsigned long long>(e["errors"].get<uint64_t>()),
+                     at("p50"), at("p90"), at("p99"), at("max"));
+    }
+    std::cerr << "adb commands/request " << report["adb"]["commands_per_request"]
+              << ", device processes/request " << report["adb"]["device_processes_per_request"]
+              << ", cache hit ratio " << report["cache"]["hit_ratio"] << "\n";
+}
+
+/**
+ * Regressions of report against baseline: an endpoint's p99 worse by more
+ * than tolerance (and by at least a millisecond, so sub-millisecond noise on
+ * /health does not count), or more adb commands per request. Any bad body
+ * is a regression, whatever the baseline had.
+ */
+std::vector<std::string> regressions(const json& baseline, const json& report, double tolerance) {
+    std::vector<std::string> found;
+    for (const auto& [name, now] : report["endpoints"].items()) {
+        if (uint64_t bad = now.value("bad_bodies", uint64_t{0})) {
+            found.push_back(name + " answered " + std::to_string(bad) + " empty or unparseable bodies");
+        }
+    }
+    if (!baseline.contains("endpoints")) return found;
+
+    for (const auto& [name, now] : report["endpoints"].items()) {
+        if (!baseline["endpoints"].contains(name)) continue;
+        const json& then = baseline["endpoints"][name]["latency_ms"];
+        if (then.is_null() || now["latency_ms"].is_null()) continue;
+        double before = then["p99"].get<double>();
+        double after = now["latency_ms"]["p99"].get<double>();
+        if (after > before * (1 + tolerance) && after - before >= 1) {
+            std::ostringstream out;
+            out << name << " p99 " << before << " -> " << after << " ms";
+            found.push_back(out.str());
+        }
+    }
+
+    if (baseline.contains("adb")) {
+        double before = baseline["adb"].value("commands_per_request", 0.0);
+        double after = report["adb"]["commands_per_request"].get<double>();
+        if (after > before * (1 + tolerance) && after - before >= 0.01) {
+            std::ostringstream out;
+            out << "adb commands/request " << before << " -> " << after;
+            found.push_back(out.str());
+        }
+    }
+    return found;
+}
+
+// ============ SERVER PROCESS ============
+
+// Capture by name from bench/captures, or by path
+std::string capture_path(const std::string& replay) {
+    if (replay.find('/') != std::string::npos || replay.find(".txt") != std::string::npos) return replay;
+    return std::string(ADB_INSIGHT_BENCH_CAPTURES) + "/" + replay + ".txt";
+}
+
+pid_t start_server(const Options& options, const bench::FakeAdbServer* fake) {
+    pid_t pid = fork();
+    if (pid < 0) throw std::runtime_error("Cannot fork the server");
+    if (pid > 0) return pid;
+
+    int log = open(options.server_log.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (log >= 0) {
+        dup2(log, STDOUT_FILENO);
+        dup2(log, STDERR_FILENO);
+        close(log);
+    }
+    if (fake) {
+        std::string socket = "tcp:127.0.0.1:" + std::to_string(fake->port());
+        setenv("ADB_SERVER_SOCKET", socket.c_str(), 1);
+        unsetenv("ANDROID_SERIAL");
+        // Runs are comparable only if every one starts without a profile
+        setenv("ADB_INSIGHT_PROFILE_DIR", "", 1);
+    }
+    execl(options.server.c_str(), options.server.c_str(), static_cast<char*>(nullptr));
+    std::perror("exec");
+    _exit(127);
+}
+
+void stop_server(pid_t pid) {
+    kill(pid, SIGTERM);
+    for (int i = 0; i < 50; ++i) {
+        if (waitpid(pid, nullptr, WNOHANG) == pid) return;
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+}
+
+// Any answer from /health, even 503 for a missing device, means it is listening
+bool wait_for_server(httplib::Client& client, pid_t pid, std::chrono::seconds timeout) {
+    auto deadline = clock::now() + timeout;
+    while (clock::now() < deadline) {
+        if (client.Get("/health")) return true;
+        if (pid > 0 && waitpid(pid, nullptr, WNOHANG) == pid) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    return false;
+}
+
+int run(const Options& options) {
+    std::shared_ptr<bench::ReplayTransport> replay;
+    std::unique_ptr<bench::FakeAdbServer> fake;
+    if (!options.replay.empty()) {
+        auto capture = std::make_shared<const bench::Capture>(bench::Capture::load(capture_path(options.replay)));
+        replay = std::make_shared<bench::ReplayTransport>(capture);
+        fake = std::make_unique<bench::FakeAdbServer>(replay, capture->name, options.adb_latency);
+        std::cerr << "Replaying " << capture->name << " on tcp:127.0.0.1:" << fake->port() << "\n";
+    }
+
+    pid_t server = options.server.empty() ? -1 : start_server(options, fake.get());
+    struct Stop {
+        pid_t pid;
+        ~Stop() { if (pid > 0) stop_server(pid); }
+    } stop{server};
+
+    auto client = make_client(options.url);
+    if (!wait_for_server(client, server, std::chrono::seconds(server > 0 ? 15 : 2))) {
+        std::cerr << "No server answering at " << options.url << "\n";
+        return 2;
+    }
+
+    std::vector<Target> mix = build_mix(client, options.mix);
+    if (mix.empty()) {
+        std::cerr << "Nothing to request: the root list was empty and no --mix was given\n";
+        return 2;
+    }
+    if (!check_bodies(client, mix)) return 1;
+
+    if (options.warmup.count() > 0) {
+        std::cerr << "Warming up for " << options.warmup.count() << " s\n";
+        run_load(options, mix, options.warmup);
+    }
+
+    std::cerr << "Running " << mix.size() << " endpoints with " << options.concurrency << " clients for "
+              << options.duration.count() << " s\n";
+    Counters before = scrape(client);
+    auto fake_before = fake ? fake->stats() : bench::FakeAdbServer::Stats{};
+    auto started = clock::now();
+    Tallies tallies = run_load(options, mix, options.duration);
+    double elapsed = std::chrono::duration<double>(clock::now() - started).count();
+    Counters after = scrape(client);
+
+    json report = build_report(options, mix, tallies, elapsed, before, after);
+    if (fake) {
+        auto stats = fake->stats();
+        auto misses = replay->misses();
+        report["fake_adb"] = {
+            {"connections", stats.connections - fake_before.connections},
+            {"shell_sessions", stats.shell_sessions - fake_before.shell_sessions},
+            {"refused", stats.refused - fake_before.refused},
+            {"misses", misses}
+        };
+        // Commands the server sent that the capture could not answer
+        for (const auto& cmd : misses) {
+            std::cerr << "warning: " << options.replay << " has no output for: " << cmd << "\n";
+        }
+    }
+    print_summary(report);
+
+    if (options.report.empty() || options.report == "-") {
+        std::cout << report.dump(2) << "\n";
+    } else {
+        std::ofstream out(options.report);
+        out << report.dump(2) << "\n";
+        if (!out) {
+            std::cerr << "Cannot write " << options.report << "\n";
+            return 2;
+        }
+    }
+
+    if (!options.compare.empty()) {
+        std::ifstream in(options.compare);
+        json baseline = json::parse(in, nullptr, false);
+        if (baseline.is_discarded()) {
+            std::cerr << "Cannot read baseline " << options.compare << "\n";
+            return 2;
+        }
+        auto found = regressions(baseline, report, options.tolerance);
+        for (const auto& regression : found) std::cerr << "REGRESSION: " << regression << "\n";
+        if (!found.empty()) return 1;
+        std::cerr << "No regressions against " << options.compare << "\n";
+    }
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    auto options = parse_options(argc, argv);
+    if (!options) return 2;
+    try {
+        return run(*options);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 2;
+    }
+}
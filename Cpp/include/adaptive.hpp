@@ -0,0 +1,89 @@
+#ifndef ADAPTIVE_HPP
+#define ADAPTIVE_HPP
+
+#include <chrono>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace adaptive {
+
+using Points = std::vector<std::pair<std::string, double>>;
+
+struct Profile {
+    std::chrono::milliseconds base{1000};  // configured interval, where a source starts
+    std::chrono::milliseconds min{1000};   // never sampled faster; the rate cap of expensive sources
+    std::chrono::milliseconds max{1000};
+    // Relative change between consecutive samples that counts as volatile
+    double tolerance = 0.05;
+};
+
+/**
+ * Profile for a source configured at base: it may run up to 4x faster,
+ * but no faster than floor unless base itself is, and back off to 8x
+ * slower.
+ */
+Profile profile(std::chrono::milliseconds base, double tolerance,
+                std::chrono::milliseconds floor = std::chrono::milliseconds(0));
+
+/**
+ * Largest relative change of any series present in both samples, each
+ * relative to max(|previous|, 1). 0 when none is shared.
+ */
+double relative_change(const Points& previous, const Points& current);
+
+/**
+ * Sampling interval of one source. A sample that moved by more than
+ * the tolerance, or an active event on the source, halves it. Samples
+ * that moved less than a quarter of it stretch it by a quarter. Not
+ * synchronized.
+ */
+class Interval {
+public:
+    Interval() = default;
+    explicit Interval(Profile profile);
+
+    // change is relative_change() of the last two samples
+    void observe(double change, bool urgent);
+
+    std::chrono::milliseconds current() const { return current_; }
+
+private:
+    Profile profile_;
+    std::chrono::milliseconds current_{1000};
+};
+
+/**
+ * Share of wall time one device's adb link may spend on sampling. The
+ * sampler records how long each fetch took; once per window the duty
+ * cycle is compared with the share and every interval is stretched
+ * by a common factor, up by half while over it and back down by a fifth
+ * while under it. Slow adb round-trips therefore slow sampling down
+ * instead of queueing behind each other. Not synchronized.
+ */
+class Budget {
+public:
+    using clock = std::chrono::steady_clock;
+
+    // share <= 0 disables the budget
+    explicit Budget(double share, std::chrono::milliseconds window = std::chrono::milliseconds(5000));
+
+    void record(clock::time_point now, clock::duration busy);
+
+    // Factor >= 1 applied to every interval
+    double stretch() const { return stretch_; }
+    // Duty cycle over the last full window
+    double duty() const { return duty_; }
+
+private:
+    double share_;
+    clock::duration window_;
+    clock::time_point window_start_{};
+    clock::duration busy_{0};
+    double duty_ = 0;
+    double stretch_ = 1;
+};
+
+} // namespace adaptive
+
+#endif // ADAPTIVE_HPP
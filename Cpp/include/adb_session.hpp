@@ -0,0 +1,125 @@
+#ifndef ADB_SESSION_HPP
+#define ADB_SESSION_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <sys/types.h>
+
+namespace adb {
+
+// Result of a command run inside a session
+struct CommandResult {
+    std::string output;
+    int exit_code;
+    // Separate stderr, when the transport can tell it apart
+    std::string error;
+};
+
+/**
+ * Runs shell commands on a device. SessionPool is the real one;
+ * replacements replay or record captured output.
+ */
+class Transport {
+public:
+    virtual ~Transport() = default;
+
+    // Throws std::runtime_error when the command could not be run
+    virtual CommandResult run(const std::string& cmd, std::chrono::milliseconds timeout) = 0;
+
+    /**
+     * run() into result, whose strings keep their capacity for callers
+     * that run a command every cycle. Transports that read into a buffer
+     * override it; the default assigns run()'s result.
+     */
+    virtual void run_into(const std::string& cmd, std::chrono::milliseconds timeout, CommandResult& result) {
+        result = run(cmd, timeout);
+    }
+};
+
+/**
+ * A long-lived "adb shell -T" process with its own stdin/stdout pipes.
+ * Commands are written to stdin followed by a sentinel line carrying the
+ * exit code, and output is read back until that sentinel appears.
+ */
+class Session {
+public:
+    // Empty serial lets adb pick the device (ANDROID_SERIAL or the only one)
+    explicit Session(const std::string& serial);
+    ~Session();
+
+    Session(const Session&) = delete;
+    Session& operator=(const Session&) = delete;
+
+    /**
+     * Run a command and return its output and exit code.
+     * Throws std::runtime_error on timeout or if the session died;
+     * the session is unusable afterwards.
+     */
+    CommandResult run(const std::string& cmd, std::chrono::milliseconds timeout);
+    void run_into(const std::string& cmd, std::chrono::milliseconds timeout, CommandResult& result);
+
+    bool alive() const { return pid_ > 0 && !broken_; }
+
+private:
+    void spawn(const std::string& serial);
+    void terminate();
+    bool write_all(const std::string& data);
+
+    pid_t pid_ = -1;
+    int stdin_fd_ = -1;
+    int stdout_fd_ = -1;
+    bool broken_ = false;
+    unsigned long long counter_ = 0;
+    std::string buffer_;
+    std::string script_;  // reused for each command's wrapper
+    std::string marker_;
+};
+
+/**
+ * Bounded pool of shell sessions. Sessions are spawned lazily,
+ * reused across calls and replaced when they die.
+ */
+class SessionPool : public Transport {
+public:
+    SessionPool(std::string serial, size_t max_sessions);
+
+    // Run on a leased session, waiting for one if all are busy
+    CommandResult run(const std::string& cmd, std::chrono::milliseconds timeout) override;
+    void run_into(const std::string& cmd, std::chrono::milliseconds timeout, CommandResult& result) override;
+
+    // RAII checkout; the session goes back to the pool on destruction
+    class Lease {
+    public:
+        Lease(SessionPool& pool, std::unique_ptr<Session> session);
+        ~Lease();
+        Lease(Lease&& other) noexcept;
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        Session* operator->() { return session_.get(); }
+
+    private:
+        SessionPool* pool_;
+        std::unique_ptr<Session> session_;
+    };
+
+    Lease acquire();
+
+private:
+    void release(std::unique_ptr<Session> session);
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<std::unique_ptr<Session>> idle_;
+    std::string serial_;
+    size_t max_sessions_;
+    size_t in_use_ = 0;
+};
+
+} // namespace adb
+
+#endif // ADB_SESSION_HPP
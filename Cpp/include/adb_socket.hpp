@@ -0,0 +1,143 @@
+#ifndef ADB_SOCKET_HPP
+#define ADB_SOCKET_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include "adb_session.hpp"
+
+namespace adb {
+
+// Where the adb server listens: ADB_SERVER_SOCKET=tcp:<host>:<port>,
+// else ANDROID_ADB_SERVER_ADDRESS / ANDROID_ADB_SERVER_PORT, else
+// 127.0.0.1:5037
+struct ServerAddress {
+    std::string host;
+    int port;
+
+    static ServerAddress from_environment();
+};
+
+// Nobody is listening: the caller may fall back to the adb client
+struct ServerUnavailable : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+struct Timeout : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+/**
+ * One connection to the adb server. The connect and every read and
+ * write are bounded by the deadline, so a stalled device or an
+ * unreachable server cannot hang the caller.
+ * Throws ServerUnavailable when the server cannot be reached in time, Timeout
+ * past the deadline, and std::runtime_error otherwise.
+ */
+class ServerConnection {
+public:
+    ServerConnection(const ServerAddress& address, std::chrono::steady_clock::time_point deadline);
+    ~ServerConnection();
+
+    ServerConnection(const ServerConnection&) = delete;
+    ServerConnection& operator=(const ServerConnection&) = delete;
+
+    // Long-lived streams move the deadline forward per exchange
+    void set_deadline(std::chrono::steady_clock::time_point deadline) { deadline_ = deadline; }
+
+    // Send a host protocol request: 4 hex digits of length, then the
+    // payload, given as service and argument so callers need not join them
+    void request(std::string_view service, std::string_view argument = {});
+
+    // Consume OKAY, or throw with the server's FAIL message
+    void expect_okay();
+
+    // A reply carrying 4 hex digits of length, then that many bytes
+    std::string read_prefixed();
+
+    // Up to n bytes; 0 at end of stream
+    size_t read_some(char* buf, size_t n);
+    void read_exact(char* buf, size_t n);
+    void write_all(const std::string& data);
+
+private:
+    void wait(short events);
+
+    int fd_ = -1;
+    std::chrono::steady_clock::time_point deadline_;
+};
+
+/**
+ * Connect to a device service (e.g. "localabstract:<name>", the
+ * socket end of adb forward) and return the raw stream to it.
+ * An empty serial means the only attached device.
+ */
+std::unique_ptr<ServerConnection> open_service(const std::string& serial, const std::string& service,
+                                               std::chrono::milliseconds timeout);
+
+/**
+ * Run cmd with input on its stdin, then close stdin. Needs shell
+ * protocol v2; throws std::runtime_error if the device lacks it.
+ */
+CommandResult shell_with_input(const std::string& serial, const std::string& cmd, const std::string& input,
+                               std::chrono::milliseconds timeout);
+
+/**
+ * Issue one host service request (e.g. "host:devices") and return its
+ * length-prefixed reply. nullopt if the server is not reachable;
+ * throws std::runtime_error if it answers FAIL.
+ */
+std::optional<std::string> host_query(const std::string& request,
+                                      std::chrono::milliseconds timeout = std::chrono::milliseconds(5000));
+
+/**
+ * Talks the adb host protocol straight to the adb server, with no adb
+ * client process in between. Each command opens a connection,
+ * switches it to the device with host:transport:<serial> and runs
+ * shell,v2,raw:<cmd> with stdin from /dev/null. Shell protocol v2 frames stdout, stderr and the
+ * exit code separately. Devices without shell_v2 get a plain shell:
+ * service with an exit-code sentinel instead.
+ *
+ * At most max_concurrent commands run at once, like the session pool.
+ * When the server is not running or does not accept in time, the
+ * command goes to fallback with what is left of its timeout, and so do
+ * the commands of the next few seconds. Running the adb client once
+ * also starts the server, so the socket works again after that.
+ */
+class SocketTransport : public Transport {
+public:
+    SocketTransport(std::string serial, size_t max_concurrent, std::unique_ptr<Transport> fallback);
+
+    CommandResult run(const std::string& cmd, std::chrono::milliseconds timeout) override;
+    // Shell v2 packets are read straight into result's strings
+    void run_into(const std::string& cmd, std::chrono::milliseconds timeout, CommandResult& result) override;
+
+private:
+    enum class Shell : int { Unknown, V2, Legacy };
+
+    void run_socket(const std::string& cmd, std::chrono::steady_clock::time_point deadline, CommandResult& result);
+    Shell shell_mode(std::chrono::steady_clock::time_point deadline);
+
+    std::string serial_;
+    std::string transport_;  // host:transport request for serial_
+    ServerAddress address_;
+    std::unique_ptr<Transport> fallback_;
+    std::atomic<Shell> shell_{Shell::Unknown};
+    // steady_clock ticks until which the server is taken as unreachable
+    std::atomic<std::chrono::steady_clock::rep> unreachable_until_{0};
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    size_t max_concurrent_;
+    size_t in_flight_ = 0;
+};
+
+} // namespace adb
+
+#endif // ADB_SOCKET_HPP
@@ -1,9 +1,16 @@
 #ifndef ADB_UTILS_HPP
 #define ADB_UTILS_HPP
 
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 #include <optional>
+#include "adb_session.hpp"
+
+namespace metrics {
+class Histogram;
+}
 
 namespace adb {
 
@@ -11,22 +18,131 @@ namespace adb {
 std::string shell_escape(const std::string& str);
 
 /**
- * Execute an adb shell command and return stdout.
- * Throws std::runtime_error if command fails.
+ * Check connected ADB devices.
+ * Returns "serial<TAB>state" lines, asked of the adb server directly
+ * (host:devices) or read from "adb devices" when the socket transport
+ * is off or the server is unreachable.
  */
-std::string shell(const std::string& cmd, bool throw_on_error = true);
+std::optional<std::string> devices();
 
 /**
- * Check connected ADB devices.
- * Returns raw output from "adb devices".
+ * Serials of devices in the "device" state, parsed from devices().
  */
-std::optional<std::string> devices();
+std::vector<std::string> attached_serials();
+
+/**
+ * What a measured round-trip (a shell_multi batch, or a single command
+ * run with a cost) cost the device, as it reads it from /proc itself
+ * with shell builtins only.
+ */
+struct ShellCost {
+    // CPU time of the shell and every process it waited for (loops,
+    // $(cat ...), dumpsys clients); not the system_server work they ask for
+    double cpu_ms = 0;
+    // Voluntary and involuntary switches of the shell: each voluntary one
+    // is a sleep and a wakeup
+    uint64_t context_switches = 0;
+    // Processes forked device-wide while the batch ran; mostly its own
+    uint64_t processes = 0;
+    // Measured round-trips added up here
+    uint64_t round_trips = 0;
+
+    ShellCost& operator+=(const ShellCost& other) {
+        cpu_ms += other.cpu_ms;
+        context_switches += other.context_switches;
+        processes += other.processes;
+        round_trips += other.round_trips;
+        return *this;
+    }
+};
 
 /**
- * Execute multiple adb shell commands efficiently.
- * Uses marker lines to split outputs.
+ * Storage Device::shell_multi reuses from one call to the next. The
+ * combined script is rebuilt only when the batch changes, and the raw
+ * output and the results keep their capacity, so a caller sending the
+ * same batch every cycle stops allocating for it once warm.
+ * Not thread-safe: one per calling thread.
  */
-std::vector<std::string> shell_multi(const std::vector<std::string>& cmds);
+class MultiBuffer {
+public:
+    // Output of each command of the last batch, in order. Swapping a
+    // string out hands its capacity back for the next call.
+    std::vector<std::string>& results() { return results_; }
+    const std::vector<std::string>& results() const { return results_; }
+
+private:
+    friend class Device;
+
+    std::vector<std::string> cmds_;  // the batch script_ was built for
+    std::string script_;
+    std::string labels_;
+    metrics::Histogram* latency_ = nullptr;
+    CommandResult raw_{"", -1, ""};
+    std::vector<std::string> results_;
+};
+
+/**
+ * One attached device, addressed with "adb -s <serial>".
+ * Owns its own session pool so a slow device cannot starve the others.
+ */
+class Device {
+public:
+    /**
+     * Empty serial lets adb pick the device (ANDROID_SERIAL or the only one).
+     * Commands go straight to the adb server socket (adb_socket.hpp),
+     * falling back to pooled adb client sessions while it is not running;
+     * ADB_INSIGHT_TRANSPORT=exec uses only the client sessions.
+     */
+    explicit Device(std::string serial, size_t max_sessions = 4);
+
+    // Run commands through transport instead of adb sessions
+    Device(std::string serial, std::unique_ptr<Transport> transport);
+
+    const std::string& serial() const { return serial_; }
+
+    /**
+     * Execute an adb shell command and return stdout.
+     * Runs on the device transport: pooled persistent sessions unless
+     * another Transport was given (see adb_session.hpp).
+     * Throws std::runtime_error if command fails.
+     */
+    std::string shell(const std::string& cmd, bool throw_on_error = true);
+
+    /**
+     * Same, measuring the command's device-side cost as shell_multi does
+     * and adding it to cost. For expensive single commands like dumpsys.
+     */
+    std::string shell(const std::string& cmd, ShellCost& cost, bool throw_on_error = true);
+
+    /**
+     * Execute multiple adb shell commands efficiently.
+     * Uses marker lines to split outputs.
+     * Failed commands yield empty outputs; with throw_on_error a failed
+     * round-trip throws std::runtime_error instead.
+     * The batch also measures its own device-side cost, which is counted
+     * in /metrics and added to *cost when given.
+     */
+    std::vector<std::string> shell_multi(const std::vector<std::string>& cmds, bool throw_on_error = false,
+                                         ShellCost* cost = nullptr);
+
+    // Same, leaving the outputs in buffer.results() (see MultiBuffer)
+    void shell_multi(const std::vector<std::string>& cmds, MultiBuffer& buffer, bool throw_on_error = false,
+                     ShellCost* cost = nullptr);
+
+private:
+    // shell() with the metrics labels the round-trip is recorded under.
+    // Errors name shown instead of cmd when given.
+    std::string run(const std::string& cmd, bool throw_on_error, const std::string& labels,
+                    const std::string* shown = nullptr);
+
+    // One round-trip into result, timed into latency. False when it
+    // failed and throw_on_error is not set.
+    bool run_into(const std::string& cmd, bool throw_on_error, metrics::Histogram& latency,
+                  const std::string& labels, CommandResult& result, const std::string* shown = nullptr);
+
+    std::string serial_;
+    std::unique_ptr<Transport> transport_;
+};
 
 } // namespace adb
 
@@ -0,0 +1,72 @@
+#ifndef AGENT_HPP
+#define AGENT_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+#include "adb_socket.hpp"
+#include "procs.hpp"
+#include "snapshot.hpp"
+
+namespace agent {
+
+/**
+ * Client for the on-device helper (agent/adb_insight_agent.cpp). The
+ * helper holds the snapshot's sysfs/procfs files open and returns their
+ * contents on request. That is one socket round-trip and a pread per
+ * file, with no shell spawned on the device. It also scans processes.
+ *
+ * When binary names a local helper build, it is pushed to
+ * /data/local/tmp and started whenever no compatible helper answers.
+ * The stream is opened as localabstract:adb_insight_agent through the
+ * adb server, which is the same path adb forward uses, so there is no
+ * local port to allocate.
+ *
+ * Not synchronized; the sampler thread owns it.
+ */
+class Reader {
+public:
+    Reader(std::string serial, std::string binary);
+    ~Reader();
+
+    Reader(const Reader&) = delete;
+    Reader& operator=(const Reader&) = delete;
+
+    /**
+     * The requested sections, formatted like snapshot::capture's shell
+     * output so the same parsers apply. nullopt while the helper is
+     * unavailable; the caller falls back to snapshot::capture.
+     */
+    std::optional<snapshot::Snapshot> capture(unsigned sections);
+
+    /**
+     * A /proc scan: every process the first time on a connection, then
+     * only what changed. nullopt while the helper is unavailable.
+     */
+    std::optional<procs::Delta> processes();
+
+private:
+    struct File {
+        snapshot::Section section;
+        std::string path;
+    };
+
+    bool ensure_connected();
+    void connect();
+    void deploy();
+    // Send one request, return the reply body; throws on Error or a mismatched reply
+    std::string exchange(uint8_t op, const std::string& body);
+
+    std::string serial_;
+    std::string binary_;
+    std::unique_ptr<adb::ServerConnection> connection_;
+    std::vector<File> files_;
+    std::chrono::steady_clock::time_point retry_at_{};
+};
+
+} // namespace agent
+
+#endif // AGENT_HPP
@@ -0,0 +1,127 @@
+#ifndef AGENT_PROTOCOL_HPP
+#define AGENT_PROTOCOL_HPP
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+/**
+ * Wire format shared by the server and the on-device helper
+ * (agent/adb_insight_agent.cpp). Header-only and free of server
+ * dependencies so the helper builds on its own with the NDK.
+ *
+ * Every message is a little-endian u32 length of what follows, a u8
+ * op, then the op's body:
+ *
+ *   Hello  -> / <- u32 version
+ *   Open   -> repeated {u8 group, u16 length, glob}
+ *          <- u32 count, repeated {u8 group, u16 length, path}
+ *   Read   -> u64 group mask
+ *          <- u64 CLOCK_MONOTONIC ns, u32 count,
+ *             repeated {u32 file, i32 length (-1 if unreadable), bytes}
+ *   Processes -> (empty)
+ *          <- u64 CLOCK_BOOTTIME ns, u8 full, u32 page size, u32 count,
+ *             repeated {u32 pid, u32 ppid, u64 start ticks, u64 cpu ticks,
+ *                       u64 rss pages, i32 oom_score_adj, u32 threads,
+ *                       u8 state, u8 length, name},
+ *             u32 exited, repeated u32 pid
+ *   Quit   -> (empty), the helper exits
+ *   Error  <- message
+ *
+ * Files are numbered in the order Open returned them. A Read returns
+ * the whole current contents of every open file whose group bit is in
+ * the mask.
+ *
+ * The first Processes reply on a connection lists every process (full
+ * is 1). Later ones list only processes that started or changed since
+ * the previous reply, plus the pids that exited.
+ */
+namespace agent::protocol {
+
+constexpr uint32_t kVersion = 3;
+constexpr const char* kSocketName = "adb_insight_agent";  // abstract unix socket
+constexpr const char* kDevicePath = "/data/local/tmp/adb_insight_agent";
+constexpr uint32_t kMaxMessage = 16u << 20;
+
+enum Op : uint8_t { Hello = 0, Open = 1, Read = 2, Quit = 3, Processes = 4, Error = 0xff };
+
+inline void put_u8(std::string& out, uint8_t v) {
+    out += static_cast<char>(v);
+}
+
+inline void put_u16(std::string& out, uint16_t v) {
+    for (int i = 0; i < 2; ++i) out += static_cast<char>(v >> (8 * i));
+}
+
+inline void put_u32(std::string& out, uint32_t v) {
+    for (int i = 0; i < 4; ++i) out += static_cast<char>(v >> (8 * i));
+}
+
+inline void put_u64(std::string& out, uint64_t v) {
+    for (int i = 0; i < 8; ++i) out += static_cast<char>(v >> (8 * i));
+}
+
+// Overwrite 4 bytes at pos, for lengths known only after the body
+inline void patch_u32(std::string& out, size_t pos, uint32_t v) {
+    for (int i = 0; i < 4; ++i) out[pos + i] = static_cast<char>(v >> (8 * i));
+}
+
+// One message: length, op, body
+inline std::string frame(Op op, const std::string& body = "") {
+    std::string out;
+    out.reserve(5 + body.size());
+    put_u32(out, static_cast<uint32_t>(1 + body.size()));
+    put_u8(out, op);
+    out += body;
+    return out;
+}
+
+/**
+ * Bounds-checked cursor over a message body; does not own it, so the
+ * body must outlive the cursor.
+ * Throws std::runtime_error when a field runs past the end.
+ */
+class Cursor {
+public:
+    Cursor(const char* data, size_t size) : p_(data), end_(data + size) {}
+    explicit Cursor(const std::string& body) : Cursor(body.data(), body.size()) {}
+
+    uint8_t u8() { return static_cast<uint8_t>(fixed(1)); }
+    uint16_t u16() { return static_cast<uint16_t>(fixed(2)); }
+    uint32_t u32() { return static_cast<uint32_t>(fixed(4)); }
+    uint64_t u64() { return fixed(8); }
+
+    // n raw bytes, valid while the body is
+    const char* bytes(size_t n) {
+        need(n);
+        const char* out = p_;
+        p_ += n;
+        return out;
+    }
+
+    std::string str(size_t n) { return std::string(bytes(n), n); }
+
+    bool done() const { return p_ == end_; }
+
+private:
+    uint64_t fixed(int n) {
+        need(n);
+        uint64_t v = 0;
+        for (int i = n - 1; i >= 0; --i) v = (v << 8) | static_cast<unsigned char>(p_[i]);
+        p_ += n;
+        return v;
+    }
+
+    void need(size_t n) const {
+        if (static_cast<size_t>(end_ - p_) < n) {
+            throw std::runtime_error("agent message truncated");
+        }
+    }
+
+    const char* p_;
+    const char* end_;
+};
+
+} // namespace agent::protocol
+
+#endif // AGENT_PROTOCOL_HPP
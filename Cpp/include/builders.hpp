@@ -0,0 +1,49 @@
+#ifndef BUILDERS_HPP
+#define BUILDERS_HPP
+
+#include <vector>
+#include "adb_utils.hpp"
+#include "models.hpp"
+#include "props.hpp"
+#include "snapshot.hpp"
+#include "sources.hpp"
+
+// Builders fetch from the device and assemble one model each.
+// They throw std::runtime_error when the data cannot be collected.
+DeviceInfo build_device_info(adb::Device& device);
+OSInfo build_os_info(adb::Device& device);
+CPUInfo build_cpu_info(adb::Device& device);
+CPUFrequency build_cpu_frequency(adb::Device& device);
+CPUGovernorInfo build_cpu_governors(adb::Device& device);
+CPUIdleInfo build_cpu_idle_info(adb::Device& device);
+MemoryInfo build_memory_info(adb::Device& device);
+StorageInfo build_storage_info(adb::Device& device);
+std::vector<MountInfo> build_storage_mounts(adb::Device& device);
+BatteryInfo build_battery_info(adb::Device& device);
+PowerInfo build_power_info(adb::Device& device);
+ThermalInfo build_thermal_info(adb::Device& device);
+CoreTemperatures build_core_temperatures(adb::Device& device);
+NetworkInfo build_network_info(adb::Device& device);
+DisplayInfo build_display_info(adb::Device& device);
+UptimeInfo build_uptime_info(adb::Device& device);
+
+// Assemble models from an already captured snapshot (no adb traffic)
+CPUFrequency cpu_frequency_from(const snapshot::Snapshot& snap);
+CPUGovernorInfo cpu_governors_from(const snapshot::Snapshot& snap);
+CPUIdleInfo cpu_idle_info_from(const snapshot::Snapshot& snap);
+MemoryInfo memory_info_from(const snapshot::Snapshot& snap);
+UptimeInfo uptime_info_from(const snapshot::Snapshot& snap);
+
+// Variants reading properties from an already fetched getprop table
+DeviceInfo device_info_from(const props::Table& props);
+OSInfo build_os_info(adb::Device& device, const props::Table& props);
+CPUInfo build_cpu_info(adb::Device& device, const props::Table& props);
+NetworkInfo build_network_info(adb::Device& device, const props::Table& props);
+
+// Variants that share dumpsys output through a request-scoped cache
+BatteryInfo build_battery_info(sources::SourceCache& sources);
+PowerInfo build_power_info(sources::SourceCache& sources);
+ThermalInfo build_thermal_info(sources::SourceCache& sources);
+CoreTemperatures build_core_temperatures(sources::SourceCache& sources);
+
+#endif // BUILDERS_HPP
@@ -0,0 +1,116 @@
+#ifndef COLLECTOR_HPP
+#define COLLECTOR_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace collector {
+
+using clock = std::chrono::steady_clock;
+
+/**
+ * Fixed-size worker pool for running builders concurrently.
+ * Tasks that outlive their caller's deadline keep their worker until
+ * they return; the adb session timeout bounds how long that can be.
+ * max_queued caps jobs waiting for a worker in try_submit (0: no cap).
+ */
+class WorkerPool {
+public:
+    explicit WorkerPool(size_t threads, size_t max_queued = 0);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    template <typename F>
+    auto submit(F&& fn) -> std::future<decltype(fn())> {
+        using R = decltype(fn());
+        auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(fn));
+        auto future = task->get_future();
+        enqueue([task] { (*task)(); }, false);
+        return future;
+    }
+
+    /**
+     * Like submit, but refuses the job instead of queueing it when
+     * max_queued jobs are already waiting, e.g. because every worker is
+     * stuck on a hung device. Returns std::nullopt when refused.
+     */
+    template <typename F>
+    auto try_submit(F&& fn) -> std::optional<std::future<decltype(fn())>> {
+        using R = decltype(fn());
+        auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(fn));
+        auto future = task->get_future();
+        if (!enqueue([task] { (*task)(); }, true)) return std::nullopt;
+        return future;
+    }
+
+private:
+    bool enqueue(std::function<void()> job, bool bounded);
+    void worker_loop();
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::function<void()>> jobs_;
+    std::vector<std::thread> workers_;
+    size_t max_queued_;
+    bool stopping_ = false;
+};
+
+/**
+ * Wait for a builder result until the deadline.
+ * Returns std::nullopt if the builder threw or did not finish in time.
+ */
+template <typename T>
+std::optional<T> await(std::future<T>& future, clock::time_point deadline, const std::string& name) {
+    if (future.wait_until(deadline) != std::future_status::ready) {
+        std::cerr << "Builder timed out: " << name << "\n";
+        return std::nullopt;
+    }
+    try {
+        return future.get();
+    } catch (const std::exception& e) {
+        std::cerr << "Builder failed: " << name << ": " << e.what() << "\n";
+        return std::nullopt;
+    }
+}
+
+/**
+ * await for a try_submit job; one the full queue refused is std::nullopt.
+ */
+template <typename T>
+std::optional<T> await(std::optional<std::future<T>>& future, clock::time_point deadline, const std::string& name) {
+    if (!future) {
+        std::cerr << "Builder skipped, queue full: " << name << "\n";
+        return std::nullopt;
+    }
+    return await(*future, deadline, name);
+}
+
+/**
+ * Run a builder inline, returning std::nullopt if it throws.
+ */
+template <typename F>
+auto attempt(F&& fn, std::string_view name) -> std::optional<decltype(fn())> {
+    try {
+        return fn();
+    } catch (const std::exception& e) {
+        std::cerr << "Builder failed: " << name << ": " << e.what() << "\n";
+        return std::nullopt;
+    }
+}
+
+} // namespace collector
+
+#endif // COLLECTOR_HPP
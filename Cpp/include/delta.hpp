@@ -0,0 +1,66 @@
+#ifndef DELTA_HPP
+#define DELTA_HPP
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "models.hpp"
+#include "payload.hpp"
+
+namespace delta {
+
+// (section name, minified JSON) in key order
+using Sections = std::vector<std::pair<std::string, std::string>>;
+
+// Top-level SystemInfo sections, timestamp excluded; missing ones are "null"
+Sections sections_of(const SystemInfo& system);
+
+// Sections changed after a client's version
+struct Patch {
+    int64_t version;
+    int64_t since;
+    // Client's version is unknown to this server (e.g. from the future
+    // after a clock step); changed holds every section
+    bool full;
+    Sections changed;
+};
+
+/**
+ * Per-device record of the last /system sections and the version each
+ * one last changed at. Versions increase with every snapshot that
+ * changes anything and start from wall-clock milliseconds, so they keep
+ * increasing across restarts and a client's stale version simply yields
+ * every section.
+ */
+class Tracker {
+public:
+    // Record a snapshot and return its version
+    int64_t update(const Sections& sections);
+
+    // Sections recorded so far that changed after since
+    Patch since(int64_t since);
+
+private:
+    struct Entry {
+        std::string bytes;
+        int64_t changed_at;
+    };
+
+    std::mutex mutex_;
+    int64_t version_ = 0;
+    std::map<std::string, Entry> sections_;
+};
+
+/**
+ * {"changes": {...}, "full": bool, "since": n, "timestamp": "...",
+ * "version": n}. Minified JSON splices the stored section bytes without
+ * re-encoding them.
+ */
+payload::PayloadPtr encode(Patch patch, std::string timestamp);
+
+} // namespace delta
+
+#endif // DELTA_HPP
@@ -0,0 +1,158 @@
+#ifndef DEVICES_HPP
+#define DEVICES_HPP
+
+#include <chrono>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "adb_utils.hpp"
+#include "collector.hpp"
+#include "delta.hpp"
+#include "procs.hpp"
+#include "profile.hpp"
+#include "props.hpp"
+#include "sampler.hpp"
+#include "sources.hpp"
+#include "stream.hpp"
+#include "ttl_cache.hpp"
+
+namespace devices {
+
+class DeviceContext;
+
+struct Settings {
+    size_t sessions = 4;
+    size_t workers = 4;
+    // /system section builds waiting for a builder worker: two collections
+    size_t workers_queue = 24;
+    // HTTP handlers' collection jobs, off the HTTP threads
+    size_t io_threads = 8;
+    size_t io_queue = 16;
+    sampler::Config sampler;
+    cache::Policy cache_default{std::chrono::seconds(30), std::chrono::seconds(30)};
+    std::function<void(cache::TtlCache&)> configure_cache;
+    // Where device profiles persist, one file per serial; empty keeps them in memory
+    std::string profile_dir;
+    // Queued on the I/O workers of each new context, e.g. to fill its profile
+    std::function<void(DeviceContext&)> warm_up;
+    // Builds a full /system document; the sampler refreshes one this often
+    std::function<SystemInfo(DeviceContext&)> collect_system;
+    std::chrono::milliseconds system_interval{5000};
+};
+
+// A recorded /system document and the delta version it was recorded at
+struct SystemSnapshot {
+    SystemInfo info;
+    int64_t version;
+    std::chrono::steady_clock::time_point collected_at;
+};
+
+/**
+ * Everything owned by one device: session pool, response cache,
+ * static profile, property table, process tracker, builder workers,
+ * handler I/O workers, stream broadcaster, /system version tracker and
+ * sampler thread. Nothing here is shared with other
+ * devices, so one hung phone only stalls its own requests.
+ */
+class DeviceContext {
+public:
+    DeviceContext(std::string serial, const Settings& settings);
+    ~DeviceContext();
+
+    DeviceContext(const DeviceContext&) = delete;
+    DeviceContext& operator=(const DeviceContext&) = delete;
+
+    /**
+     * dumpsys battery and thermalservice for request handlers: fresh
+     * sources for every call, except with Config::low_observer. The
+     * sampler leaves dumpsys alone then, so handlers share one set for
+     * a minute rather than running dumpsys for every client request.
+     */
+    std::shared_ptr<sources::SourceCache> dumpsys();
+
+    /**
+     * The last recorded /system document if it is younger than two
+     * system intervals, else a fresh one. Collections never overlap:
+     * concurrent callers share the one in flight, so versions are
+     * recorded in the order the documents were built.
+     */
+    std::shared_ptr<const SystemSnapshot> system();
+
+    // system() and the sections changed after since, as of that document
+    std::pair<std::shared_ptr<const SystemSnapshot>, delta::Patch> system_since(int64_t since);
+
+    adb::Device adb;
+    cache::TtlCache cache;
+    profile::Profile profile;
+    props::Cache props;
+    procs::Tracker processes;
+    collector::WorkerPool workers;
+    stream::Broadcaster broadcaster;
+    delta::Tracker system_versions;
+    sampler::Sampler sampler;
+
+private:
+    using SystemFuture = std::shared_future<std::shared_ptr<const SystemSnapshot>>;
+
+    // Collect and record a /system document, or join the collection in flight
+    std::shared_ptr<const SystemSnapshot> refresh_system();
+    // Sampler cycle hook: queue a refresh once the last document is due
+    void on_sampler_cycle();
+
+    std::function<SystemInfo(DeviceContext&)> collect_system_;
+    std::chrono::milliseconds system_interval_;
+
+    std::mutex dumpsys_mutex_;
+    std::shared_ptr<sources::SourceCache> dumpsys_;
+    std::chrono::steady_clock::time_point dumpsys_at_{};
+
+    std::mutex system_mutex_;
+    std::shared_ptr<const SystemSnapshot> system_;
+    SystemFuture system_refresh_;
+    bool system_queued_ = false;
+
+public:
+    // Last, so queued jobs are joined before anything they use goes away
+    collector::WorkerPool io;
+};
+
+/**
+ * Lazily created contexts keyed by serial, one per physical device: the
+ * unprefixed routes and /devices/<serial> share a context when they reach
+ * the same phone. Contexts live for the lifetime of the server.
+ */
+class Registry {
+public:
+    explicit Registry(Settings settings);
+
+    // Device used by unprefixed routes: ANDROID_SERIAL, or adb's own choice,
+    // which is the only attached device
+    DeviceContext& default_device();
+
+    // Context for an attached serial, or nullptr if it is not attached
+    DeviceContext* find(const std::string& serial);
+
+    // Contexts of every attached device, from one adb device listing
+    std::vector<DeviceContext*> attached();
+
+private:
+    DeviceContext& get_or_create(const std::string& serial);
+    // get_or_create for a serial in attached, which may adopt the "" context
+    DeviceContext& attached_context(const std::string& serial, const std::vector<std::string>& attached);
+
+    Settings settings_;
+    std::mutex mutex_;
+    // A context adopted by its serial is held under both keys
+    std::map<std::string, std::shared_ptr<DeviceContext>> contexts_;
+    // Context of adb's own choice once its serial is known
+    DeviceContext* default_ = nullptr;
+    std::chrono::steady_clock::time_point default_checked_{};
+};
+
+} // namespace devices
+
+#endif // DEVICES_HPP
@@ -0,0 +1,128 @@
+#ifndef EVENTS_HPP
+#define EVENTS_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "models.hpp"
+#include "parsers.hpp"
+#include "sources.hpp"
+
+namespace events {
+
+enum class Kind : uint8_t {
+    FreqCapped,      // a core's scaling_max_freq fell below cpuinfo_max_freq, or moved while below it
+    FreqRestored,    // the cap was lifted
+    ThermalStatus,   // a thermal sensor's throttling status changed
+    DischargeSpike   // battery draw jumped well above its recent baseline
+};
+
+// "freq_capped", "freq_restored", "thermal_status", "discharge_spike"
+const char* kind_name(Kind kind);
+
+/**
+ * One detected change. Trivially copyable, so the log copies it in and
+ * out word by word without a lock.
+ */
+struct Event {
+    uint64_t id = 0;  // assigned by the log, increasing from 1
+    int64_t t_ms = 0;
+    Kind kind = Kind::FreqCapped;
+    char subject[31] = {};  // core, sensor name or "battery"; truncated
+    double value = 0;       // cap kHz, new status, or current mA
+    double reference = 0;   // hardware max kHz, previous status, or baseline mA
+
+    std::string subject_name() const { return std::string(subject, strnlen(subject, sizeof(subject))); }
+};
+
+void to_json(json& j, const Event& event);
+
+/**
+ * Fixed-capacity ring of the newest events, one writer and any number
+ * of readers, none of which ever block.
+ *
+ * Each slot is a seqlock: the writer marks it odd, stores the event
+ * and marks it with the event's id. A reader copies a slot and keeps
+ * the copy only if the mark matched the id it wanted before and after
+ * the copy. A reader that falls more than capacity events behind
+ * resumes at the oldest event still held.
+ */
+class Log {
+public:
+    explicit Log(size_t capacity = 1024);
+
+    Log(const Log&) = delete;
+    Log& operator=(const Log&) = delete;
+
+    // Single writer only. Returns the event with its id set.
+    Event push(Event event);
+
+    // Events with id > since_id, oldest first, at most limit
+    std::vector<Event> since(uint64_t since_id, size_t limit) const;
+
+    uint64_t last_id() const { return last_id_.load(std::memory_order_acquire); }
+
+private:
+    static constexpr size_t kWords = (sizeof(Event) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    struct Slot {
+        std::atomic<uint64_t> sequence{0};  // 2 * id once written, odd while being written
+        std::atomic<uint64_t> words[kWords];
+    };
+
+    std::unique_ptr<Slot[]> slots_;
+    size_t capacity_;
+    std::atomic<uint64_t> last_id_{0};
+};
+
+struct Rules {
+    // Draw counts as a spike above baseline * spike_ratio and
+    // baseline + spike_min_ma
+    double spike_ratio = 1.5;
+    double spike_min_ma = 200;
+    // Weight of each new sample in the baseline moving average
+    double baseline_alpha = 0.1;
+    // Discharging samples folded in before spikes are reported
+    int warmup_samples = 5;
+};
+
+/**
+ * Incremental rules over the sampler's observations. Each call compares
+ * one observation against the state kept from the previous one and pushes
+ * what changed, so the work per sample does not depend on how many
+ * clients watch. State before the first observation counts as
+ * unthrottled. Not synchronized; the sampler thread owns it.
+ */
+class Detector {
+public:
+    explicit Detector(Log& log, Rules rules = {});
+
+    // Each returns the events it pushed
+    std::vector<Event> freq_limits(int64_t t_ms, const parsers::PerCore<parsers::CpuFreqLimit>& limits);
+    std::vector<Event> thermal(int64_t t_ms, const sources::ThermalMap& sensors);
+    std::vector<Event> power(int64_t t_ms, const PowerInfo& power);
+
+    // Whether a condition is still in progress, for the sampler to watch it closely
+    bool freq_capped() const { return !caps_.empty(); }
+    bool thermal_throttling() const;
+    bool discharge_spiking() const { return spiking_; }
+
+private:
+    Event emit(int64_t t_ms, Kind kind, const std::string& subject, double value, double reference);
+
+    Log& log_;
+    Rules rules_;
+    std::map<size_t, int> caps_;  // cores currently capped -> scaling_max_freq
+    std::map<std::string, int> statuses_;
+    double baseline_ma_ = 0;
+    int discharging_samples_ = 0;
+    bool spiking_ = false;
+};
+
+} // namespace events
+
+#endif // EVENTS_HPP
@@ -0,0 +1,64 @@
+#ifndef FLEET_HPP
+#define FLEET_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+#include "devices.hpp"
+#include "models.hpp"
+
+namespace fleet {
+
+struct Options {
+    // Device jobs in flight at once for one fleet request
+    size_t concurrency = 16;
+    // Each device's budget, counted from when its job is handed out
+    std::chrono::milliseconds deadline{5000};
+};
+
+// One device's document, or why there is none
+struct Result {
+    std::string serial;
+    std::optional<json> document;
+    std::string error;
+    std::chrono::milliseconds elapsed{0};
+};
+
+using Fetch = std::function<json(devices::DeviceContext&)>;
+
+/**
+ * Run fetch for every device, each on that device's own I/O workers,
+ * with at most options.concurrency running at once. A device that
+ * misses its deadline or whose I/O queue is full gets an error result;
+ * a late job finishes in the background. Results are in input order.
+ * Returns once every device has answered or timed out.
+ */
+std::vector<Result> collect(const std::vector<devices::DeviceContext*>& devices, const Fetch& fetch,
+                            const Options& options);
+
+struct Stats {
+    double min;
+    double max;
+    double p50;
+    double p95;
+    size_t count;
+};
+
+void to_json(json& j, const Stats& stats);
+
+/**
+ * Summary of every numeric field across the documents, keyed by its
+ * dotted path ("temperatures.SKIN", "per_core.cpu4", "battery.level").
+ * Array elements are indexed ("mounts.0.used_gb"). Booleans and strings
+ * are skipped. Fields missing from some documents summarize the ones that
+ * have them. Percentiles are nearest-rank.
+ */
+std::map<std::string, Stats> summarize(const std::vector<Result>& results);
+
+} // namespace fleet
+
+#endif // FLEET_HPP
@@ -0,0 +1,95 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace metrics {
+
+// Writers spread over this many cache-line sized stripes, picked per
+// thread, so concurrent updates almost never touch the same line
+constexpr size_t kStripes = 8;
+
+/**
+ * Monotonic counter. inc() is a relaxed atomic add on the calling
+ * thread's stripe.
+ */
+class Counter {
+public:
+    void inc(uint64_t n = 1);
+    uint64_t value() const;
+
+private:
+    struct alignas(64) Stripe {
+        std::atomic<uint64_t> value{0};
+    };
+    std::array<Stripe, kStripes> stripes_;
+};
+
+/**
+ * Latency histogram with power-of-two buckets from 128ns to ~34s.
+ * observe() is a few relaxed atomic adds on the calling thread's
+ * stripe: no locks, no allocation. Buckets are cumulative only when
+ * rendered.
+ */
+class Histogram {
+public:
+    static constexpr int kMinShift = 7;   // first bucket: <= 2^7 ns
+    static constexpr size_t kBuckets = 29; // last finite bucket: <= 2^35 ns
+
+    void observe(std::chrono::nanoseconds duration);
+
+    // Upper bound of bucket i in seconds
+    static double bucket_bound(size_t i);
+
+    struct Totals {
+        std::array<uint64_t, kBuckets + 1> buckets{};  // last is +Inf
+        uint64_t count = 0;
+        uint64_t sum_ns = 0;
+    };
+    Totals totals() const;
+
+private:
+    struct alignas(64) Stripe {
+        std::array<std::atomic<uint64_t>, kBuckets + 1> buckets{};
+        std::atomic<uint64_t> sum_ns{0};
+    };
+    std::array<Stripe, kStripes> stripes_;
+};
+
+/**
+ * Registered series live for the whole process; hold on to the
+ * returned reference (e.g. in a function-local static) rather than
+ * looking it up on every call. labels is Prometheus label syntax
+ * without braces, e.g. R"(parser="scan_cpu_freq")".
+ */
+Histogram& histogram(const std::string& name, const std::string& help, const std::string& labels = "");
+Counter& counter(const std::string& name, const std::string& help, const std::string& labels = "");
+
+// Escape a label value for use inside quotes
+std::string label_value(const std::string& value);
+
+// Every registered series in Prometheus text exposition format
+std::string render();
+
+// Observes the lifetime of the scope into a histogram
+class Timer {
+public:
+    explicit Timer(Histogram& histogram)
+        : histogram_(histogram), start_(std::chrono::steady_clock::now()) {}
+    ~Timer() { histogram_.observe(std::chrono::steady_clock::now() - start_); }
+
+    Timer(const Timer&) = delete;
+    Timer& operator=(const Timer&) = delete;
+
+private:
+    Histogram& histogram_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+} // namespace metrics
+
+#endif // METRICS_HPP
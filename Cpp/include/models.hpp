@@ -7,6 +7,7 @@
 #include <map>
 #include <optional>
 #include <chrono>
+#include "wire.hpp"
 
 using json = nlohmann::json;
 using timestamp_t = std::chrono::system_clock::time_point;
@@ -21,6 +22,7 @@ struct DeviceInfo {
     std::string board;
 
     NLOHMANN_DEFINE_TYPE_INTRUSIVE(DeviceInfo, model, manufacturer, android_version, sdk, hardware, board)
+    WIRE_DEFINE_FIELDS(DeviceInfo, android_version, board, hardware, manufacturer, model, sdk)
 };
 
 // OS info
@@ -32,6 +34,7 @@ struct OSInfo {
     std::string kernel_version;
 
     NLOHMANN_DEFINE_TYPE_INTRUSIVE(OSInfo, android_version, sdk, security_patch, build_id, kernel_version)
+    WIRE_DEFINE_FIELDS(OSInfo, android_version, build_id, kernel_version, sdk, security_patch)
 };
 
 // CPU info
@@ -42,6 +45,7 @@ struct CPUInfo {
     std::string arch;
 
     NLOHMANN_DEFINE_TYPE_INTRUSIVE(CPUInfo, cores, abi, abi_list, arch)
+    WIRE_DEFINE_FIELDS(CPUInfo, abi, abi_list, arch, cores)
 };
 
 // CPU frequency
@@ -55,6 +59,7 @@ struct CPUFrequency {
     int core_count;
 
     NLOHMANN_DEFINE_TYPE_INTRUSIVE(CPUFrequency, per_core, min_khz, max_khz, min_mhz, max_mhz, avg_mhz, core_count)
+    WIRE_DEFINE_FIELDS(CPUFrequency, avg_mhz, core_count, max_khz, max_mhz, min_khz, min_mhz, per_core)
 };
 
 // CPU Governor
@@ -63,6 +68,7 @@ struct CPUGovernorInfo {
     std::vector<std::string> available_governors;
 
     NLOHMANN_DEFINE_TYPE_INTRUSIVE(CPUGovernorInfo, per_core, available_governors)
+    WIRE_DEFINE_FIELDS(CPUGovernorInfo, available_governors, per_core)
 };
 
 // CPU Idle State
@@ -73,6 +79,7 @@ struct CPUIdleState {
     int usage;
 
     NLOHMANN_DEFINE_TYPE_INTRUSIVE(CPUIdleState, state, name, time_us, usage)
+    WIRE_DEFINE_FIELDS(CPUIdleState, name, state, time_us, usage)
 };
 
 // CPU Idle Info
@@ -80,6 +87,41 @@ struct CPUIdleInfo {
     std::map<std::string, std::vector<CPUIdleState>> per_core;
 
     NLOHMANN_DEFINE_TYPE_INTRUSIVE(CPUIdleInfo, per_core)
+    WIRE_DEFINE_FIELDS(CPUIdleInfo, per_core)
+};
+
+// Rates of one core over the sampler window; null where the source
+// is unavailable on the device
+struct CoreRates {
+    std::optional<double> utilization_percent;
+    std::map<std::string, double> idle_residency_percent;
+    std::optional<double> avg_freq_mhz;
+
+    json to_json() const {
+        json j;
+        j["utilization_percent"] = utilization_percent ? json(*utilization_percent) : json(nullptr);
+        j["idle_residency_percent"] = idle_residency_percent;
+        j["avg_freq_mhz"] = avg_freq_mhz ? json(*avg_freq_mhz) : json(nullptr);
+        return j;
+    }
+
+    friend void to_json(json& j, const CoreRates& v) { j = v.to_json(); }
+    WIRE_DEFINE_FIELDS(CoreRates, avg_freq_mhz, idle_residency_percent, utilization_percent)
+};
+
+// Derived CPU rates
+struct CPURates {
+    std::map<std::string, CoreRates> per_core;
+    int64_t window_ms;
+    int samples;
+
+    // to_json only: CoreRates has no from_json for the macro to use
+    friend void to_json(json& j, const CPURates& v) {
+        j["per_core"] = v.per_core;
+        j["window_ms"] = v.window_ms;
+        j["samples"] = v.samples;
+    }
+    WIRE_DEFINE_FIELDS(CPURates, per_core, samples, window_ms)
 };
 
 // Memory info
@@ -92,6 +134,7 @@ struct MemoryInfo {
     double swap_free_mb;
 
     NLOHMANN_DEFINE_TYPE_INTRUSIVE(MemoryInfo, total_mb, available_mb, used_mb, usage_percent, swap_total_mb, swap_free_mb)
+    WIRE_DEFINE_FIELDS(MemoryInfo, available_mb, swap_free_mb, swap_total_mb, total_mb, usage_percent, used_mb)
 };
 
 // Storage info
@@ -103,6 +146,7 @@ struct StorageInfo {
     double usage_percent;
 
     NLOHMANN_DEFINE_TYPE_INTRUSIVE(StorageInfo, filesystem, total_gb, used_gb, free_gb, usage_percent)
+    WIRE_DEFINE_FIELDS(StorageInfo, filesystem, free_gb, total_gb, usage_percent, used_gb)
 };
 
 // Mount info
@@ -115,6 +159,7 @@ struct MountInfo {
     std::string mountpoint;
 
     NLOHMANN_DEFINE_TYPE_INTRUSIVE(MountInfo, filesystem, size_kb, used_kb, available_kb, use_percent, mountpoint)
+    WIRE_DEFINE_FIELDS(MountInfo, available_kb, filesystem, mountpoint, size_kb, use_percent, used_kb)
 };
 
 // Battery info
@@ -128,6 +173,7 @@ struct BatteryInfo {
     bool is_charging;
 
     NLOHMANN_DEFINE_TYPE_INTRUSIVE(BatteryInfo, level, health, status, voltage_mv, temperature_c, technology, is_charging)
+    WIRE_DEFINE_FIELDS(BatteryInfo, health, is_charging, level, status, technology, temperature_c, voltage_mv)
 };
 
 // Thermal info
@@ -137,6 +183,7 @@ struct ThermalInfo {
     double min_temp_c;
 
     NLOHMANN_DEFINE_TYPE_INTRUSIVE(ThermalInfo, temperatures, max_temp_c, min_temp_c)
+    WIRE_DEFINE_FIELDS(ThermalInfo, max_temp_c, min_temp_c, temperatures)
 };
 
 // Core temperatures
@@ -146,6 +193,7 @@ struct CoreTemperatures {
     bool available;
 
     NLOHMANN_DEFINE_TYPE_INTRUSIVE(CoreTemperatures, per_core, source, available)
+    WIRE_DEFINE_FIELDS(CoreTemperatures, available, per_core, source)
 };
 
 // Network info
@@ -167,6 +215,9 @@ struct NetworkInfo {
         j["data_state"] = data_state.has_value() ? json(data_state.value()) : json(nullptr);
         return j;
     }
+
+    friend void to_json(json& j, const NetworkInfo& v) { j = v.to_json(); }
+    WIRE_DEFINE_FIELDS(NetworkInfo, carrier, data_state, hostname, network_type, wifi_ip, wifi_mac)
 };
 
 // Display info
@@ -175,6 +226,7 @@ struct DisplayInfo {
     int density_dpi;
 
     NLOHMANN_DEFINE_TYPE_INTRUSIVE(DisplayInfo, size_px, density_dpi)
+    WIRE_DEFINE_FIELDS(DisplayInfo, density_dpi, size_px)
 };
 
 // Power info
@@ -192,6 +244,18 @@ struct PowerInfo {
         j["charging_status"] = charging_status;
         return j;
     }
+
+    friend void to_json(json& j, const PowerInfo& v) { j = v.to_json(); }
+
+    // Hand-written to match to_json(), which omits missing optionals
+    friend void wire_write(wire::Writer& w, const PowerInfo& v) {
+        w.begin_object();
+        if (v.charge_counter) w.member("charge_counter", *v.charge_counter);
+        w.member("charging_status", v.charging_status);
+        w.member("current_ma", v.current_ma);
+        if (v.max_charging_current) w.member("max_charging_current", *v.max_charging_current);
+        w.end_object();
+    }
 };
 
 // Health status
@@ -201,6 +265,7 @@ struct HealthStatus {
     std::string timestamp;
 
     NLOHMANN_DEFINE_TYPE_INTRUSIVE(HealthStatus, status, adb_connected, timestamp)
+    WIRE_DEFINE_FIELDS(HealthStatus, adb_connected, status, timestamp)
 };
 
 // Uptime info
@@ -210,47 +275,80 @@ struct UptimeInfo {
     std::string boot_time;
 
     NLOHMANN_DEFINE_TYPE_INTRUSIVE(UptimeInfo, uptime_seconds, uptime_formatted, boot_time)
+    WIRE_DEFINE_FIELDS(UptimeInfo, boot_time, uptime_formatted, uptime_seconds)
+};
+
+// One process from a /proc scan
+struct ProcessInfo {
+    int pid;
+    int ppid;
+    std::string name;
+    std::string state;
+    int threads;
+    double cpu_percent;  // of one core, since the previous scan
+    double rss_mb;
+    int oom_score_adj;
+
+    NLOHMANN_DEFINE_TYPE_INTRUSIVE(ProcessInfo, pid, ppid, name, state, threads, cpu_percent, rss_mb, oom_score_adj)
+    WIRE_DEFINE_FIELDS(ProcessInfo, cpu_percent, name, oom_score_adj, pid, ppid, rss_mb, state, threads)
+};
+
+// Top processes of one scan
+struct ProcessList {
+    std::vector<ProcessInfo> processes;
+    int total;             // processes in the scan
+    std::string sort;      // "cpu" or "rss"
+    int64_t interval_ms;   // what cpu_percent is averaged over
+    std::string source;    // "agent" or "shell"
+
+    NLOHMANN_DEFINE_TYPE_INTRUSIVE(ProcessList, processes, total, sort, interval_ms, source)
+    WIRE_DEFINE_FIELDS(ProcessList, interval_ms, processes, sort, source, total)
 };
 
 // System info (aggregate)
+// Sections are optional so a failed or timed-out builder serializes as null
 struct SystemInfo {
-    DeviceInfo device;
-    OSInfo os;
-    CPUInfo cpu;
-    CPUFrequency cpu_frequency;
+    std::optional<DeviceInfo> device;
+    std::optional<OSInfo> os;
+    std::optional<CPUInfo> cpu;
+    std::optional<CPUFrequency> cpu_frequency;
     std::optional<CPUGovernorInfo> cpu_governors;
     std::optional<CPUIdleInfo> cpu_idle;
-    MemoryInfo memory;
-    StorageInfo storage;
+    std::optional<MemoryInfo> memory;
+    std::optional<StorageInfo> storage;
     std::optional<std::vector<MountInfo>> mounts;
-    BatteryInfo battery;
-    PowerInfo power;
-    ThermalInfo thermal;
+    std::optional<BatteryInfo> battery;
+    std::optional<PowerInfo> power;
+    std::optional<ThermalInfo> thermal;
     std::optional<CoreTemperatures> core_temperatures;
-    NetworkInfo network;
-    DisplayInfo display;
+    std::optional<NetworkInfo> network;
+    std::optional<DisplayInfo> display;
     std::string timestamp;
 
     json to_json() const {
         json j;
-        j["device"] = device;
-        j["os"] = os;
-        j["cpu"] = cpu;
-        j["cpu_frequency"] = cpu_frequency;
-        if (cpu_governors) j["cpu_governors"] = cpu_governors.value();
-        if (cpu_idle) j["cpu_idle"] = cpu_idle.value();
-        j["memory"] = memory;
-        j["storage"] = storage;
-        if (mounts) j["mounts"] = mounts.value();
-        j["battery"] = battery;
-        j["power"] = power.to_json();
-        j["thermal"] = thermal;
-        if (core_temperatures) j["core_temperatures"] = core_temperatures.value();
-        j["network"] = network.to_json();
-        j["display"] = display;
+        j["device"] = device ? json(device.value()) : json(nullptr);
+        j["os"] = os ? json(os.value()) : json(nullptr);
+        j["cpu"] = cpu ? json(cpu.value()) : json(nullptr);
+        j["cpu_frequency"] = cpu_frequency ? json(cpu_frequency.value()) : json(nullptr);
+        j["cpu_governors"] = cpu_governors ? json(cpu_governors.value()) : json(nullptr);
+        j["cpu_idle"] = cpu_idle ? json(cpu_idle.value()) : json(nullptr);
+        j["memory"] = memory ? json(memory.value()) : json(nullptr);
+        j["storage"] = storage ? json(storage.value()) : json(nullptr);
+        j["mounts"] = mounts ? json(mounts.value()) : json(nullptr);
+        j["battery"] = battery ? json(battery.value()) : json(nullptr);
+        j["power"] = power ? power->to_json() : json(nullptr);
+        j["thermal"] = thermal ? json(thermal.value()) : json(nullptr);
+        j["core_temperatures"] = core_temperatures ? json(core_temperatures.value()) : json(nullptr);
+        j["network"] = network ? network->to_json() : json(nullptr);
+        j["display"] = display ? json(display.value()) : json(nullptr);
         j["timestamp"] = timestamp;
         return j;
     }
+
+    friend void to_json(json& j, const SystemInfo& v) { j = v.to_json(); }
+    WIRE_DEFINE_FIELDS(SystemInfo, battery, core_temperatures, cpu, cpu_frequency, cpu_governors, cpu_idle,
+                       device, display, memory, mounts, network, os, power, storage, thermal, timestamp)
 };
 
 #endif // MODELS_HPP
@@ -1,13 +1,151 @@
 #ifndef PARSERS_HPP
 #define PARSERS_HPP
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
 #include "models.hpp"
+#include "small_vector.hpp"
 
 namespace parsers {
 
+// ============ VIEW API ============
+// Tokenizes in place and returns flat containers of views into the
+// input text, which must outlive the result. The std::string API below
+// is a thin adapter over these.
+
+using KeyValueView = std::pair<std::string_view, std::string_view>;
+using KeyValueList = SmallVector<KeyValueView, 48>;
+
+// Trimmed key:value pairs in input order; duplicates are kept
+KeyValueList scan_key_value_block(std::string_view text);
+
+// Value of the last pair with this key, or an empty view
+std::string_view find_value(const KeyValueList& pairs, std::string_view key);
+
+/**
+ * Values indexed by core number instead of by "cpuN" string.
+ * Core numbers from kMaxCores on are dropped, so a malformed cpuNNNNNNNNN
+ * path cannot make a parser allocate gigabytes.
+ */
+template <typename T>
+class PerCore {
+public:
+    static constexpr size_t kMaxCores = 4096;
+
+    void set(size_t core, const T& value) {
+        if (core >= kMaxCores) return;
+        if (core >= values_.size()) {
+            values_.resize(core + 1);
+            present_.resize(core + 1, 0);
+        }
+        values_[core] = value;
+        present_[core] = 1;
+    }
+
+    bool has(size_t core) const { return core < present_.size() && present_[core]; }
+    const T& at(size_t core) const { return values_[core]; }
+
+    // Highest core number seen plus one
+    size_t extent() const { return values_.size(); }
+
+    size_t count() const {
+        size_t n = 0;
+        for (char p : present_) n += p != 0;
+        return n;
+    }
+
+    // fn(core, value) for each present core, in core order
+    template <typename F>
+    void for_each(F&& fn) const {
+        for (size_t core = 0; core < values_.size(); ++core) {
+            if (present_[core]) fn(core, values_[core]);
+        }
+    }
+
+private:
+    SmallVector<T, 16> values_;
+    SmallVector<char, 16> present_;  // not bool: needs contiguous storage
+};
+
+// "<path with cpuN>: <int>" lines
+PerCore<int> scan_cpu_freq(std::string_view text);
+
+// "<path with cpuN>: <value>" lines, value trimmed
+PerCore<std::string_view> scan_path_value_block(std::string_view text);
+
+struct IdleStateView {
+    size_t core;
+    std::string_view state;
+    std::string_view name;
+    int64_t time_us;
+    int usage;
+};
+using IdleStateList = SmallVector<IdleStateView, 64>;
+
+// "cpuN stateM name time usage" lines
+IdleStateList scan_cpu_idle_output(std::string_view text);
+
+// Cumulative jiffies of one core; idle includes iowait
+struct CpuJiffies {
+    uint64_t total;
+    uint64_t idle;
+};
+
+// Per-core "cpuN user nice system idle iowait irq softirq steal ..."
+// lines of /proc/stat; the aggregate "cpu" line is skipped
+PerCore<CpuJiffies> scan_proc_stat(std::string_view text);
+
+struct TimeInStateView {
+    size_t core;
+    int64_t freq_khz;
+    int64_t time;  // 10ms units
+};
+using TimeInStateList = SmallVector<TimeInStateView, 128>;
+
+// "cpuN freq_khz time" lines (cpufreq/stats/time_in_state prefixed with the core)
+TimeInStateList scan_time_in_state(std::string_view text);
+
+// Hardware ceiling and current policy cap of one core
+struct CpuFreqLimit {
+    int cpuinfo_max_khz;
+    int scaling_max_khz;
+};
+
+// "<path with cpuN>/cpuinfo_max_freq: <int>" and ".../scaling_max_freq: <int>"
+// lines; cores missing either file are skipped
+PerCore<CpuFreqLimit> scan_cpu_freq_limits(std::string_view text);
+
+// A few hundred to a few thousand entries, too many for inline storage
+using PropertyList = std::vector<KeyValueView>;
+
+/**
+ * "[key]: [value]" lines of a bare getprop, in input order. A value
+ * spanning lines is kept whole, newlines included.
+ */
+PropertyList scan_getprop(std::string_view text);
+
+struct ProcessView {
+    uint32_t pid;
+    uint32_t ppid;
+    uint64_t start_ticks;
+    uint64_t cpu_ticks;  // utime + stime
+    uint64_t rss_pages;
+    int32_t oom_score_adj;
+    uint32_t threads;
+    char state;
+    std::string_view name;
+};
+using ProcessViewList = std::vector<ProcessView>;
+
+// "pid state ppid utime stime threads starttime rss_pages oom_score_adj name"
+// lines of the process scan script; the name runs to the end of the line
+ProcessViewList scan_processes(std::string_view text);
+
+// ============ STRING API ============
+
 // Parse key:value blocks
 std::map<std::string, std::string> parse_key_value_block(const std::string& text);
 
@@ -0,0 +1,86 @@
+#ifndef PAYLOAD_HPP
+#define PAYLOAD_HPP
+
+#include <array>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <nlohmann/json.hpp>
+#include "wire.hpp"
+
+namespace payload {
+
+enum class Format { Json, PrettyJson, MsgPack, Cbor };
+enum class Encoding { Identity, Gzip, Deflate };
+
+const char* content_type(Format format);
+
+std::string encode(const nlohmann::json& document, Format format);
+
+// Compress body; throws std::runtime_error if zlib fails
+std::string compress(const std::string& body, Encoding encoding);
+
+// One ready-to-send representation
+struct Body {
+    std::string bytes;
+    std::string etag;  // quoted strong ETag, distinct per format and encoding
+    Encoding encoding;
+};
+
+using BodyPtr = std::shared_ptr<const Body>;
+
+/**
+ * Immutable response value that serializes itself lazily, at most once
+ * per format and encoding. Bodies are refcounted and shared by every
+ * request asking for the same representation, so an unchanged value is
+ * never encoded or copied twice.
+ */
+class Payload {
+public:
+    using Encoder = std::function<std::string(Format)>;
+
+    explicit Payload(Encoder encoder) : encoder_(std::move(encoder)) {}
+
+    /**
+     * Body for the format, compressed with encoding unless it is too
+     * small to be worth it (check Body::encoding).
+     */
+    BodyPtr body(Format format, Encoding encoding) const;
+
+private:
+    static constexpr size_t kFormats = 4;
+    static constexpr size_t kEncodings = 3;
+
+    Encoder encoder_;
+    mutable std::mutex mutex_;
+    mutable std::array<BodyPtr, kFormats * kEncodings> bodies_;
+};
+
+using PayloadPtr = std::shared_ptr<const Payload>;
+
+/**
+ * Wrap a model or json document. Minified JSON of a model is written
+ * with wire::Writer; other formats go through the json DOM.
+ */
+template <typename T>
+PayloadPtr make(std::shared_ptr<const T> value) {
+    return std::make_shared<const Payload>([value](Format format) {
+        if constexpr (std::is_same_v<T, nlohmann::json>) {
+            return encode(*value, format);
+        } else {
+            if (format == Format::Json) return wire::to_string(*value);
+            return encode(nlohmann::json(*value), format);
+        }
+    });
+}
+
+template <typename T>
+PayloadPtr make(T value) {
+    return make(std::make_shared<const T>(std::move(value)));
+}
+
+} // namespace payload
+
+#endif // PAYLOAD_HPP
@@ -0,0 +1,113 @@
+#ifndef PROCS_HPP
+#define PROCS_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+#include "adb_utils.hpp"
+#include "models.hpp"
+
+namespace agent {
+class Reader;
+}
+
+namespace procs {
+
+// One process as a scan reads it
+struct Sample {
+    uint32_t pid;
+    uint32_t ppid;
+    uint64_t start_ticks;  // since boot; tells a reused pid apart
+    uint64_t cpu_ticks;    // utime + stime
+    uint64_t rss_pages;
+    int32_t oom_score_adj;
+    uint32_t threads;
+    char state;
+    std::string name;
+};
+
+/**
+ * What one scan returned: every process when full, otherwise only the
+ * processes that started or changed since the previous scan on the
+ * same agent connection, plus the pids that exited.
+ */
+struct Delta {
+    bool full = true;
+    uint32_t page_size = 0;  // 0 when the scan did not say
+    uint64_t uptime_ticks = 0;  // since boot, when the scan began; 0 when it did not say
+    std::vector<Sample> changed;
+    std::vector<uint32_t> exited;
+};
+
+enum class Order { Cpu, Rss };
+
+/**
+ * Per-process CPU and memory of one device, kept between scans in a
+ * flat table sorted by pid.
+ *
+ * A scan goes through the on-device agent when one is configured, and
+ * the agent sends only the processes that changed. Otherwise one
+ * builtin-only shell script walks /proc. Either way a scan is one
+ * round-trip.
+ *
+ * A process's CPU% is the CPU time it used since the previous scan,
+ * divided by the time between the scans; 100 is one core. A process
+ * the previous scan did not list is charged all its CPU time only if
+ * it started after that scan; otherwise it was just missed, and shows
+ * 0 until the next one. A scan younger than a second is shared by
+ * every caller. When the previous scan is missing or older than 30 s,
+ * a baseline is taken half a second before the real one, without
+ * holding the tracker: callers meanwhile wait for its result.
+ *
+ * Thread-safe.
+ */
+class Tracker {
+public:
+    Tracker(std::string serial, std::string agent_binary);
+    ~Tracker();
+
+    Tracker(const Tracker&) = delete;
+    Tracker& operator=(const Tracker&) = delete;
+
+    /**
+     * The limit processes using the most CPU or memory.
+     * Throws std::runtime_error if the scan fails.
+     */
+    ProcessList top(adb::Device& device, Order order, size_t limit);
+
+    // One process from a fresh scan, or nullopt if it is not running
+    std::optional<ProcessInfo> find(adb::Device& device, uint32_t pid);
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    struct Entry {
+        Sample sample;
+        double cpu_percent;
+    };
+
+    void refresh(adb::Device& device, std::unique_lock<std::mutex>& lock);
+    Delta scan(adb::Device& device);
+    void apply(Delta delta, double elapsed_s);
+    ProcessInfo info(const Entry& entry) const;
+
+    std::mutex mutex_;
+    std::condition_variable baseline_done_;
+    bool baseline_pending_ = false;
+    std::unique_ptr<agent::Reader> agent_;
+    std::vector<Entry> table_;
+    clock::time_point scanned_at_{};
+    clock::duration interval_{0};
+    uint64_t scanned_ticks_ = 0;  // Delta::uptime_ticks of the last scan applied
+    uint32_t page_size_ = 0;
+    const char* source_ = "shell";
+};
+
+} // namespace procs
+
+#endif // PROCS_HPP
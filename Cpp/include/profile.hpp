@@ -0,0 +1,110 @@
+#ifndef PROFILE_HPP
+#define PROFILE_HPP
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <nlohmann/json.hpp>
+#include "adb_utils.hpp"
+#include "payload.hpp"
+
+namespace profile {
+
+// What a static section is valid for: one build, until the next reboot
+struct Identity {
+    std::string build_id;     // ro.build.display.id
+    std::string fingerprint;  // ro.build.fingerprint
+    std::string boot_id;      // /proc/sys/kernel/random/boot_id
+
+    bool operator==(const Identity& other) const {
+        return build_id == other.build_id && fingerprint == other.fingerprint && boot_id == other.boot_id;
+    }
+    bool operator!=(const Identity& other) const { return !(*this == other); }
+};
+
+/**
+ * Current identity in one batched round-trip.
+ * Throws std::runtime_error if the round-trip fails.
+ */
+Identity read_identity(adb::Device& device);
+
+/**
+ * Static sections of one device (device, os, cpu and display info),
+ * kept across restarts in a small binary file.
+ *
+ * Sections loaded from the file are served as they are. The identity
+ * they were built for is checked again in the background, at most
+ * every revalidate interval, with one round-trip; lookups never wait
+ * for it, and a failed check keeps the sections. Once the build or the
+ * boot is confirmed to have changed, every section is dropped and
+ * rebuilt on its next lookup. The file is rewritten whenever a section
+ * is added.
+ *
+ * Thread-safe.
+ */
+class Profile {
+public:
+    using Document = std::shared_ptr<const nlohmann::json>;
+    using Builder = std::function<nlohmann::json()>;
+    // Queues a job off the request path; false if it was not queued
+    using Submit = std::function<bool(std::function<void()>)>;
+
+    /**
+     * Loads path if it exists and matches the format. An empty path keeps
+     * the profile in memory only. Identity checks go through submit, or
+     * run inline on the lookup that finds one due when it is empty.
+     */
+    Profile(adb::Device& device, std::string path, Submit submit = nullptr,
+            std::chrono::seconds revalidate = std::chrono::seconds(60));
+
+    Profile(const Profile&) = delete;
+    Profile& operator=(const Profile&) = delete;
+
+    /**
+     * The section, built with build when missing or invalidated.
+     * Exceptions from the builder propagate.
+     */
+    payload::PayloadPtr get_or_build(const std::string& key, const Builder& build);
+
+    // Same section as a document, for callers that want the model back
+    Document document(const std::string& key, const Builder& build);
+
+private:
+    struct Entry {
+        Document document;
+        payload::PayloadPtr value;
+    };
+
+    struct Section {
+        Entry entry;
+        std::string msgpack;  // as persisted
+    };
+
+    Entry entry(const std::string& key, const Builder& build);
+    // Queue an identity check unless one ran within the interval or is queued
+    void schedule_check();
+    void check_identity();
+    void load();
+    void save() const;
+
+    adb::Device& device_;
+    std::string path_;
+    Submit submit_;
+    std::chrono::seconds revalidate_;
+
+    std::mutex check_mutex_;
+    std::chrono::steady_clock::time_point checked_at_{};
+    bool checked_ = false;
+    bool checking_ = false;  // one identity round-trip at a time
+
+    mutable std::mutex mutex_;
+    Identity identity_;
+    std::map<std::string, Section> sections_;
+};
+
+} // namespace profile
+
+#endif // PROFILE_HPP
@@ -0,0 +1,68 @@
+#ifndef PROPS_HPP
+#define PROPS_HPP
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "adb_utils.hpp"
+#include "parsers.hpp"
+
+namespace props {
+
+/**
+ * One getprop listing, parsed once and sorted by key. Entries are views
+ * into the text the table owns, so it is neither copied nor moved;
+ * share it through TablePtr.
+ */
+class Table {
+public:
+    explicit Table(std::string text);
+
+    Table(const Table&) = delete;
+    Table& operator=(const Table&) = delete;
+
+    // Value of key, or an empty view; O(log n)
+    std::string_view get(std::string_view key) const;
+
+    std::string value(std::string_view key) const { return std::string(get(key)); }
+
+    // Entries whose key starts with prefix, in key order
+    std::vector<parsers::KeyValueView> with_prefix(std::string_view prefix) const;
+
+    size_t size() const { return entries_.size(); }
+
+private:
+    std::string text_;
+    parsers::PropertyList entries_;
+};
+
+using TablePtr = std::shared_ptr<const Table>;
+
+// Every property from one bare getprop. Throws std::runtime_error if it fails.
+TablePtr fetch(adb::Device& device);
+
+/**
+ * A device's table, shared by every builder until it is max_age old.
+ * One caller refetches while the others wait for it. Thread-safe.
+ */
+class Cache {
+public:
+    explicit Cache(std::chrono::milliseconds max_age = std::chrono::seconds(10)) : max_age_(max_age) {}
+
+    TablePtr get(adb::Device& device);
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    std::chrono::milliseconds max_age_;
+    std::mutex mutex_;
+    TablePtr table_;
+    clock::time_point fetched_at_{};
+};
+
+} // namespace props
+
+#endif // PROPS_HPP
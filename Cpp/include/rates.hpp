@@ -0,0 +1,74 @@
+#ifndef RATES_HPP
+#define RATES_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "models.hpp"
+
+namespace rates {
+
+/**
+ * Turns cumulative CPU counters into rates over a sliding time window:
+ * per-core utilization from /proc/stat, idle residency per cpuidle
+ * state, and time_in_state weighted average frequency.
+ *
+ * Each update costs O(counters in the sample). Per-sample deltas are
+ * added to running sums and subtracted again when they leave the
+ * window, so nothing is recomputed over stored history. Counters that
+ * go backwards (reboot, hotplug) count as zero for that step.
+ * Not thread-safe; the sampler thread owns it.
+ */
+class Engine {
+public:
+    using clock = std::chrono::steady_clock;
+
+    explicit Engine(std::chrono::milliseconds window);
+
+    // Fold in one capture of /proc/stat, cpuidle and time_in_state output
+    void update(clock::time_point t, std::string_view proc_stat, std::string_view cpu_idle,
+                std::string_view time_in_state);
+
+    // Rates over the current window; nullopt until two samples are in
+    std::optional<CPURates> rates() const;
+
+private:
+    enum class Kind : uint8_t { Total, Busy, IdleState, TimeInState };
+
+    // (core, kind, state index or frequency in kHz)
+    using Key = std::tuple<size_t, Kind, int64_t>;
+
+    struct Step {
+        clock::time_point t;
+        double wall_us;
+        std::vector<std::pair<uint32_t, double>> deltas;
+    };
+
+    uint32_t slot(size_t core, Kind kind, int64_t sub);
+
+    // Record a cumulative value; its delta goes into step
+    void observe(Step& step, uint32_t slot, double value);
+
+    std::chrono::milliseconds window_;
+    std::map<Key, uint32_t> slots_;
+    std::vector<double> prev_;
+    std::vector<char> has_prev_;
+    std::vector<double> sums_;
+    std::map<std::pair<size_t, int64_t>, std::string> state_names_;
+    std::deque<Step> steps_;
+    // Deltas storage of the last step to leave the window, reused by the next update
+    std::vector<std::pair<uint32_t, double>> spare_;
+    double window_us_ = 0;
+    std::optional<clock::time_point> last_t_;
+};
+
+} // namespace rates
+
+#endif // RATES_HPP
@@ -0,0 +1,42 @@
+#ifndef RESPONSE_HPP
+#define RESPONSE_HPP
+
+#include <string>
+#include <httplib.h>
+#include "payload.hpp"
+
+namespace response {
+
+using payload::Encoding;
+using payload::Format;
+
+/**
+ * Body format chosen from Accept. Browsers (text/html) get indented
+ * JSON, everything else minified JSON unless it asks for
+ * application/msgpack or application/cbor. ?pretty=1 forces indentation
+ * for JSON clients.
+ */
+Format negotiate_format(const httplib::Request& req);
+
+// gzip or deflate from Accept-Encoding, honouring q-values
+Encoding negotiate_encoding(const httplib::Request& req);
+
+/**
+ * Send the negotiated representation of p, with its ETag, Vary and
+ * Content-Encoding. A 2xx whose ETag matches If-None-Match becomes a
+ * bodiless 304. The shared body is streamed, not copied.
+ */
+void send(const httplib::Request& req, httplib::Response& res, const payload::Payload& p, int status = 200);
+
+// Same for a one-off model or json document
+template <typename T>
+void send(const httplib::Request& req, httplib::Response& res, T value, int status = 200) {
+    send(req, res, *payload::make(std::move(value)), status);
+}
+
+// {"error": message} with the given status
+void send_error(const httplib::Request& req, httplib::Response& res, const std::string& message, int status);
+
+} // namespace response
+
+#endif // RESPONSE_HPP
@@ -0,0 +1,220 @@
+#ifndef SAMPLER_HPP
+#define SAMPLER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "adaptive.hpp"
+#include "adb_utils.hpp"
+#include "agent.hpp"
+#include "events.hpp"
+#include "models.hpp"
+#include "payload.hpp"
+#include "rates.hpp"
+#include "snapshot.hpp"
+#include "store.hpp"
+
+namespace sampler {
+
+// One sample of one series; t_ms is wall-clock milliseconds since epoch
+struct Point {
+    int64_t t_ms;
+    double value;
+};
+
+/**
+ * Fixed-capacity ring of points, allocated once and overwritten oldest
+ * first. Not synchronized; the owning channel holds the lock.
+ */
+class RingBuffer {
+public:
+    explicit RingBuffer(size_t capacity);
+
+    void push(Point point);
+
+    // Points with t_ms > since_ms, oldest first
+    std::vector<Point> since(int64_t since_ms) const;
+
+private:
+    std::vector<Point> data_;
+    size_t head_ = 0;
+    size_t size_ = 0;
+};
+
+using History = std::map<std::string, std::vector<Point>>;
+
+struct Config {
+    std::chrono::milliseconds cpu_frequency{1000};
+    std::chrono::milliseconds thermal{2000};
+    std::chrono::milliseconds battery{5000};
+    std::chrono::milliseconds memory{2000};
+    std::chrono::milliseconds cpu_rates{1000};
+    // Sliding window the CPU rates are computed over
+    std::chrono::milliseconds rates_window{10000};
+    size_t history_size = 600;
+    // Local build of agent/adb_insight_agent to push and read snapshots
+    // through; empty keeps every snapshot on the shell
+    std::string agent_binary;
+    // Root of the on-disk history (one subdirectory per device); empty
+    // keeps history in the ring buffers only
+    std::string store_dir;
+    std::chrono::hours store_retention{0};
+    // Events kept for /events; older ones are overwritten
+    size_t event_log_size = 1024;
+    // Move each interval between 4x faster and 8x slower than configured,
+    // following how much its values change and any event in progress
+    bool adaptive = true;
+    // Share of time adb may spend on sampling before every interval is
+    // stretched; 0 disables the budget
+    double adb_budget = 0.5;
+    // Keep the sampler's own load off the measurements: no dumpsys (thermal
+    // and battery are only fetched when requested), snapshots read with
+    // shell builtins, and metrics due soon folded into the current round-trip
+    bool low_observer = false;
+};
+
+// Device-side cost of the sampler's shell round-trips: snapshots and dumpsys
+struct Overhead {
+    adb::ShellCost last_cycle;
+    adb::ShellCost total;
+    // Cycles that ran at least one measured round-trip; agent-only and
+    // failed cycles cost nothing measurable and are not counted
+    uint64_t cycles = 0;
+};
+
+// Receives each metric's serialized JSON after it is sampled
+using Listener = std::function<void(const std::string& metric, const std::string& payload)>;
+
+// Runs on the sampler thread after every cycle; must not block
+using CycleHook = std::function<void()>;
+
+/**
+ * Background thread polling volatile metrics into ring buffers.
+ * Handlers read the latest sample without touching adb; a sample older
+ * than a few intervals is treated as missing so callers fall back to a
+ * live fetch. With Config::adaptive each metric keeps its own interval,
+ * adjusted after every sample.
+ */
+class Sampler {
+public:
+    Sampler(adb::Device& device, Config config, Listener listener = nullptr, CycleHook on_cycle = nullptr);
+    ~Sampler();
+
+    Sampler(const Sampler&) = delete;
+    Sampler& operator=(const Sampler&) = delete;
+
+    void start();
+    void stop();
+
+    // Latest sample, or nullptr if none is fresh
+    std::shared_ptr<const CPUFrequency> cpu_frequency() const;
+    std::shared_ptr<const ThermalInfo> thermal() const;
+    std::shared_ptr<const BatteryInfo> battery() const;
+    std::shared_ptr<const MemoryInfo> memory() const;
+    std::shared_ptr<const CPURates> cpu_rates() const;
+
+    /**
+     * Latest fresh sample of a metric wrapped for serving, so unchanged
+     * samples are never re-encoded. nullptr if none is fresh or the
+     * metric is unknown.
+     */
+    payload::PayloadPtr latest(const std::string& metric) const;
+
+    /**
+     * Series for a metric ("cpu_frequency", "thermal", "battery", "memory",
+     * "cpu_rates" as per-core utilization)
+     * newer than since_ms. Returns std::nullopt for an unknown metric.
+     */
+    std::optional<History> history(const std::string& metric, int64_t since_ms) const;
+
+    // On-disk history of every sampled series, or nullptr when disabled
+    const store::Store* store() const { return store_.get(); }
+
+    // Throttling and drain events detected while sampling
+    const events::Log& events() const { return events_; }
+
+    // Current interval per metric, including any budget stretch
+    std::map<std::string, std::chrono::milliseconds> intervals() const;
+
+    // adb duty cycle over the last budget window
+    double adb_duty() const;
+
+    Overhead overhead() const;
+    bool low_observer() const { return config_.low_observer; }
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    template <typename T>
+    struct Channel {
+        std::chrono::milliseconds interval;
+        clock::time_point next_due;
+
+        mutable std::mutex mutex;
+        std::shared_ptr<const T> latest;
+        payload::PayloadPtr encoded;
+        clock::time_point sampled_at;
+        std::map<std::string, RingBuffer> series;
+
+        // Sampler thread only
+        adaptive::Interval pace;
+        adaptive::Points last_points;
+
+        bool is_fresh() const;  // caller holds mutex
+        std::shared_ptr<const T> fresh() const;
+        payload::PayloadPtr fresh_payload() const;
+        payload::PayloadPtr record(T value, const std::vector<std::pair<std::string, double>>& points,
+                                   size_t capacity);
+        History since(int64_t since_ms) const;
+        std::chrono::milliseconds current_interval() const;
+    };
+
+    void run();
+    void tick(clock::time_point now);
+    void notify(const char* metric, const payload::Payload& sample);
+    void persist(const char* metric, const std::vector<std::pair<std::string, double>>& points);
+    void publish(const std::vector<events::Event>& found);
+    template <typename T>
+    void adapt(Channel<T>& channel, const adaptive::Points& points, bool urgent);
+    template <typename T>
+    void reschedule(Channel<T>& channel, clock::time_point now);
+
+    adb::Device& device_;
+    Config config_;
+    Listener listener_;
+    CycleHook on_cycle_;
+    Channel<CPUFrequency> cpu_frequency_;
+    Channel<ThermalInfo> thermal_;
+    Channel<BatteryInfo> battery_;
+    Channel<MemoryInfo> memory_;
+    Channel<CPURates> cpu_rates_;
+    rates::Engine rates_engine_;
+    snapshot::Capturer capturer_;  // reused every cycle
+    std::unique_ptr<agent::Reader> agent_;
+    std::unique_ptr<store::Store> store_;
+    events::Log events_;
+    events::Detector detector_;
+    adaptive::Budget budget_;
+    std::atomic<double> adb_duty_{0};
+    mutable std::mutex overhead_mutex_;
+    Overhead overhead_;
+
+    std::thread thread_;
+    std::mutex wake_mutex_;
+    std::condition_variable wake_;
+    bool running_ = false;
+};
+
+} // namespace sampler
+
+#endif // SAMPLER_HPP
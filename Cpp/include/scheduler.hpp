@@ -0,0 +1,76 @@
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+namespace scheduler {
+
+/**
+ * Budget for one endpoint. At most concurrency requests are admitted
+ * at once. An admitted request waits at most deadline for its
+ * collection job before the HTTP thread gives up with a 503.
+ * shared requests also count against the server-wide gate, which
+ * keeps a few HTTP workers free. Probes like /health set it
+ * to false so they stay answerable while everything else is busy.
+ */
+struct Limit {
+    size_t concurrency;
+    std::chrono::milliseconds deadline;
+    bool shared = true;
+};
+
+/**
+ * "concurrency[:deadline_ms]" over base, e.g. "2:8000".
+ * Throws std::invalid_argument on malformed specs.
+ */
+Limit parse_limit(const std::string& spec, Limit base);
+
+/**
+ * Counting admission gate. Never blocks: a full gate turns the request
+ * away instead of queueing it behind the ones already waiting on adb.
+ */
+class Gate {
+public:
+    explicit Gate(size_t capacity);
+
+    Gate(const Gate&) = delete;
+    Gate& operator=(const Gate&) = delete;
+
+    bool try_acquire();
+    void release();
+
+    size_t capacity() const { return capacity_; }
+    size_t in_flight() const { return in_flight_.load(std::memory_order_relaxed); }
+
+private:
+    const size_t capacity_;
+    std::atomic<size_t> in_flight_{0};
+};
+
+/**
+ * Holds one slot in every gate given, or none: a request refused by
+ * any gate releases the ones it already passed.
+ */
+class Admission {
+public:
+    explicit Admission(std::initializer_list<Gate*> gates);
+    ~Admission();
+
+    Admission(const Admission&) = delete;
+    Admission& operator=(const Admission&) = delete;
+
+    explicit operator bool() const { return admitted_; }
+
+private:
+    std::vector<Gate*> held_;
+    bool admitted_ = false;
+};
+
+} // namespace scheduler
+
+#endif // SCHEDULER_HPP
@@ -0,0 +1,76 @@
+#ifndef SMALL_VECTOR_HPP
+#define SMALL_VECTOR_HPP
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+/**
+ * Vector with inline storage for the first N elements; only spills to
+ * the heap beyond that. Meant for small default-constructible values
+ * such as string_view pairs and counters.
+ */
+template <typename T, size_t N>
+class SmallVector {
+public:
+    using value_type = T;
+    using iterator = T*;
+    using const_iterator = const T*;
+
+    void push_back(const T& value) {
+        if (size_ < N && heap_.empty()) {
+            inline_[size_] = value;
+        } else {
+            spill();
+            heap_.push_back(value);
+        }
+        ++size_;
+    }
+
+    void resize(size_t count, const T& value = T()) {
+        if (count <= N && heap_.empty()) {
+            for (size_t i = size_; i < count; ++i) inline_[i] = value;
+        } else {
+            spill();
+            heap_.resize(count, value);
+        }
+        size_ = count;
+    }
+
+    void clear() {
+        heap_.clear();
+        size_ = 0;
+    }
+
+    T* data() { return heap_.empty() ? inline_.data() : heap_.data(); }
+    const T* data() const { return heap_.empty() ? inline_.data() : heap_.data(); }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    T& operator[](size_t i) { return data()[i]; }
+    const T& operator[](size_t i) const { return data()[i]; }
+
+    T& back() { return data()[size_ - 1]; }
+    const T& back() const { return data()[size_ - 1]; }
+
+    iterator begin() { return data(); }
+    iterator end() { return data() + size_; }
+    const_iterator begin() const { return data(); }
+    const_iterator end() const { return data() + size_; }
+
+private:
+    void spill() {
+        if (heap_.empty() && size_ > 0) {
+            heap_.assign(inline_.begin(), inline_.begin() + size_);
+        } else if (heap_.empty()) {
+            heap_.reserve(N * 2);
+        }
+    }
+
+    std::array<T, N> inline_{};
+    std::vector<T> heap_;
+    size_t size_ = 0;
+};
+
+#endif // SMALL_VECTOR_HPP
@@ -0,0 +1,90 @@
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include <string>
+#include <vector>
+#include "adb_utils.hpp"
+
+namespace snapshot {
+
+// sysfs/procfs sources that can be captured in one round-trip
+enum Section : unsigned {
+    CpuCurFreq            = 1u << 0,
+    CpuMinFreq            = 1u << 1,
+    CpuMaxFreq            = 1u << 2,
+    CpuAvailableGovernors = 1u << 3,
+    CpuGovernors          = 1u << 4,
+    CpuIdle               = 1u << 5,
+    MemInfo               = 1u << 6,
+    Uptime                = 1u << 7,
+    ProcStat              = 1u << 8,
+    CpuTimeInState        = 1u << 9,
+    CpuFreqLimits         = 1u << 10,
+
+    CpuFrequency = CpuCurFreq | CpuMinFreq | CpuMaxFreq,
+    CpuGovernor  = CpuAvailableGovernors | CpuGovernors,
+    CpuRates     = CpuIdle | ProcStat | CpuTimeInState,
+    All          = CpuFrequency | CpuGovernor | CpuIdle | MemInfo | Uptime | ProcStat | CpuTimeInState |
+                   CpuFreqLimits
+};
+
+// Raw output per section, empty when not requested
+struct Snapshot {
+    std::string cpu_cur_freq;
+    std::string cpu_min_freq;
+    std::string cpu_max_freq;
+    std::string cpu_available_governors;
+    std::string cpu_governors;
+    std::string cpu_idle;
+    std::string meminfo;
+    std::string uptime;
+    std::string proc_stat;
+    std::string cpu_time_in_state;
+    std::string cpu_freq_limits;
+};
+
+enum class Script {
+    Shell,  // cat, sed and basename, one process per file
+    Lean    // the same output from shell builtins, forking nothing
+};
+
+/**
+ * Run one compound script covering the requested sections and
+ * demultiplex its output. The batch's device-side cost is added to
+ * *cost when given.
+ * Throws std::runtime_error if the adb round-trip fails.
+ */
+Snapshot capture(adb::Device& device, unsigned sections = All, Script script = Script::Shell,
+                 adb::ShellCost* cost = nullptr);
+
+/**
+ * capture() for a caller that runs every cycle, like the sampler. Each
+ * combination of sections keeps its own command list and shell_multi
+ * buffers, and the section strings are kept between calls, so once warm
+ * a capture allocates nothing between the transport and the parsers.
+ * Not thread-safe: one per calling thread.
+ */
+class Capturer {
+public:
+    // Valid until the next call; sections not requested are empty
+    const Snapshot& capture(adb::Device& device, unsigned sections = All, Script script = Script::Shell,
+                            adb::ShellCost* cost = nullptr);
+
+private:
+    struct Batch {
+        unsigned sections;
+        Script script;
+        std::vector<std::string> cmds;
+        std::vector<std::string Snapshot::*> fields;
+        adb::MultiBuffer buffer;
+    };
+
+    Batch& batch(unsigned sections, Script script);
+
+    std::vector<Batch> batches_;
+    Snapshot snapshot_;
+};
+
+} // namespace snapshot
+
+#endif // SNAPSHOT_HPP
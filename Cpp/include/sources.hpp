@@ -0,0 +1,81 @@
+#ifndef SOURCES_HPP
+#define SOURCES_HPP
+
+#include <exception>
+#include <map>
+#include <mutex>
+#include <string>
+#include "adb_utils.hpp"
+
+namespace sources {
+
+/**
+ * Value fetched at most once, shared by every caller.
+ * A failed fetch is remembered and rethrown to later callers too,
+ * so a broken source does not get retried within the same cycle.
+ */
+template <typename T>
+class Once {
+public:
+    template <typename F>
+    const T& get(F&& fetch) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!done_) {
+            try {
+                value_ = fetch();
+            } catch (...) {
+                error_ = std::current_exception();
+            }
+            done_ = true;
+        }
+        if (error_) std::rethrow_exception(error_);
+        return value_;
+    }
+
+    bool failed() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return error_ != nullptr;
+    }
+
+private:
+    std::mutex mutex_;
+    bool done_ = false;
+    T value_{};
+    std::exception_ptr error_;
+};
+
+using KeyValueMap = std::map<std::string, std::string>;
+using ThermalMap = std::map<std::string, std::map<std::string, double>>;
+
+/**
+ * Request-scoped cache of expensive shared sources.
+ * Each command runs once per collection cycle and its parsed form is
+ * handed to every builder that needs it. Safe to share across threads.
+ * With a cost, each command's device-side cost is added to it.
+ */
+class SourceCache {
+public:
+    explicit SourceCache(adb::Device& device, adb::ShellCost* cost = nullptr) : device_(device), cost_(cost) {}
+
+    // parse_key_value_block("dumpsys battery")
+    const KeyValueMap& battery();
+
+    // parse_thermal_data("dumpsys thermalservice")
+    const ThermalMap& thermal();
+
+    // Whether either source failed; a long-lived cache starts over then
+    bool failed() { return battery_.failed() || thermal_.failed(); }
+
+private:
+    std::string fetch(const std::string& cmd);
+
+    adb::Device& device_;
+    adb::ShellCost* cost_;
+    std::mutex cost_mutex_;
+    Once<KeyValueMap> battery_;
+    Once<ThermalMap> thermal_;
+};
+
+} // namespace sources
+
+#endif // SOURCES_HPP
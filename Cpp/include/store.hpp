@@ -0,0 +1,100 @@
+#ifndef STORE_HPP
+#define STORE_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace store {
+
+struct Config {
+    std::string dir;
+    // Sealed segments entirely older than this are deleted; 0 keeps all
+    std::chrono::hours retention{0};
+};
+
+struct Point {
+    int64_t t_ms;
+    double value;
+};
+
+// Summary of the points in [t_ms, t_ms + step)
+struct Bucket {
+    int64_t t_ms;
+    double min;
+    double max;
+    double avg;
+    uint64_t count;
+};
+
+class Column;
+
+/**
+ * Append-only columnar history on disk, one column per series
+ * ("cpu_frequency" / "cpu4", "thermal" / "SKIN", ...).
+ *
+ * A column is a directory of fixed-size, memory-mapped segments. Each
+ * segment is a run of blocks of up to 256 points. A block stores its
+ * first point whole, then the deltas of the following points' timestamps and
+ * milli-unit values as zigzag varints, a few bytes per point.
+ * The segment's block index holds each block's time range, min, max
+ * and sum. Range queries skip whole blocks by time, and downsampling
+ * reads the summaries of blocks inside one bucket without decoding
+ * them.
+ *
+ * Only the segment being written is kept mapped. Queries map sealed
+ * segments read-only for their duration, so memory does not grow with
+ * the length of the soak. Values are rounded to 0.001.
+ *
+ * Thread-safe: the sampler appends while handlers query.
+ */
+class Store {
+public:
+    /**
+     * Open or create the store under config.dir. Segments a previous
+     * run left open are sealed. Throws std::runtime_error if the
+     * directory cannot be used.
+     */
+    explicit Store(Config config);
+    ~Store();
+
+    Store(const Store&) = delete;
+    Store& operator=(const Store&) = delete;
+
+    // One timestamp for all of a metric's series; a clock stepping back is clamped per column
+    void append(const std::string& metric, const std::vector<std::pair<std::string, double>>& points, int64_t t_ms);
+
+    // Series stored for a metric, including ones from earlier runs
+    std::vector<std::string> series(const std::string& metric) const;
+
+    /**
+     * Points with from_ms <= t_ms < to_ms, oldest first, at most limit.
+     * truncated is set when more were available.
+     */
+    std::vector<Point> points(const std::string& metric, const std::string& series, int64_t from_ms, int64_t to_ms,
+                              size_t limit, bool* truncated = nullptr) const;
+
+    /**
+     * min/max/avg per step_ms bucket from from_ms up to to_ms; empty
+     * buckets are omitted.
+     */
+    std::vector<Bucket> downsample(const std::string& metric, const std::string& series, int64_t from_ms,
+                                   int64_t to_ms, int64_t step_ms) const;
+
+private:
+    Column* find(const std::string& metric, const std::string& series) const;
+    Column& get_or_create(const std::string& metric, const std::string& series);
+
+    Config config_;
+    mutable std::mutex mutex_;
+    std::map<std::string, std::map<std::string, std::unique_ptr<Column>>> columns_;
+};
+
+} // namespace store
+
+#endif // STORE_HPP
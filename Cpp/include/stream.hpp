@@ -0,0 +1,68 @@
+#ifndef STREAM_HPP
+#define STREAM_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace stream {
+
+using Event = std::shared_ptr<const std::string>;
+
+/**
+ * One connected client. Holds a bounded queue of encoded events; a
+ * client that falls behind loses its oldest events rather than
+ * growing memory.
+ */
+class Subscriber {
+public:
+    explicit Subscriber(std::set<std::string> metrics);
+
+    bool wants(const std::string& metric) const;
+
+    void push(Event event);
+
+    // Next event, or nullptr on timeout or once closed
+    Event next(std::chrono::milliseconds timeout);
+
+    void close();
+    bool closed() const;
+
+private:
+    static constexpr size_t kMaxQueued = 64;
+
+    std::set<std::string> metrics_;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Event> queue_;
+    bool closed_ = false;
+};
+
+/**
+ * Fans sampler output out to stream subscribers. Each sample is encoded
+ * as a Server-Sent Event once and the same buffer is queued for every
+ * subscriber; samples identical to the previous one are not sent.
+ */
+class Broadcaster {
+public:
+    // Empty metrics means all of them
+    std::shared_ptr<Subscriber> subscribe(std::set<std::string> metrics);
+
+    void publish(const std::string& metric, const std::string& payload);
+
+private:
+    std::mutex mutex_;
+    std::map<std::string, std::string> last_payload_;
+    std::map<std::string, Event> last_event_;
+    std::vector<std::weak_ptr<Subscriber>> subscribers_;
+};
+
+} // namespace stream
+
+#endif // STREAM_HPP
@@ -0,0 +1,86 @@
+#ifndef TTL_CACHE_HPP
+#define TTL_CACHE_HPP
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "metrics.hpp"
+#include "payload.hpp"
+
+namespace cache {
+
+// Freshness policy for one key
+struct Policy {
+    std::chrono::seconds ttl;
+    // How long past the TTL a stale value may still be served while a
+    // single caller rebuilds it
+    std::chrono::seconds stale;
+};
+
+/**
+ * Sharded, thread-safe TTL cache with single-flight refresh.
+ *
+ * On a miss one caller rebuilds the value while concurrent callers for
+ * the same key wait for it. Once the TTL has passed, the rebuilding
+ * caller blocks but everyone else keeps getting the stale value until
+ * the stale window also runs out.
+ *
+ * Values are payloads, so each format a client negotiates is encoded
+ * once per build and then served from the same shared body.
+ *
+ * Every lookup counts into adb_insight_cache_requests_total{key, result}
+ * as a hit, a stale serve or a miss (the caller that rebuilt).
+ */
+class TtlCache {
+public:
+    using Value = payload::PayloadPtr;
+    using Builder = std::function<payload::PayloadPtr()>;
+
+    explicit TtlCache(Policy default_policy);
+
+    // Override the policy for a key; call before serving requests
+    void configure(const std::string& key, Policy policy);
+
+    /**
+     * Return the cached value for key, building it when needed.
+     * Exceptions from the builder propagate to the caller that ran it.
+     */
+    Value get_or_build(const std::string& key, const Builder& build);
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    struct Entry {
+        Value value;
+        clock::time_point built_at;
+        bool refreshing = false;
+        // Registered on first lookup of the key
+        metrics::Counter* hits = nullptr;
+        metrics::Counter* stale = nullptr;
+        metrics::Counter* misses = nullptr;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::unordered_map<std::string, Entry> entries;
+    };
+
+    static constexpr size_t kShards = 16;
+
+    Shard& shard_for(const std::string& key);
+    Policy policy_for(const std::string& key) const;
+
+    std::array<Shard, kShards> shards_;
+    std::unordered_map<std::string, Policy> policies_;
+    Policy default_policy_;
+};
+
+} // namespace cache
+
+#endif // TTL_CACHE_HPP
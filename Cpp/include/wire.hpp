@@ -0,0 +1,136 @@
+#ifndef WIRE_HPP
+#define WIRE_HPP
+
+#include <cstdint>
+#include <initializer_list>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace wire {
+
+/**
+ * Streaming JSON writer appending straight to a caller-owned buffer.
+ * Output matches nlohmann::json::dump() byte for byte: same number
+ * formatting, same escaping, and it rejects invalid UTF-8 like dump()
+ * does (as std::runtime_error here).
+ *
+ * Structs are written through a wire_write(Writer&, const T&) overload
+ * found by ADL, normally generated with WIRE_DEFINE_FIELDS.
+ */
+class Writer {
+public:
+    explicit Writer(std::string& out) : out_(out) {}
+
+    void null();
+    void boolean(bool v);
+    void integer(int64_t v);
+    void number(double v);
+    void string(std::string_view v);
+
+    // Append an already encoded JSON value as is
+    void raw(std::string_view encoded);
+
+    void begin_object();
+    void key(std::string_view name);
+    void end_object();
+
+    void begin_array();
+    void end_array();
+
+    template <typename T>
+    void member(std::string_view name, const T& v) {
+        key(name);
+        value(v);
+    }
+
+    template <typename T>
+    void value(const T& v) {
+        if constexpr (std::is_same_v<T, bool>) boolean(v);
+        else if constexpr (std::is_integral_v<T>) integer(v);
+        else if constexpr (std::is_floating_point_v<T>) number(v);
+        else if constexpr (std::is_convertible_v<const T&, std::string_view>) string(v);
+        else wire_write(*this, v);
+    }
+
+    template <typename T>
+    void value(const std::optional<T>& v) {
+        if (v) value(*v);
+        else null();
+    }
+
+    template <typename T>
+    void value(const std::vector<T>& v) {
+        begin_array();
+        for (const auto& item : v) value(item);
+        end_array();
+    }
+
+    // std::map iterates in key order, which is also nlohmann's object order
+    template <typename T>
+    void value(const std::map<std::string, T>& v) {
+        begin_object();
+        for (const auto& [name, item] : v) member(name, item);
+        end_object();
+    }
+
+private:
+    // Comma before a value or key that follows a sibling
+    void separate();
+
+    std::string& out_;
+    bool need_comma_ = false;
+};
+
+// Encode one value as minified JSON. It is written into a buffer each
+// thread keeps, so the result is allocated once, at its final size.
+template <typename T>
+std::string to_string(const T& v) {
+    constexpr size_t kMaxKept = 1 << 20;  // a rare huge document is not held on to
+    thread_local std::string scratch;
+    scratch.clear();
+    Writer(scratch).value(v);
+    std::string out = scratch;
+    if (scratch.capacity() > kMaxKept) std::string().swap(scratch);
+    return out;
+}
+
+// Append to a reused buffer instead of allocating a new string
+template <typename T>
+void append(std::string& out, const T& v) {
+    Writer(out).value(v);
+}
+
+constexpr bool keys_sorted(std::initializer_list<std::string_view> keys) {
+    const std::string_view* prev = nullptr;
+    for (const auto& key : keys) {
+        if (prev && !(*prev < key)) return false;
+        prev = &key;
+    }
+    return true;
+}
+
+} // namespace wire
+
+#define WIRE_KEY(field) #field,
+#define WIRE_MEMBER(field) w.member(#field, v.field);
+
+/**
+ * Generate wire_write() for a struct. Fields must be listed in key
+ * order, since that is the order nlohmann::json emits object members in;
+ * a static_assert catches lists that are not. Uses nlohmann's
+ * NLOHMANN_JSON_PASTE to expand the field list.
+ */
+#define WIRE_DEFINE_FIELDS(Type, ...)                                              \
+    friend void wire_write(wire::Writer& w, const Type& v) {                       \
+        static_assert(wire::keys_sorted({NLOHMANN_JSON_PASTE(WIRE_KEY, __VA_ARGS__)}), \
+                      #Type ": wire fields must be in key order");                  \
+        w.begin_object();                                                          \
+        NLOHMANN_JSON_PASTE(WIRE_MEMBER, __VA_ARGS__)                              \
+        w.end_object();                                                            \
+    }
+
+#endif // WIRE_HPP
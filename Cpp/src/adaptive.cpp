@@ -0,0 +1,66 @@
+#include "adaptive.hpp"
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+namespace adaptive {
+
+namespace {
+
+// How far a source may speed up and back off from its configured interval
+constexpr int kSpeedup = 4;
+constexpr int kBackoff = 8;
+constexpr double kMaxStretch = 16;
+
+} // namespace
+
+Profile profile(std::chrono::milliseconds base, double tolerance, std::chrono::milliseconds floor) {
+    Profile p;
+    p.base = base;
+    p.min = std::min(base, std::max(base / kSpeedup, floor));
+    p.max = base * kBackoff;
+    p.tolerance = tolerance;
+    return p;
+}
+
+double relative_change(const Points& previous, const Points& current) {
+    std::map<std::string, double> before(previous.begin(), previous.end());
+    double change = 0;
+    for (const auto& [name, value] : current) {
+        auto it = before.find(name);
+        if (it == before.end()) continue;
+        change = std::max(change, std::abs(value - it->second) / std::max(std::abs(it->second), 1.0));
+    }
+    return change;
+}
+
+// ============ INTERVAL ============
+
+Interval::Interval(Profile profile) : profile_(profile), current_(profile.base) {}
+
+void Interval::observe(double change, bool urgent) {
+    if (urgent || change > profile_.tolerance) {
+        current_ = std::max(profile_.min, current_ / 2);
+    } else if (change < profile_.tolerance / 4) {
+        current_ = std::min(profile_.max, current_ + current_ / 4);
+    }
+}
+
+// ============ BUDGET ============
+
+Budget::Budget(double share, std::chrono::milliseconds window) : share_(share), window_(window) {}
+
+void Budget::record(clock::time_point now, clock::duration busy) {
+    if (share_ <= 0) return;
+    if (window_start_ == clock::time_point{}) window_start_ = now;
+    busy_ += busy;
+
+    auto elapsed = now - window_start_;
+    if (elapsed < window_) return;
+    duty_ = std::chrono::duration<double>(busy_).count() / std::chrono::duration<double>(elapsed).count();
+    stretch_ = duty_ > share_ ? std::min(stretch_ * 1.5, kMaxStretch) : std::max(stretch_ * 0.8, 1.0);
+    window_start_ = now;
+    busy_ = clock::duration{0};
+}
+
+} // namespace adaptive
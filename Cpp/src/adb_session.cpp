@@ -0,0 +1,240 @@
+#include "adb_session.hpp"
+#include <array>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "metrics.hpp"
+
+namespace adb {
+
+namespace {
+
+constexpr const char* kSentinelPrefix = "__ADB_DONE_";
+
+std::once_flag sigpipe_once;
+
+} // namespace
+
+// ============ SESSION ============
+
+Session::Session(const std::string& serial) {
+    spawn(serial);
+}
+
+Session::~Session() {
+    terminate();
+}
+
+void Session::spawn(const std::string& serial) {
+    // A dead adb process must surface as a write error, not kill the server
+    std::call_once(sigpipe_once, [] { std::signal(SIGPIPE, SIG_IGN); });
+
+    int in_pipe[2];
+    int out_pipe[2];
+    if (pipe2(in_pipe, O_CLOEXEC) != 0) {
+        throw std::runtime_error("Failed to create adb session pipe");
+    }
+    if (pipe2(out_pipe, O_CLOEXEC) != 0) {
+        close(in_pipe[0]);
+        close(in_pipe[1]);
+        throw std::runtime_error("Failed to create adb session pipe");
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(in_pipe[0]);
+        close(in_pipe[1]);
+        close(out_pipe[0]);
+        close(out_pipe[1]);
+        throw std::runtime_error("Failed to fork adb shell session");
+    }
+
+    if (pid == 0) {
+        dup2(in_pipe[0], STDIN_FILENO);
+        dup2(out_pipe[1], STDOUT_FILENO);
+        if (serial.empty()) {
+            execlp("adb", "adb", "shell", "-T", static_cast<char*>(nullptr));
+        } else {
+            execlp("adb", "adb", "-s", serial.c_str(), "shell", "-T", static_cast<char*>(nullptr));
+        }
+        _exit(127);
+    }
+
+    close(in_pipe[0]);
+    close(out_pipe[1]);
+    pid_ = pid;
+    stdin_fd_ = in_pipe[1];
+    stdout_fd_ = out_pipe[0];
+}
+
+void Session::terminate() {
+    if (stdin_fd_ >= 0) close(stdin_fd_);
+    if (stdout_fd_ >= 0) close(stdout_fd_);
+    stdin_fd_ = -1;
+    stdout_fd_ = -1;
+
+    if (pid_ > 0) {
+        kill(pid_, SIGKILL);
+        waitpid(pid_, nullptr, 0);
+    }
+    pid_ = -1;
+}
+
+bool Session::write_all(const std::string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = write(stdin_fd_, data.data() + written, data.size() - written);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+CommandResult Session::run(const std::string& cmd, std::chrono::milliseconds timeout) {
+    CommandResult result{"", -1, ""};
+    run_into(cmd, timeout, result);
+    return result;
+}
+
+void Session::run_into(const std::string& cmd, std::chrono::milliseconds timeout, CommandResult& result) {
+    if (!alive()) {
+        throw std::runtime_error("ADB shell session is not running");
+    }
+
+    // Run in a subshell with stdin detached so the command can neither
+    // exit the session nor swallow the commands queued behind it
+    char sentinel[48];
+    std::snprintf(sentinel, sizeof(sentinel), "%s%llu__", kSentinelPrefix, ++counter_);
+    script_.assign("(").append(cmd).append("\n) </dev/null; printf '\\n").append(sentinel).append(" %d\\n' $?\n");
+
+    if (!write_all(script_)) {
+        broken_ = true;
+        throw std::runtime_error("ADB shell session closed");
+    }
+
+    const std::string& marker = marker_.assign("\n").append(sentinel).append(" ");
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    std::array<char, 65536> chunk;
+    size_t search_from = 0;
+
+    while (true) {
+        size_t pos = buffer_.find(marker, search_from);
+        if (pos != std::string::npos) {
+            size_t eol = buffer_.find('\n', pos + marker.size());
+            if (eol != std::string::npos) {
+                result.exit_code = std::atoi(buffer_.c_str() + pos + marker.size());
+                result.output.assign(buffer_, 0, pos);
+                result.error.clear();
+                buffer_.erase(0, eol + 1);
+                return;
+            }
+        }
+        search_from = buffer_.size() >= marker.size() ? buffer_.size() - marker.size() : 0;
+        if (pos != std::string::npos) search_from = pos;
+
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()
+        );
+        if (remaining.count() <= 0) {
+            broken_ = true;
+            throw std::runtime_error("ADB command timed out: " + cmd);
+        }
+
+        pollfd pfd{stdout_fd_, POLLIN, 0};
+        int ready = poll(&pfd, 1, static_cast<int>(remaining.count()));
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            broken_ = true;
+            throw std::runtime_error("ADB shell session poll failed");
+        }
+        if (ready == 0) continue;
+
+        ssize_t n = read(stdout_fd_, chunk.data(), chunk.size());
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            broken_ = true;
+            throw std::runtime_error("ADB shell session read failed");
+        }
+        if (n == 0) {
+            broken_ = true;
+            throw std::runtime_error("ADB shell session closed");
+        }
+        buffer_.append(chunk.data(), static_cast<size_t>(n));
+    }
+}
+
+// ============ POOL ============
+
+SessionPool::SessionPool(std::string serial, size_t max_sessions)
+    : serial_(std::move(serial)), max_sessions_(max_sessions == 0 ? 1 : max_sessions) {}
+
+SessionPool::Lease::Lease(SessionPool& pool, std::unique_ptr<Session> session)
+    : pool_(&pool), session_(std::move(session)) {}
+
+SessionPool::Lease::Lease(Lease&& other) noexcept
+    : pool_(other.pool_), session_(std::move(other.session_)) {
+    other.pool_ = nullptr;
+}
+
+SessionPool::Lease::~Lease() {
+    if (pool_) pool_->release(std::move(session_));
+}
+
+SessionPool::Lease SessionPool::acquire() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return !idle_.empty() || in_use_ < max_sessions_; });
+
+    ++in_use_;
+    if (!idle_.empty()) {
+        auto session = std::move(idle_.back());
+        idle_.pop_back();
+        return Lease(*this, std::move(session));
+    }
+
+    // Spawn outside the lock; the slot is already reserved
+    lock.unlock();
+    try {
+        return Lease(*this, std::make_unique<Session>(serial_));
+    } catch (...) {
+        lock.lock();
+        --in_use_;
+        cv_.notify_one();
+        throw;
+    }
+}
+
+CommandResult SessionPool::run(const std::string& cmd, std::chrono::milliseconds timeout) {
+    CommandResult result{"", -1, ""};
+    run_into(cmd, timeout, result);
+    return result;
+}
+
+void SessionPool::run_into(const std::string& cmd, std::chrono::milliseconds timeout, CommandResult& result) {
+    static metrics::Histogram& wait = metrics::histogram(
+        "adb_insight_adb_session_wait_seconds", "Time spent waiting for a free pooled adb session");
+
+    auto waiting = std::chrono::steady_clock::now();
+    auto session = acquire();
+    wait.observe(std::chrono::steady_clock::now() - waiting);
+    session->run_into(cmd, timeout, result);
+}
+
+void SessionPool::release(std::unique_ptr<Session> session) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (session && session->alive()) {
+        idle_.push_back(std::move(session));
+    }
+    --in_use_;
+    cv_.notify_one();
+}
+
+} // namespace adb
@@ -0,0 +1,419 @@
+#include "adb_socket.hpp"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "metrics.hpp"
+
+namespace adb {
+
+namespace {
+
+constexpr const char* kExitSentinel = "__ADB_EXIT__";
+
+// Commands get no stdin, as on the other transports: one that reads it
+// sees end of file instead of hanging until the deadline. exec with only
+// a redirection applies to the shell itself, so nothing is forked.
+constexpr const char* kShellV2 = "shell,v2,raw:exec </dev/null; ";
+
+// After a failed connect, commands go straight to the fallback this long,
+// rather than each waiting out the connect again
+constexpr std::chrono::seconds kServerBackoff{5};
+
+// shell protocol v2 packet ids
+enum PacketId : unsigned char { Stdin = 0, Stdout = 1, Stderr = 2, Exit = 3, CloseStdin = 4, WindowSize = 5 };
+
+std::string transport_request(const std::string& serial) {
+    return serial.empty() ? "host:transport-any" : "host:transport:" + serial;
+}
+
+// Read packet data straight onto the end of out
+void append_from(ServerConnection& connection, std::string& out, uint32_t length) {
+    size_t at = out.size();
+    out.resize(at + length);
+    if (length > 0) connection.read_exact(&out[at], length);
+}
+
+void skip(ServerConnection& connection, uint32_t length) {
+    std::array<char, 64> discard;
+    while (length > 0) {
+        size_t n = std::min<size_t>(length, discard.size());
+        connection.read_exact(discard.data(), n);
+        length -= static_cast<uint32_t>(n);
+    }
+}
+
+// Split shell v2 packets into result until the exit packet
+void read_shell_v2(ServerConnection& connection, CommandResult& result) {
+    result.output.clear();
+    result.error.clear();
+    result.exit_code = -1;
+    std::array<char, 5> header;
+    while (true) {
+        connection.read_exact(header.data(), header.size());
+        uint32_t length = 0;
+        for (int i = 4; i >= 1; --i) {
+            length = (length << 8) | static_cast<unsigned char>(header[i]);
+        }
+
+        switch (static_cast<unsigned char>(header[0])) {
+            case Stdout: append_from(connection, result.output, length); break;
+            case Stderr: append_from(connection, result.error, length); break;
+            case Exit:
+                if (length > 0) {
+                    char code;
+                    connection.read_exact(&code, 1);
+                    skip(connection, length - 1);
+                    result.exit_code = static_cast<unsigned char>(code);
+                }
+                return;
+            default: skip(connection, length); break;
+        }
+    }
+}
+
+CommandResult read_shell_v2(ServerConnection& connection) {
+    CommandResult result{"", -1, ""};
+    read_shell_v2(connection, result);
+    return result;
+}
+
+// Plain shell: has no exit status, so the script prints one last
+CommandResult read_legacy_shell(ServerConnection& connection) {
+    std::string buffer;
+    std::array<char, 65536> chunk;
+    while (size_t n = connection.read_some(chunk.data(), chunk.size())) {
+        buffer.append(chunk.data(), n);
+    }
+
+    std::string marker = std::string("\n") + kExitSentinel + " ";
+    size_t pos = buffer.rfind(marker);
+    if (pos == std::string::npos) {
+        throw std::runtime_error("ADB shell closed without an exit status");
+    }
+    return CommandResult{buffer.substr(0, pos), std::atoi(buffer.c_str() + pos + marker.size()), ""};
+}
+
+enum class Connect { Connected, Refused, TimedOut };
+
+// connect() without blocking past the deadline: a remote or blackholed
+// server would otherwise hold the caller for the kernel's SYN timeout
+Connect connect_until(int fd, const sockaddr* address, socklen_t size,
+                      std::chrono::steady_clock::time_point deadline) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0) return Connect::Refused;
+    if (connect(fd, address, size) != 0) {
+        if (errno != EINPROGRESS && errno != EINTR) return Connect::Refused;
+        while (true) {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now()
+            );
+            if (remaining.count() <= 0) return Connect::TimedOut;
+            pollfd pfd{fd, POLLOUT, 0};
+            int ready = poll(&pfd, 1, static_cast<int>(remaining.count()));
+            if (ready > 0) break;
+            if (ready < 0 && errno != EINTR) return Connect::Refused;
+        }
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0) return Connect::Refused;
+    }
+    // Reads and writes wait on the deadline themselves
+    return fcntl(fd, F_SETFL, flags) == 0 ? Connect::Connected : Connect::Refused;
+}
+
+} // namespace
+
+// ============ CONNECTION ============
+
+ServerConnection::ServerConnection(const ServerAddress& address, std::chrono::steady_clock::time_point deadline)
+    : deadline_(deadline) {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* result = nullptr;
+    std::string port = std::to_string(address.port);
+    if (getaddrinfo(address.host.c_str(), port.c_str(), &hints, &result) != 0) {
+        throw ServerUnavailable("Cannot resolve adb server " + address.host);
+    }
+    bool timed_out = false;
+    for (addrinfo* ai = result; ai && fd_ < 0 && !timed_out; ai = ai->ai_next) {
+        int fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0) continue;
+        Connect outcome = connect_until(fd, ai->ai_addr, ai->ai_addrlen, deadline_);
+        if (outcome == Connect::Connected) {
+            fd_ = fd;
+        } else {
+            close(fd);
+            timed_out = outcome == Connect::TimedOut;
+        }
+    }
+    freeaddrinfo(result);
+    if (fd_ < 0) {
+        // Unavailable either way, so the caller falls back to the adb client
+        throw ServerUnavailable(timed_out ? "adb server at " + address.host + ":" + port + " did not accept in time"
+                                          : "adb server not reachable at " + address.host + ":" + port);
+    }
+}
+
+ServerConnection::~ServerConnection() {
+    if (fd_ >= 0) close(fd_);
+}
+
+void ServerConnection::request(std::string_view service, std::string_view argument) {
+    size_t size = service.size() + argument.size();
+    if (size > 0xffff) {
+        throw std::runtime_error("adb request too long");
+    }
+    // One write per request, from a buffer each thread keeps
+    thread_local std::string frame;
+    char length[5];
+    std::snprintf(length, sizeof(length), "%04zx", size);
+    frame.assign(length, 4).append(service).append(argument);
+    write_all(frame);
+}
+
+void ServerConnection::expect_okay() {
+    char status[4];
+    read_exact(status, 4);
+    if (std::memcmp(status, "OKAY", 4) == 0) return;
+    if (std::memcmp(status, "FAIL", 4) == 0) {
+        throw std::runtime_error("adb: " + read_prefixed());
+    }
+    throw std::runtime_error("adb: unexpected reply from server");
+}
+
+std::string ServerConnection::read_prefixed() {
+    char length[5] = {};
+    read_exact(length, 4);
+    size_t size = std::strtoul(length, nullptr, 16);
+    std::string out(size, '\0');
+    if (size > 0) read_exact(&out[0], size);
+    return out;
+}
+
+size_t ServerConnection::read_some(char* buf, size_t n) {
+    while (true) {
+        wait(POLLIN);
+        ssize_t got = recv(fd_, buf, n, 0);
+        if (got >= 0) return static_cast<size_t>(got);
+        if (errno != EINTR && errno != EAGAIN) {
+            throw std::runtime_error("adb server read failed");
+        }
+    }
+}
+
+void ServerConnection::read_exact(char* buf, size_t n) {
+    while (n > 0) {
+        size_t got = read_some(buf, n);
+        if (got == 0) {
+            throw std::runtime_error("adb server closed the connection");
+        }
+        buf += got;
+        n -= got;
+    }
+}
+
+void ServerConnection::write_all(const std::string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        wait(POLLOUT);
+        ssize_t n = send(fd_, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN) continue;
+            throw std::runtime_error("adb server write failed");
+        }
+        written += static_cast<size_t>(n);
+    }
+}
+
+void ServerConnection::wait(short events) {
+    while (true) {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline_ - std::chrono::steady_clock::now()
+        );
+        if (remaining.count() <= 0) {
+            throw Timeout("adb server timed out");
+        }
+        pollfd pfd{fd_, events, 0};
+        int ready = poll(&pfd, 1, static_cast<int>(remaining.count()));
+        if (ready > 0) return;
+        if (ready < 0 && errno != EINTR) {
+            throw std::runtime_error("adb server poll failed");
+        }
+    }
+}
+
+// ============ SERVER ============
+
+ServerAddress ServerAddress::from_environment() {
+    ServerAddress address{"127.0.0.1", 5037};
+
+    if (const char* socket = std::getenv("ADB_SERVER_SOCKET")) {
+        // tcp:<host>:<port> or tcp:<port>
+        std::string spec = socket;
+        if (spec.compare(0, 4, "tcp:") == 0) {
+            spec = spec.substr(4);
+            size_t colon = spec.rfind(':');
+            if (colon != std::string::npos) {
+                address.host = spec.substr(0, colon);
+                spec = spec.substr(colon + 1);
+            }
+            address.port = std::atoi(spec.c_str());
+        }
+        return address;
+    }
+    if (const char* host = std::getenv("ANDROID_ADB_SERVER_ADDRESS")) {
+        address.host = host;
+    }
+    if (const char* port = std::getenv("ANDROID_ADB_SERVER_PORT")) {
+        address.port = std::atoi(port);
+    }
+    return address;
+}
+
+std::optional<std::string> host_query(const std::string& request, std::chrono::milliseconds timeout) {
+    try {
+        ServerConnection connection(ServerAddress::from_environment(), std::chrono::steady_clock::now() + timeout);
+        connection.request(request);
+        connection.expect_okay();
+        return connection.read_prefixed();
+    } catch (const ServerUnavailable&) {
+        return std::nullopt;
+    }
+}
+
+std::unique_ptr<ServerConnection> open_service(const std::string& serial, const std::string& service,
+                                               std::chrono::milliseconds timeout) {
+    auto connection = std::make_unique<ServerConnection>(ServerAddress::from_environment(),
+                                                         std::chrono::steady_clock::now() + timeout);
+    connection->request(transport_request(serial));
+    connection->expect_okay();
+    connection->request(service);
+    connection->expect_okay();
+    return connection;
+}
+
+CommandResult shell_with_input(const std::string& serial, const std::string& cmd, const std::string& input,
+                               std::chrono::milliseconds timeout) {
+    auto connection = open_service(serial, "shell,v2,raw:" + cmd, timeout);
+
+    // Small packets: adbd's shell protocol buffer is a few KiB on old devices
+    constexpr size_t kChunk = 16 * 1024;
+    auto packet = [](PacketId id, const char* data, size_t size) {
+        std::string out(1, static_cast<char>(id));
+        for (int i = 0; i < 4; ++i) out += static_cast<char>(size >> (8 * i));
+        if (size > 0) out.append(data, size);
+        return out;
+    };
+    for (size_t pos = 0; pos < input.size(); pos += kChunk) {
+        connection->write_all(packet(Stdin, input.data() + pos, std::min(kChunk, input.size() - pos)));
+    }
+    connection->write_all(packet(CloseStdin, nullptr, 0));
+    return read_shell_v2(*connection);
+}
+
+// ============ TRANSPORT ============
+
+SocketTransport::SocketTransport(std::string serial, size_t max_concurrent, std::unique_ptr<Transport> fallback)
+    : serial_(std::move(serial)),
+      transport_(transport_request(serial_)),
+      address_(ServerAddress::from_environment()),
+      fallback_(std::move(fallback)),
+      max_concurrent_(max_concurrent == 0 ? 1 : max_concurrent) {}
+
+CommandResult SocketTransport::run(const std::string& cmd, std::chrono::milliseconds timeout) {
+    CommandResult result{"", -1, ""};
+    run_into(cmd, timeout, result);
+    return result;
+}
+
+void SocketTransport::run_into(const std::string& cmd, std::chrono::milliseconds timeout, CommandResult& result) {
+    static metrics::Histogram& wait = metrics::histogram(
+        "adb_insight_adb_session_wait_seconds", "Time spent waiting for a free pooled adb session");
+    static metrics::Counter& fallbacks = metrics::counter(
+        "adb_insight_adb_socket_fallbacks_total", "Commands run through the adb client because the adb server was unreachable");
+
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    {
+        auto waiting = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return in_flight_ < max_concurrent_; });
+        ++in_flight_;
+        wait.observe(std::chrono::steady_clock::now() - waiting);
+    }
+    struct Slot {
+        SocketTransport& self;
+        ~Slot() {
+            std::lock_guard<std::mutex> lock(self.mutex_);
+            --self.in_flight_;
+            self.cv_.notify_one();
+        }
+    } slot{*this};
+
+    auto now = std::chrono::steady_clock::now();
+    bool backing_off = fallback_ && now.time_since_epoch().count() < unreachable_until_.load(std::memory_order_relaxed);
+    if (!backing_off) {
+        try {
+            run_socket(cmd, deadline, result);
+            return;
+        } catch (const ServerUnavailable&) {
+            if (!fallback_) throw;
+            now = std::chrono::steady_clock::now();
+            unreachable_until_.store((now + kServerBackoff).time_since_epoch().count(), std::memory_order_relaxed);
+        }
+    }
+
+    // Whatever the connect left of the command's own timeout
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now);
+    if (remaining.count() <= 0) throw std::runtime_error("ADB command timed out: " + cmd);
+    fallbacks.inc();
+    fallback_->run_into(cmd, remaining, result);
+}
+
+SocketTransport::Shell SocketTransport::shell_mode(std::chrono::steady_clock::time_point deadline) {
+    Shell mode = shell_.load(std::memory_order_relaxed);
+    if (mode != Shell::Unknown) return mode;
+
+    // Device features are a comma-separated list, e.g. "shell_v2,cmd,stat_v2,..."
+    ServerConnection connection(address_, deadline);
+    connection.request(serial_.empty() ? "host:features" : "host-serial:" + serial_ + ":features");
+    connection.expect_okay();
+    std::string features = "," + connection.read_prefixed() + ",";
+    mode = features.find(",shell_v2,") != std::string::npos ? Shell::V2 : Shell::Legacy;
+    shell_.store(mode, std::memory_order_relaxed);
+    return mode;
+}
+
+void SocketTransport::run_socket(const std::string& cmd, std::chrono::steady_clock::time_point deadline,
+                                 CommandResult& result) {
+    Shell mode = shell_mode(deadline);
+
+    ServerConnection connection(address_, deadline);
+    connection.request(transport_);
+    connection.expect_okay();
+
+    try {
+        if (mode == Shell::V2) {
+            connection.request(kShellV2, cmd);
+            connection.expect_okay();
+            read_shell_v2(connection, result);
+            return;
+        }
+        connection.request("shell:(" + cmd + "\n) </dev/null; printf '\\n" + kExitSentinel + " %d\\n' $?");
+        connection.expect_okay();
+        result = read_legacy_shell(connection);
+    } catch (const Timeout&) {
+        throw std::runtime_error("ADB command timed out: " + cmd);
+    }
+}
+
+} // namespace adb
@@ -1,57 +1,224 @@
 #include "adb_utils.hpp"
+#include <algorithm>
+#include <charconv>
 #include <cstdlib>
 #include <cstring>
 #include <memory>
 #include <array>
 #include <sstream>
 #include <stdexcept>
+#include <string_view>
 #include <iostream>
-#include <fstream>
-#include <unistd.h>
+#include "adb_socket.hpp"
+#include "metrics.hpp"
 
 namespace adb {
 
-std::string shell(const std::string& cmd, bool throw_on_error) {
-    std::array<char, 256> buffer;
-    std::string result;
-    
-    // Write command to temp file to avoid shell interpretation
-    std::string temp_file = "/tmp/adb_cmd_" + std::to_string(getpid()) + ".sh";
-    std::ofstream out(temp_file);
-    out << cmd << "\n";
-    out << "exit\n";
-    out.close();
-    
-    std::string full_cmd = "adb shell < " + temp_file;
-    
-    FILE* pipe = popen(full_cmd.c_str(), "r");
-    if (!pipe) {
-        std::remove(temp_file.c_str());
-        if (throw_on_error) {
-            throw std::runtime_error("Failed to execute adb shell command");
+namespace {
+
+// Matches the timeout used by the Python implementation
+constexpr std::chrono::milliseconds kCommandTimeout{10000};
+
+constexpr const char* kCommandSeconds = "adb_insight_adb_command_seconds";
+constexpr const char* kCommandSecondsHelp = "Wall time of adb shell round-trips";
+constexpr const char* kMultiMarker = "__ADB_MULTI__";
+constexpr const char* kFirstMarker = "__ADB_MULTI__0";
+
+// Length of text without trailing newlines and spaces
+size_t trimmed_size(std::string_view text) {
+    size_t size = text.size();
+    while (size > 0 && (text[size - 1] == '\n' || text[size - 1] == '\r' || text[size - 1] == ' ')) --size;
+    return size;
+}
+
+// Bounded label for a shell command: the program, plus its first
+// argument for multiplexers like dumpsys and getprop
+std::string command_label(const std::string& cmd) {
+    static const char* const kWithArgument[] = {"dumpsys", "cat", "getprop", "settings", "cmd", "wm"};
+
+    std::istringstream iss(cmd.substr(0, cmd.find_first_of("|;&")));
+    std::string program, argument;
+    iss >> program >> argument;
+    for (const char* name : kWithArgument) {
+        if (program == name && !argument.empty()) return program + " " + argument;
+    }
+    return program;
+}
+
+// ADB_INSIGHT_TRANSPORT=exec keeps everything on adb client processes
+bool use_socket() {
+    static const bool socket = [] {
+        const char* mode = std::getenv("ADB_INSIGHT_TRANSPORT");
+        return !mode || std::strcmp(mode, "exec") != 0;
+    }();
+    return socket;
+}
+
+std::unique_ptr<Transport> default_transport(const std::string& serial, size_t max_sessions) {
+    auto pool = std::make_unique<SessionPool>(serial, max_sessions);
+    if (!use_socket()) return pool;
+    return std::make_unique<SocketTransport>(serial, max_sessions, std::move(pool));
+}
+
+std::string first_line(const std::string& text) {
+    size_t start = text.find_first_not_of(" \t\r\n");
+    if (start == std::string::npos) return "";
+    return text.substr(start, text.find_first_of("\r\n", start) - start);
+}
+
+std::string command_labels(const std::string& cmd, const char* mode) {
+    return "command=\"" + metrics::label_value(command_label(cmd)) + "\",mode=\"" + mode + "\"";
+}
+
+constexpr const char* kCostMarker = "__ADB_COST__";
+
+// Android's USER_HZ, the unit of /proc/<pid>/stat times
+constexpr double kTickMs = 10;
+
+/**
+ * Script printing "__ADB_COST__<tag> <forks> <voluntary> <involuntary>
+ * <stat fields after comm>" for the running shell. Only builtins and
+ * redirected loops, which run in the shell itself, so measuring spawns
+ * nothing.
+ *
+ * /proc/self rather than /proc/$$: a pooled session runs the batch in a
+ * subshell, where $$ is still the long-lived session shell. The builtin
+ * opens the file itself, so self is whichever shell runs the batch.
+ */
+std::string cost_probe(char tag) {
+    return std::string("__p=; while read -r __k __v __r; do [ \"$__k\" = processes ] && __p=$__v; done < /proc/stat; "
+                       "__c=; while read -r __k __v; do case $__k in *ctxt_switches:) __c=\"$__c $__v\";; esac; "
+                       "done < /proc/self/status; "
+                       "read -r __s < /proc/self/stat; echo ") + kCostMarker + tag + " $__p$__c ${__s##*\\)}; ";
+}
+
+struct CostSample {
+    uint64_t processes = 0;
+    uint64_t context_switches = 0;
+    uint64_t ticks = 0;  // utime + stime + cutime + cstime
+};
+
+// Tokens after the marker; false if the probe could not read /proc
+bool parse_cost_sample(std::string_view text, CostSample& sample) {
+    // forks and the two switch counts, then stat from field 3 (state) on,
+    // so token n is stat field n: utime, stime, cutime, cstime are 14-17
+    uint64_t values[18] = {};
+    size_t count = 0;
+    size_t pos = 0;
+    while (count < 18) {
+        pos = text.find_first_not_of(' ', pos);
+        if (pos == std::string_view::npos) break;
+        size_t end = std::min(text.find(' ', pos), text.size());
+        // Only these are read: the others include the state letter and tpgid, often -1
+        if (count <= 2 || count >= 14) {
+            auto [ptr, ec] = std::from_chars(text.data() + pos, text.data() + end, values[count]);
+            if (ec != std::errc() || ptr != text.data() + end) return false;
         }
-        return "";
+        ++count;
+        pos = end;
     }
+    if (count < 18) return false;
+    sample.processes = values[0];
+    sample.context_switches = values[1] + values[2];
+    sample.ticks = values[14] + values[15] + values[16] + values[17];
+    return true;
+}
+
+// Cost between two samples; one measured round-trip
+ShellCost cost_between(const CostSample& before, const CostSample& after) {
+    ShellCost cost;
+    cost.cpu_ms = static_cast<double>(after.ticks - before.ticks) * kTickMs;
+    cost.context_switches = after.context_switches - before.context_switches;
+    cost.processes = after.processes - before.processes;
+    cost.round_trips = 1;
+    return cost;
+}
+
+void record_cost(const ShellCost& cost) {
+    static metrics::Counter& cpu = metrics::counter(
+        "adb_insight_device_shell_cpu_ms_total", "Device CPU time spent by shell_multi batches, in ms");
+    static metrics::Counter& switches = metrics::counter(
+        "adb_insight_device_context_switches_total", "Context switches of the device shell running shell_multi batches");
+    static metrics::Counter& processes = metrics::counter(
+        "adb_insight_device_processes_total", "Processes forked on the device while shell_multi batches ran");
+    cpu.inc(static_cast<uint64_t>(cost.cpu_ms));
+    switches.inc(cost.context_switches);
+    processes.inc(cost.processes);
+}
+
+} // namespace
+
+Device::Device(std::string serial, size_t max_sessions)
+    : serial_(std::move(serial)), transport_(default_transport(serial_, max_sessions)) {}
+
+Device::Device(std::string serial, std::unique_ptr<Transport> transport)
+    : serial_(std::move(serial)), transport_(std::move(transport)) {}
+
+std::string Device::shell(const std::string& cmd, bool throw_on_error) {
+    return run(cmd, throw_on_error, command_labels(cmd, "single"));
+}
+
+std::string Device::shell(const std::string& cmd, ShellCost& cost, bool throw_on_error) {
+    // The exit status is the command's, not the closing probe's; a builtin
+    // test carries it over without forking
+    std::string script = cost_probe('0') + cmd + "; __rc=$?; " + cost_probe('1') + "[ \"$__rc\" = 0 ]";
+    std::string output = run(script, throw_on_error, command_labels(cmd, "single"), &cmd);
     
-    while (fgets(buffer.data(), buffer.size(), pipe) != nullptr) {
-        result += buffer.data();
+    // The opening probe is the first line; the closing one may share the
+    // last line with output lacking a final newline
+    const std::string opening = std::string(kCostMarker) + '0';
+    const std::string closing = std::string(kCostMarker) + '1';
+    CostSample before, after;
+    bool measured = false;
+    if (output.compare(0, opening.size(), opening) == 0) {
+        size_t eol = std::min(output.find('\n'), output.size());
+        measured = parse_cost_sample(std::string_view(output).substr(opening.size(), eol - opening.size()), before);
+        output.erase(0, std::min(eol + 1, output.size()));
     }
-    
-    int status = pclose(pipe);
-    std::remove(temp_file.c_str());
-    
-    if (status != 0 && throw_on_error) {
-        throw std::runtime_error("ADB command failed: " + cmd);
+    size_t probe = output.rfind(closing);
+    if (probe != std::string::npos) {
+        measured = parse_cost_sample(std::string_view(output).substr(probe + closing.size()), after) && measured;
+        output.resize(trimmed_size(std::string_view(output).substr(0, probe)));
     }
-    
-    // Remove trailing whitespace
-    while (!result.empty() && (result.back() == '\n' || result.back() == '\r' || result.back() == ' ')) {
-        result.pop_back();
+    if (measured) {
+        ShellCost spent = cost_between(before, after);
+        record_cost(spent);
+        cost += spent;
     }
+    return output;
+}
+
+std::string Device::run(const std::string& cmd, bool throw_on_error, const std::string& labels,
+                        const std::string* shown) {
+    CommandResult command{"", -1, ""};
+    metrics::Histogram& latency = metrics::histogram(kCommandSeconds, kCommandSecondsHelp, labels);
+    if (!run_into(cmd, throw_on_error, latency, labels, command, shown)) return "";
     
+    std::string result = std::move(command.output);
+    result.resize(trimmed_size(result));
     return result;
 }
 
+bool Device::run_into(const std::string& cmd, bool throw_on_error, metrics::Histogram& latency,
+                      const std::string& labels, CommandResult& result, const std::string* shown) {
+    try {
+        metrics::Timer timer(latency);
+        transport_->run_into(cmd, kCommandTimeout, result);
+    } catch (const std::exception& e) {
+        metrics::counter("adb_insight_adb_command_failures_total", "adb shell round-trips that failed or timed out", labels).inc();
+        if (throw_on_error) {
+            throw std::runtime_error(std::string("Failed to execute adb shell command: ") + e.what());
+        }
+        return false;
+    }
+    
+    if (result.exit_code != 0 && throw_on_error) {
+        std::string reason = first_line(result.error);
+        throw std::runtime_error("ADB command failed: " + (shown ? *shown : cmd) + (reason.empty() ? "" : ": " + reason));
+    }
+    return true;
+}
+
 std::string shell_escape(const std::string& str) {
     std::string escaped = "'";
     for (char c : str) {
@@ -66,6 +233,15 @@ std::string shell_escape(const std::string& str) {
 }
 
 std::optional<std::string> devices() {
+    if (use_socket()) {
+        try {
+            // Same "serial\tstate" lines as "adb devices", minus the header
+            if (auto reply = host_query("host:devices")) return reply;
+        } catch (const std::exception& e) {
+            std::cerr << "adb server: " << e.what() << "\n";
+        }
+    }
+
     try {
         std::array<char, 256> buffer;
         std::string result;
@@ -88,67 +264,115 @@ std::optional<std::string> devices() {
     }
 }
 
-std::vector<std::string> shell_multi(const std::vector<std::string>& cmds) {
+std::vector<std::string> attached_serials() {
+    std::vector<std::string> serials;
+    auto output = devices();
+    if (!output) return serials;
+    
+    std::istringstream iss(*output);
+    std::string line;
+    while (std::getline(iss, line)) {
+        std::istringstream line_stream(line);
+        std::string serial, status;
+        if (line_stream >> serial >> status && status == "device") {
+            serials.push_back(serial);
+        }
+    }
+    return serials;
+}
+
+std::vector<std::string> Device::shell_multi(const std::vector<std::string>& cmds, bool throw_on_error,
+                                             ShellCost* cost) {
+    MultiBuffer buffer;
+    shell_multi(cmds, buffer, throw_on_error, cost);
+    return std::move(buffer.results_);
+}
+
+void Device::shell_multi(const std::vector<std::string>& cmds, MultiBuffer& buffer, bool throw_on_error,
+                         ShellCost* cost) {
+    std::vector<std::string>& results = buffer.results_;
+    results.resize(cmds.size());
+    for (auto& result : results) result.clear();
     if (cmds.empty()) {
-        return {};
+        return;
     }
     
-    std::string marker = "__ADB_MULTI__";
-    std::string combined;
+    const std::string_view marker = kMultiMarker;
+    if (!buffer.latency_ || cmds != buffer.cmds_) {
+        buffer.cmds_ = cmds;
+        buffer.script_ = cost_probe('0');
+        for (size_t i = 0; i < cmds.size(); ++i) {
+            buffer.script_.append("echo ").append(marker).append(std::to_string(i)).append("; ");
+            buffer.script_.append(cmds[i]).append("; ");
+        }
+        buffer.script_ += cost_probe('1');
+        buffer.labels_ = command_labels(cmds[0], "multi");
+        buffer.latency_ = &metrics::histogram(kCommandSeconds, kCommandSecondsHelp, buffer.labels_);
+    }
     
-    for (size_t i = 0; i < cmds.size(); ++i) {
-        combined += "echo " + marker + std::to_string(i) + "; " + cmds[i] + "; ";
+    std::string_view output;
+    if (run_into(buffer.script_, false, *buffer.latency_, buffer.labels_, buffer.raw_)) {
+        output = buffer.raw_.output;
+        output = output.substr(0, trimmed_size(output));
     }
     
-    std::string output;
-    try {
-        output = shell(combined, false);
-    } catch (...) {
-        return std::vector<std::string>(cmds.size(), "");
+    // The first marker is always echoed, so its absence means the
+    // round-trip itself failed rather than one of the commands
+    if (throw_on_error && output.find(kFirstMarker) == std::string_view::npos) {
+        throw std::runtime_error("ADB command failed: " + buffer.script_);
     }
     
-    std::vector<std::string> results(cmds.size(), "");
+    // Each section runs from the line after its marker to the line before
+    // the next one, so it is copied out of the output in one piece
     int current = -1;
-    std::stringstream buffer;
+    size_t begin = 0;
+    size_t end = 0;
+    bool has_lines = false;
+    auto flush = [&] {
+        if (current >= 0 && static_cast<size_t>(current) < results.size() && has_lines) {
+            results[current].assign(output.data() + begin, end - begin);
+        }
+    };
+    CostSample before, after;
+    bool measured_before = false, measured_after = false;
     
-    for (const auto& line : [&output]() {
-        std::vector<std::string> lines;
-        std::istringstream iss(output);
-        std::string l;
-        while (std::getline(iss, l)) {
-            lines.push_back(l);
+    for (size_t pos = 0; pos < output.size();) {
+        size_t line_start = pos;
+        size_t eol = output.find('\n', pos);
+        size_t line_end = eol == std::string_view::npos ? output.size() : eol;
+        pos = line_end + 1;
+        std::string_view line = output.substr(line_start, line_end - line_start);
+        
+        // The closing probe may share a line with output lacking a final newline
+        size_t probe = line.find(kCostMarker);
+        if (probe != std::string_view::npos) {
+            std::string_view sample = line.substr(probe + std::strlen(kCostMarker));
+            if (!sample.empty() && sample[0] == '0') measured_before = parse_cost_sample(sample.substr(1), before);
+            if (!sample.empty() && sample[0] == '1') measured_after = parse_cost_sample(sample.substr(1), after);
+            line = line.substr(0, probe);
+            line_end = line_start + probe;
+            if (line.empty()) continue;
         }
-        return lines;
-    }()) {
-        if (line.find(marker) == 0) {
-            if (current >= 0) {
-                std::string buffered = buffer.str();
-                if (!buffered.empty() && buffered.back() == '\n') {
-                    buffered.pop_back();
-                }
-                results[current] = buffered;
-                buffer.str("");
-                buffer.clear();
-            }
-            try {
-                current = std::stoi(line.substr(marker.length()));
-            } catch (...) {
-                current++;
-            }
+        if (line.substr(0, marker.size()) == marker) {
+            flush();
+            int index = 0;
+            std::string_view digits = line.substr(marker.size());
+            bool numbered = std::from_chars(digits.data(), digits.data() + digits.size(), index).ec == std::errc();
+            current = numbered ? index : current + 1;
+            has_lines = false;
         } else if (current >= 0) {
-            buffer << line << "\n";
+            if (!has_lines) begin = line_start;
+            has_lines = true;
+            end = line_end;
         }
     }
+    flush();
     
-    if (current >= 0) {
-        std::string buffered = buffer.str();
-        if (!buffered.empty() && buffered.back() == '\n') {
-            buffered.pop_back();
-        }
-        results[current] = buffered;
+    if (measured_before && measured_after) {
+        ShellCost batch = cost_between(before, after);
+        record_cost(batch);
+        if (cost) *cost += batch;
     }
-    
-    return results;
 }
 
 } // namespace adb
@@ -0,0 +1,367 @@
+#include "agent.hpp"
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include "agent_protocol.hpp"
+#include "metrics.hpp"
+
+namespace agent {
+
+namespace {
+
+using namespace protocol;
+using snapshot::Section;
+
+constexpr std::chrono::milliseconds kTimeout{1000};
+constexpr std::chrono::milliseconds kPushTimeout{30000};
+constexpr std::chrono::seconds kRetryInterval{30};
+
+// Same files the snapshot script reads, one glob per kind of file
+struct Source {
+    Section section;
+    const char* pattern;
+};
+
+const Source kSources[] = {
+    {snapshot::CpuCurFreq, "/sys/devices/system/cpu/cpu*/cpufreq/scaling_cur_freq"},
+    {snapshot::CpuMinFreq, "/sys/devices/system/cpu/cpu*/cpufreq/cpuinfo_min_freq"},
+    {snapshot::CpuMaxFreq, "/sys/devices/system/cpu/cpu*/cpufreq/cpuinfo_max_freq"},
+    {snapshot::CpuAvailableGovernors, "/sys/devices/system/cpu/cpu0/cpufreq/scaling_available_governors"},
+    {snapshot::CpuGovernors, "/sys/devices/system/cpu/cpu*/cpufreq/scaling_governor"},
+    {snapshot::CpuIdle, "/sys/devices/system/cpu/cpu[0-9]*/cpuidle/state*/name"},
+    {snapshot::CpuIdle, "/sys/devices/system/cpu/cpu[0-9]*/cpuidle/state*/time"},
+    {snapshot::CpuIdle, "/sys/devices/system/cpu/cpu[0-9]*/cpuidle/state*/usage"},
+    {snapshot::MemInfo, "/proc/meminfo"},
+    {snapshot::Uptime, "/proc/uptime"},
+    {snapshot::ProcStat, "/proc/stat"},
+    {snapshot::CpuTimeInState, "/sys/devices/system/cpu/cpu[0-9]*/cpufreq/stats/time_in_state"},
+    {snapshot::CpuFreqLimits, "/sys/devices/system/cpu/cpu*/cpufreq/cpuinfo_max_freq"},
+    {snapshot::CpuFreqLimits, "/sys/devices/system/cpu/cpu*/cpufreq/scaling_max_freq"},
+};
+
+// Groups on the wire are Section bit positions
+uint8_t group_of(Section section) {
+    uint8_t group = 0;
+    while (group < 63 && !(static_cast<unsigned>(section) & (1u << group))) ++group;
+    return group;
+}
+
+std::string trim(const std::string& s) {
+    size_t start = s.find_first_not_of(" \t\r\n");
+    if (start == std::string::npos) return "";
+    size_t end = s.find_last_not_of(" \t\r\n");
+    return s.substr(start, end - start + 1);
+}
+
+// Numbered path component, e.g. numbered(".../cpu3/cpuidle/state1/time", "/state") == "state1"
+std::string numbered(const std::string& path, const std::string& prefix) {
+    size_t pos = path.find(prefix);
+    while (pos != std::string::npos && !std::isdigit(static_cast<unsigned char>(path[pos + prefix.size()]))) {
+        pos = path.find(prefix, pos + 1);
+    }
+    if (pos == std::string::npos) return "";
+    ++pos;  // past the '/'
+    size_t end = path.find('/', pos);
+    return path.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+}
+
+std::string basename_of(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+// shell_multi drops one trailing newline per section; match it
+void finish(std::string& section) {
+    if (!section.empty() && section.back() == '\n') section.pop_back();
+}
+
+struct IdleState {
+    std::string name;
+    std::string time;
+    std::string usage;
+};
+
+} // namespace
+
+// ============ READER ============
+
+Reader::Reader(std::string serial, std::string binary)
+    : serial_(std::move(serial)), binary_(std::move(binary)) {}
+
+Reader::~Reader() = default;
+
+std::optional<snapshot::Snapshot> Reader::capture(unsigned sections) {
+    static metrics::Histogram& latency = metrics::histogram(
+        "adb_insight_agent_read_seconds", "Round-trip of one read through the on-device agent");
+    static metrics::Counter& unavailable = metrics::counter(
+        "adb_insight_agent_unavailable_total", "Snapshots taken through the shell because the agent was unavailable");
+
+    if (!ensure_connected()) {
+        unavailable.inc();
+        return std::nullopt;
+    }
+
+    try {
+        std::string reply;
+        {
+            metrics::Timer timer(latency);
+            std::string mask;
+            put_u64(mask, sections);
+            reply = exchange(Read, mask);
+        }
+
+        Cursor cursor(reply);
+        cursor.u64();  // device monotonic time; the sampler stamps samples itself
+        uint32_t count = cursor.u32();
+
+        snapshot::Snapshot snap;
+        std::map<std::pair<std::string, std::string>, IdleState> idle;
+        for (uint32_t i = 0; i < count; ++i) {
+            uint32_t id = cursor.u32();
+            uint32_t length = cursor.u32();
+            if (id >= files_.size()) {
+                throw std::runtime_error("agent returned unknown file " + std::to_string(id));
+            }
+            if (length == 0xffffffffu) continue;  // unreadable now, e.g. offline core
+            std::string value = cursor.str(length);
+            const File& file = files_[id];
+
+            switch (file.section) {
+                case snapshot::CpuCurFreq:
+                    snap.cpu_cur_freq += file.path + ": " + trim(value) + "\n";
+                    break;
+                case snapshot::CpuFreqLimits:
+                    snap.cpu_freq_limits += file.path + ": " + trim(value) + "\n";
+                    break;
+                case snapshot::CpuGovernors:
+                    snap.cpu_governors += file.path + ": " + trim(value) + "\n";
+                    break;
+                case snapshot::CpuMinFreq:
+                    snap.cpu_min_freq += trim(value) + "\n";
+                    break;
+                case snapshot::CpuMaxFreq:
+                    snap.cpu_max_freq += trim(value) + "\n";
+                    break;
+                case snapshot::CpuAvailableGovernors:
+                    snap.cpu_available_governors += value;
+                    break;
+                case snapshot::CpuIdle: {
+                    IdleState& state = idle[{numbered(file.path, "/cpu"), numbered(file.path, "/state")}];
+                    std::string field = basename_of(file.path);
+                    if (field == "name") state.name = trim(value);
+                    else if (field == "time") state.time = trim(value);
+                    else if (field == "usage") state.usage = trim(value);
+                    break;
+                }
+                case snapshot::MemInfo:
+                    snap.meminfo += value;
+                    break;
+                case snapshot::Uptime:
+                    snap.uptime += value;
+                    break;
+                case snapshot::ProcStat:
+                    snap.proc_stat += value;
+                    break;
+                case snapshot::CpuTimeInState: {
+                    std::string core = numbered(file.path, "/cpu");
+                    size_t pos = 0;
+                    while (pos < value.size()) {
+                        size_t end = value.find('\n', pos);
+                        if (end == std::string::npos) end = value.size();
+                        if (end > pos) snap.cpu_time_in_state += core + " " + value.substr(pos, end - pos) + "\n";
+                        pos = end + 1;
+                    }
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+        // "cpuN stateK name time usage", as the snapshot script echoes it
+        for (const auto& [key, state] : idle) {
+            snap.cpu_idle += key.first + " " + key.second + " " + state.name + " " + state.time + " " +
+                             state.usage + "\n";
+        }
+
+        for (auto* section : {&snap.cpu_cur_freq, &snap.cpu_min_freq, &snap.cpu_max_freq,
+                              &snap.cpu_available_governors, &snap.cpu_governors, &snap.cpu_idle,
+                              &snap.meminfo, &snap.uptime, &snap.proc_stat, &snap.cpu_time_in_state,
+                              &snap.cpu_freq_limits}) {
+            finish(*section);
+        }
+        return snap;
+    } catch (const std::exception& e) {
+        std::cerr << "adb_insight agent: " << e.what() << "\n";
+        connection_.reset();
+        files_.clear();
+        unavailable.inc();
+        return std::nullopt;
+    }
+}
+
+std::optional<procs::Delta> Reader::processes() {
+    static metrics::Histogram& latency = metrics::histogram(
+        "adb_insight_agent_process_scan_seconds", "Round-trip of one process scan through the on-device agent");
+
+    if (!ensure_connected()) return std::nullopt;
+
+    try {
+        std::string reply;
+        {
+            metrics::Timer timer(latency);
+            reply = exchange(Processes, "");
+        }
+
+        Cursor cursor(reply);
+        procs::Delta delta;
+        delta.uptime_ticks = cursor.u64() / 10000000;  // boot time in ns
+        delta.full = cursor.u8() != 0;
+        delta.page_size = cursor.u32();
+        uint32_t count = cursor.u32();
+        delta.changed.reserve(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            procs::Sample sample;
+            sample.pid = cursor.u32();
+            sample.ppid = cursor.u32();
+            sample.start_ticks = cursor.u64();
+            sample.cpu_ticks = cursor.u64();
+            sample.rss_pages = cursor.u64();
+            sample.oom_score_adj = static_cast<int32_t>(cursor.u32());
+            sample.threads = cursor.u32();
+            sample.state = static_cast<char>(cursor.u8());
+            sample.name = cursor.str(cursor.u8());
+            delta.changed.push_back(std::move(sample));
+        }
+        uint32_t exited = cursor.u32();
+        delta.exited.reserve(exited);
+        for (uint32_t i = 0; i < exited; ++i) delta.exited.push_back(cursor.u32());
+        return delta;
+    } catch (const std::exception& e) {
+        std::cerr << "adb_insight agent: " << e.what() << "\n";
+        connection_.reset();
+        files_.clear();
+        return std::nullopt;
+    }
+}
+
+bool Reader::ensure_connected() {
+    if (connection_) return true;
+
+    auto now = std::chrono::steady_clock::now();
+    if (now < retry_at_) return false;
+    retry_at_ = now + kRetryInterval;
+
+    try {
+        connect();
+        return true;
+    } catch (const std::exception&) {
+        // Not running, or an older protocol: (re)deploy below
+    }
+    if (binary_.empty()) return false;
+
+    try {
+        deploy();
+        // The daemon binds before detaching, but adbd may take a moment
+        // to route the first localabstract: connection
+        for (int attempt = 0;; ++attempt) {
+            try {
+                connect();
+                return true;
+            } catch (const std::exception&) {
+                if (attempt >= 9) throw;
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "adb_insight agent unavailable, using the shell: " << e.what() << "\n";
+        connection_.reset();
+        return false;
+    }
+}
+
+void Reader::connect() {
+    connection_ = adb::open_service(serial_, std::string("localabstract:") + kSocketName, kTimeout);
+
+    try {
+        uint32_t version = Cursor(exchange(Hello, "")).u32();
+        if (version != kVersion) {
+            // Stop the stale helper so the fresh one can take the socket
+            connection_->write_all(frame(Quit));
+            throw std::runtime_error("agent speaks protocol " + std::to_string(version) + ", want " +
+                                     std::to_string(kVersion));
+        }
+
+        std::string request;
+        for (const auto& source : kSources) {
+            std::string pattern = source.pattern;
+            put_u8(request, group_of(source.section));
+            put_u16(request, static_cast<uint16_t>(pattern.size()));
+            request += pattern;
+        }
+
+        std::string opened = exchange(Open, request);
+        Cursor reply(opened);
+        std::vector<File> files(reply.u32());
+        for (auto& file : files) {
+            file.section = static_cast<Section>(1u << reply.u8());
+            file.path = reply.str(reply.u16());
+        }
+        files_ = std::move(files);
+    } catch (...) {
+        connection_.reset();
+        files_.clear();
+        throw;
+    }
+}
+
+void Reader::deploy() {
+    std::ifstream in(binary_, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("Cannot read agent binary: " + binary_);
+    }
+    std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    // Write beside and rename, so a running helper keeps its image
+    std::string path = kDevicePath;
+    auto push = adb::shell_with_input(
+        serial_, "cat > " + path + ".tmp && chmod 755 " + path + ".tmp && mv " + path + ".tmp " + path,
+        bytes, kPushTimeout);
+    if (push.exit_code != 0) {
+        throw std::runtime_error("Cannot push agent: " + trim(push.error));
+    }
+
+    auto launch = adb::shell_with_input(serial_, path + " --daemon", "", kTimeout * 5);
+    if (launch.exit_code != 0) {
+        throw std::runtime_error("Cannot start agent: " + trim(launch.error));
+    }
+}
+
+std::string Reader::exchange(uint8_t op, const std::string& body) {
+    connection_->set_deadline(std::chrono::steady_clock::now() + kTimeout);
+    connection_->write_all(frame(static_cast<Op>(op), body));
+
+    char header[4];
+    connection_->read_exact(header, sizeof(header));
+    uint32_t length = Cursor(header, sizeof(header)).u32();
+    if (length == 0 || length > kMaxMessage) {
+        throw std::runtime_error("agent sent a malformed message");
+    }
+    std::string reply(length, '\0');
+    connection_->read_exact(&reply[0], length);
+
+    uint8_t reply_op = static_cast<uint8_t>(reply[0]);
+    if (reply_op == Error) {
+        throw std::runtime_error("agent: " + reply.substr(1));
+    }
+    if (reply_op != op) {
+        throw std::runtime_error("agent answered op " + std::to_string(reply_op) + " to " + std::to_string(op));
+    }
+    return reply.substr(1);
+}
+
+} // namespace agent
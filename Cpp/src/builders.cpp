@@ -0,0 +1,417 @@
+#include "builders.hpp"
+#include "adb_utils.hpp"
+#include "parsers.hpp"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <iomanip>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+
+namespace {
+
+// fn(line) for each line of text, without its newline
+template <typename F>
+void for_each_line(std::string_view text, F&& fn) {
+    while (!text.empty()) {
+        size_t eol = text.find('\n');
+        fn(text.substr(0, eol));
+        text = eol == std::string_view::npos ? std::string_view() : text.substr(eol + 1);
+    }
+}
+
+std::string_view trim_view(std::string_view s) {
+    size_t start = s.find_first_not_of(" \t\r");
+    if (start == std::string_view::npos) return {};
+    return s.substr(start, s.find_last_not_of(" \t\r") - start + 1);
+}
+
+// A line of digits only, as sysfs frequency files hold
+std::optional<int> whole_number(std::string_view line) {
+    int value = 0;
+    auto [ptr, ec] = std::from_chars(line.data(), line.data() + line.size(), value);
+    if (line.empty() || line[0] == '-' || ec != std::errc() || ptr != line.data() + line.size()) return std::nullopt;
+    return value;
+}
+
+// Sensor names of the form cpu<digits>
+bool is_cpu_sensor(const std::string& name) {
+    return name.size() > 3 && name.compare(0, 3, "cpu") == 0 &&
+           std::all_of(name.begin() + 3, name.end(), [](char c) { return c >= '0' && c <= '9'; });
+}
+
+OSInfo os_info(const props::Table& props, const std::string& kernel) {
+    std::string sdk = props.value("ro.build.version.sdk");
+    return OSInfo{
+        props.value("ro.build.version.release"),
+        sdk.empty() ? 0 : std::stoi(sdk),
+        props.value("ro.build.version.security_patch"),
+        props.value("ro.build.display.id"),
+        kernel
+    };
+}
+
+CPUInfo cpu_info(const props::Table& props, const std::string& nproc) {
+    int cores = nproc.empty() ? 0 : std::stoi(nproc);
+    std::string abi = props.value("ro.product.cpu.abi");
+    
+    std::vector<std::string> abi_list;
+    std::istringstream iss(props.value("ro.product.cpu.abilist"));
+    std::string item;
+    while (std::getline(iss, item, ',')) {
+        item.erase(0, item.find_first_not_of(" \t"));
+        item.erase(item.find_last_not_of(" \t") + 1);
+        if (!item.empty()) abi_list.push_back(item);
+    }
+    
+    std::map<std::string, std::string> arch_map = {
+        {"arm64-v8a", "ARMv8"},
+        {"armeabi-v7a", "ARMv7"},
+        {"x86_64", "x86-64"},
+        {"x86", "x86"}
+    };
+    
+    std::string arch = arch_map.count(abi) ? arch_map[abi] : "Unknown";
+    
+    return CPUInfo{cores, abi, abi_list, arch};
+}
+
+} // namespace
+
+DeviceInfo build_device_info(adb::Device& device) {
+    return device_info_from(*props::fetch(device));
+}
+
+DeviceInfo device_info_from(const props::Table& props) {
+    std::string sdk = props.value("ro.build.version.sdk");
+    return DeviceInfo{
+        props.value("ro.product.model"),
+        props.value("ro.product.manufacturer"),
+        props.value("ro.build.version.release"),
+        sdk.empty() ? 0 : std::stoi(sdk),
+        props.value("ro.hardware"),
+        props.value("ro.board.platform")
+    };
+}
+
+OSInfo build_os_info(adb::Device& device) {
+    auto results = device.shell_multi({"getprop", "uname -r"});
+    return os_info(props::Table(std::move(results[0])), results[1]);
+}
+
+OSInfo build_os_info(adb::Device& device, const props::Table& props) {
+    return os_info(props, device.shell("uname -r", false));
+}
+
+CPUInfo build_cpu_info(adb::Device& device) {
+    auto results = device.shell_multi({"nproc", "getprop"});
+    return cpu_info(props::Table(std::move(results[1])), results[0]);
+}
+
+CPUInfo build_cpu_info(adb::Device& device, const props::Table& props) {
+    return cpu_info(props, device.shell("nproc", false));
+}
+
+CPUFrequency build_cpu_frequency(adb::Device& device) {
+    return cpu_frequency_from(snapshot::capture(device, snapshot::CpuFrequency));
+}
+
+CPUFrequency cpu_frequency_from(const snapshot::Snapshot& snap) {
+    auto freq_data = parsers::parse_cpu_frequencies_detailed(snap.cpu_cur_freq);
+    
+    if (freq_data.error) {
+        throw std::runtime_error("Failed to parse CPU frequencies");
+    }
+    
+    int min_freq = freq_data.min_khz;
+    int max_freq = freq_data.max_khz;
+    
+    // One frequency per line; lines that are not a plain number are skipped
+    bool first = true;
+    for_each_line(snap.cpu_min_freq, [&](std::string_view line) {
+        if (auto khz = whole_number(line)) {
+            min_freq = first ? *khz : std::min(min_freq, *khz);
+            first = false;
+        }
+    });
+    first = true;
+    for_each_line(snap.cpu_max_freq, [&](std::string_view line) {
+        if (auto khz = whole_number(line)) {
+            max_freq = first ? *khz : std::max(max_freq, *khz);
+            first = false;
+        }
+    });
+    
+    return CPUFrequency{
+        std::move(freq_data.per_core),
+        min_freq,
+        max_freq,
+        std::round((min_freq / 1000.0) * 100) / 100,
+        std::round((max_freq / 1000.0) * 100) / 100,
+        freq_data.avg_mhz,
+        freq_data.core_count
+    };
+}
+
+CPUGovernorInfo build_cpu_governors(adb::Device& device) {
+    return cpu_governors_from(snapshot::capture(device, snapshot::CpuGovernor));
+}
+
+CPUGovernorInfo cpu_governors_from(const snapshot::Snapshot& snap) {
+    std::vector<std::string> available;
+    std::istringstream iss(snap.cpu_available_governors);
+    std::string governor;
+    while (iss >> governor) {
+        available.push_back(governor);
+    }
+    
+    auto per_core = parsers::parse_path_value_block(snap.cpu_governors);
+    
+    return CPUGovernorInfo{per_core, available};
+}
+
+CPUIdleInfo build_cpu_idle_info(adb::Device& device) {
+    return cpu_idle_info_from(snapshot::capture(device, snapshot::CpuIdle));
+}
+
+CPUIdleInfo cpu_idle_info_from(const snapshot::Snapshot& snap) {
+    auto per_core = parsers::parse_cpu_idle_output(snap.cpu_idle);
+    return CPUIdleInfo{per_core};
+}
+
+MemoryInfo build_memory_info(adb::Device& device) {
+    return memory_info_from(snapshot::capture(device, snapshot::MemInfo));
+}
+
+MemoryInfo memory_info_from(const snapshot::Snapshot& snap) {
+    double total = 0, available = 0, swap_total = 0, swap_free = 0;
+    
+    // Views into the snapshot: "MemTotal:        7834540 kB" needs no copy
+    for_each_line(snap.meminfo, [&](std::string_view line) {
+        size_t pos = line.find(':');
+        if (pos == std::string_view::npos) return;
+        std::string_view key = trim_view(line.substr(0, pos));
+        double* slot = key == "MemTotal" ? &total
+                     : key == "MemAvailable" ? &available
+                     : key == "SwapTotal" ? &swap_total
+                     : key == "SwapFree" ? &swap_free
+                     : nullptr;
+        if (!slot) return;
+        std::string_view value = trim_view(line.substr(pos + 1));
+        value = value.substr(0, value.find_first_of(" \t"));
+        if (!value.empty()) *slot = parsers::kb_to_mb(std::string(value));
+    });
+    
+    double used = total - available;
+    double usage_percent = total > 0 ? std::round((used / total * 100) * 100) / 100 : 0;
+    
+    return MemoryInfo{
+        total,
+        available,
+        used,
+        usage_percent,
+        swap_total,
+        swap_free
+    };
+}
+
+StorageInfo build_storage_info(adb::Device& device) {
+    std::string output = device.shell("df /data | tail -1");
+    std::istringstream iss(output);
+    
+    std::string filesystem;
+    int total_kb, used_kb, free_kb;
+    
+    if (!(iss >> filesystem >> total_kb >> used_kb >> free_kb)) {
+        throw std::runtime_error("Failed to parse storage info");
+    }
+    
+    double usage_percent = total_kb > 0 ? std::round((used_kb / (double)total_kb * 100) * 100) / 100 : 0;
+    
+    return StorageInfo{
+        filesystem,
+        parsers::kb_to_gb(total_kb),
+        parsers::kb_to_gb(used_kb),
+        parsers::kb_to_gb(free_kb),
+        usage_percent
+    };
+}
+
+std::vector<MountInfo> build_storage_mounts(adb::Device& device) {
+    std::string raw = device.shell("df -k");
+    return parsers::parse_df_output(raw);
+}
+
+BatteryInfo build_battery_info(adb::Device& device) {
+    sources::SourceCache sources(device);
+    return build_battery_info(sources);
+}
+
+BatteryInfo build_battery_info(sources::SourceCache& sources) {
+    auto battery = parsers::parse_battery_level(sources.battery());
+    
+    return BatteryInfo{
+        battery.level,
+        battery.health,
+        battery.status,
+        battery.voltage_mv,
+        battery.temperature_c,
+        battery.technology,
+        battery.is_charging
+    };
+}
+
+PowerInfo build_power_info(adb::Device& device) {
+    sources::SourceCache sources(device);
+    return build_power_info(sources);
+}
+
+PowerInfo build_power_info(sources::SourceCache& sources) {
+    return parsers::parse_power_info(sources.battery());
+}
+
+ThermalInfo build_thermal_info(adb::Device& device) {
+    sources::SourceCache sources(device);
+    return build_thermal_info(sources);
+}
+
+ThermalInfo build_thermal_info(sources::SourceCache& sources) {
+    const auto& temps = sources.thermal();
+    
+    if (temps.empty()) {
+        throw std::runtime_error("Failed to parse thermal data");
+    }
+    
+    std::map<std::string, double> simple_temps;
+    std::vector<double> temp_values;
+    
+    for (const auto& [name, data] : temps) {
+        double value = data.at("value");
+        simple_temps[name] = value;
+        temp_values.push_back(value);
+    }
+    
+    double max_temp = !temp_values.empty() ? *std::max_element(temp_values.begin(), temp_values.end()) : 0;
+    double min_temp = !temp_values.empty() ? *std::min_element(temp_values.begin(), temp_values.end()) : 0;
+    
+    return ThermalInfo{simple_temps, max_temp, min_temp};
+}
+
+CoreTemperatures build_core_temperatures(adb::Device& device) {
+    sources::SourceCache sources(device);
+    return build_core_temperatures(sources);
+}
+
+CoreTemperatures build_core_temperatures(sources::SourceCache& sources) {
+    const auto& temps = sources.thermal();
+    
+    std::map<std::string, double> per_core;
+    
+    for (const auto& [name, data] : temps) {
+        std::string lower_name = name;
+        std::transform(lower_name.begin(), lower_name.end(), lower_name.begin(), ::tolower);
+        if (is_cpu_sensor(lower_name)) {
+            per_core[lower_name] = data.at("value");
+        }
+    }
+    
+    return CoreTemperatures{
+        per_core,
+        "thermalservice",
+        !per_core.empty()
+    };
+}
+
+NetworkInfo build_network_info(adb::Device& device) {
+    return build_network_info(device, *props::fetch(device));
+}
+
+NetworkInfo build_network_info(adb::Device& device, const props::Table& props) {
+    std::string hostname = props.value("net.hostname");
+    std::string wifi_ip = props.value("dhcp.wlan0.ipaddress");
+    std::string operator_name = props.value("gsm.operator.alpha");
+    std::string network_type = props.value("gsm.network.type");
+    std::string data_state = props.value("gsm.data.state");
+
+    if (wifi_ip.empty()) {
+        try {
+            std::string ip_out = device.shell("ip -f inet addr show wlan0 | grep inet | awk '{print $2}' | head -n 1");
+            size_t slash_pos = ip_out.find('/');
+            if (slash_pos != std::string::npos) {
+                wifi_ip = ip_out.substr(0, slash_pos);
+            }
+        } catch (...) {}
+    }
+    
+    return NetworkInfo{
+        hostname.empty() ? "android" : hostname,
+        wifi_ip.empty() ? std::nullopt : std::optional<std::string>(wifi_ip),
+        std::nullopt,
+        operator_name.empty() ? std::nullopt : std::optional<std::string>(operator_name),
+        network_type.empty() ? std::nullopt : std::optional<std::string>(network_type),
+        data_state.empty() ? std::nullopt : std::optional<std::string>(data_state)
+    };
+}
+
+DisplayInfo build_display_info(adb::Device& device) {
+    std::string size_out = device.shell("wm size | head -n 1");
+    std::string density_out = device.shell("wm density | head -n 1");
+    
+    std::string size_px = "unknown";
+    if (size_out.find(':') != std::string::npos) {
+        size_px = size_out.substr(size_out.find(':') + 1);
+        size_px.erase(0, size_px.find_first_not_of(" \t"));
+    }
+    
+    int density_dpi = 0;
+    if (density_out.find(':') != std::string::npos) {
+        std::string density_str = density_out.substr(density_out.find(':') + 1);
+        density_str.erase(0, density_str.find_first_not_of(" \t"));
+        std::istringstream iss(density_str);
+        iss >> density_dpi;
+    }
+    
+    return DisplayInfo{size_px, density_dpi};
+}
+
+UptimeInfo build_uptime_info(adb::Device& device) {
+    return uptime_info_from(snapshot::capture(device, snapshot::Uptime));
+}
+
+UptimeInfo uptime_info_from(const snapshot::Snapshot& snap) {
+    const std::string& result = snap.uptime;
+    int uptime_seconds = (int)std::stod(result.substr(0, result.find(' ')));
+    
+    int days = uptime_seconds / 86400;
+    int hours = (uptime_seconds % 86400) / 3600;
+    int minutes = (uptime_seconds % 3600) / 60;
+    int seconds = uptime_seconds % 60;
+    
+    std::string formatted;
+    if (days > 0) {
+        formatted = std::to_string(days) + "d " + std::to_string(hours) + "h " +
+                   std::to_string(minutes) + "m " + std::to_string(seconds) + "s";
+    } else if (hours > 0) {
+        formatted = std::to_string(hours) + "h " + std::to_string(minutes) + "m " +
+                   std::to_string(seconds) + "s";
+    } else {
+        formatted = std::to_string(minutes) + "m " + std::to_string(seconds) + "s";
+    }
+    
+    auto now = std::chrono::system_clock::now();
+    auto boot_time = now - std::chrono::seconds(uptime_seconds);
+    auto boot_time_t = std::chrono::system_clock::to_time_t(boot_time);
+    auto ms = std::chrono::duration_cast<std::chrono::microseconds>(boot_time.time_since_epoch()) % 1000000;
+    
+    std::tm local{};
+    localtime_r(&boot_time_t, &local);
+    std::ostringstream boot_ss;
+    boot_ss << std::put_time(&local, "%Y-%m-%dT%H:%M:%S");
+    boot_ss << "." << std::setfill('0') << std::setw(6) << ms.count();
+    
+    return UptimeInfo{uptime_seconds, formatted, boot_ss.str()};
+}
@@ -0,0 +1,119 @@
+#include "delta.hpp"
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+namespace delta {
+
+namespace {
+
+int64_t wall_clock_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()
+    ).count();
+}
+
+template <typename T>
+void add(Sections& sections, const char* name, const T& value) {
+    sections.emplace_back(name, wire::to_string(value));
+}
+
+} // namespace
+
+Sections sections_of(const SystemInfo& system) {
+    Sections sections;
+    sections.reserve(15);
+    add(sections, "battery", system.battery);
+    add(sections, "core_temperatures", system.core_temperatures);
+    add(sections, "cpu", system.cpu);
+    add(sections, "cpu_frequency", system.cpu_frequency);
+    add(sections, "cpu_governors", system.cpu_governors);
+    add(sections, "cpu_idle", system.cpu_idle);
+    add(sections, "device", system.device);
+    add(sections, "display", system.display);
+    add(sections, "memory", system.memory);
+    add(sections, "mounts", system.mounts);
+    add(sections, "network", system.network);
+    add(sections, "os", system.os);
+    add(sections, "power", system.power);
+    add(sections, "storage", system.storage);
+    add(sections, "thermal", system.thermal);
+    return sections;
+}
+
+int64_t Tracker::update(const Sections& sections) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<Entry*> changed;
+    for (const auto& [name, bytes] : sections) {
+        auto it = sections_.find(name);
+        if (it == sections_.end()) {
+            it = sections_.emplace(name, Entry{bytes, 0}).first;
+        } else if (it->second.bytes != bytes) {
+            it->second.bytes = bytes;
+        } else {
+            continue;
+        }
+        changed.push_back(&it->second);
+    }
+
+    if (!changed.empty()) {
+        version_ = std::max(version_ + 1, wall_clock_ms());
+        for (Entry* entry : changed) entry->changed_at = version_;
+    }
+    return version_;
+}
+
+Patch Tracker::since(int64_t since) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Patch patch;
+    patch.version = version_;
+    patch.since = since;
+    patch.full = since > patch.version;
+    for (const auto& [name, entry] : sections_) {
+        if (patch.full || entry.changed_at > since) {
+            patch.changed.emplace_back(name, entry.bytes);
+        }
+    }
+    return patch;
+}
+
+payload::PayloadPtr encode(Patch patch, std::string timestamp) {
+    auto shared = std::make_shared<const std::pair<Patch, std::string>>(std::move(patch), std::move(timestamp));
+    return std::make_shared<const payload::Payload>([shared](payload::Format format) {
+        const Patch& p = shared->first;
+        const std::string& ts = shared->second;
+
+        if (format == payload::Format::Json) {
+            std::string out;
+            wire::Writer w(out);
+            w.begin_object();
+            w.key("changes");
+            w.begin_object();
+            for (const auto& [name, bytes] : p.changed) {
+                w.key(name);
+                w.raw(bytes);
+            }
+            w.end_object();
+            w.member("full", p.full);
+            w.member("since", p.since);
+            w.member("timestamp", ts);
+            w.member("version", p.version);
+            w.end_object();
+            return out;
+        }
+
+        nlohmann::json changes = nlohmann::json::object();
+        for (const auto& [name, bytes] : p.changed) {
+            changes[name] = nlohmann::json::parse(bytes);
+        }
+        nlohmann::json j;
+        j["changes"] = changes;
+        j["full"] = p.full;
+        j["since"] = p.since;
+        j["timestamp"] = ts;
+        j["version"] = p.version;
+        return payload::encode(j, format);
+    });
+}
+
+} // namespace delta
@@ -0,0 +1,220 @@
+#include "devices.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <exception>
+#include <stdexcept>
+
+namespace devices {
+
+namespace {
+
+// How long low-observer handlers share one dumpsys
+constexpr std::chrono::seconds kLowObserverDumpsys{60};
+
+// How often unprefixed routes list devices while adb's choice is unknown
+constexpr std::chrono::seconds kDefaultRecheck{5};
+
+std::string profile_path(const std::string& dir, const std::string& serial) {
+    if (dir.empty()) return "";
+    // Serials of TCP devices look like host:port
+    std::string name = serial.empty() ? "default" : serial;
+    std::replace_if(name.begin(), name.end(), [](char c) { return c == '/' || c == ':'; }, '_');
+    return dir + "/" + name + ".profile";
+}
+
+} // namespace
+
+DeviceContext::DeviceContext(std::string serial, const Settings& settings)
+    : adb(std::move(serial), settings.sessions),
+      cache(settings.cache_default),
+      profile(adb, profile_path(settings.profile_dir, adb.serial()),
+              [this](std::function<void()> job) { return io.try_submit(std::move(job)).has_value(); }),
+      processes(adb.serial(), settings.sampler.agent_binary),
+      workers(settings.workers, settings.workers_queue),
+      sampler(adb, settings.sampler,
+              [this](const std::string& metric, const std::string& payload) { broadcaster.publish(metric, payload); },
+              [this] { on_sampler_cycle(); }),
+      collect_system_(settings.collect_system),
+      system_interval_(settings.system_interval),
+      io(settings.io_threads, settings.io_queue) {
+    if (settings.configure_cache) settings.configure_cache(cache);
+    sampler.start();
+    if (settings.warm_up) {
+        io.try_submit([this, warm_up = settings.warm_up] { warm_up(*this); });
+    }
+}
+
+DeviceContext::~DeviceContext() {
+    // The sampler's cycle hook queues on io, which goes first
+    sampler.stop();
+}
+
+std::shared_ptr<sources::SourceCache> DeviceContext::dumpsys() {
+    if (!sampler.low_observer()) return std::make_shared<sources::SourceCache>(adb);
+
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(dumpsys_mutex_);
+    if (!dumpsys_ || now - dumpsys_at_ >= kLowObserverDumpsys || dumpsys_->failed()) {
+        dumpsys_ = std::make_shared<sources::SourceCache>(adb);
+        dumpsys_at_ = now;
+    }
+    return dumpsys_;
+}
+
+std::shared_ptr<const SystemSnapshot> DeviceContext::system() {
+    {
+        std::lock_guard<std::mutex> lock(system_mutex_);
+        if (system_ && std::chrono::steady_clock::now() - system_->collected_at < 2 * system_interval_) {
+            return system_;
+        }
+    }
+    return refresh_system();
+}
+
+std::pair<std::shared_ptr<const SystemSnapshot>, delta::Patch> DeviceContext::system_since(int64_t since) {
+    system();
+    // The tracker and system_ move together under system_mutex_
+    std::lock_guard<std::mutex> lock(system_mutex_);
+    return {system_, system_versions.since(since)};
+}
+
+std::shared_ptr<const SystemSnapshot> DeviceContext::refresh_system() {
+    std::promise<std::shared_ptr<const SystemSnapshot>> promise;
+    SystemFuture in_flight;
+    {
+        std::lock_guard<std::mutex> lock(system_mutex_);
+        if (system_refresh_.valid()) {
+            in_flight = system_refresh_;
+        } else {
+            system_refresh_ = promise.get_future().share();
+        }
+    }
+    if (in_flight.valid()) return in_flight.get();
+
+    std::shared_ptr<const SystemSnapshot> snapshot;
+    std::exception_ptr error;
+    try {
+        if (!collect_system_) throw std::runtime_error("No /system collector configured");
+        SystemInfo info = collect_system_(*this);
+        auto sections = delta::sections_of(info);
+        std::lock_guard<std::mutex> lock(system_mutex_);
+        snapshot = std::make_shared<const SystemSnapshot>(
+            SystemSnapshot{std::move(info), system_versions.update(sections), std::chrono::steady_clock::now()});
+        system_ = snapshot;
+    } catch (...) {
+        error = std::current_exception();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(system_mutex_);
+        system_refresh_ = SystemFuture();
+    }
+    if (error) {
+        promise.set_exception(error);
+        std::rethrow_exception(error);
+    }
+    promise.set_value(snapshot);
+    return snapshot;
+}
+
+void DeviceContext::on_sampler_cycle() {
+    // Low-observer mode keeps collections to what clients ask for
+    if (!collect_system_ || sampler.low_observer()) return;
+    {
+        std::lock_guard<std::mutex> lock(system_mutex_);
+        if (system_queued_ || system_refresh_.valid()) return;
+        if (system_ && std::chrono::steady_clock::now() - system_->collected_at < system_interval_) return;
+        system_queued_ = true;
+    }
+    auto queued = io.try_submit([this] {
+        {
+            std::lock_guard<std::mutex> lock(system_mutex_);
+            system_queued_ = false;
+        }
+        collector::attempt([this] { return refresh_system(); }, "system");
+    });
+    if (!queued) {
+        std::lock_guard<std::mutex> lock(system_mutex_);
+        system_queued_ = false;
+    }
+}
+
+Registry::Registry(Settings settings) : settings_(std::move(settings)) {}
+
+DeviceContext& Registry::default_device() {
+    const char* env = std::getenv("ANDROID_SERIAL");
+    if (env && *env) return get_or_create(env);
+
+    auto now = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (default_) return *default_;
+        auto unnamed = contexts_.find("");
+        if (unnamed != contexts_.end() && now - default_checked_ < kDefaultRecheck) return *unnamed->second;
+        default_checked_ = now;
+    }
+
+    // Without a serial adb talks to the only attached device; with none or
+    // several there is no choice yet, and the "" context answers with adb's error
+    auto serials = adb::attached_serials();
+    if (serials.size() != 1) return get_or_create("");
+    DeviceContext& context = attached_context(serials.front(), serials);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!default_) default_ = &context;
+    return *default_;
+}
+
+DeviceContext* Registry::find(const std::string& serial) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = contexts_.find(serial);
+        if (it != contexts_.end()) return it->second.get();
+    }
+
+    auto attached = adb::attached_serials();
+    if (serial.empty() || std::find(attached.begin(), attached.end(), serial) == attached.end()) {
+        return nullptr;
+    }
+    return &attached_context(serial, attached);
+}
+
+std::vector<DeviceContext*> Registry::attached() {
+    std::vector<DeviceContext*> contexts;
+    auto serials = adb::attached_serials();
+    for (const auto& serial : serials) {
+        contexts.push_back(&attached_context(serial, serials));
+    }
+    return contexts;
+}
+
+DeviceContext& Registry::attached_context(const std::string& serial, const std::vector<std::string>& attached) {
+    if (attached.size() == 1) {
+        // The "" context already samples the only attached device; give it
+        // the serial too instead of starting a second sampler on the phone
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto unnamed = contexts_.find("");
+        if (!default_ && unnamed != contexts_.end() && !contexts_.count(serial)) {
+            contexts_[serial] = unnamed->second;
+            default_ = unnamed->second.get();
+        }
+    }
+    return get_or_create(serial);
+}
+
+DeviceContext& Registry::get_or_create(const std::string& serial) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = contexts_.find(serial);
+        if (it != contexts_.end()) return *it->second;
+    }
+
+    // Construction starts the sampler and loads the profile, so it runs
+    // unlocked; a context built concurrently for the same serial is dropped
+    auto built = std::make_shared<DeviceContext>(serial, settings_);
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& context = contexts_[serial];
+    if (!context) context = std::move(built);
+    return *context;
+}
+
+} // namespace devices
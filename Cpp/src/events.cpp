@@ -0,0 +1,159 @@
+#include "events.hpp"
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+
+namespace events {
+
+static_assert(std::is_trivially_copyable<Event>::value, "events are copied word by word");
+
+const char* kind_name(Kind kind) {
+    switch (kind) {
+        case Kind::FreqCapped: return "freq_capped";
+        case Kind::FreqRestored: return "freq_restored";
+        case Kind::ThermalStatus: return "thermal_status";
+        case Kind::DischargeSpike: return "discharge_spike";
+    }
+    return "unknown";
+}
+
+void to_json(json& j, const Event& event) {
+    j = json{{"id", event.id}, {"t", event.t_ms}, {"type", kind_name(event.kind)}};
+    switch (event.kind) {
+        case Kind::FreqCapped:
+        case Kind::FreqRestored:
+            j["core"] = event.subject_name();
+            j["limit_khz"] = static_cast<int>(event.value);
+            j["cpuinfo_max_khz"] = static_cast<int>(event.reference);
+            break;
+        case Kind::ThermalStatus:
+            j["sensor"] = event.subject_name();
+            j["status"] = static_cast<int>(event.value);
+            j["previous_status"] = static_cast<int>(event.reference);
+            break;
+        case Kind::DischargeSpike:
+            j["current_ma"] = event.value;
+            j["baseline_ma"] = std::round(event.reference * 10) / 10;
+            break;
+    }
+}
+
+// ============ LOG ============
+
+Log::Log(size_t capacity)
+    : slots_(std::make_unique<Slot[]>(capacity == 0 ? 1 : capacity)), capacity_(capacity == 0 ? 1 : capacity) {}
+
+Event Log::push(Event event) {
+    event.id = last_id_.load(std::memory_order_relaxed) + 1;
+    uint64_t words[kWords] = {};
+    std::memcpy(words, &event, sizeof(event));
+
+    Slot& slot = slots_[(event.id - 1) % capacity_];
+    slot.sequence.store(2 * event.id - 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < kWords; ++i) slot.words[i].store(words[i], std::memory_order_relaxed);
+    slot.sequence.store(2 * event.id, std::memory_order_release);
+
+    last_id_.store(event.id, std::memory_order_release);
+    return event;
+}
+
+std::vector<Event> Log::since(uint64_t since_id, size_t limit) const {
+    std::vector<Event> result;
+    uint64_t last = last_id();
+    uint64_t first = std::max<uint64_t>(since_id + 1, last > capacity_ ? last - capacity_ + 1 : 1);
+
+    for (uint64_t id = first; id <= last && result.size() < limit; ++id) {
+        const Slot& slot = slots_[(id - 1) % capacity_];
+        if (slot.sequence.load(std::memory_order_acquire) != 2 * id) continue;  // already overwritten
+
+        uint64_t words[kWords];
+        for (size_t i = 0; i < kWords; ++i) words[i] = slot.words[i].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != 2 * id) continue;  // overwritten mid-copy
+
+        Event event;
+        std::memcpy(&event, words, sizeof(event));
+        result.push_back(event);
+    }
+    return result;
+}
+
+// ============ DETECTOR ============
+
+Detector::Detector(Log& log, Rules rules) : log_(log), rules_(rules) {}
+
+Event Detector::emit(int64_t t_ms, Kind kind, const std::string& subject, double value, double reference) {
+    Event event;
+    event.t_ms = t_ms;
+    event.kind = kind;
+    std::memcpy(event.subject, subject.data(), std::min(subject.size(), sizeof(event.subject)));
+    event.value = value;
+    event.reference = reference;
+    return log_.push(event);
+}
+
+std::vector<Event> Detector::freq_limits(int64_t t_ms, const parsers::PerCore<parsers::CpuFreqLimit>& limits) {
+    std::vector<Event> found;
+    limits.for_each([&](size_t core, const parsers::CpuFreqLimit& limit) {
+        std::string name = "cpu" + std::to_string(core);
+        auto capped = caps_.find(core);
+        if (limit.scaling_max_khz < limit.cpuinfo_max_khz) {
+            if (capped == caps_.end() || capped->second != limit.scaling_max_khz) {
+                caps_[core] = limit.scaling_max_khz;
+                found.push_back(emit(t_ms, Kind::FreqCapped, name, limit.scaling_max_khz, limit.cpuinfo_max_khz));
+            }
+        } else if (capped != caps_.end()) {
+            caps_.erase(capped);
+            found.push_back(emit(t_ms, Kind::FreqRestored, name, limit.scaling_max_khz, limit.cpuinfo_max_khz));
+        }
+    });
+    return found;
+}
+
+std::vector<Event> Detector::thermal(int64_t t_ms, const sources::ThermalMap& sensors) {
+    std::vector<Event> found;
+    for (const auto& [sensor, fields] : sensors) {
+        auto it = fields.find("status");
+        if (it == fields.end()) continue;
+        int status = static_cast<int>(it->second);
+
+        auto known = statuses_.emplace(sensor, 0).first;
+        if (known->second != status) {
+            found.push_back(emit(t_ms, Kind::ThermalStatus, sensor, status, known->second));
+            known->second = status;
+        }
+    }
+    return found;
+}
+
+bool Detector::thermal_throttling() const {
+    return std::any_of(statuses_.begin(), statuses_.end(), [](const auto& entry) { return entry.second > 0; });
+}
+
+std::vector<Event> Detector::power(int64_t t_ms, const PowerInfo& power) {
+    std::vector<Event> found;
+    // Baseline only covers discharging; plugging in starts it over
+    if (power.charging_status == "charging" || power.charging_status == "full") {
+        discharging_samples_ = 0;
+        spiking_ = false;
+        return found;
+    }
+
+    // Sign conventions differ between fuel gauges; draw is the magnitude
+    double draw = std::abs(static_cast<double>(power.current_ma));
+    if (discharging_samples_ == 0) baseline_ma_ = draw;
+
+    bool spike = discharging_samples_ >= rules_.warmup_samples && draw > baseline_ma_ * rules_.spike_ratio &&
+                 draw > baseline_ma_ + rules_.spike_min_ma;
+    if (spike && !spiking_) {
+        found.push_back(emit(t_ms, Kind::DischargeSpike, "battery", draw, baseline_ma_));
+    }
+    spiking_ = spike;
+
+    baseline_ma_ += rules_.baseline_alpha * (draw - baseline_ma_);
+    ++discharging_samples_;
+    return found;
+}
+
+} // namespace events
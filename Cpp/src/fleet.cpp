@@ -0,0 +1,145 @@
+#include "fleet.hpp"
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+namespace fleet {
+
+namespace {
+
+using clock = std::chrono::steady_clock;
+
+// State shared with device jobs, which may outlive the request
+struct Round {
+    std::mutex mutex;
+    std::condition_variable done;
+    std::vector<Result> results;
+    std::vector<char> abandoned;  // timed out: a late job leaves its result alone
+    std::vector<size_t> finished;
+};
+
+struct Running {
+    size_t index;
+    clock::time_point deadline;
+};
+
+void flatten(const json& value, const std::string& path, std::map<std::string, std::vector<double>>& fields) {
+    if (value.is_object()) {
+        for (const auto& [key, child] : value.items()) {
+            flatten(child, path.empty() ? key : path + "." + key, fields);
+        }
+    } else if (value.is_array()) {
+        for (size_t i = 0; i < value.size(); ++i) {
+            flatten(value[i], path.empty() ? std::to_string(i) : path + "." + std::to_string(i), fields);
+        }
+    } else if (value.is_number()) {
+        fields[path].push_back(value.get<double>());
+    }
+}
+
+// Nearest-rank percentile of sorted values
+double percentile(const std::vector<double>& sorted, double p) {
+    size_t rank = static_cast<size_t>(std::ceil(p / 100 * sorted.size()));
+    return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+}
+
+} // namespace
+
+std::vector<Result> collect(const std::vector<devices::DeviceContext*>& devices, const Fetch& fetch,
+                            const Options& options) {
+    auto round = std::make_shared<Round>();
+    round->results.resize(devices.size());
+    round->abandoned.resize(devices.size(), 0);
+    for (size_t i = 0; i < devices.size(); ++i) round->results[i].serial = devices[i]->adb.serial();
+    auto job_fetch = std::make_shared<const Fetch>(fetch);
+    size_t concurrency = std::max<size_t>(options.concurrency, 1);
+
+    std::vector<Running> running;
+    size_t next = 0;
+    size_t remaining = devices.size();
+
+    std::unique_lock<std::mutex> lock(round->mutex);
+    while (remaining > 0) {
+        while (running.size() < concurrency && next < devices.size()) {
+            size_t index = next++;
+            devices::DeviceContext* ctx = devices[index];
+            auto started = clock::now();
+
+            lock.unlock();
+            auto submitted = ctx->io.try_submit([round, job_fetch, ctx, index, started] {
+                std::optional<json> document;
+                std::string error;
+                try {
+                    document = (*job_fetch)(*ctx);
+                } catch (const std::exception& e) {
+                    error = e.what();
+                }
+                auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(clock::now() - started);
+
+                std::lock_guard<std::mutex> guard(round->mutex);
+                if (round->abandoned[index]) return;
+                Result& result = round->results[index];
+                result.document = std::move(document);
+                result.error = std::move(error);
+                result.elapsed = elapsed;
+                round->finished.push_back(index);
+                round->done.notify_one();
+            });
+            lock.lock();
+
+            if (!submitted) {
+                round->results[index].error = "Device I/O queue is full";
+                --remaining;
+                continue;
+            }
+            running.push_back({index, started + options.deadline});
+        }
+        if (running.empty()) continue;
+
+        auto earliest = std::min_element(running.begin(), running.end(), [](const Running& a, const Running& b) {
+            return a.deadline < b.deadline;
+        })->deadline;
+        round->done.wait_until(lock, earliest, [&] { return !round->finished.empty(); });
+
+        auto now = clock::now();
+        auto settled = [&](const Running& job) {
+            if (std::find(round->finished.begin(), round->finished.end(), job.index) != round->finished.end()) {
+                return true;
+            }
+            if (job.deadline > now) return false;
+            round->abandoned[job.index] = 1;
+            round->results[job.index].error = "Timed out waiting for the device";
+            round->results[job.index].elapsed = options.deadline;
+            return true;
+        };
+        auto kept = std::remove_if(running.begin(), running.end(), settled);
+        remaining -= static_cast<size_t>(running.end() - kept);
+        running.erase(kept, running.end());
+        round->finished.clear();
+    }
+
+    // Copied, not moved: abandoned jobs still check their flag under the lock
+    return round->results;
+}
+
+void to_json(json& j, const Stats& stats) {
+    j = json{{"min", stats.min}, {"max", stats.max}, {"p50", stats.p50}, {"p95", stats.p95}, {"n", stats.count}};
+}
+
+std::map<std::string, Stats> summarize(const std::vector<Result>& results) {
+    std::map<std::string, std::vector<double>> fields;
+    for (const auto& result : results) {
+        if (result.document) flatten(*result.document, "", fields);
+    }
+
+    std::map<std::string, Stats> summary;
+    for (auto& [path, values] : fields) {
+        std::sort(values.begin(), values.end());
+        summary[path] = {values.front(), values.back(), percentile(values, 50), percentile(values, 95), values.size()};
+    }
+    return summary;
+}
+
+} // namespace fleet
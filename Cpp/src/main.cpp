@@ -3,454 +3,626 @@
 #include "adb_utils.hpp"
 #include "parsers.hpp"
 #include "models.hpp"
+#include "builders.hpp"
+#include "collector.hpp"
+#include "snapshot.hpp"
+#include "sources.hpp"
+#include "ttl_cache.hpp"
+#include "sampler.hpp"
+#include "devices.hpp"
+#include "response.hpp"
+#include "delta.hpp"
+#include "metrics.hpp"
+#include "scheduler.hpp"
+#include "store.hpp"
+#include "events.hpp"
+#include "fleet.hpp"
+#include <algorithm>
+#include <functional>
+#include <set>
+#include <cstdlib>
 #include <iostream>
 #include <memory>
+#include <optional>
+#include <regex>
 #include <chrono>
 #include <iomanip>
 #include <sstream>
+#include <ctime>
 
 using json = nlohmann::json;
 
-// Cache with TTL
-struct CacheEntry {
-    std::string value;
-    std::chrono::system_clock::time_point timestamp;
-};
+// Per-builder budget for aggregate endpoints; sections that miss it are null
+constexpr std::chrono::milliseconds kBuilderDeadline{5000};
+
+// HTTP workers kept out of reach of device handlers, so /health,
+// /metrics and /devices are answered while every device is stuck
+constexpr size_t kReservedWorkers = 2;
 
-std::map<std::string, CacheEntry> cache;
+constexpr scheduler::Limit kDefaultLimit{4, std::chrono::milliseconds(5000)};
+
+// Idle stream connections get a comment line this often
+constexpr std::chrono::milliseconds kStreamKeepalive{15000};
 
 std::string get_iso_timestamp() {
     auto now = std::chrono::system_clock::now();
     auto time_t_now = std::chrono::system_clock::to_time_t(now);
     auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()) % 1000;
     
+    // gmtime's buffer is shared by every HTTP and sampler thread
+    std::tm utc{};
+    gmtime_r(&time_t_now, &utc);
     std::ostringstream ss;
-    ss << std::put_time(std::gmtime(&time_t_now), "%Y-%m-%dT%H:%M:%S");
+    ss << std::put_time(&utc, "%Y-%m-%dT%H:%M:%S");
     ss << '.' << std::setfill('0') << std::setw(6) << ms.count() * 1000;
     return ss.str();
 }
 
-bool is_cached_valid(const std::string& key, int ttl_seconds) {
-    auto it = cache.find(key);
-    if (it == cache.end()) return false;
+// Parse "key=value,key=value" from an environment variable
+std::vector<std::pair<std::string, std::string>> env_pairs(const char* name) {
+    std::vector<std::pair<std::string, std::string>> pairs;
+    const char* env = std::getenv(name);
+    if (!env) return pairs;
     
-    auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(
-        std::chrono::system_clock::now() - it->second.timestamp
-    );
-    return elapsed.count() < ttl_seconds;
-}
-
-std::string get_cached(const std::string& key) {
-    auto it = cache.find(key);
-    return it != cache.end() ? it->second.value : "";
-}
-
-void set_cached(const std::string& key, const std::string& value) {
-    cache[key] = {value, std::chrono::system_clock::now()};
-}
-
-// Builder functions
-DeviceInfo build_device_info() {
-    auto results = adb::shell_multi({
-        "getprop ro.product.model",
-        "getprop ro.product.manufacturer",
-        "getprop ro.build.version.release",
-        "getprop ro.build.version.sdk",
-        "getprop ro.hardware",
-        "getprop ro.board.platform"
-    });
-    
-    return DeviceInfo{
-        results[0],
-        results[1],
-        results[2],
-        results[3].empty() ? 0 : std::stoi(results[3]),
-        results[4],
-        results[5]
-    };
-}
-
-OSInfo build_os_info() {
-    auto results = adb::shell_multi({
-        "getprop ro.build.version.release",
-        "getprop ro.build.version.sdk",
-        "getprop ro.build.version.security_patch",
-        "getprop ro.build.display.id",
-        "uname -r"
-    });
-    
-    return OSInfo{
-        results[0],
-        results[1].empty() ? 0 : std::stoi(results[1]),
-        results[2],
-        results[3],
-        results[4]
-    };
-}
-
-CPUInfo build_cpu_info() {
-    auto results = adb::shell_multi({
-        "nproc",
-        "getprop ro.product.cpu.abi",
-        "getprop ro.product.cpu.abilist"
-    });
-    
-    int cores = results[0].empty() ? 0 : std::stoi(results[0]);
-    std::string abi = results[1];
-    
-    std::vector<std::string> abi_list;
-    std::istringstream iss(results[2]);
+    std::istringstream iss(env);
     std::string item;
     while (std::getline(iss, item, ',')) {
-        item.erase(0, item.find_first_not_of(" \t"));
-        item.erase(item.find_last_not_of(" \t") + 1);
-        if (!item.empty()) abi_list.push_back(item);
+        size_t eq = item.find('=');
+        if (eq == std::string::npos) continue;
+        pairs.emplace_back(item.substr(0, eq), item.substr(eq + 1));
     }
-    
-    std::map<std::string, std::string> arch_map = {
-        {"arm64-v8a", "ARMv8"},
-        {"armeabi-v7a", "ARMv7"},
-        {"x86_64", "x86-64"},
-        {"x86", "x86"}
+    return pairs;
+}
+
+// Default TTLs, overridable with ADB_INSIGHT_CACHE_TTL="key=ttl[:stale],..."
+void configure_cache(cache::TtlCache& cache) {
+    const std::map<std::string, int> defaults = {
+        {"device_info", 300},
+        {"os_info", 300},
+        {"cpu_info", 300},
+        {"cpu_governors", 300},
+        {"display_info", 300},
+        {"storage_mounts", 30},
+        {"network_info", 30}
     };
+    for (const auto& [key, ttl] : defaults) {
+        cache.configure(key, {std::chrono::seconds(ttl), std::chrono::seconds(ttl)});
+    }
     
-    std::string arch = arch_map.count(abi) ? arch_map[abi] : "Unknown";
-    
-    return CPUInfo{cores, abi, abi_list, arch};
+    for (const auto& [key, spec] : env_pairs("ADB_INSIGHT_CACHE_TTL")) {
+        try {
+            size_t colon = spec.find(':');
+            int ttl = std::stoi(spec.substr(0, colon));
+            int stale = colon == std::string::npos ? ttl : std::stoi(spec.substr(colon + 1));
+            cache.configure(key, {std::chrono::seconds(ttl), std::chrono::seconds(stale)});
+        } catch (...) {
+            std::cerr << "Ignoring invalid cache TTL: " << key << "=" << spec << "\n";
+        }
+    }
 }
 
-CPUFrequency build_cpu_frequency() {
-    std::string raw = adb::shell(
-        "for f in /sys/devices/system/cpu/cpu*/cpufreq/scaling_cur_freq; "
-        "do echo $f: $(cat $f); done"
-    );
-    
-    auto freq_data = parsers::parse_cpu_frequencies_detailed(raw);
+// Sample intervals, overridable with ADB_INSIGHT_SAMPLE_MS="metric=ms,..."
+sampler::Config sampler_config() {
+    sampler::Config config;
+    const std::map<std::string, std::chrono::milliseconds*> intervals = {
+        {"cpu_frequency", &config.cpu_frequency},
+        {"thermal", &config.thermal},
+        {"battery", &config.battery},
+        {"memory", &config.memory},
+        {"cpu_rates", &config.cpu_rates}
+    };
     
-    if (freq_data.error) {
-        throw std::runtime_error("Failed to parse CPU frequencies");
+    if (const char* agent = std::getenv("ADB_INSIGHT_AGENT")) {
+        config.agent_binary = agent;
     }
-    
-    int min_freq = freq_data.min_khz;
-    int max_freq = freq_data.max_khz;
-    
-    try {
-        std::string min_raw = adb::shell(
-            "for f in /sys/devices/system/cpu/cpu*/cpufreq/cpuinfo_min_freq; "
-            "do cat $f; done"
-        );
-        std::vector<int> min_freqs;
-        std::istringstream iss(min_raw);
-        std::string line;
-        while (std::getline(iss, line)) {
-            if (!line.empty() && std::all_of(line.begin(), line.end(), ::isdigit)) {
-                min_freqs.push_back(std::stoi(line));
-            }
-        }
-        if (!min_freqs.empty()) {
-            min_freq = *std::min_element(min_freqs.begin(), min_freqs.end());
+    if (const char* dir = std::getenv("ADB_INSIGHT_STORE")) {
+        config.store_dir = dir;
+    }
+    if (const char* hours = std::getenv("ADB_INSIGHT_STORE_RETENTION_H")) {
+        try {
+            config.store_retention = std::chrono::hours(std::stoi(hours));
+        } catch (...) {
+            std::cerr << "Ignoring invalid store retention: " << hours << "\n";
         }
-    } catch (...) {}
-    
-    try {
-        std::string max_raw = adb::shell(
-            "for f in /sys/devices/system/cpu/cpu*/cpufreq/cpuinfo_max_freq; "
-            "do cat $f; done"
-        );
-        std::vector<int> max_freqs;
-        std::istringstream iss(max_raw);
-        std::string line;
-        while (std::getline(iss, line)) {
-            if (!line.empty() && std::all_of(line.begin(), line.end(), ::isdigit)) {
-                max_freqs.push_back(std::stoi(line));
+    }
+
+    for (const auto& [key, spec] : env_pairs("ADB_INSIGHT_SAMPLE_MS")) {
+        try {
+            if (key == "history") {
+                config.history_size = std::stoul(spec);
+            } else if (key == "rates_window") {
+                config.rates_window = std::chrono::milliseconds(std::stoi(spec));
+            } else if (key == "adaptive") {
+                config.adaptive = std::stoi(spec) != 0;
+            } else if (key == "adb_budget_percent") {
+                config.adb_budget = std::stod(spec) / 100;
+            } else if (key == "low_observer") {
+                config.low_observer = std::stoi(spec) != 0;
+            } else if (intervals.count(key)) {
+                *intervals.at(key) = std::chrono::milliseconds(std::stoi(spec));
+            } else {
+                throw std::invalid_argument(key);
             }
+        } catch (...) {
+            std::cerr << "Ignoring invalid sample setting: " << key << "=" << spec << "\n";
         }
-        if (!max_freqs.empty()) {
-            max_freq = *std::max_element(max_freqs.begin(), max_freqs.end());
-        }
-    } catch (...) {}
-    
-    return CPUFrequency{
-        freq_data.per_core,
-        min_freq,
-        max_freq,
-        std::round((min_freq / 1000.0) * 100) / 100,
-        std::round((max_freq / 1000.0) * 100) / 100,
-        freq_data.avg_mhz,
-        freq_data.core_count
-    };
+    }
+    return config;
 }
 
-CPUGovernorInfo build_cpu_governors() {
-    std::string available_raw = adb::shell(
-        "cat /sys/devices/system/cpu/cpu0/cpufreq/scaling_available_governors"
-    );
-    std::vector<std::string> available;
-    std::istringstream iss(available_raw);
-    std::string governor;
-    while (iss >> governor) {
-        available.push_back(governor);
+// Device profiles: ADB_INSIGHT_PROFILE_DIR, set empty to keep them in memory
+std::string profile_dir() {
+    if (const char* dir = std::getenv("ADB_INSIGHT_PROFILE_DIR")) return dir;
+    const char* home = std::getenv("HOME");
+    return home ? std::string(home) + "/.cache/adb_insight/profiles" : "";
+}
+
+/**
+ * httplib's default worker pool, timing how long each accepted
+ * connection waits for a worker before its first request is read.
+ */
+class TimedTaskQueue : public httplib::TaskQueue {
+public:
+    TimedTaskQueue()
+        : pool_(CPPHTTPLIB_THREAD_POOL_COUNT),
+          delay_(metrics::histogram("adb_insight_http_queue_seconds",
+                                    "Time accepted connections wait for an HTTP worker thread")) {}
+
+    bool enqueue(std::function<void()> fn) override {
+        auto queued = std::chrono::steady_clock::now();
+        return pool_.enqueue([this, queued, fn = std::move(fn)] {
+            delay_.observe(std::chrono::steady_clock::now() - queued);
+            fn();
+        });
     }
-    
-    std::string raw = adb::shell(
-        "for f in /sys/devices/system/cpu/cpu*/cpufreq/scaling_governor; "
-        "do echo $f: $(cat $f); done"
-    );
-    
-    auto per_core = parsers::parse_path_value_block(raw);
-    
-    return CPUGovernorInfo{per_core, available};
+
+    void shutdown() override { pool_.shutdown(); }
+
+private:
+    httplib::ThreadPool pool_;
+    metrics::Histogram& delay_;
+};
+
+using DeviceHandler = std::function<void(devices::DeviceContext&, const httplib::Request&, httplib::Response&)>;
+
+// Budget per endpoint pattern, overridable with
+// ADB_INSIGHT_LIMITS="system=2:8000,battery=8,..." (concurrency[:deadline_ms]).
+// std::nullopt runs the handler on its HTTP thread.
+std::optional<scheduler::Limit> endpoint_limit(const std::string& pattern) {
+    static const auto limits = [] {
+        std::map<std::string, std::optional<scheduler::Limit>> limits = {
+            // Reads only the sampler's state and the cached device list
+            {"/health", std::nullopt},
+            {"/system", scheduler::Limit{2, kBuilderDeadline + std::chrono::milliseconds(2000)}},
+            // Holds its HTTP thread for as long as the client listens,
+            // admitted through stream_gate instead
+            {"/stream", std::nullopt}
+        };
+        for (const auto& [key, spec] : env_pairs("ADB_INSIGHT_LIMITS")) {
+            std::string pattern = "/" + key;
+            auto it = limits.find(pattern);
+            try {
+                if (it != limits.end() && !it->second) throw std::invalid_argument(key);
+                limits[pattern] = scheduler::parse_limit(spec, it != limits.end() ? *it->second : kDefaultLimit);
+            } catch (...) {
+                std::cerr << "Ignoring invalid limit: " << key << "=" << spec << "\n";
+            }
+        }
+        return limits;
+    }();
+    auto it = limits.find(pattern);
+    return it == limits.end() ? kDefaultLimit : it->second;
 }
 
-CPUIdleInfo build_cpu_idle_info() {
-    std::string raw = adb::shell(
-        "for cpu in /sys/devices/system/cpu/cpu[0-9]*; do "
-        "c=$(basename $cpu); "
-        "for s in $cpu/cpuidle/state*; do "
-        "st=$(basename $s); "
-        "name=$(cat $s/name 2>/dev/null); "
-        "time=$(cat $s/time 2>/dev/null); "
-        "usage=$(cat $s/usage 2>/dev/null); "
-        "echo $c $st $name $time $usage; "
-        "done; "
-        "done"
-    );
-    
-    auto per_core = parsers::parse_cpu_idle_output(raw);
-    return CPUIdleInfo{per_core};
+// HTTP workers that may wait on device handlers at once, server-wide
+scheduler::Gate& shared_gate() {
+    static scheduler::Gate gate(CPPHTTPLIB_THREAD_POOL_COUNT > kReservedWorkers
+                                    ? CPPHTTPLIB_THREAD_POOL_COUNT - kReservedWorkers : 1);
+    return gate;
 }
 
-MemoryInfo build_memory_info() {
-    std::string meminfo = adb::shell("cat /proc/meminfo");
-    std::map<std::string, double> data;
-    
-    std::istringstream iss(meminfo);
-    std::string line;
-    while (std::getline(iss, line)) {
-        if (line.find("MemTotal") != std::string::npos ||
-            line.find("MemAvailable") != std::string::npos ||
-            line.find("SwapTotal") != std::string::npos ||
-            line.find("SwapFree") != std::string::npos) {
-            
-            size_t pos = line.find(':');
-            if (pos != std::string::npos) {
-                std::string key = line.substr(0, pos);
-                std::string value_str = line.substr(pos + 1);
-                value_str.erase(0, value_str.find_first_not_of(" \t"));
-                std::istringstream val_stream(value_str);
-                std::string val;
-                val_stream >> val;
-                
-                if (!val.empty()) {
-                    key.erase(0, key.find_first_not_of(" \t"));
-                    key.erase(key.find_last_not_of(" \t") + 1);
-                    data[key] = parsers::kb_to_mb(val);
-                }
-            }
+// Open /stream connections, each holding an HTTP worker until its client
+// leaves: at most half of the shared workers, so dashboards cannot take
+// the ones device endpoints wait on
+scheduler::Gate& stream_gate() {
+    static scheduler::Gate gate(std::max<size_t>(1, shared_gate().capacity() / 2));
+    return gate;
+}
+
+/**
+ * One endpoint's handler and budget. The handler runs as a job on the
+ * device's I/O workers while the HTTP thread only waits for it, no
+ * longer than the deadline. A request refused by a gate or the I/O
+ * queue, or one whose job misses the deadline, is shed with 503 and
+ * Retry-After. A job that times out keeps running, so a cold cache
+ * entry is still filled for the next request.
+ */
+class Endpoint {
+public:
+    Endpoint(const std::string& pattern, DeviceHandler handler)
+        : handler_(std::move(handler)), limit_(endpoint_limit(pattern)) {
+        if (limit_) gate_ = std::make_unique<scheduler::Gate>(limit_->concurrency);
+        std::string labels = "route=\"" + metrics::label_value(pattern) + "\",reason=";
+        const char* help = "Requests answered 503 instead of waiting on a device";
+        shed_limit_ = &metrics::counter("adb_insight_http_shed_total", help, labels + "\"limit\"");
+        shed_queue_ = &metrics::counter("adb_insight_http_shed_total", help, labels + "\"queue\"");
+        shed_deadline_ = &metrics::counter("adb_insight_http_shed_total", help, labels + "\"deadline\"");
+    }
+
+    void serve(const std::regex& route, devices::DeviceContext& ctx, const httplib::Request& req,
+               httplib::Response& res) const {
+        if (!limit_) {
+            handler_(ctx, req, res);
+            return;
+        }
+
+        scheduler::Admission admission({gate_.get(), limit_->shared ? &shared_gate() : nullptr});
+        if (!admission) {
+            shed_limit_->inc();
+            shed(req, res, "Too many concurrent requests", std::chrono::seconds(1));
+            return;
         }
+
+        // The job owns its request and response: past the deadline this
+        // thread returns, and req/res go with it. Copied matches still
+        // point into req.path, so match again against the copy's own.
+        auto request = std::make_shared<httplib::Request>(req);
+        std::regex_match(request->path, request->matches, route);
+        auto response = std::make_shared<httplib::Response>();
+
+        auto done = ctx.io.try_submit([this, &ctx, request, response] {
+            handler_(ctx, *request, *response);
+        });
+        if (!done) {
+            shed_queue_->inc();
+            shed(req, res, "Device I/O queue is full", std::chrono::seconds(1));
+            return;
+        }
+        if (done->wait_until(std::chrono::steady_clock::now() + limit_->deadline) != std::future_status::ready) {
+            shed_deadline_->inc();
+            shed(req, res, "Timed out waiting for the device",
+                 std::chrono::duration_cast<std::chrono::seconds>(limit_->deadline) + std::chrono::seconds(1));
+            return;
+        }
+        done->get();
+
+        res.status = response->status;
+        res.headers.insert(response->headers.begin(), response->headers.end());
+        res.body = std::move(response->body);
+        // response::send streams through a content provider, which has to
+        // come along too. The releaser moves so that it runs only once.
+        res.content_length_ = response->content_length_;
+        res.content_provider_ = std::move(response->content_provider_);
+        res.content_provider_resource_releaser_ = std::move(response->content_provider_resource_releaser_);
+        response->content_provider_resource_releaser_ = nullptr;
+        res.is_chunked_content_provider_ = response->is_chunked_content_provider_;
     }
-    
-    double total = data.count("MemTotal") ? data["MemTotal"] : 0;
-    double available = data.count("MemAvailable") ? data["MemAvailable"] : 0;
-    double used = total - available;
-    double usage_percent = total > 0 ? std::round((used / total * 100) * 100) / 100 : 0;
-    
-    return MemoryInfo{
-        total,
-        available,
-        used,
-        usage_percent,
-        data.count("SwapTotal") ? data["SwapTotal"] : 0,
-        data.count("SwapFree") ? data["SwapFree"] : 0
-    };
-}
 
-StorageInfo build_storage_info() {
-    std::string output = adb::shell("df /data | tail -1");
-    std::istringstream iss(output);
-    
-    std::string filesystem;
-    int total_kb, used_kb, free_kb;
-    
-    if (!(iss >> filesystem >> total_kb >> used_kb >> free_kb)) {
-        throw std::runtime_error("Failed to parse storage info");
+private:
+    static void shed(const httplib::Request& req, httplib::Response& res, const std::string& message,
+                     std::chrono::seconds retry_after) {
+        res.set_header("Retry-After", std::to_string(retry_after.count()));
+        response::send_error(req, res, message, 503);
     }
-    
-    double usage_percent = total_kb > 0 ? std::round((used_kb / (double)total_kb * 100) * 100) / 100 : 0;
-    
-    return StorageInfo{
-        filesystem,
-        parsers::kb_to_gb(total_kb),
-        parsers::kb_to_gb(used_kb),
-        parsers::kb_to_gb(free_kb),
-        usage_percent
-    };
-}
 
-std::vector<MountInfo> build_storage_mounts() {
-    std::string raw = adb::shell("df -k");
-    return parsers::parse_df_output(raw);
+    DeviceHandler handler_;
+    std::optional<scheduler::Limit> limit_;
+    std::unique_ptr<scheduler::Gate> gate_;
+    metrics::Counter* shed_limit_;
+    metrics::Counter* shed_queue_;
+    metrics::Counter* shed_deadline_;
+};
+
+// Register a device endpoint both unprefixed (default device) and
+// under /devices/<serial>/. Capture groups in pattern come after the serial.
+void route(httplib::Server& svr, devices::Registry& registry, const std::string& pattern, DeviceHandler handler) {
+    auto& latency = metrics::histogram("adb_insight_http_request_seconds", "Time spent handling HTTP requests",
+                                       "route=\"" + metrics::label_value(pattern) + "\"");
+    auto endpoint = std::make_shared<const Endpoint>(pattern, std::move(handler));
+    auto plain = std::make_shared<const std::regex>(pattern);
+    auto prefixed = std::make_shared<const std::regex>("/devices/([^/]+)" + pattern);
+
+    svr.Get(pattern, [&registry, &latency, endpoint, plain](const httplib::Request& req, httplib::Response& res) {
+        metrics::Timer timer(latency);
+        endpoint->serve(*plain, registry.default_device(), req, res);
+    });
+    svr.Get("/devices/([^/]+)" + pattern, [&registry, &latency, endpoint, prefixed](const httplib::Request& req, httplib::Response& res) {
+        metrics::Timer timer(latency);
+        std::string serial = req.matches[1];
+        auto* context = registry.find(serial);
+        if (!context) {
+            response::send_error(req, res, "Device not attached: " + serial, 404);
+            return;
+        }
+        endpoint->serve(*prefixed, *context, req, res);
+    });
 }
 
-BatteryInfo build_battery_info() {
-    std::string raw = adb::shell("dumpsys battery");
-    auto battery_data = parsers::parse_key_value_block(raw);
-    auto battery = parsers::parse_battery_level(battery_data);
-    
-    return BatteryInfo{
-        battery.level,
-        battery.health,
-        battery.status,
-        battery.voltage_mv,
-        battery.temperature_c,
-        battery.technology,
-        battery.is_charging
+// Sections that only change with an OTA, kept in each device's profile.
+// cpu_governors stays out: governors are switched at runtime.
+const std::map<std::string, std::function<json(devices::DeviceContext&)>>& static_sections() {
+    using devices::DeviceContext;
+    static const std::map<std::string, std::function<json(DeviceContext&)>> sections = {
+        {"device_info", [](DeviceContext& ctx) { return json(device_info_from(*ctx.props.get(ctx.adb))); }},
+        {"os_info", [](DeviceContext& ctx) { return json(build_os_info(ctx.adb, *ctx.props.get(ctx.adb))); }},
+        {"cpu_info", [](DeviceContext& ctx) { return json(build_cpu_info(ctx.adb, *ctx.props.get(ctx.adb))); }},
+        {"display_info", [](DeviceContext& ctx) { return json(build_display_info(ctx.adb)); }}
     };
+    return sections;
 }
 
-PowerInfo build_power_info() {
-    std::string raw = adb::shell("dumpsys battery");
-    auto battery_data = parsers::parse_key_value_block(raw);
-    return parsers::parse_power_info(battery_data);
+// A static section through the response cache, then the device profile
+payload::PayloadPtr static_section(devices::DeviceContext& ctx, const std::string& key) {
+    const auto& build = static_sections().at(key);
+    return ctx.cache.get_or_build(key, [&] {
+        return ctx.profile.get_or_build(key, [&] { return build(ctx); });
+    });
 }
 
-ThermalInfo build_thermal_info() {
-    std::string raw = adb::shell("dumpsys thermalservice");
-    auto temps = parsers::parse_thermal_data(raw);
-    
-    if (temps.empty()) {
-        throw std::runtime_error("Failed to parse thermal data");
-    }
-    
-    std::map<std::string, double> simple_temps;
-    std::vector<double> temp_values;
-    
-    for (const auto& [name, data] : temps) {
-        double value = data.at("value");
-        simple_temps[name] = value;
-        temp_values.push_back(value);
-    }
-    
-    double max_temp = !temp_values.empty() ? *std::max_element(temp_values.begin(), temp_values.end()) : 0;
-    double min_temp = !temp_values.empty() ? *std::min_element(temp_values.begin(), temp_values.end()) : 0;
-    
-    return ThermalInfo{simple_temps, max_temp, min_temp};
+template <typename T>
+T static_model(devices::DeviceContext& ctx, const std::string& key) {
+    const auto& build = static_sections().at(key);
+    T model;
+    ctx.profile.document(key, [&] { return build(ctx); })->get_to(model);
+    return model;
 }
 
-CoreTemperatures build_core_temperatures() {
-    std::string raw = adb::shell("dumpsys thermalservice");
-    auto temps = parsers::parse_thermal_data(raw);
-    
-    std::map<std::string, double> per_core;
-    std::regex cpu_regex(R"(^cpu\d+$)");
-    
-    for (const auto& [name, data] : temps) {
-        std::string lower_name = name;
-        std::transform(lower_name.begin(), lower_name.end(), lower_name.begin(), ::tolower);
-        if (std::regex_match(lower_name, cpu_regex)) {
-            per_core[lower_name] = data.at("value");
+/**
+ * Fill a new context's cache before its first request. Persisted
+ * sections cost one identity check; the rest are built.
+ */
+void warm_up(devices::DeviceContext& ctx) {
+    for (const auto& [key, build] : static_sections()) {
+        try {
+            static_section(ctx, key);
+        } catch (const std::exception& e) {
+            std::cerr << "Warm-up of " << key << " failed: " << e.what() << "\n";
         }
     }
-    
-    return CoreTemperatures{
-        per_core,
-        "thermalservice",
-        !per_core.empty()
-    };
+    try {
+        ctx.cache.get_or_build("cpu_governors", [&ctx] {
+            return payload::make(build_cpu_governors(ctx.adb));
+        });
+    } catch (const std::exception& e) {
+        std::cerr << "Warm-up of cpu_governors failed: " << e.what() << "\n";
+    }
 }
 
-NetworkInfo build_network_info() {
-    auto results = adb::shell_multi({
-        "getprop net.hostname",
-        "getprop dhcp.wlan0.ipaddress",
-        "getprop gsm.operator.alpha",
-        "getprop gsm.network.type",
-        "getprop gsm.data.state"
+/**
+ * Every /system section, built in parallel on the device's workers.
+ * A section that fails, misses kBuilderDeadline or finds the builder
+ * queue full is left empty, so builds abandoned by earlier requests
+ * cannot pile up behind a hung device.
+ */
+SystemInfo collect_system(devices::DeviceContext& ctx) {
+    auto& pool = ctx.workers;
+    auto deadline = collector::clock::now() + kBuilderDeadline;
+    
+    // All sysfs/procfs sections come from one snapshot round-trip,
+    // and dumpsys battery/thermalservice run once for all builders
+    auto shared = ctx.dumpsys();
+    auto snap = pool.try_submit([&ctx] {
+        return snapshot::capture(ctx.adb, snapshot::CpuFrequency | snapshot::CpuGovernor |
+                                          snapshot::CpuIdle | snapshot::MemInfo);
     });
-    
-    std::string wifi_ip = results[1];
-    if (wifi_ip.empty()) {
+    auto device = pool.try_submit([&ctx] { return static_model<DeviceInfo>(ctx, "device_info"); });
+    auto os = pool.try_submit([&ctx] { return static_model<OSInfo>(ctx, "os_info"); });
+    auto cpu = pool.try_submit([&ctx] { return static_model<CPUInfo>(ctx, "cpu_info"); });
+    auto storage = pool.try_submit([&ctx] { return build_storage_info(ctx.adb); });
+    auto mounts = pool.try_submit([&ctx] { return build_storage_mounts(ctx.adb); });
+    auto battery = pool.try_submit([shared] { return build_battery_info(*shared); });
+    auto power = pool.try_submit([shared] { return build_power_info(*shared); });
+    auto thermal = pool.try_submit([shared] { return build_thermal_info(*shared); });
+    auto core_temps = pool.try_submit([shared] { return build_core_temperatures(*shared); });
+    auto network = pool.try_submit([&ctx] { return build_network_info(ctx.adb, *ctx.props.get(ctx.adb)); });
+    auto display = pool.try_submit([&ctx] { return static_model<DisplayInfo>(ctx, "display_info"); });
+    
+    SystemInfo system;
+    system.device = collector::await(device, deadline, "device");
+    system.os = collector::await(os, deadline, "os");
+    system.cpu = collector::await(cpu, deadline, "cpu");
+    if (auto sysfs = collector::await(snap, deadline, "snapshot")) {
+        system.cpu_frequency = collector::attempt([&] { return cpu_frequency_from(*sysfs); }, "cpu_frequency");
+        system.cpu_governors = collector::attempt([&] { return cpu_governors_from(*sysfs); }, "cpu_governors");
+        system.cpu_idle = collector::attempt([&] { return cpu_idle_info_from(*sysfs); }, "cpu_idle");
+        system.memory = collector::attempt([&] { return memory_info_from(*sysfs); }, "memory");
+    }
+    system.storage = collector::await(storage, deadline, "storage");
+    system.mounts = collector::await(mounts, deadline, "mounts");
+    system.battery = collector::await(battery, deadline, "battery");
+    system.power = collector::await(power, deadline, "power");
+    system.thermal = collector::await(thermal, deadline, "thermal");
+    system.core_temperatures = collector::await(core_temps, deadline, "core_temperatures");
+    system.network = collector::await(network, deadline, "network");
+    system.display = collector::await(display, deadline, "display");
+    system.timestamp = get_iso_timestamp();
+    return system;
+}
+
+// /fleet requests collecting at once; each holds its HTTP thread throughout
+constexpr size_t kFleetRequests = 2;
+
+fleet::Options fleet_options() {
+    fleet::Options options;
+    options.deadline = kBuilderDeadline + std::chrono::milliseconds(2000);
+    for (const auto& [key, spec] : env_pairs("ADB_INSIGHT_FLEET")) {
         try {
-            std::string ip_out = adb::shell("ip -f inet addr show wlan0 | grep inet | awk '{print $2}' | head -n 1");
-            size_t slash_pos = ip_out.find('/');
-            if (slash_pos != std::string::npos) {
-                wifi_ip = ip_out.substr(0, slash_pos);
+            if (key == "concurrency") {
+                options.concurrency = std::stoul(spec);
+            } else if (key == "deadline") {
+                options.deadline = std::chrono::milliseconds(std::stoi(spec));
+            } else {
+                throw std::invalid_argument(key);
             }
-        } catch (...) {}
+        } catch (...) {
+            std::cerr << "Ignoring invalid fleet setting: " << key << "=" << spec << "\n";
+        }
     }
-    
-    return NetworkInfo{
-        results[0].empty() ? "android" : results[0],
-        wifi_ip.empty() ? std::nullopt : std::optional<std::string>(wifi_ip),
-        std::nullopt,
-        results[2].empty() ? std::nullopt : std::optional<std::string>(results[2]),
-        results[3].empty() ? std::nullopt : std::optional<std::string>(results[3]),
-        results[4].empty() ? std::nullopt : std::optional<std::string>(results[4])
+    return options;
+}
+
+/**
+ * One device's document for /fleet/<metric>. Sampled metrics use the
+ * sampler's fresh sample when there is one, as their own endpoints do.
+ */
+const fleet::Fetch* fleet_fetch(const std::string& metric) {
+    using devices::DeviceContext;
+    static const std::map<std::string, fleet::Fetch> fetches = {
+        {"system", [](DeviceContext& ctx) { return json(collect_system(ctx)); }},
+        {"cpu_frequency", [](DeviceContext& ctx) {
+            if (auto sample = ctx.sampler.cpu_frequency()) return json(*sample);
+            return json(build_cpu_frequency(ctx.adb));
+        }},
+        {"cpu_rates", [](DeviceContext& ctx) {
+            auto sample = ctx.sampler.cpu_rates();
+            if (!sample) throw std::runtime_error("CPU rates not sampled yet");
+            return json(*sample);
+        }},
+        {"thermal", [](DeviceContext& ctx) {
+            if (auto sample = ctx.sampler.thermal()) return json(*sample);
+            return json(build_thermal_info(*ctx.dumpsys()));
+        }},
+        {"battery", [](DeviceContext& ctx) {
+            if (auto sample = ctx.sampler.battery()) return json(*sample);
+            return json(build_battery_info(*ctx.dumpsys()));
+        }},
+        {"memory", [](DeviceContext& ctx) {
+            if (auto sample = ctx.sampler.memory()) return json(*sample);
+            return json(build_memory_info(ctx.adb));
+        }},
+        {"power", [](DeviceContext& ctx) { return json(build_power_info(*ctx.dumpsys())); }},
+        {"storage", [](DeviceContext& ctx) { return json(build_storage_info(ctx.adb)); }},
+        {"uptime", [](DeviceContext& ctx) { return json(build_uptime_info(ctx.adb)); }},
+        {"device", [](DeviceContext& ctx) { return json(static_model<DeviceInfo>(ctx, "device_info")); }},
+        {"os", [](DeviceContext& ctx) { return json(static_model<OSInfo>(ctx, "os_info")); }}
     };
+    auto it = fetches.find(metric);
+    return it == fetches.end() ? nullptr : &it->second;
 }
 
-DisplayInfo build_display_info() {
-    std::string size_out = adb::shell("wm size | head -n 1");
-    std::string density_out = adb::shell("wm density | head -n 1");
-    
-    std::string size_px = "unknown";
-    if (size_out.find(':') != std::string::npos) {
-        size_px = size_out.substr(size_out.find(':') + 1);
-        size_px.erase(0, size_px.find_first_not_of(" \t"));
+// Raw points per series from a /history range query without step
+constexpr size_t kMaxStoredPoints = 10000;
+constexpr size_t kMaxEvents = 1000;
+// /processes without ?limit=
+constexpr size_t kDefaultProcesses = 20;
+
+void send_stored_history(devices::DeviceContext& ctx, const httplib::Request& req, httplib::Response& res) {
+    const store::Store* history = ctx.sampler.store();
+    if (!history) {
+        response::send_error(req, res, "History store is disabled; set ADB_INSIGHT_STORE", 404);
+        return;
     }
-    
-    int density_dpi = 0;
-    if (density_out.find(':') != std::string::npos) {
-        std::string density_str = density_out.substr(density_out.find(':') + 1);
-        density_str.erase(0, density_str.find_first_not_of(" \t"));
-        std::istringstream iss(density_str);
-        iss >> density_dpi;
+    try {
+        std::string metric = req.matches[req.matches.size() - 1];
+        int64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        int64_t to = req.has_param("to") ? std::stoll(req.get_param_value("to")) : now_ms + 1;
+        int64_t from = req.has_param("from") ? std::stoll(req.get_param_value("from")) : to - 3600 * 1000;
+        std::optional<int64_t> step;
+        if (req.has_param("step")) step = std::stoll(req.get_param_value("step"));
+
+        json series = json::object();
+        bool truncated = false;
+        for (const auto& name : history->series(metric)) {
+            json samples = json::array();
+            if (step) {
+                for (const auto& bucket : history->downsample(metric, name, from, to, *step)) {
+                    samples.push_back({{"t", bucket.t_ms}, {"min", bucket.min}, {"max", bucket.max},
+                                       {"avg", bucket.avg}, {"n", bucket.count}});
+                }
+            } else {
+                bool cut = false;
+                for (const auto& point : history->points(metric, name, from, to, kMaxStoredPoints, &cut)) {
+                    samples.push_back({{"t", point.t_ms}, {"v", point.value}});
+                }
+                truncated = truncated || cut;
+            }
+            series[name] = samples;
+        }
+
+        json j;
+        j["metric"] = metric;
+        j["from"] = from;
+        j["to"] = to;
+        if (step) j["step"] = *step;
+        else j["truncated"] = truncated;
+        j["series"] = series;
+        response::send(req, res, j);
+    } catch (const std::exception& e) {
+        response::send_error(req, res, e.what(), 400);
     }
-    
-    return DisplayInfo{size_px, density_dpi};
 }
 
-UptimeInfo build_uptime_info() {
-    std::string result = adb::shell("cat /proc/uptime");
-    int uptime_seconds = (int)std::stod(result.substr(0, result.find(' ')));
-    
-    int days = uptime_seconds / 86400;
-    int hours = (uptime_seconds % 86400) / 3600;
-    int minutes = (uptime_seconds % 3600) / 60;
-    int seconds = uptime_seconds % 60;
-    
-    std::string formatted;
-    if (days > 0) {
-        formatted = std::to_string(days) + "d " + std::to_string(hours) + "h " +
-                   std::to_string(minutes) + "m " + std::to_string(seconds) + "s";
-    } else if (hours > 0) {
-        formatted = std::to_string(hours) + "h " + std::to_string(minutes) + "m " +
-                   std::to_string(seconds) + "s";
-    } else {
-        formatted = std::to_string(minutes) + "m " + std::to_string(seconds) + "s";
+// How old the device list behind /health may get
+constexpr std::chrono::seconds kDeviceListAge{2};
+
+/**
+ * adb's attached serials for /health, which answers on its HTTP thread.
+ * A stale list is refreshed on a background worker while callers keep
+ * the previous one, so a slow adb server never holds them.
+ */
+class DeviceList {
+public:
+    std::vector<std::string> get() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!refreshing_ && std::chrono::steady_clock::now() - listed_at_ >= kDeviceListAge) {
+            refreshing_ = refresher_.try_submit([this] { refresh(); }).has_value();
+        }
+        return serials_;
     }
-    
-    auto now = std::chrono::system_clock::now();
-    auto boot_time = now - std::chrono::seconds(uptime_seconds);
-    auto boot_time_t = std::chrono::system_clock::to_time_t(boot_time);
-    auto ms = std::chrono::duration_cast<std::chrono::microseconds>(boot_time.time_since_epoch()) % 1000000;
-    
-    std::ostringstream boot_ss;
-    boot_ss << std::put_time(std::localtime(&boot_time_t), "%Y-%m-%dT%H:%M:%S");
-    boot_ss << "." << std::setfill('0') << std::setw(6) << ms.count();
-    
-    return UptimeInfo{uptime_seconds, formatted, boot_ss.str()};
+
+    void refresh() {
+        std::vector<std::string> serials;
+        try {
+            serials = adb::attached_serials();
+        } catch (const std::exception& e) {
+            std::cerr << "Listing devices failed: " << e.what() << "\n";
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        serials_ = std::move(serials);
+        listed_at_ = std::chrono::steady_clock::now();
+        refreshing_ = false;
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<std::string> serials_;
+    std::chrono::steady_clock::time_point listed_at_{};
+    bool refreshing_ = false;
+    // Last, so its thread is joined before the state it writes goes away
+    collector::WorkerPool refresher_{1, 1};
+};
+
+DeviceList& device_list() {
+    static DeviceList list;
+    return list;
 }
 
 int main() {
+    devices::Settings settings;
+    settings.sampler = sampler_config();
+    settings.configure_cache = configure_cache;
+    settings.profile_dir = profile_dir();
+    settings.warm_up = warm_up;
+    settings.collect_system = collect_system;
+    devices::Registry registry(settings);
+    
+    // Start sampling the default device right away
+    registry.default_device();
+    device_list().refresh();
+    
     httplib::Server svr;
+    svr.new_task_queue = [] { return new TimedTaskQueue(); };
     
     // CORS middleware
     svr.set_post_routing_handler([](const httplib::Request&, httplib::Response& res) {
         res.set_header("Access-Control-Allow-Origin", "*");
         res.set_header("Access-Control-Allow-Methods", "GET, POST, PUT, DELETE, OPTIONS");
         res.set_header("Access-Control-Allow-Headers", "*");
-        res.set_header("Content-Type", "application/json");
+        res.set_header("Access-Control-Expose-Headers", "ETag, X-System-Version, Retry-After");
+        if (!res.has_header("Content-Type")) {
+            res.set_header("Content-Type", "application/json");
+        }
     });
     
     svr.Options(".*", [](const httplib::Request&, httplib::Response& res) {
@@ -460,45 +632,68 @@ int main() {
     });
     
     // ============ HEALTH ============
-    svr.Get("/health", [](const httplib::Request&, httplib::Response& res) {
+    route(svr, registry, "/health", [](devices::DeviceContext& ctx, const httplib::Request& req, httplib::Response& res) {
         try {
-            auto devices_output = adb::devices();
-            bool is_connected = false;
+            auto serials = device_list().get();
+            const std::string& serial = ctx.adb.serial();
+            bool is_connected = serial.empty()
+                ? !serials.empty()
+                : std::find(serials.begin(), serials.end(), serial) != serials.end();
             
-            if (devices_output) {
-                std::istringstream iss(*devices_output);
-                std::string line;
-                while (std::getline(iss, line)) {
-                    std::istringstream line_stream(line);
-                    std::string device, status;
-                    if (line_stream >> device >> status && status == "device") {
-                        is_connected = true;
-                        break;
-                    }
-                }
-            }
+            json j;
+            j["status"] = is_connected ? "healthy" : "degraded";
+            j["adb_connected"] = is_connected;
             
-            json response;
-            response["status"] = is_connected ? "healthy" : "degraded";
-            response["adb_connected"] = is_connected;
-            response["timestamp"] = get_iso_timestamp();
+            json intervals;
+            for (const auto& [metric, interval] : ctx.sampler.intervals()) intervals[metric] = interval.count();
+            auto overhead = ctx.sampler.overhead();
+            auto cost_json = [](const adb::ShellCost& cost) {
+                return json{{"cpu_ms", cost.cpu_ms}, {"context_switches", cost.context_switches},
+                            {"processes", cost.processes}};
+            };
+            j["sampling"] = {
+                {"intervals_ms", intervals},
+                {"adb_duty", ctx.sampler.adb_duty()},
+                {"low_observer", ctx.sampler.low_observer()},
+                {"device_cost", {
+                    {"last_cycle", cost_json(overhead.last_cycle)},
+                    {"total", cost_json(overhead.total)},
+                    {"cycles", overhead.cycles}
+                }}
+            };
+            j["timestamp"] = get_iso_timestamp();
             
-            res.set_content(response.dump(2), "application/json");
+            response::send(req, res, j);
         } catch (const std::exception& e) {
-            json error;
-            error["error"] = e.what();
-            res.set_content(error.dump(2), "application/json");
-            res.status = 503;
+            response::send_error(req, res, e.what(), 503);
+        }
+    });
+    
+    // ============ DEVICES ============
+    svr.Get("/devices", [](const httplib::Request& req, httplib::Response& res) {
+        json list = json::array();
+        for (const auto& serial : adb::attached_serials()) {
+            list.push_back({{"serial", serial}, {"prefix", "/devices/" + serial}});
         }
+        
+        json j;
+        j["devices"] = list;
+        j["timestamp"] = get_iso_timestamp();
+        response::send(req, res, j);
+    });
+    
+    // ============ METRICS ============
+    svr.Get("/metrics", [](const httplib::Request&, httplib::Response& res) {
+        res.set_content(metrics::render(), "text/plain; version=0.0.4; charset=utf-8");
     });
     
     // ============ ROOT ============
-    svr.Get("/", [](const httplib::Request&, httplib::Response& res) {
-        json response;
-        response["app"] = "DroidMetrics";
-        response["by"] = "bluecape";
-        response["version"] = "2.0.0";
-        response["endpoints"] = {
+    svr.Get("/", [](const httplib::Request& req, httplib::Response& res) {
+        json j;
+        j["app"] = "DroidMetrics";
+        j["by"] = "bluecape";
+        j["version"] = "2.0.0";
+        j["endpoints"] = {
             {"health", "/health"},
             {"device", "/device"},
             {"os", "/os"},
@@ -506,6 +701,7 @@ int main() {
             {"cpu_frequency", "/cpu/frequency"},
             {"cpu_governors", "/cpu/governors"},
             {"cpu_idle", "/cpu/idle"},
+            {"cpu_rates", "/cpu/rates"},
             {"memory", "/memory"},
             {"storage", "/storage"},
             {"mounts", "/storage/mounts"},
@@ -514,325 +710,449 @@ int main() {
             {"thermal", "/thermal"},
             {"core_temperatures", "/thermal/cores"},
             {"network", "/network"},
+            {"props", "/props"},
+            {"processes", "/processes"},
             {"display", "/display"},
             {"uptime", "/uptime"},
-            {"system", "/system"}
+            {"system", "/system"},
+            {"system_delta", "/system?since={version}"},
+            {"history", "/history/{metric}?since={epoch_ms}"},
+            {"events", "/events?since={id}"},
+            {"stream", "/stream?metrics={cpu_frequency,thermal,battery,memory,cpu_rates,events}"},
+            {"devices", "/devices"},
+            {"per_device", "/devices/{serial}/{endpoint}"},
+            {"fleet", "/fleet/{system,cpu_frequency,thermal,battery,memory,...}?summary=1&fields={prefixes}"},
+            {"metrics", "/metrics"}
         };
-        response["timestamp"] = get_iso_timestamp();
+        j["timestamp"] = get_iso_timestamp();
         
-        res.set_content(response.dump(2), "application/json");
+        response::send(req, res, j);
     });
     
     // ============ DEVICE ============
-    svr.Get("/device", [](const httplib::Request&, httplib::Response& res) {
+    route(svr, registry, "/device", [](devices::DeviceContext& ctx, const httplib::Request& req, httplib::Response& res) {
         try {
-            if (is_cached_valid("device_info", 300)) {
-                res.set_content(get_cached("device_info"), "application/json");
-                return;
-            }
-            
-            auto device = build_device_info();
-            json j = device;
-            std::string content = j.dump(2);
-            set_cached("device_info", content);
-            res.set_content(content, "application/json");
+            auto content = static_section(ctx, "device_info");
+            response::send(req, res, *content);
         } catch (const std::exception& e) {
-            json error;
-            error["error"] = e.what();
-            res.set_content(error.dump(2), "application/json");
-            res.status = 500;
+            response::send_error(req, res, e.what(), 500);
         }
     });
     
     // ============ OS ============
-    svr.Get("/os", [](const httplib::Request&, httplib::Response& res) {
+    route(svr, registry, "/os", [](devices::DeviceContext& ctx, const httplib::Request& req, httplib::Response& res) {
         try {
-            if (is_cached_valid("os_info", 300)) {
-                res.set_content(get_cached("os_info"), "application/json");
-                return;
-            }
-            
-            auto os = build_os_info();
-            json j = os;
-            std::string content = j.dump(2);
-            set_cached("os_info", content);
-            res.set_content(content, "application/json");
+            auto content = static_section(ctx, "os_info");
+            response::send(req, res, *content);
         } catch (const std::exception& e) {
-            json error;
-            error["error"] = e.what();
-            res.set_content(error.dump(2), "application/json");
-            res.status = 500;
+            response::send_error(req, res, e.what(), 500);
         }
     });
     
     // ============ CPU ============
-    svr.Get("/cpu", [](const httplib::Request&, httplib::Response& res) {
+    route(svr, registry, "/cpu", [](devices::DeviceContext& ctx, const httplib::Request& req, httplib::Response& res) {
         try {
-            if (is_cached_valid("cpu_info", 300)) {
-                res.set_content(get_cached("cpu_info"), "application/json");
-                return;
-            }
-            
-            auto cpu = build_cpu_info();
-            json j = cpu;
-            std::string content = j.dump(2);
-            set_cached("cpu_info", content);
-            res.set_content(content, "application/json");
+            auto content = static_section(ctx, "cpu_info");
+            response::send(req, res, *content);
         } catch (const std::exception& e) {
-            json error;
-            error["error"] = e.what();
-            res.set_content(error.dump(2), "application/json");
-            res.status = 500;
+            response::send_error(req, res, e.what(), 500);
         }
     });
     
     // ============ CPU FREQUENCY ============
-    svr.Get("/cpu/frequency", [](const httplib::Request&, httplib::Response& res) {
+    route(svr, registry, "/cpu/frequency", [](devices::DeviceContext& ctx, const httplib::Request& req, httplib::Response& res) {
         try {
-            auto cpu_freq = build_cpu_frequency();
-            json j = cpu_freq;
-            res.set_content(j.dump(2), "application/json");
+            if (auto sample = ctx.sampler.latest("cpu_frequency")) {
+                response::send(req, res, *sample);
+            } else {
+                response::send(req, res, build_cpu_frequency(ctx.adb));
+            }
         } catch (const std::exception& e) {
-            json error;
-            error["error"] = e.what();
-            res.set_content(error.dump(2), "application/json");
-            res.status = 500;
+            response::send_error(req, res, e.what(), 500);
         }
     });
     
     // ============ CPU GOVERNORS ============
-    svr.Get("/cpu/governors", [](const httplib::Request&, httplib::Response& res) {
+    route(svr, registry, "/cpu/governors", [](devices::DeviceContext& ctx, const httplib::Request& req, httplib::Response& res) {
         try {
-            if (is_cached_valid("cpu_governors", 300)) {
-                res.set_content(get_cached("cpu_governors"), "application/json");
-                return;
-            }
-            
-            auto cpu_gov = build_cpu_governors();
-            json j = cpu_gov;
-            std::string content = j.dump(2);
-            set_cached("cpu_governors", content);
-            res.set_content(content, "application/json");
+            auto content = ctx.cache.get_or_build("cpu_governors", [&ctx] {
+                return payload::make(build_cpu_governors(ctx.adb));
+            });
+            response::send(req, res, *content);
         } catch (const std::exception& e) {
-            json error;
-            error["error"] = e.what();
-            res.set_content(error.dump(2), "application/json");
-            res.status = 500;
+            response::send_error(req, res, e.what(), 500);
         }
     });
     
     // ============ CPU IDLE ============
-    svr.Get("/cpu/idle", [](const httplib::Request&, httplib::Response& res) {
+    route(svr, registry, "/cpu/idle", [](devices::DeviceContext& ctx, const httplib::Request& req, httplib::Response& res) {
         try {
-            auto cpu_idle = build_cpu_idle_info();
-            json j = cpu_idle;
-            res.set_content(j.dump(2), "application/json");
+            response::send(req, res, build_cpu_idle_info(ctx.adb));
         } catch (const std::exception& e) {
-            json error;
-            error["error"] = e.what();
-            res.set_content(error.dump(2), "application/json");
-            res.status = 500;
+            response::send_error(req, res, e.what(), 500);
+        }
+    });
+    
+    // ============ CPU RATES ============
+    route(svr, registry, "/cpu/rates", [](devices::DeviceContext& ctx, const httplib::Request& req, httplib::Response& res) {
+        // Rates need two samples, so there is no live fallback
+        if (auto sample = ctx.sampler.latest("cpu_rates")) {
+            response::send(req, res, *sample);
+        } else {
+            response::send_error(req, res, "CPU rates not sampled yet", 503);
         }
     });
     
     // ============ MEMORY ============
-    svr.Get("/memory", [](const httplib::Request&, httplib::Response& res) {
+    route(svr, registry, "/memory", [](devices::DeviceContext& ctx, const httplib::Request& req, httplib::Response& res) {
         try {
-            auto memory = build_memory_info();
-            json j = memory;
-            res.set_content(j.dump(2), "application/json");
+            if (auto sample = ctx.sampler.latest("memory")) {
+                response::send(req, res, *sample);
+            } else {
+                response::send(req, res, build_memory_info(ctx.adb));
+            }
         } catch (const std::exception& e) {
-            json error;
-            error["error"] = e.what();
-            res.set_content(error.dump(2), "application/json");
-            res.status = 500;
+            response::send_error(req, res, e.what(), 500);
         }
     });
     
     // ============ STORAGE ============
-    svr.Get("/storage", [](const httplib::Request&, httplib::Response& res) {
+    route(svr, registry, "/storage", [](devices::DeviceContext& ctx, const httplib::Request& req, httplib::Response& res) {
         try {
-            auto storage = build_storage_info();
-            json j = storage;
-            res.set_content(j.dump(2), "application/json");
+            response::send(req, res, build_storage_info(ctx.adb));
         } catch (const std::exception& e) {
-            json error;
-            error["error"] = e.what();
-            res.set_content(error.dump(2), "application/json");
-            res.status = 500;
+            response::send_error(req, res, e.what(), 500);
         }
     });
     
     // ============ MOUNTS ============
-    svr.Get("/storage/mounts", [](const httplib::Request&, httplib::Response& res) {
+    route(svr, registry, "/storage/mounts", [](devices::DeviceContext& ctx, const httplib::Request& req, httplib::Response& res) {
         try {
-            if (is_cached_valid("storage_mounts", 30)) {
-                res.set_content(get_cached("storage_mounts"), "application/json");
-                return;
-            }
-            
-            auto mounts = build_storage_mounts();
-            json j = mounts;
-            std::string content = j.dump(2);
-            set_cached("storage_mounts", content);
-            res.set_content(content, "application/json");
+            auto content = ctx.cache.get_or_build("storage_mounts", [&ctx] {
+                return payload::make(build_storage_mounts(ctx.adb));
+            });
+            response::send(req, res, *content);
         } catch (const std::exception& e) {
-            json error;
-            error["error"] = e.what();
-            res.set_content(error.dump(2), "application/json");
-            res.status = 500;
+            response::send_error(req, res, e.what(), 500);
         }
     });
     
     // ============ BATTERY ============
-    svr.Get("/battery", [](const httplib::Request&, httplib::Response& res) {
+    route(svr, registry, "/battery", [](devices::DeviceContext& ctx, const httplib::Request& req, httplib::Response& res) {
         try {
-            auto battery = build_battery_info();
-            json j = battery;
-            res.set_content(j.dump(2), "application/json");
+            if (auto sample = ctx.sampler.latest("battery")) {
+                response::send(req, res, *sample);
+            } else {
+                response::send(req, res, build_battery_info(*ctx.dumpsys()));
+            }
         } catch (const std::exception& e) {
-            json error;
-            error["error"] = e.what();
-            res.set_content(error.dump(2), "application/json");
-            res.status = 500;
+            response::send_error(req, res, e.what(), 500);
         }
     });
     
     // ============ POWER ============
-    svr.Get("/power", [](const httplib::Request&, httplib::Response& res) {
+    route(svr, registry, "/power", [](devices::DeviceContext& ctx, const httplib::Request& req, httplib::Response& res) {
         try {
-            auto power = build_power_info();
-            res.set_content(power.to_json().dump(2), "application/json");
+            response::send(req, res, build_power_info(*ctx.dumpsys()));
         } catch (const std::exception& e) {
-            json error;
-            error["error"] = e.what();
-            res.set_content(error.dump(2), "application/json");
-            res.status = 500;
+            response::send_error(req, res, e.what(), 500);
         }
     });
     
     // ============ THERMAL ============
-    svr.Get("/thermal", [](const httplib::Request&, httplib::Response& res) {
+    route(svr, registry, "/thermal", [](devices::DeviceContext& ctx, const httplib::Request& req, httplib::Response& res) {
         try {
-            auto thermal = build_thermal_info();
-            json j = thermal;
-            res.set_content(j.dump(2), "application/json");
+            if (auto sample = ctx.sampler.latest("thermal")) {
+                response::send(req, res, *sample);
+            } else {
+                response::send(req, res, build_thermal_info(*ctx.dumpsys()));
+            }
         } catch (const std::exception& e) {
-            json error;
-            error["error"] = e.what();
-            res.set_content(error.dump(2), "application/json");
-            res.status = 500;
+            response::send_error(req, res, e.what(), 500);
         }
     });
     
     // ============ CORE TEMPERATURES ============
-    svr.Get("/thermal/cores", [](const httplib::Request&, httplib::Response& res) {
+    route(svr, registry, "/thermal/cores", [](devices::DeviceContext& ctx, const httplib::Request& req, httplib::Response& res) {
         try {
-            auto core_temps = build_core_temperatures();
-            json j = core_temps;
-            res.set_content(j.dump(2), "application/json");
+            response::send(req, res, build_core_temperatures(*ctx.dumpsys()));
         } catch (const std::exception& e) {
-            json error;
-            error["error"] = e.what();
-            res.set_content(error.dump(2), "application/json");
-            res.status = 500;
+            response::send_error(req, res, e.what(), 500);
         }
     });
     
     // ============ NETWORK ============
-    svr.Get("/network", [](const httplib::Request&, httplib::Response& res) {
+    route(svr, registry, "/network", [](devices::DeviceContext& ctx, const httplib::Request& req, httplib::Response& res) {
         try {
-            if (is_cached_valid("network_info", 30)) {
-                res.set_content(get_cached("network_info"), "application/json");
-                return;
+            auto content = ctx.cache.get_or_build("network_info", [&ctx] {
+                return payload::make(build_network_info(ctx.adb, *ctx.props.get(ctx.adb)));
+            });
+            response::send(req, res, *content);
+        } catch (const std::exception& e) {
+            response::send_error(req, res, e.what(), 500);
+        }
+    });
+    
+    // ============ PROPS ============
+    route(svr, registry, "/props", [](devices::DeviceContext& ctx, const httplib::Request& req, httplib::Response& res) {
+        try {
+            std::string prefix = req.has_param("prefix") ? req.get_param_value("prefix") : "";
+            auto table = ctx.props.get(ctx.adb);
+            json properties = json::object();
+            for (const auto& [key, value] : table->with_prefix(prefix)) {
+                properties[std::string(key)] = value;
             }
             
-            auto network = build_network_info();
-            json j = network.to_json();
-            std::string content = j.dump(2);
-            set_cached("network_info", content);
-            res.set_content(content, "application/json");
+            json j;
+            j["prefix"] = prefix;
+            j["count"] = properties.size();
+            j["properties"] = properties;
+            response::send(req, res, j);
         } catch (const std::exception& e) {
-            json error;
-            error["error"] = e.what();
-            res.set_content(error.dump(2), "application/json");
-            res.status = 500;
+            response::send_error(req, res, e.what(), 500);
         }
     });
     
-    // ============ DISPLAY ============
-    svr.Get("/display", [](const httplib::Request&, httplib::Response& res) {
+    // ============ PROCESSES ============
+    route(svr, registry, "/processes", [](devices::DeviceContext& ctx, const httplib::Request& req, httplib::Response& res) {
+        procs::Order order = procs::Order::Cpu;
+        size_t limit = kDefaultProcesses;
+        try {
+            std::string sort = req.has_param("sort") ? req.get_param_value("sort") : "cpu";
+            if (sort == "rss") order = procs::Order::Rss;
+            else if (sort != "cpu") throw std::invalid_argument("sort must be cpu or rss");
+            if (req.has_param("limit")) limit = std::stoul(req.get_param_value("limit"));
+        } catch (const std::exception& e) {
+            response::send_error(req, res, e.what(), 400);
+            return;
+        }
+        
+        try {
+            response::send(req, res, ctx.processes.top(ctx.adb, order, limit));
+        } catch (const std::exception& e) {
+            response::send_error(req, res, e.what(), 500);
+        }
+    });
+    
+    route(svr, registry, R"(/processes/(\d+))", [](devices::DeviceContext& ctx, const httplib::Request& req, httplib::Response& res) {
         try {
-            if (is_cached_valid("display_info", 300)) {
-                res.set_content(get_cached("display_info"), "application/json");
+            std::string pid = req.matches[req.matches.size() - 1];
+            auto process = ctx.processes.find(ctx.adb, static_cast<uint32_t>(std::stoul(pid)));
+            if (!process) {
+                response::send_error(req, res, "No such process: " + pid, 404);
                 return;
             }
-            
-            auto display = build_display_info();
-            json j = display;
-            std::string content = j.dump(2);
-            set_cached("display_info", content);
-            res.set_content(content, "application/json");
+            response::send(req, res, *process);
+        } catch (const std::exception& e) {
+            response::send_error(req, res, e.what(), 500);
+        }
+    });
+    
+    // ============ DISPLAY ============
+    route(svr, registry, "/display", [](devices::DeviceContext& ctx, const httplib::Request& req, httplib::Response& res) {
+        try {
+            auto content = static_section(ctx, "display_info");
+            response::send(req, res, *content);
         } catch (const std::exception& e) {
-            json error;
-            error["error"] = e.what();
-            res.set_content(error.dump(2), "application/json");
-            res.status = 500;
+            response::send_error(req, res, e.what(), 500);
         }
     });
     
     // ============ UPTIME ============
-    svr.Get("/uptime", [](const httplib::Request&, httplib::Response& res) {
+    route(svr, registry, "/uptime", [](devices::DeviceContext& ctx, const httplib::Request& req, httplib::Response& res) {
         try {
-            auto uptime = build_uptime_info();
-            json j = uptime;
-            res.set_content(j.dump(2), "application/json");
+            response::send(req, res, build_uptime_info(ctx.adb));
         } catch (const std::exception& e) {
-            json error;
-            error["error"] = e.what();
-            res.set_content(error.dump(2), "application/json");
-            res.status = 500;
+            response::send_error(req, res, e.what(), 500);
         }
     });
     
-    // ============ SYSTEM ============
-    svr.Get("/system", [](const httplib::Request&, httplib::Response& res) {
+    // ============ HISTORY ============
+    route(svr, registry, R"(/history/(\w+))", [](devices::DeviceContext& ctx, const httplib::Request& req, httplib::Response& res) {
+        // from/to (epoch ms) query the on-disk store, step downsamples it
+        if (req.has_param("from") || req.has_param("to")) {
+            send_stored_history(ctx, req, res);
+            return;
+        }
         try {
-            auto device = build_device_info();
-            auto os = build_os_info();
-            auto cpu = build_cpu_info();
-            auto cpu_freq = build_cpu_frequency();
-            auto cpu_gov = build_cpu_governors();
-            auto cpu_idle = build_cpu_idle_info();
-            auto memory = build_memory_info();
-            auto storage = build_storage_info();
-            auto mounts = build_storage_mounts();
-            auto battery = build_battery_info();
-            auto power = build_power_info();
-            auto thermal = build_thermal_info();
-            auto core_temps = build_core_temperatures();
-            auto network = build_network_info();
-            auto display = build_display_info();
+            int64_t since = req.has_param("since") ? std::stoll(req.get_param_value("since")) : 0;
+            std::string metric = req.matches[req.matches.size() - 1];
+            auto history = ctx.sampler.history(metric, since);
+            if (!history) {
+                response::send_error(req, res, "Unknown metric: " + metric, 404);
+                return;
+            }
             
-            SystemInfo system{
-                device, os, cpu, cpu_freq,
-                std::optional<CPUGovernorInfo>(cpu_gov),
-                std::optional<CPUIdleInfo>(cpu_idle),
-                memory, storage,
-                std::optional<std::vector<MountInfo>>(mounts),
-                battery, power, thermal,
-                std::optional<CoreTemperatures>(core_temps),
-                network, display,
-                get_iso_timestamp()
-            };
+            json series = json::object();
+            for (const auto& [name, points] : *history) {
+                json samples = json::array();
+                for (const auto& point : points) {
+                    samples.push_back({{"t", point.t_ms}, {"v", point.value}});
+                }
+                series[name] = samples;
+            }
             
-            res.set_content(system.to_json().dump(2), "application/json");
+            json j;
+            j["metric"] = metric;
+            j["since"] = since;
+            j["series"] = series;
+            response::send(req, res, j);
+        } catch (const std::exception& e) {
+            response::send_error(req, res, e.what(), 400);
+        }
+    });
+    
+    // ============ EVENTS ============
+    route(svr, registry, "/events", [](devices::DeviceContext& ctx, const httplib::Request& req, httplib::Response& res) {
+        try {
+            uint64_t since = req.has_param("since") ? std::stoull(req.get_param_value("since")) : 0;
+            size_t limit = req.has_param("limit") ? std::stoul(req.get_param_value("limit")) : kMaxEvents;
+            limit = std::min(limit, kMaxEvents);
+            const auto& log = ctx.sampler.events();
+            uint64_t last_id = log.last_id();
+            auto found = log.since(since, limit);
+            bool truncated = !found.empty() && found.size() == limit;
+
+            // Pass last_id back as since to resume; events the ring already overwrote are skipped
+            json j;
+            j["events"] = found;
+            j["last_id"] = truncated ? found.back().id : std::max({since, last_id, found.empty() ? 0 : found.back().id});
+            j["truncated"] = truncated;
+            response::send(req, res, j);
+        } catch (const std::exception& e) {
+            response::send_error(req, res, e.what(), 400);
+        }
+    });
+    
+    // ============ STREAM ============
+    route(svr, registry, "/stream", [](devices::DeviceContext& ctx, const httplib::Request& req, httplib::Response& res) {
+        std::set<std::string> metrics;
+        std::istringstream iss(req.get_param_value("metrics"));
+        std::string metric;
+        while (std::getline(iss, metric, ',')) {
+            if (!metric.empty()) metrics.insert(metric);
+        }
+        
+        // Held until the stream closes, released with the subscriber
+        auto admission = std::make_shared<scheduler::Admission>(
+            std::initializer_list<scheduler::Gate*>{&stream_gate(), &shared_gate()});
+        if (!*admission) {
+            static metrics::Counter& shed = metrics::counter(
+                "adb_insight_http_shed_total", "Requests answered 503 instead of waiting on a device",
+                "route=\"/stream\",reason=\"limit\"");
+            shed.inc();
+            res.set_header("Retry-After", "5");
+            response::send_error(req, res, "Too many open streams", 503);
+            return;
+        }
+        
+        auto subscriber = ctx.broadcaster.subscribe(metrics);
+        res.set_header("Cache-Control", "no-cache");
+        res.set_chunked_content_provider(
+            "text/event-stream",
+            [subscriber](size_t, httplib::DataSink& sink) {
+                auto event = subscriber->next(kStreamKeepalive);
+                if (!event) {
+                    static const std::string keepalive = ": keepalive\n\n";
+                    return sink.write(keepalive.data(), keepalive.size());
+                }
+                return sink.write(event->data(), event->size());
+            },
+            [subscriber, admission](bool) { subscriber->close(); }
+        );
+    });
+    
+    // ============ SYSTEM ============
+    route(svr, registry, "/system", [](devices::DeviceContext& ctx, const httplib::Request& req, httplib::Response& res) {
+        std::optional<int64_t> since;
+        if (req.has_param("since")) {
+            try {
+                since = std::stoll(req.get_param_value("since"));
+            } catch (const std::exception&) {
+                response::send_error(req, res, "Invalid since: " + req.get_param_value("since"), 400);
+                return;
+            }
+        }
+        
+        try {
+            // Versions are recorded by the context's single /system collector,
+            // refreshed from the sampler, never by this request
+            if (since) {
+                auto [snapshot, patch] = ctx.system_since(*since);
+                res.set_header("X-System-Version", std::to_string(patch.version));
+                response::send(req, res, *delta::encode(std::move(patch), snapshot->info.timestamp));
+            } else {
+                auto snapshot = ctx.system();
+                res.set_header("X-System-Version", std::to_string(snapshot->version));
+                response::send(req, res, snapshot->info);
+            }
         } catch (const std::exception& e) {
-            json error;
-            error["error"] = e.what();
-            res.set_content(error.dump(2), "application/json");
-            res.status = 500;
+            response::send_error(req, res, e.what(), 500);
+        }
+    });
+    
+    // ============ FLEET ============
+    svr.Get(R"(/fleet/(\w+))", [&registry](const httplib::Request& req, httplib::Response& res) {
+        static const fleet::Options options = fleet_options();
+        static scheduler::Gate gate(kFleetRequests);
+        static metrics::Histogram& latency = metrics::histogram(
+            "adb_insight_http_request_seconds", "Time spent handling HTTP requests",
+            "route=\"" + metrics::label_value(R"(/fleet/(\w+))") + "\"");
+        metrics::Timer timer(latency);
+
+        std::string metric = req.matches[1];
+        const fleet::Fetch* fetch = fleet_fetch(metric);
+        if (!fetch) {
+            response::send_error(req, res, "Unknown fleet metric: " + metric, 404);
+            return;
+        }
+        scheduler::Admission admission({&gate, &shared_gate()});
+        if (!admission) {
+            res.set_header("Retry-After", "1");
+            response::send_error(req, res, "Too many concurrent fleet requests", 503);
+            return;
+        }
+
+        auto results = fleet::collect(registry.attached(), *fetch, options);
+
+        json j;
+        j["metric"] = metric;
+        j["device_count"] = results.size();
+        json errors = json::object();
+        json elapsed = json::object();
+        for (const auto& result : results) {
+            if (!result.document) errors[result.serial] = result.error;
+            elapsed[result.serial] = result.elapsed.count();
+        }
+
+        // ?summary=1 replaces the documents with per-field statistics;
+        // fields=a,b keeps only paths under those prefixes
+        if (req.get_param_value("summary") == "1") {
+            std::vector<std::string> prefixes;
+            std::istringstream iss(req.get_param_value("fields"));
+            std::string prefix;
+            while (std::getline(iss, prefix, ',')) {
+                if (!prefix.empty()) prefixes.push_back(prefix);
+            }
+            json summary = json::object();
+            for (const auto& [path, stats] : fleet::summarize(results)) {
+                bool wanted = prefixes.empty() || std::any_of(prefixes.begin(), prefixes.end(), [&](const std::string& p) {
+                    return path.compare(0, p.size(), p) == 0 && (path.size() == p.size() || path[p.size()] == '.');
+                });
+                if (wanted) summary[path] = stats;
+            }
+            j["summary"] = summary;
+        } else {
+            json documents = json::object();
+            for (auto& result : results) {
+                if (result.document) documents[result.serial] = std::move(*result.document);
+            }
+            j["devices"] = documents;
         }
+        j["errors"] = errors;
+        j["elapsed_ms"] = elapsed;
+        j["timestamp"] = get_iso_timestamp();
+        response::send(req, res, j);
     });
     
     std::cout << "DroidMetrics (by bluecape) listening on http://0.0.0.0:8000\n";
@@ -0,0 +1,176 @@
+#include "metrics.hpp"
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace metrics {
+
+namespace {
+
+// Round-robin stripe assignment, fixed for the life of each thread
+size_t stripe_index() {
+    static std::atomic<size_t> next{0};
+    thread_local size_t index = next.fetch_add(1, std::memory_order_relaxed) % kStripes;
+    return index;
+}
+
+// Number of significant bits in v
+int bit_width(uint64_t v) {
+    return v == 0 ? 0 : 64 - __builtin_clzll(v);
+}
+
+std::string format_double(double value) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.9g", value);
+    return buf;
+}
+
+struct Family {
+    std::string help;
+    const char* type;
+    std::map<std::string, std::unique_ptr<Histogram>> histograms;
+    std::map<std::string, std::unique_ptr<Counter>> counters;
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::map<std::string, Family> families;
+};
+
+Registry& registry() {
+    static Registry* instance = new Registry();  // never destroyed: series outlive static destructors
+    return *instance;
+}
+
+Family& family(Registry& reg, const std::string& name, const std::string& help, const char* type) {
+    auto [it, inserted] = reg.families.try_emplace(name);
+    if (inserted) {
+        it->second.help = help;
+        it->second.type = type;
+    }
+    return it->second;
+}
+
+std::string series(const std::string& name, const char* suffix, const std::string& labels, const std::string& extra = "") {
+    std::string out = name;
+    out += suffix;
+    if (!labels.empty() || !extra.empty()) {
+        out += '{';
+        out += labels;
+        if (!labels.empty() && !extra.empty()) out += ',';
+        out += extra;
+        out += '}';
+    }
+    return out;
+}
+
+} // namespace
+
+// ============ COUNTER ============
+
+void Counter::inc(uint64_t n) {
+    stripes_[stripe_index()].value.fetch_add(n, std::memory_order_relaxed);
+}
+
+uint64_t Counter::value() const {
+    uint64_t total = 0;
+    for (const auto& stripe : stripes_) total += stripe.value.load(std::memory_order_relaxed);
+    return total;
+}
+
+// ============ HISTOGRAM ============
+
+void Histogram::observe(std::chrono::nanoseconds duration) {
+    uint64_t ns = duration.count() > 0 ? static_cast<uint64_t>(duration.count()) : 0;
+    // Bucket i holds (2^(i+kMinShift-1), 2^(i+kMinShift)] ns
+    int shift = bit_width(ns > 0 ? ns - 1 : 0);
+    size_t bucket = shift <= kMinShift ? 0 : static_cast<size_t>(shift - kMinShift);
+    if (bucket > kBuckets) bucket = kBuckets;
+
+    Stripe& stripe = stripes_[stripe_index()];
+    stripe.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    stripe.sum_ns.fetch_add(ns, std::memory_order_relaxed);
+}
+
+double Histogram::bucket_bound(size_t i) {
+    return static_cast<double>(uint64_t{1} << (i + kMinShift)) / 1e9;
+}
+
+Histogram::Totals Histogram::totals() const {
+    Totals totals;
+    for (const auto& stripe : stripes_) {
+        for (size_t i = 0; i <= kBuckets; ++i) {
+            totals.buckets[i] += stripe.buckets[i].load(std::memory_order_relaxed);
+        }
+        totals.sum_ns += stripe.sum_ns.load(std::memory_order_relaxed);
+    }
+    // Derived from the buckets so that +Inf always equals _count
+    for (uint64_t n : totals.buckets) totals.count += n;
+    return totals;
+}
+
+// ============ REGISTRY ============
+
+Histogram& histogram(const std::string& name, const std::string& help, const std::string& labels) {
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    auto& slot = family(reg, name, help, "histogram").histograms[labels];
+    if (!slot) slot = std::make_unique<Histogram>();
+    return *slot;
+}
+
+Counter& counter(const std::string& name, const std::string& help, const std::string& labels) {
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    auto& slot = family(reg, name, help, "counter").counters[labels];
+    if (!slot) slot = std::make_unique<Counter>();
+    return *slot;
+}
+
+std::string label_value(const std::string& value) {
+    std::string out;
+    out.reserve(value.size());
+    for (char c : value) {
+        switch (c) {
+            case '\\': out += "\\\\"; break;
+            case '"': out += "\\\""; break;
+            case '\n': out += "\\n"; break;
+            default: out += c;
+        }
+    }
+    return out;
+}
+
+// ============ EXPOSITION ============
+
+std::string render() {
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+
+    std::string out;
+    for (const auto& [name, fam] : reg.families) {
+        out += "# HELP " + name + " " + fam.help + "\n";
+        out += "# TYPE " + name + " " + fam.type + "\n";
+
+        for (const auto& [labels, c] : fam.counters) {
+            out += series(name, "", labels) + " " + std::to_string(c->value()) + "\n";
+        }
+
+        for (const auto& [labels, h] : fam.histograms) {
+            Histogram::Totals totals = h->totals();
+            uint64_t cumulative = 0;
+            for (size_t i = 0; i < Histogram::kBuckets; ++i) {
+                cumulative += totals.buckets[i];
+                std::string le = "le=\"" + format_double(Histogram::bucket_bound(i)) + "\"";
+                out += series(name, "_bucket", labels, le) + " " + std::to_string(cumulative) + "\n";
+            }
+            out += series(name, "_bucket", labels, "le=\"+Inf\"") + " " + std::to_string(totals.count) + "\n";
+            out += series(name, "_sum", labels) + " " + format_double(static_cast<double>(totals.sum_ns) / 1e9) + "\n";
+            out += series(name, "_count", labels) + " " + std::to_string(totals.count) + "\n";
+        }
+    }
+    return out;
+}
+
+} // namespace metrics
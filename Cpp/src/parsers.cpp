@@ -1,137 +1,442 @@
 #include "parsers.hpp"
 #include <sstream>
 #include <algorithm>
-#include <regex>
+#include <charconv>
 #include <cmath>
+#include <string_view>
+#include "metrics.hpp"
 
 namespace parsers {
 
-std::map<std::string, std::string> parse_key_value_block(const std::string& text) {
-    std::map<std::string, std::string> data;
-    std::istringstream iss(text);
-    std::string line;
+namespace {
+
+metrics::Histogram& parse_latency(const char* parser) {
+    return metrics::histogram("adb_insight_parse_seconds", "Time spent parsing adb output",
+                              std::string("parser=\"") + parser + "\"");
+}
+
+// Call fn for each line, split like std::getline (no trailing empty line)
+template <typename F>
+void for_each_line(std::string_view text, F&& fn) {
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find('\n', start);
+        if (end == std::string_view::npos) end = text.size();
+        fn(text.substr(start, end - start));
+        start = end + 1;
+    }
+}
+
+std::string_view trim(std::string_view s, std::string_view chars) {
+    size_t first = s.find_first_not_of(chars);
+    if (first == std::string_view::npos) return {};
+    size_t last = s.find_last_not_of(chars);
+    return s.substr(first, last - first + 1);
+}
+
+bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// Matches the ECMAScript \w class
+bool is_word(char c) {
+    return is_digit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+// First "cpu<digits>" in s, like searching for cpu(\d+)
+std::string_view find_cpu_token(std::string_view s) {
+    size_t pos = 0;
+    while ((pos = s.find("cpu", pos)) != std::string_view::npos) {
+        size_t end = pos + 3;
+        while (end < s.size() && is_digit(s[end])) ++end;
+        if (end > pos + 3) return s.substr(pos, end - pos);
+        pos += 3;
+    }
+    return {};
+}
+
+// Leading integer like std::stoi: optional sign, trailing junk ignored
+bool parse_int_prefix(std::string_view s, int& out) {
+    if (!s.empty() && s.front() == '+') s.remove_prefix(1);
+    auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), out);
+    return ec == std::errc() && ptr != s.data();
+}
+
+// Leading floating point value like std::stod
+bool parse_double_prefix(std::string_view s, double& out) {
+    s = trim(s, " \t\n\r");
+    if (!s.empty() && s.front() == '+') s.remove_prefix(1);
+    auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), out);
+    return ec == std::errc() && ptr != s.data();
+}
+
+// Core number from a "cpu<digits>" token
+bool parse_core(std::string_view cpu_token, size_t& core) {
+    if (cpu_token.size() <= 3) return false;
+    auto [ptr, ec] = std::from_chars(cpu_token.data() + 3, cpu_token.data() + cpu_token.size(), core);
+    return ec == std::errc() && ptr == cpu_token.data() + cpu_token.size();
+}
+
+// Whole-token 64-bit integer like operator>> on a single token
+bool parse_int64_token(std::string_view s, int64_t& out) {
+    if (!s.empty() && s.front() == '+') s.remove_prefix(1);
+    auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), out);
+    return ec == std::errc() && ptr == s.data() + s.size();
+}
+
+bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// Split up to max whitespace-separated tokens into out; returns the count
+size_t split_tokens(std::string_view line, std::string_view* out, size_t max) {
+    size_t n = 0, i = 0;
+    while (n < max) {
+        while (i < line.size() && is_space(line[i])) ++i;
+        if (i >= line.size()) break;
+        size_t start = i;
+        while (i < line.size() && !is_space(line[i])) ++i;
+        out[n++] = line.substr(start, i - start);
+    }
+    return n;
+}
+
+// fn(core, value) for "<path with cpuN>: <value>" lines
+template <typename F>
+void for_each_core_line(std::string_view text, F&& fn) {
+    for_each_line(text, [&](std::string_view line) {
+        size_t pos = line.find(':');
+        if (pos == std::string_view::npos) return;
+        
+        // Find CPU part like cpu0, cpu1, etc.
+        size_t core;
+        if (!parse_core(find_cpu_token(line.substr(0, pos)), core)) return;
+        
+        fn(core, trim(line.substr(pos + 1), " \t\n\r"));
+    });
+}
+
+std::string core_key(size_t core) {
+    return "cpu" + std::to_string(core);
+}
+
+} // namespace
+
+// ============ VIEW API ============
+
+KeyValueList scan_key_value_block(std::string_view text) {
+    static metrics::Histogram& latency = parse_latency("scan_key_value_block");
+    metrics::Timer timer(latency);
+    KeyValueList pairs;
     
-    while (std::getline(iss, line)) {
+    for_each_line(text, [&](std::string_view line) {
         size_t pos = line.find(':');
-        if (pos != std::string::npos) {
-            std::string key = line.substr(0, pos);
-            std::string value = line.substr(pos + 1);
-            
-            // Trim whitespace
-            key.erase(0, key.find_first_not_of(" \t\n\r"));
-            key.erase(key.find_last_not_of(" \t\n\r") + 1);
-            value.erase(0, value.find_first_not_of(" \t\n\r"));
-            value.erase(value.find_last_not_of(" \t\n\r") + 1);
-            
-            if (!key.empty() && !value.empty()) {
-                data[key] = value;
-            }
+        if (pos == std::string_view::npos) return;
+        
+        std::string_view key = trim(line.substr(0, pos), " \t\n\r");
+        std::string_view value = trim(line.substr(pos + 1), " \t\n\r");
+        if (!key.empty() && !value.empty()) {
+            pairs.push_back({key, value});
         }
+    });
+    
+    return pairs;
+}
+
+std::string_view find_value(const KeyValueList& pairs, std::string_view key) {
+    for (size_t i = pairs.size(); i > 0; --i) {
+        if (pairs[i - 1].first == key) return pairs[i - 1].second;
     }
+    return {};
+}
+
+PerCore<int> scan_cpu_freq(std::string_view text) {
+    static metrics::Histogram& latency = parse_latency("scan_cpu_freq");
+    metrics::Timer timer(latency);
+    PerCore<int> freqs;
+    for_each_core_line(text, [&](size_t core, std::string_view value) {
+        int freq;
+        if (parse_int_prefix(value, freq)) freqs.set(core, freq);
+    });
+    return freqs;
+}
+
+PerCore<std::string_view> scan_path_value_block(std::string_view text) {
+    static metrics::Histogram& latency = parse_latency("scan_path_value_block");
+    metrics::Timer timer(latency);
+    PerCore<std::string_view> values;
+    for_each_core_line(text, [&](size_t core, std::string_view value) {
+        values.set(core, value);
+    });
+    return values;
+}
+
+IdleStateList scan_cpu_idle_output(std::string_view text) {
+    static metrics::Histogram& latency = parse_latency("scan_cpu_idle_output");
+    metrics::Timer timer(latency);
+    IdleStateList states;
     
-    return data;
+    for_each_line(text, [&](std::string_view line) {
+        std::string_view tokens[5];
+        if (split_tokens(line, tokens, 5) < 5) return;
+        
+        IdleStateView view;
+        if (!parse_core(tokens[0], view.core)) return;
+        if (!parse_int64_token(tokens[3], view.time_us)) return;
+        if (!parse_int_prefix(tokens[4], view.usage)) return;
+        view.state = tokens[1];
+        view.name = tokens[2];
+        states.push_back(view);
+    });
+    
+    return states;
 }
 
-std::map<std::string, int> parse_cpu_freq(const std::string& text) {
-    std::map<std::string, int> freqs;
-    std::istringstream iss(text);
-    std::string line;
+PerCore<CpuJiffies> scan_proc_stat(std::string_view text) {
+    static metrics::Histogram& latency = parse_latency("scan_proc_stat");
+    metrics::Timer timer(latency);
+    PerCore<CpuJiffies> cores;
     
-    while (std::getline(iss, line)) {
+    for_each_line(text, [&](std::string_view line) {
+        std::string_view tokens[9];
+        size_t n = split_tokens(line, tokens, 9);
+        if (n < 5) return;
+        
+        size_t core;
+        if (!parse_core(tokens[0], core)) return;
+        
+        // user nice system idle iowait irq softirq steal; guest time is
+        // already counted in user
+        CpuJiffies jiffies{0, 0};
+        for (size_t i = 1; i < n; ++i) {
+            int64_t value;
+            if (!parse_int64_token(tokens[i], value) || value < 0) return;
+            jiffies.total += static_cast<uint64_t>(value);
+            if (i == 4 || i == 5) jiffies.idle += static_cast<uint64_t>(value);
+        }
+        cores.set(core, jiffies);
+    });
+    
+    return cores;
+}
+
+TimeInStateList scan_time_in_state(std::string_view text) {
+    static metrics::Histogram& latency = parse_latency("scan_time_in_state");
+    metrics::Timer timer(latency);
+    TimeInStateList entries;
+    
+    for_each_line(text, [&](std::string_view line) {
+        std::string_view tokens[3];
+        if (split_tokens(line, tokens, 3) < 3) return;
+        
+        TimeInStateView view;
+        if (!parse_core(tokens[0], view.core)) return;
+        if (!parse_int64_token(tokens[1], view.freq_khz)) return;
+        if (!parse_int64_token(tokens[2], view.time)) return;
+        entries.push_back(view);
+    });
+    
+    return entries;
+}
+
+PerCore<CpuFreqLimit> scan_cpu_freq_limits(std::string_view text) {
+    static metrics::Histogram& latency = parse_latency("scan_cpu_freq_limits");
+    metrics::Timer timer(latency);
+    PerCore<int> hardware, policy;
+    for_each_line(text, [&](std::string_view line) {
         size_t pos = line.find(':');
-        if (pos != std::string::npos) {
-            std::string path = line.substr(0, pos);
-            std::string value_str = line.substr(pos + 1);
-            
-            // Find CPU part like cpu0, cpu1, etc.
-            std::regex cpu_regex(R"(cpu(\d+))");
-            std::smatch match;
-            if (std::regex_search(path, match, cpu_regex)) {
-                std::string cpu_part = "cpu" + match[1].str();
-                try {
-                    value_str.erase(0, value_str.find_first_not_of(" \t\n\r"));
-                    int freq = std::stoi(value_str);
-                    freqs[cpu_part] = freq;
-                } catch (...) {
-                    continue;
-                }
-            }
+        if (pos == std::string_view::npos) return;
+        std::string_view path = line.substr(0, pos);
+        size_t core;
+        int freq;
+        if (!parse_core(find_cpu_token(path), core)) return;
+        if (!parse_int_prefix(trim(line.substr(pos + 1), " \t\n\r"), freq)) return;
+
+        auto ends_with = [&](std::string_view suffix) {
+            return path.size() >= suffix.size() && path.substr(path.size() - suffix.size()) == suffix;
+        };
+        if (ends_with("/cpuinfo_max_freq")) hardware.set(core, freq);
+        else if (ends_with("/scaling_max_freq")) policy.set(core, freq);
+    });
+
+    PerCore<CpuFreqLimit> limits;
+    hardware.for_each([&](size_t core, int max_khz) {
+        if (policy.has(core)) limits.set(core, {max_khz, policy.at(core)});
+    });
+    return limits;
+}
+
+PropertyList scan_getprop(std::string_view text) {
+    static metrics::Histogram& latency = parse_latency("scan_getprop");
+    metrics::Timer timer(latency);
+    PropertyList props;
+    props.reserve(text.size() / 48);
+
+    // Offset of the current value in text, npos before the first entry
+    size_t value_start = std::string_view::npos;
+    for_each_line(text, [&](std::string_view line) {
+        line = trim(line, "\r");
+        if (line.empty()) return;
+        size_t offset = static_cast<size_t>(line.data() - text.data());
+        size_t end = offset + line.size() - (line.back() == ']' ? 1 : 0);
+
+        size_t sep = line.find("]: [");
+        if (line.front() == '[' && sep != std::string_view::npos) {
+            value_start = offset + sep + 4;
+            props.push_back({line.substr(1, sep - 1), text.substr(value_start, end - value_start)});
+        } else if (value_start != std::string_view::npos) {
+            // Continuation of a multi-line value, which runs up to this line's bracket
+            props.back().second = text.substr(value_start, end - value_start);
         }
+    });
+    return props;
+}
+
+ProcessViewList scan_processes(std::string_view text) {
+    static metrics::Histogram& latency = parse_latency("scan_processes");
+    metrics::Timer timer(latency);
+    ProcessViewList processes;
+    processes.reserve(text.size() / 48);
+
+    for_each_line(text, [&](std::string_view line) {
+        std::string_view tokens[9];
+        if (split_tokens(line, tokens, 9) < 9 || tokens[1].size() != 1) return;
+
+        int64_t fields[9];
+        for (size_t i = 0; i < 9; ++i) {
+            if (i != 1 && !parse_int64_token(tokens[i], fields[i])) return;
+        }
+        // Everything after the ninth token, spaces included
+        size_t name_start = static_cast<size_t>(tokens[8].data() + tokens[8].size() - line.data());
+        std::string_view name = trim(line.substr(name_start), " \t\r");
+
+        processes.push_back({
+            static_cast<uint32_t>(fields[0]),
+            static_cast<uint32_t>(fields[2]),
+            static_cast<uint64_t>(fields[6]),
+            static_cast<uint64_t>(fields[3] + fields[4]),
+            static_cast<uint64_t>(fields[7]),
+            static_cast<int32_t>(fields[8]),
+            static_cast<uint32_t>(fields[5]),
+            tokens[1][0],
+            name
+        });
+    });
+    return processes;
+}
+
+// ============ STRING API ============
+
+std::map<std::string, std::string> parse_key_value_block(const std::string& text) {
+    std::map<std::string, std::string> data;
+    for (const auto& [key, value] : scan_key_value_block(text)) {
+        data[std::string(key)] = std::string(value);
     }
-    
+    return data;
+}
+
+std::map<std::string, int> parse_cpu_freq(const std::string& text) {
+    std::map<std::string, int> freqs;
+    scan_cpu_freq(text).for_each([&](size_t core, int freq) {
+        freqs[core_key(core)] = freq;
+    });
     return freqs;
 }
 
 CPUFreqData parse_cpu_frequencies_detailed(const std::string& text) {
+    static metrics::Histogram& latency = parse_latency("parse_cpu_frequencies_detailed");
+    metrics::Timer timer(latency);
     CPUFreqData result;
     result.error = false;
     
-    result.per_core = parse_cpu_freq(text);
-    
-    if (result.per_core.empty()) {
+    auto freqs = scan_cpu_freq(text);
+    if (freqs.count() == 0) {
         result.error = true;
         return result;
     }
     
-    std::vector<int> freq_values;
-    for (const auto& [_, freq] : result.per_core) {
-        freq_values.push_back(freq);
-    }
+    int min_khz = 0, max_khz = 0;
+    double sum = 0;
+    bool first = true;
+    freqs.for_each([&](size_t core, int freq) {
+        result.per_core[core_key(core)] = freq;
+        min_khz = first ? freq : std::min(min_khz, freq);
+        max_khz = first ? freq : std::max(max_khz, freq);
+        sum += freq;
+        first = false;
+    });
     
-    if (!freq_values.empty()) {
-        result.min_khz = *std::min_element(freq_values.begin(), freq_values.end());
-        result.max_khz = *std::max_element(freq_values.begin(), freq_values.end());
-        result.min_mhz = std::round((result.min_khz / 1000.0) * 100) / 100;
-        result.max_mhz = std::round((result.max_khz / 1000.0) * 100) / 100;
-        
-        double sum = 0;
-        for (int f : freq_values) sum += f;
-        result.avg_mhz = std::round((sum / freq_values.size() / 1000.0) * 100) / 100;
-        result.core_count = freq_values.size();
-    }
+    result.min_khz = min_khz;
+    result.max_khz = max_khz;
+    result.min_mhz = std::round((result.min_khz / 1000.0) * 100) / 100;
+    result.max_mhz = std::round((result.max_khz / 1000.0) * 100) / 100;
+    result.avg_mhz = std::round((sum / freqs.count() / 1000.0) * 100) / 100;
+    result.core_count = freqs.count();
     
     return result;
 }
 
 std::map<std::string, std::map<std::string, double>> parse_thermal_data(const std::string& text) {
+    static metrics::Histogram& latency = parse_latency("parse_thermal_data");
+    metrics::Timer timer(latency);
     std::map<std::string, std::map<std::string, double>> temps;
-    std::regex temp_regex(R"(Temperature\{([^}]+)\})");
-    std::sregex_iterator iter(text.begin(), text.end(), temp_regex);
-    std::sregex_iterator end;
+    std::string_view input(text);
+    constexpr std::string_view open = "Temperature{";
+    size_t from = 0;
     
-    while (iter != end) {
-        std::string content = (*iter)[1].str();
-        std::map<std::string, std::string> temp_data;
-        
-        std::regex item_regex(R"((\w+)=([^,}]+))");
-        std::sregex_iterator item_iter(content.begin(), content.end(), item_regex);
-        
-        while (item_iter != end) {
-            std::string key = (*item_iter)[1].str();
-            std::string value = (*item_iter)[2].str();
-            value.erase(0, value.find_first_not_of(" \t"));
-            value.erase(value.find_last_not_of(" \t") + 1);
-            temp_data[key] = value;
-            ++item_iter;
+    // Each Temperature{...} block with non-empty content
+    while ((from = input.find(open, from)) != std::string_view::npos) {
+        size_t begin = from + open.size();
+        size_t close = input.find('}', begin);
+        if (close == std::string_view::npos) break;
+        if (close == begin) {
+            from = begin;
+            continue;
         }
+        std::string_view content = input.substr(begin, close - begin);
+        from = close + 1;
         
-        if (temp_data.count("mName")) {
-            std::string name = temp_data["mName"];
-            try {
-                double value = std::stod(temp_data["mValue"]);
-                temps[name]["value"] = value;
-                if (temp_data.count("mType")) {
-                    temps[name]["type"] = std::stod(temp_data["mType"]);
-                }
-                if (temp_data.count("mStatus")) {
-                    temps[name]["status"] = std::stod(temp_data["mStatus"]);
-                }
-            } catch (...) {
+        // key=value items, where key is a word run directly before '=' and
+        // value runs up to the next ','; later keys override earlier ones
+        std::string_view name, value, type, status;
+        bool has_name = false, has_type = false, has_status = false;
+        size_t i = 0;
+        while (i < content.size()) {
+            if (!is_word(content[i])) {
+                ++i;
                 continue;
             }
+            size_t key_end = i;
+            while (key_end < content.size() && is_word(content[key_end])) ++key_end;
+            if (key_end + 1 >= content.size() || content[key_end] != '=' || content[key_end + 1] == ',') {
+                i = key_end;
+                continue;
+            }
+            size_t value_end = content.find(',', key_end + 1);
+            if (value_end == std::string_view::npos) value_end = content.size();
+            
+            std::string_view key = content.substr(i, key_end - i);
+            std::string_view item = trim(content.substr(key_end + 1, value_end - key_end - 1), " \t");
+            if (key == "mName") { name = item; has_name = true; }
+            else if (key == "mValue") value = item;
+            else if (key == "mType") { type = item; has_type = true; }
+            else if (key == "mStatus") { status = item; has_status = true; }
+            i = value_end;
         }
         
-        ++iter;
+        if (!has_name) continue;
+        
+        double number;
+        if (!parse_double_prefix(value, number)) continue;
+        auto& sensor = temps[std::string(name)];
+        sensor["value"] = number;
+        if (has_type) {
+            if (!parse_double_prefix(type, number)) continue;
+            sensor["type"] = number;
+        }
+        if (has_status && parse_double_prefix(status, number)) {
+            sensor["status"] = number;
+        }
     }
     
     return temps;
@@ -178,6 +483,8 @@ BatteryData parse_battery_level(const std::map<std::string, std::string>& data)
 }
 
 std::vector<MountInfo> parse_df_output(const std::string& text) {
+    static metrics::Histogram& latency = parse_latency("parse_df_output");
+    metrics::Timer timer(latency);
     std::vector<MountInfo> mounts;
     std::istringstream iss(text);
     std::string line;
@@ -222,26 +529,15 @@ std::vector<MountInfo> parse_df_output(const std::string& text) {
 
 std::map<std::string, std::vector<CPUIdleState>> parse_cpu_idle_output(const std::string& text) {
     std::map<std::string, std::vector<CPUIdleState>> per_core;
-    std::istringstream iss(text);
-    std::string line;
     
-    while (std::getline(iss, line)) {
-        std::istringstream line_stream(line);
-        std::string cpu, state, name;
-        int64_t time_us;
-        int usage;
-        
-        if (!(line_stream >> cpu >> state >> name >> time_us >> usage)) {
-            continue;
-        }
-        
+    for (const auto& view : scan_cpu_idle_output(text)) {
         CPUIdleState idle_state;
-        idle_state.state = state;
-        idle_state.name = name;
-        idle_state.time_us = time_us;
-        idle_state.usage = usage;
+        idle_state.state = std::string(view.state);
+        idle_state.name = std::string(view.name);
+        idle_state.time_us = view.time_us;
+        idle_state.usage = view.usage;
         
-        per_core[cpu].push_back(idle_state);
+        per_core[core_key(view.core)].push_back(idle_state);
     }
     
     return per_core;
@@ -249,27 +545,9 @@ std::map<std::string, std::vector<CPUIdleState>> parse_cpu_idle_output(const std
 
 std::map<std::string, std::string> parse_path_value_block(const std::string& text) {
     std::map<std::string, std::string> values;
-    std::istringstream iss(text);
-    std::string line;
-    
-    while (std::getline(iss, line)) {
-        size_t pos = line.find(':');
-        if (pos != std::string::npos) {
-            std::string path = line.substr(0, pos);
-            std::string value = line.substr(pos + 1);
-            
-            // Find CPU part like cpu0, cpu1, etc.
-            std::regex cpu_regex(R"(cpu(\d+))");
-            std::smatch match;
-            if (std::regex_search(path, match, cpu_regex)) {
-                std::string cpu_part = "cpu" + match[1].str();
-                value.erase(0, value.find_first_not_of(" \t\n\r"));
-                value.erase(value.find_last_not_of(" \t\n\r") + 1);
-                values[cpu_part] = value;
-            }
-        }
-    }
-    
+    scan_path_value_block(text).for_each([&](size_t core, std::string_view value) {
+        values[core_key(core)] = std::string(value);
+    });
     return values;
 }
 
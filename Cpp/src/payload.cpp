@@ -0,0 +1,147 @@
+#include "payload.hpp"
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <iterator>
+#include <stdexcept>
+#include <zlib.h>
+#include "metrics.hpp"
+
+namespace payload {
+
+namespace {
+
+// Bodies smaller than this go out uncompressed; the gzip framing alone
+// eats most of the saving
+constexpr size_t kCompressMinBytes = 1024;
+
+// FNV-1a over the encoded bytes, seeded with the format
+std::string make_etag(const std::string& bytes, Format format) {
+    uint64_t hash = 1469598103934665603ULL ^ static_cast<uint64_t>(format);
+    for (unsigned char c : bytes) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    char buf[20];
+    std::snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(hash));
+    return buf;
+}
+
+const char* encoding_suffix(Encoding encoding) {
+    switch (encoding) {
+        case Encoding::Gzip: return "-gzip";
+        case Encoding::Deflate: return "-deflate";
+        default: return "";
+    }
+}
+
+metrics::Histogram& serialize_latency(Format format) {
+    static const char* const kNames[] = {"json", "pretty_json", "msgpack", "cbor"};
+    static const auto histograms = [] {
+        std::array<metrics::Histogram*, std::size(kNames)> out{};
+        for (size_t i = 0; i < out.size(); ++i) {
+            out[i] = &metrics::histogram("adb_insight_serialize_seconds", "Time spent encoding response bodies",
+                                         std::string("format=\"") + kNames[i] + "\"");
+        }
+        return out;
+    }();
+    return *histograms[static_cast<size_t>(format)];
+}
+
+metrics::Histogram& compress_latency(Encoding encoding) {
+    static metrics::Histogram& gzip = metrics::histogram(
+        "adb_insight_compress_seconds", "Time spent compressing response bodies", R"(encoding="gzip")");
+    static metrics::Histogram& deflate = metrics::histogram(
+        "adb_insight_compress_seconds", "Time spent compressing response bodies", R"(encoding="deflate")");
+    return encoding == Encoding::Gzip ? gzip : deflate;
+}
+
+} // namespace
+
+const char* content_type(Format format) {
+    switch (format) {
+        case Format::MsgPack: return "application/msgpack";
+        case Format::Cbor: return "application/cbor";
+        default: return "application/json";
+    }
+}
+
+std::string encode(const nlohmann::json& document, Format format) {
+    switch (format) {
+        case Format::PrettyJson:
+            return document.dump(2);
+        case Format::MsgPack: {
+            auto bytes = nlohmann::json::to_msgpack(document);
+            return std::string(bytes.begin(), bytes.end());
+        }
+        case Format::Cbor: {
+            auto bytes = nlohmann::json::to_cbor(document);
+            return std::string(bytes.begin(), bytes.end());
+        }
+        default:
+            return document.dump();
+    }
+}
+
+std::string compress(const std::string& body, Encoding encoding) {
+    if (encoding == Encoding::Identity) return body;
+
+    // windowBits 15 gives the zlib wrapper HTTP calls "deflate"; +16 gives gzip
+    z_stream zs{};
+    int window_bits = encoding == Encoding::Gzip ? 15 + 16 : 15;
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw std::runtime_error("deflateInit2 failed");
+    }
+
+    std::string out(deflateBound(&zs, body.size()), '\0');
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(body.data()));
+    zs.avail_in = static_cast<uInt>(body.size());
+    zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    zs.avail_out = static_cast<uInt>(out.size());
+
+    int rc = deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    if (rc != Z_STREAM_END) {
+        throw std::runtime_error("deflate failed");
+    }
+    return out;
+}
+
+BodyPtr Payload::body(Format format, Encoding encoding) const {
+    auto slot = [](Format f, Encoding e) {
+        return static_cast<size_t>(f) * kEncodings + static_cast<size_t>(e);
+    };
+
+    // Encoding under the lock is deliberate: concurrent first requests
+    // wait for one encode instead of each doing their own
+    std::lock_guard<std::mutex> lock(mutex_);
+    BodyPtr& identity = bodies_[slot(format, Encoding::Identity)];
+    if (!identity) {
+        std::string bytes;
+        {
+            metrics::Timer timer(serialize_latency(format));
+            bytes = encoder_(format);
+        }
+        std::string hash = make_etag(bytes, format);
+        identity = std::make_shared<const Body>(Body{std::move(bytes), "\"" + hash + "\"", Encoding::Identity});
+    }
+    if (encoding == Encoding::Identity || identity->bytes.size() < kCompressMinBytes) {
+        return identity;
+    }
+
+    BodyPtr& compressed = bodies_[slot(format, encoding)];
+    if (!compressed) {
+        std::string etag = identity->etag;
+        etag.insert(etag.size() - 1, encoding_suffix(encoding));
+        std::string bytes;
+        {
+            metrics::Timer timer(compress_latency(encoding));
+            bytes = compress(identity->bytes, encoding);
+        }
+        compressed = std::make_shared<const Body>(Body{std::move(bytes), std::move(etag), encoding});
+    }
+    return compressed;
+}
+
+} // namespace payload
@@ -0,0 +1,219 @@
+#include "procs.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <thread>
+#include <utility>
+#include "agent.hpp"
+#include "parsers.hpp"
+
+namespace procs {
+
+namespace {
+
+constexpr std::chrono::milliseconds kMinInterval{1000};
+constexpr std::chrono::seconds kMaxAge{30};
+constexpr std::chrono::milliseconds kBaselineDelay{500};
+// USER_HZ, fixed at 100 on Android
+constexpr double kTickSeconds = 0.01;
+constexpr uint32_t kDefaultPageSize = 4096;
+
+/**
+ * Builtins only, so walking several hundred processes forks nothing.
+ * Prints "uptime <seconds>", then "pid state ppid utime stime threads
+ * starttime rss oom name" per process; fields after the name are
+ * numbered from $1 = state (field 3 of stat).
+ */
+constexpr const char* kScanScript =
+    "read -r u _ < /proc/uptime && echo \"uptime $u\"; "
+    "for d in /proc/[0-9]*; do "
+    "read -r s < $d/stat || continue; "
+    "read -r m < $d/statm || continue; "
+    "read -r o < $d/oom_score_adj || o=0; "
+    "n=${s#*\\(}; n=${n%\\)*}; "
+    "set -- ${s##*\\) }; "
+    "r=${m#* }; "
+    "echo \"${d#/proc/} $1 $2 ${12} ${13} ${18} ${20} ${r%% *} $o $n\"; "
+    "done 2>/dev/null";
+
+double round2(double value) {
+    return std::round(value * 100) / 100;
+}
+
+Delta parse_scan(std::string_view output) {
+    Delta delta;
+    // The uptime line has too few fields for scan_processes to take it
+    constexpr std::string_view kUptime = "uptime ";
+    if (output.substr(0, kUptime.size()) == kUptime) {
+        double seconds = std::strtod(std::string(output.substr(kUptime.size(), 32)).c_str(), nullptr);
+        if (seconds > 0) delta.uptime_ticks = static_cast<uint64_t>(seconds / kTickSeconds);
+    }
+    for (const auto& view : parsers::scan_processes(output)) {
+        delta.changed.push_back({view.pid, view.ppid, view.start_ticks, view.cpu_ticks, view.rss_pages,
+                                 view.oom_score_adj, view.threads, view.state, std::string(view.name)});
+    }
+    return delta;
+}
+
+} // namespace
+
+Tracker::Tracker(std::string serial, std::string agent_binary) {
+    if (!agent_binary.empty()) agent_ = std::make_unique<agent::Reader>(std::move(serial), std::move(agent_binary));
+}
+
+Tracker::~Tracker() = default;
+
+ProcessList Tracker::top(adb::Device& device, Order order, size_t limit) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    refresh(device, lock);
+
+    std::vector<const Entry*> ranked;
+    ranked.reserve(table_.size());
+    for (const auto& entry : table_) ranked.push_back(&entry);
+    auto before = [order](const Entry* a, const Entry* b) {
+        if (order == Order::Cpu && a->cpu_percent != b->cpu_percent) return a->cpu_percent > b->cpu_percent;
+        if (a->sample.rss_pages != b->sample.rss_pages) return a->sample.rss_pages > b->sample.rss_pages;
+        return a->sample.pid < b->sample.pid;
+    };
+    limit = std::min(limit, ranked.size());
+    std::partial_sort(ranked.begin(), ranked.begin() + static_cast<std::ptrdiff_t>(limit), ranked.end(), before);
+
+    ProcessList list;
+    list.processes.reserve(limit);
+    for (size_t i = 0; i < limit; ++i) list.processes.push_back(info(*ranked[i]));
+    list.total = static_cast<int>(table_.size());
+    list.sort = order == Order::Cpu ? "cpu" : "rss";
+    list.interval_ms = std::chrono::duration_cast<std::chrono::milliseconds>(interval_).count();
+    list.source = source_;
+    return list;
+}
+
+std::optional<ProcessInfo> Tracker::find(adb::Device& device, uint32_t pid) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    refresh(device, lock);
+    auto it = std::lower_bound(table_.begin(), table_.end(), pid, [](const Entry& entry, uint32_t value) {
+        return entry.sample.pid < value;
+    });
+    if (it == table_.end() || it->sample.pid != pid) return std::nullopt;
+    return info(*it);
+}
+
+void Tracker::refresh(adb::Device& device, std::unique_lock<std::mutex>& lock) {
+    // Another caller is between its baseline and real scans; share its result
+    baseline_done_.wait(lock, [this] { return !baseline_pending_; });
+
+    auto now = clock::now();
+    bool primed = scanned_at_ != clock::time_point{};
+    if (primed && now - scanned_at_ < kMinInterval) return;
+
+    if (!primed || now - scanned_at_ > kMaxAge) {
+        apply(scan(device), 0);
+        scanned_at_ = clock::now();
+        baseline_pending_ = true;
+        lock.unlock();
+        std::this_thread::sleep_for(kBaselineDelay);
+        lock.lock();
+        baseline_pending_ = false;
+        baseline_done_.notify_all();
+    }
+
+    Delta delta = scan(device);
+    now = clock::now();
+    interval_ = now - scanned_at_;
+    apply(std::move(delta), std::chrono::duration<double>(interval_).count());
+    scanned_at_ = now;
+}
+
+Delta Tracker::scan(adb::Device& device) {
+    if (agent_) {
+        if (auto delta = agent_->processes()) {
+            source_ = "agent";
+            return std::move(*delta);
+        }
+    }
+
+    source_ = "shell";
+    if (page_size_ == 0) {
+        auto results = device.shell_multi({"getconf PAGESIZE", kScanScript}, true);
+        Delta delta = parse_scan(results[1]);
+        delta.page_size = static_cast<uint32_t>(std::strtoul(results[0].c_str(), nullptr, 10));
+        if (delta.page_size == 0) delta.page_size = kDefaultPageSize;
+        return delta;
+    }
+    return parse_scan(device.shell(kScanScript));
+}
+
+void Tracker::apply(Delta delta, double elapsed_s) {
+    if (delta.page_size) page_size_ = delta.page_size;
+    uint64_t previous_ticks = std::exchange(scanned_ticks_, delta.uptime_ticks);
+
+    // CPU% since the previous scan. A pid new to the table is charged its
+    // whole CPU time only if it started after that scan: the shell scan
+    // skips processes it fails to read, and a long-lived one it missed
+    // would otherwise show its lifetime CPU as one interval's. Either way
+    // its current value is the baseline for the next scan.
+    auto percent = [&](const Sample& now, const Entry* before) {
+        if (elapsed_s <= 0) return 0.0;
+        uint64_t used;
+        if (before && before->sample.start_ticks == now.start_ticks) {
+            used = now.cpu_ticks > before->sample.cpu_ticks ? now.cpu_ticks - before->sample.cpu_ticks : 0;
+        } else if (previous_ticks && now.start_ticks > previous_ticks) {
+            used = now.cpu_ticks;
+        } else {
+            return 0.0;
+        }
+        return round2(static_cast<double>(used) * kTickSeconds / elapsed_s * 100);
+    };
+    auto by_pid = [](const Sample& a, const Sample& b) { return a.pid < b.pid; };
+    auto entry_before = [](const Entry& entry, uint32_t pid) { return entry.sample.pid < pid; };
+    std::sort(delta.changed.begin(), delta.changed.end(), by_pid);
+
+    if (delta.full) {
+        // Both sides sorted by pid: one merge pass
+        std::vector<Entry> next;
+        next.reserve(delta.changed.size());
+        auto old = table_.begin();
+        for (auto& sample : delta.changed) {
+            while (old != table_.end() && old->sample.pid < sample.pid) ++old;
+            const Entry* before = old != table_.end() && old->sample.pid == sample.pid ? &*old : nullptr;
+            double cpu = percent(sample, before);
+            next.push_back({std::move(sample), cpu});
+        }
+        table_ = std::move(next);
+        return;
+    }
+
+    // Unlisted processes used no CPU since the previous scan
+    for (auto& entry : table_) entry.cpu_percent = 0;
+    for (uint32_t pid : delta.exited) {
+        auto it = std::lower_bound(table_.begin(), table_.end(), pid, entry_before);
+        if (it != table_.end() && it->sample.pid == pid) table_.erase(it);
+    }
+    for (auto& sample : delta.changed) {
+        auto it = std::lower_bound(table_.begin(), table_.end(), sample.pid, entry_before);
+        if (it != table_.end() && it->sample.pid == sample.pid) {
+            it->cpu_percent = percent(sample, &*it);
+            it->sample = std::move(sample);
+        } else {
+            double cpu = percent(sample, nullptr);
+            table_.insert(it, {std::move(sample), cpu});
+        }
+    }
+}
+
+ProcessInfo Tracker::info(const Entry& entry) const {
+    const Sample& s = entry.sample;
+    double page_mb = static_cast<double>(page_size_ ? page_size_ : kDefaultPageSize) / (1024 * 1024);
+    return ProcessInfo{
+        static_cast<int>(s.pid),
+        static_cast<int>(s.ppid),
+        s.name,
+        std::string(1, s.state),
+        static_cast<int>(s.threads),
+        entry.cpu_percent,
+        round2(static_cast<double>(s.rss_pages) * page_mb),
+        s.oom_score_adj
+    };
+}
+
+} // namespace procs
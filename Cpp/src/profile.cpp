@@ -0,0 +1,232 @@
+#include "profile.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include <nlohmann/json.hpp>
+
+namespace profile {
+
+namespace {
+
+namespace fs = std::filesystem;
+
+constexpr char kMagic[4] = {'A', 'I', 'P', '1'};
+// Anything larger is not a profile this code wrote
+constexpr uint32_t kMaxField = 4u << 20;
+
+// Little-endian, whatever the host
+void put_u32(std::string& out, uint32_t value) {
+    for (int shift = 0; shift < 32; shift += 8) out.push_back(static_cast<char>((value >> shift) & 0xff));
+}
+
+void put_string(std::string& out, const std::string& value) {
+    put_u32(out, static_cast<uint32_t>(value.size()));
+    out += value;
+}
+
+// Reads back what put_u32 and put_string wrote
+class Reader {
+public:
+    explicit Reader(const std::string& data) : data_(data) {}
+
+    uint32_t u32() {
+        if (data_.size() - pos_ < 4) throw std::runtime_error("truncated profile");
+        uint32_t value = 0;
+        for (int i = 0; i < 4; ++i) {
+            value |= static_cast<uint32_t>(static_cast<unsigned char>(data_[pos_ + i])) << (8 * i);
+        }
+        pos_ += 4;
+        return value;
+    }
+
+    std::string string() {
+        uint32_t size = u32();
+        if (size > kMaxField || data_.size() - pos_ < size) throw std::runtime_error("truncated profile");
+        std::string value = data_.substr(pos_, size);
+        pos_ += size;
+        return value;
+    }
+
+    bool done() const { return pos_ == data_.size(); }
+
+private:
+    const std::string& data_;
+    size_t pos_ = 4;  // past the magic
+};
+
+std::string trim(const std::string& s) {
+    size_t start = s.find_first_not_of(" \t\r\n");
+    if (start == std::string::npos) return "";
+    size_t end = s.find_last_not_of(" \t\r\n");
+    return s.substr(start, end - start + 1);
+}
+
+} // namespace
+
+Identity read_identity(adb::Device& device) {
+    auto results = device.shell_multi({
+        "getprop ro.build.display.id",
+        "getprop ro.build.fingerprint",
+        "cat /proc/sys/kernel/random/boot_id"
+    }, true);
+    return {trim(results[0]), trim(results[1]), trim(results[2])};
+}
+
+// ============ PROFILE ============
+
+Profile::Profile(adb::Device& device, std::string path, Submit submit, std::chrono::seconds revalidate)
+    : device_(device), path_(std::move(path)), submit_(std::move(submit)), revalidate_(revalidate) {
+    if (!path_.empty()) load();
+}
+
+payload::PayloadPtr Profile::get_or_build(const std::string& key, const Builder& build) {
+    return entry(key, build).value;
+}
+
+Profile::Document Profile::document(const std::string& key, const Builder& build) {
+    return entry(key, build).document;
+}
+
+Profile::Entry Profile::entry(const std::string& key, const Builder& build) {
+    schedule_check();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = sections_.find(key);
+        if (it != sections_.end()) return it->second.entry;
+    }
+
+    auto document = std::make_shared<const nlohmann::json>(build());
+    Entry built{document, payload::make(document)};
+    auto bytes = nlohmann::json::to_msgpack(*document);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        sections_[key] = {built, std::string(bytes.begin(), bytes.end())};
+    }
+    save();
+    return built;
+}
+
+void Profile::schedule_check() {
+    std::pair<bool, std::chrono::steady_clock::time_point> previous;
+    {
+        std::lock_guard<std::mutex> check(check_mutex_);
+        auto now = std::chrono::steady_clock::now();
+        if (checking_ || (checked_ && now - checked_at_ < revalidate_)) return;
+        previous = {checked_, checked_at_};
+        // A failed check also waits for the next interval
+        checking_ = true;
+        checked_ = true;
+        checked_at_ = now;
+    }
+
+    auto job = [this] {
+        check_identity();
+        std::lock_guard<std::mutex> check(check_mutex_);
+        checking_ = false;
+    };
+    if (!submit_) {
+        job();
+    } else if (!submit_(job)) {
+        // Queue full: the next lookup tries again
+        std::lock_guard<std::mutex> check(check_mutex_);
+        checked_ = previous.first;
+        checked_at_ = previous.second;
+        checking_ = false;
+    }
+}
+
+void Profile::check_identity() {
+    Identity current;
+    try {
+        current = read_identity(device_);
+    } catch (const std::exception& e) {
+        std::cerr << "Device profile " << (device_.serial().empty() ? "default" : device_.serial())
+                  << ": identity check failed, keeping static sections: " << e.what() << "\n";
+        return;
+    }
+
+    bool changed;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // Sections built before the first check were read from this same device
+        bool known = identity_ != Identity{};
+        changed = current != identity_;
+        if (changed && known) {
+            if (!sections_.empty()) {
+                std::cerr << "Device profile " << (device_.serial().empty() ? "default" : device_.serial())
+                          << ": build or boot changed, rebuilding static sections\n";
+            }
+            sections_.clear();
+        }
+        identity_ = current;
+    }
+    if (changed) save();
+}
+
+void Profile::load() {
+    std::ifstream in(path_, std::ios::binary);
+    if (!in) return;
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    try {
+        if (data.size() < sizeof(kMagic) || data.compare(0, sizeof(kMagic), kMagic, sizeof(kMagic)) != 0) {
+            throw std::runtime_error("not a profile");
+        }
+        Reader reader(data);
+        Identity identity;
+        identity.build_id = reader.string();
+        identity.fingerprint = reader.string();
+        identity.boot_id = reader.string();
+
+        std::map<std::string, Section> sections;
+        for (uint32_t i = 0, n = reader.u32(); i < n; ++i) {
+            std::string key = reader.string();
+            std::string msgpack = reader.string();
+            auto document = std::make_shared<const nlohmann::json>(nlohmann::json::from_msgpack(msgpack));
+            sections[key] = {{document, payload::make(document)}, std::move(msgpack)};
+        }
+        if (!reader.done()) throw std::runtime_error("trailing bytes");
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        identity_ = std::move(identity);
+        sections_ = std::move(sections);
+    } catch (const std::exception& e) {
+        std::cerr << "Ignoring device profile " << path_ << ": " << e.what() << "\n";
+    }
+}
+
+void Profile::save() const {
+    if (path_.empty()) return;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string data(kMagic, sizeof(kMagic));
+    put_string(data, identity_.build_id);
+    put_string(data, identity_.fingerprint);
+    put_string(data, identity_.boot_id);
+    put_u32(data, static_cast<uint32_t>(sections_.size()));
+    for (const auto& [key, section] : sections_) {
+        put_string(data, key);
+        put_string(data, section.msgpack);
+    }
+
+    // Write beside and rename, so a crash never leaves half a profile
+    try {
+        fs::path path(path_);
+        if (path.has_parent_path()) fs::create_directories(path.parent_path());
+        std::string temp = path_ + ".tmp";
+        {
+            std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+            out.write(data.data(), static_cast<std::streamsize>(data.size()));
+            if (!out) throw std::runtime_error("cannot write " + temp);
+        }
+        fs::rename(temp, path);
+    } catch (const std::exception& e) {
+        std::cerr << "Cannot save device profile " << path_ << ": " << e.what() << "\n";
+    }
+}
+
+} // namespace profile
@@ -0,0 +1,51 @@
+#include "props.hpp"
+#include <algorithm>
+
+namespace props {
+
+namespace {
+
+bool key_less(const parsers::KeyValueView& entry, std::string_view key) {
+    return entry.first < key;
+}
+
+} // namespace
+
+Table::Table(std::string text) : text_(std::move(text)), entries_(parsers::scan_getprop(text_)) {
+    // Stable, so the first of duplicated keys wins, as with getprop <key>
+    std::stable_sort(entries_.begin(), entries_.end(), [](const auto& a, const auto& b) {
+        return a.first < b.first;
+    });
+}
+
+std::string_view Table::get(std::string_view key) const {
+    auto it = std::lower_bound(entries_.begin(), entries_.end(), key, key_less);
+    if (it == entries_.end() || it->first != key) return {};
+    return it->second;
+}
+
+std::vector<parsers::KeyValueView> Table::with_prefix(std::string_view prefix) const {
+    auto first = std::lower_bound(entries_.begin(), entries_.end(), prefix, key_less);
+    auto last = std::find_if(first, entries_.end(), [&](const parsers::KeyValueView& entry) {
+        return entry.first.substr(0, prefix.size()) != prefix;
+    });
+    return {first, last};
+}
+
+TablePtr fetch(adb::Device& device) {
+    return std::make_shared<const Table>(device.shell("getprop"));
+}
+
+// ============ CACHE ============
+
+TablePtr Cache::get(adb::Device& device) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto now = clock::now();
+    if (!table_ || now - fetched_at_ >= max_age_) {
+        table_ = fetch(device);
+        fetched_at_ = now;
+    }
+    return table_;
+}
+
+} // namespace props
@@ -0,0 +1,144 @@
+#include "rates.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include "parsers.hpp"
+
+namespace rates {
+
+namespace {
+
+double round2(double value) {
+    return std::round(value * 100) / 100;
+}
+
+// N from "stateN", or -1
+int64_t state_index(std::string_view state) {
+    constexpr std::string_view prefix = "state";
+    if (state.substr(0, prefix.size()) != prefix) return -1;
+    int64_t index;
+    auto [ptr, ec] = std::from_chars(state.data() + prefix.size(), state.data() + state.size(), index);
+    if (ec != std::errc() || ptr != state.data() + state.size()) return -1;
+    return index;
+}
+
+} // namespace
+
+Engine::Engine(std::chrono::milliseconds window) : window_(window) {}
+
+uint32_t Engine::slot(size_t core, Kind kind, int64_t sub) {
+    auto [it, inserted] = slots_.emplace(Key{core, kind, sub}, static_cast<uint32_t>(prev_.size()));
+    if (inserted) {
+        prev_.push_back(0);
+        has_prev_.push_back(0);
+        sums_.push_back(0);
+    }
+    return it->second;
+}
+
+void Engine::observe(Step& step, uint32_t slot, double value) {
+    if (has_prev_[slot]) {
+        double delta = value - prev_[slot];
+        if (delta < 0) delta = 0;
+        step.deltas.emplace_back(slot, delta);
+        sums_[slot] += delta;
+    }
+    prev_[slot] = value;
+    has_prev_[slot] = 1;
+}
+
+void Engine::update(clock::time_point t, std::string_view proc_stat, std::string_view cpu_idle,
+                    std::string_view time_in_state) {
+    Step step;
+    step.deltas.swap(spare_);
+    step.deltas.clear();
+    step.t = t;
+    step.wall_us = last_t_
+        ? std::chrono::duration<double, std::micro>(t - *last_t_).count()
+        : 0.0;
+
+    parsers::scan_proc_stat(proc_stat).for_each([&](size_t core, const parsers::CpuJiffies& jiffies) {
+        observe(step, slot(core, Kind::Total, 0), static_cast<double>(jiffies.total));
+        observe(step, slot(core, Kind::Busy, 0), static_cast<double>(jiffies.total - jiffies.idle));
+    });
+
+    for (const auto& idle : parsers::scan_cpu_idle_output(cpu_idle)) {
+        int64_t index = state_index(idle.state);
+        if (index < 0) continue;
+        auto& name = state_names_[{idle.core, index}];
+        if (name != idle.name) name = std::string(idle.name);
+        observe(step, slot(idle.core, Kind::IdleState, index), static_cast<double>(idle.time_us));
+    }
+
+    for (const auto& entry : parsers::scan_time_in_state(time_in_state)) {
+        observe(step, slot(entry.core, Kind::TimeInState, entry.freq_khz), static_cast<double>(entry.time));
+    }
+
+    bool first = !last_t_;
+    last_t_ = t;
+    if (first) return;
+
+    window_us_ += step.wall_us;
+    steps_.push_back(std::move(step));
+
+    // Drop steps that ended before the window, always keeping the newest
+    while (steps_.size() > 1 && steps_.front().t <= t - window_) {
+        for (const auto& [s, delta] : steps_.front().deltas) sums_[s] -= delta;
+        window_us_ -= steps_.front().wall_us;
+        spare_.swap(steps_.front().deltas);
+        steps_.pop_front();
+    }
+}
+
+std::optional<CPURates> Engine::rates() const {
+    if (steps_.empty() || window_us_ <= 0) return std::nullopt;
+
+    CPURates result;
+    result.window_ms = static_cast<int64_t>(std::llround(window_us_ / 1000.0));
+    result.samples = static_cast<int>(steps_.size());
+
+    // Slots are ordered by core then kind, so each core's entries are contiguous
+    size_t core = SIZE_MAX;
+    CoreRates* core_rates = nullptr;
+    double total = 0, weighted_khz = 0, tis_time = 0;
+    auto finish = [&] {
+        if (!core_rates) return;
+        if (tis_time > 0) core_rates->avg_freq_mhz = round2(weighted_khz / tis_time / 1000.0);
+    };
+
+    for (const auto& [key, s] : slots_) {
+        auto [slot_core, kind, sub] = key;
+        if (slot_core != core) {
+            finish();
+            core = slot_core;
+            core_rates = &result.per_core["cpu" + std::to_string(core)];
+            total = weighted_khz = tis_time = 0;
+        }
+
+        double sum = sums_[s];
+        switch (kind) {
+            case Kind::Total:
+                total = sum;
+                break;
+            case Kind::Busy:
+                if (total > 0) core_rates->utilization_percent = round2(sum / total * 100);
+                break;
+            case Kind::IdleState: {
+                auto name = state_names_.find({core, sub});
+                double percent = std::min(100.0, sum / window_us_ * 100);
+                core_rates->idle_residency_percent[name->second.empty() ? "state" + std::to_string(sub) : name->second] = round2(percent);
+                break;
+            }
+            case Kind::TimeInState:
+                weighted_khz += static_cast<double>(sub) * sum;
+                tis_time += sum;
+                break;
+        }
+    }
+    finish();
+
+    return result;
+}
+
+} // namespace rates
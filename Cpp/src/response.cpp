@@ -0,0 +1,148 @@
+#include "response.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <vector>
+
+namespace response {
+
+namespace {
+
+struct Preference {
+    std::string token;
+    double q;
+};
+
+std::string trim(const std::string& s) {
+    size_t first = s.find_first_not_of(" \t");
+    if (first == std::string::npos) return "";
+    size_t last = s.find_last_not_of(" \t");
+    return s.substr(first, last - first + 1);
+}
+
+std::string trim_lower(const std::string& s) {
+    std::string out = trim(s);
+    std::transform(out.begin(), out.end(), out.begin(), [](unsigned char c) { return std::tolower(c); });
+    return out;
+}
+
+// Split "a;q=0.5, b" into tokens with q-values, in header order
+std::vector<Preference> parse_preferences(const std::string& header) {
+    std::vector<Preference> prefs;
+    size_t start = 0;
+    while (start <= header.size()) {
+        size_t end = header.find(',', start);
+        if (end == std::string::npos) end = header.size();
+        std::string item = header.substr(start, end - start);
+        start = end + 1;
+
+        size_t semi = item.find(';');
+        Preference pref{trim_lower(item.substr(0, semi)), 1.0};
+        while (semi != std::string::npos) {
+            size_t next = item.find(';', semi + 1);
+            std::string param = trim_lower(item.substr(semi + 1, next == std::string::npos ? std::string::npos : next - semi - 1));
+            if (param.rfind("q=", 0) == 0) {
+                pref.q = std::strtod(param.c_str() + 2, nullptr);
+            }
+            semi = next;
+        }
+        if (!pref.token.empty()) prefs.push_back(pref);
+    }
+    return prefs;
+}
+
+// Highest-q entry that maps to a value; earlier entries win ties
+template <typename T, typename Map>
+bool pick(const std::vector<Preference>& prefs, Map&& map, T& out) {
+    double best = 0.0;
+    bool found = false;
+    for (const auto& pref : prefs) {
+        T value;
+        if (pref.q > best && map(pref.token, value)) {
+            best = pref.q;
+            out = value;
+            found = true;
+        }
+    }
+    return found;
+}
+
+// If-None-Match uses weak comparison, so W/ prefixes are ignored
+bool etag_matches(const std::string& header, const std::string& etag) {
+    size_t start = 0;
+    while (start < header.size()) {
+        size_t end = header.find(',', start);
+        if (end == std::string::npos) end = header.size();
+        std::string tag = trim(header.substr(start, end - start));
+        start = end + 1;
+
+        if (tag == "*") return true;
+        if (tag.rfind("W/", 0) == 0) tag.erase(0, 2);
+        if (tag == etag) return true;
+    }
+    return false;
+}
+
+} // namespace
+
+Format negotiate_format(const httplib::Request& req) {
+    Format format = Format::Json;
+    pick(parse_preferences(req.get_header_value("Accept")), [](const std::string& type, Format& f) {
+        if (type == "application/json" || type == "application/*" || type == "*/*") f = Format::Json;
+        else if (type == "text/html") f = Format::PrettyJson;
+        else if (type == "application/msgpack" || type == "application/x-msgpack" ||
+                 type == "application/vnd.msgpack") f = Format::MsgPack;
+        else if (type == "application/cbor") f = Format::Cbor;
+        else return false;
+        return true;
+    }, format);
+
+    if (req.has_param("pretty") && (format == Format::Json || format == Format::PrettyJson)) {
+        format = req.get_param_value("pretty") == "0" ? Format::Json : Format::PrettyJson;
+    }
+    return format;
+}
+
+Encoding negotiate_encoding(const httplib::Request& req) {
+    Encoding encoding = Encoding::Identity;
+    pick(parse_preferences(req.get_header_value("Accept-Encoding")), [](const std::string& token, Encoding& e) {
+        if (token == "gzip" || token == "x-gzip") e = Encoding::Gzip;
+        else if (token == "deflate") e = Encoding::Deflate;
+        else return false;
+        return true;
+    }, encoding);
+    return encoding;
+}
+
+void send(const httplib::Request& req, httplib::Response& res, const payload::Payload& p, int status) {
+    Format format = negotiate_format(req);
+    payload::BodyPtr body = p.body(format, negotiate_encoding(req));
+
+    res.set_header("Vary", "Accept, Accept-Encoding");
+    res.status = status;
+    if (status >= 200 && status < 300) {
+        res.set_header("ETag", body->etag);
+        if (etag_matches(req.get_header_value("If-None-Match"), body->etag)) {
+            res.status = 304;
+            return;
+        }
+    }
+    if (body->encoding != Encoding::Identity) {
+        res.set_header("Content-Encoding", body->encoding == Encoding::Gzip ? "gzip" : "deflate");
+    }
+
+    // Stream straight from the shared body instead of copying it into res
+    res.set_content_provider(
+        body->bytes.size(), payload::content_type(format),
+        [body](size_t offset, size_t length, httplib::DataSink& sink) {
+            return sink.write(body->bytes.data() + offset, length);
+        });
+}
+
+void send_error(const httplib::Request& req, httplib::Response& res, const std::string& message, int status) {
+    nlohmann::json error;
+    error["error"] = message;
+    send(req, res, error, status);
+}
+
+} // namespace response
@@ -0,0 +1,420 @@
+#include "sampler.hpp"
+#include "builders.hpp"
+#include "collector.hpp"
+#include "snapshot.hpp"
+#include "sources.hpp"
+#include <algorithm>
+#include <iostream>
+
+namespace sampler {
+
+namespace {
+
+// A sample older than this many intervals is no longer served
+constexpr int kFreshIntervals = 3;
+
+// dumpsys is the most expensive thing sampled; adapting never polls it faster than this
+constexpr std::chrono::milliseconds kDumpsysFloor{1000};
+
+int64_t wall_clock_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()
+    ).count();
+}
+
+} // namespace
+
+// ============ RING BUFFER ============
+
+RingBuffer::RingBuffer(size_t capacity) : data_(capacity == 0 ? 1 : capacity) {}
+
+void RingBuffer::push(Point point) {
+    data_[head_] = point;
+    head_ = (head_ + 1) % data_.size();
+    if (size_ < data_.size()) ++size_;
+}
+
+std::vector<Point> RingBuffer::since(int64_t since_ms) const {
+    std::vector<Point> points;
+    size_t start = (head_ + data_.size() - size_) % data_.size();
+    for (size_t i = 0; i < size_; ++i) {
+        const Point& point = data_[(start + i) % data_.size()];
+        if (point.t_ms > since_ms) points.push_back(point);
+    }
+    return points;
+}
+
+// ============ CHANNEL ============
+
+template <typename T>
+bool Sampler::Channel<T>::is_fresh() const {
+    return latest && clock::now() - sampled_at <= interval * kFreshIntervals;
+}
+
+template <typename T>
+std::shared_ptr<const T> Sampler::Channel<T>::fresh() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return is_fresh() ? latest : nullptr;
+}
+
+template <typename T>
+payload::PayloadPtr Sampler::Channel<T>::fresh_payload() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return is_fresh() ? encoded : nullptr;
+}
+
+template <typename T>
+payload::PayloadPtr Sampler::Channel<T>::record(T value, const std::vector<std::pair<std::string, double>>& points,
+                                                size_t capacity) {
+    auto sample = std::make_shared<const T>(std::move(value));
+    auto sample_payload = payload::make(sample);
+    int64_t t_ms = wall_clock_ms();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    latest = std::move(sample);
+    encoded = sample_payload;
+    sampled_at = clock::now();
+    for (const auto& [name, v] : points) {
+        auto it = series.find(name);
+        if (it == series.end()) {
+            it = series.emplace(name, RingBuffer(capacity)).first;
+        }
+        it->second.push({t_ms, v});
+    }
+    return sample_payload;
+}
+
+template <typename T>
+std::chrono::milliseconds Sampler::Channel<T>::current_interval() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return interval;
+}
+
+template <typename T>
+History Sampler::Channel<T>::since(int64_t since_ms) const {
+    History history;
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& [name, ring] : series) {
+        history[name] = ring.since(since_ms);
+    }
+    return history;
+}
+
+// ============ SAMPLER ============
+
+Sampler::Sampler(adb::Device& device, Config config, Listener listener, CycleHook on_cycle)
+    : device_(device), config_(config), listener_(std::move(listener)), on_cycle_(std::move(on_cycle)),
+      rates_engine_(config.rates_window),
+      events_(config.event_log_size), detector_(events_), budget_(config.adaptive ? config.adb_budget : 0) {
+    cpu_frequency_.interval = config.cpu_frequency;
+    thermal_.interval = config.thermal;
+    battery_.interval = config.battery;
+    memory_.interval = config.memory;
+    cpu_rates_.interval = config.cpu_rates;
+
+    // Tolerances are relative changes between samples: 10% of a core's
+    // frequency, about 1 degree, a 1% battery level or 40 mV step
+    auto pace = [&](adaptive::Profile profile) {
+        if (!config.adaptive) profile.min = profile.max = profile.base;
+        return adaptive::Interval(profile);
+    };
+    cpu_frequency_.pace = pace(adaptive::profile(config.cpu_frequency, 0.10));
+    thermal_.pace = pace(adaptive::profile(config.thermal, 0.02, kDumpsysFloor));
+    battery_.pace = pace(adaptive::profile(config.battery, 0.01, kDumpsysFloor));
+    memory_.pace = pace(adaptive::profile(config.memory, 0.02));
+    // Utilization is in percent and noisy; rates also need two samples inside their window
+    adaptive::Profile rates = adaptive::profile(config.cpu_rates, 0.5);
+    rates.max = std::max(rates.base, std::min(rates.max, config.rates_window / 2));
+    cpu_rates_.pace = pace(rates);
+
+    if (config.low_observer) {
+        // Both come from dumpsys, which costs the device far more than sysfs reads
+        thermal_.next_due = clock::time_point::max();
+        battery_.next_due = clock::time_point::max();
+    }
+    if (!config.agent_binary.empty()) {
+        agent_ = std::make_unique<agent::Reader>(device.serial(), config.agent_binary);
+    }
+    if (!config.store_dir.empty()) {
+        std::string dir = config.store_dir + "/" + (device.serial().empty() ? "default" : device.serial());
+        try {
+            store_ = std::make_unique<store::Store>(store::Config{dir, config.store_retention});
+        } catch (const std::exception& e) {
+            std::cerr << "History store disabled: " << e.what() << "\n";
+        }
+    }
+}
+
+Sampler::~Sampler() {
+    stop();
+}
+
+void Sampler::start() {
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    if (running_) return;
+    running_ = true;
+    thread_ = std::thread([this] { run(); });
+}
+
+void Sampler::stop() {
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        if (!running_) return;
+        running_ = false;
+    }
+    wake_.notify_all();
+    thread_.join();
+}
+
+std::shared_ptr<const CPUFrequency> Sampler::cpu_frequency() const {
+    return cpu_frequency_.fresh();
+}
+
+std::shared_ptr<const ThermalInfo> Sampler::thermal() const {
+    return thermal_.fresh();
+}
+
+std::shared_ptr<const BatteryInfo> Sampler::battery() const {
+    return battery_.fresh();
+}
+
+std::shared_ptr<const MemoryInfo> Sampler::memory() const {
+    return memory_.fresh();
+}
+
+std::shared_ptr<const CPURates> Sampler::cpu_rates() const {
+    return cpu_rates_.fresh();
+}
+
+payload::PayloadPtr Sampler::latest(const std::string& metric) const {
+    if (metric == "cpu_frequency") return cpu_frequency_.fresh_payload();
+    if (metric == "thermal") return thermal_.fresh_payload();
+    if (metric == "battery") return battery_.fresh_payload();
+    if (metric == "memory") return memory_.fresh_payload();
+    if (metric == "cpu_rates") return cpu_rates_.fresh_payload();
+    return nullptr;
+}
+
+std::optional<History> Sampler::history(const std::string& metric, int64_t since_ms) const {
+    if (metric == "cpu_frequency") return cpu_frequency_.since(since_ms);
+    if (metric == "thermal") return thermal_.since(since_ms);
+    if (metric == "battery") return battery_.since(since_ms);
+    if (metric == "memory") return memory_.since(since_ms);
+    if (metric == "cpu_rates") return cpu_rates_.since(since_ms);
+    return std::nullopt;
+}
+
+std::map<std::string, std::chrono::milliseconds> Sampler::intervals() const {
+    return {
+        {"cpu_frequency", cpu_frequency_.current_interval()},
+        {"thermal", thermal_.current_interval()},
+        {"battery", battery_.current_interval()},
+        {"memory", memory_.current_interval()},
+        {"cpu_rates", cpu_rates_.current_interval()}
+    };
+}
+
+double Sampler::adb_duty() const {
+    return adb_duty_.load(std::memory_order_relaxed);
+}
+
+Overhead Sampler::overhead() const {
+    std::lock_guard<std::mutex> lock(overhead_mutex_);
+    return overhead_;
+}
+
+void Sampler::run() {
+    std::unique_lock<std::mutex> lock(wake_mutex_);
+    while (running_) {
+        lock.unlock();
+        auto now = clock::now();
+        tick(now);
+        if (on_cycle_) on_cycle_();
+
+        auto next = std::min({cpu_frequency_.next_due, thermal_.next_due,
+                              battery_.next_due, memory_.next_due, cpu_rates_.next_due});
+        lock.lock();
+        wake_.wait_until(lock, next, [this] { return !running_; });
+    }
+}
+
+void Sampler::notify(const char* metric, const payload::Payload& sample) {
+    if (!listener_) return;
+    // Shares the HTTP handlers' minified JSON body
+    auto body = collector::attempt([&] {
+        return sample.body(payload::Format::Json, payload::Encoding::Identity);
+    }, metric);
+    if (body) listener_(metric, (*body)->bytes);
+}
+
+void Sampler::persist(const char* metric, const std::vector<std::pair<std::string, double>>& points) {
+    if (store_) store_->append(metric, points, wall_clock_ms());
+}
+
+void Sampler::publish(const std::vector<events::Event>& found) {
+    if (!listener_) return;
+    for (const auto& event : found) listener_("events", json(event).dump());
+}
+
+template <typename T>
+void Sampler::adapt(Channel<T>& channel, const adaptive::Points& points, bool urgent) {
+    if (!channel.last_points.empty()) {
+        channel.pace.observe(adaptive::relative_change(channel.last_points, points), urgent);
+    }
+    channel.last_points = points;
+}
+
+template <typename T>
+void Sampler::reschedule(Channel<T>& channel, clock::time_point now) {
+    auto next = std::chrono::duration_cast<std::chrono::milliseconds>(channel.pace.current() * budget_.stretch());
+    channel.next_due = now + next;
+    std::lock_guard<std::mutex> lock(channel.mutex);
+    channel.interval = next;
+}
+
+void Sampler::tick(clock::time_point now) {
+    bool cpu_due = now >= cpu_frequency_.next_due;
+    bool thermal_due = now >= thermal_.next_due;
+    bool battery_due = now >= battery_.next_due;
+    bool memory_due = now >= memory_.next_due;
+    bool rates_due = now >= cpu_rates_.next_due;
+
+    if (config_.low_observer && (cpu_due || memory_due || rates_due)) {
+        // Fold metrics due within half an interval into this round-trip, so the device is woken once
+        auto soon = [&](const auto& channel) { return now + channel.pace.current() / 2 >= channel.next_due; };
+        cpu_due = cpu_due || soon(cpu_frequency_);
+        memory_due = memory_due || soon(memory_);
+        rates_due = rates_due || soon(cpu_rates_);
+    }
+
+    // Metrics due together share one snapshot round-trip
+    unsigned sections = 0;
+    if (cpu_due) sections |= snapshot::CpuFrequency | snapshot::CpuFreqLimits;
+    if (memory_due) sections |= snapshot::MemInfo;
+    if (rates_due) sections |= snapshot::CpuRates;
+
+    // Every adb round-trip counts against the budget
+    auto timed = [&](auto&& fetch) {
+        auto started = clock::now();
+        auto result = fetch();
+        auto finished = clock::now();
+        budget_.record(finished, finished - started);
+        return result;
+    };
+
+    adb::ShellCost cost;
+    auto script = config_.low_observer ? snapshot::Script::Lean : snapshot::Script::Shell;
+    std::optional<snapshot::Snapshot> fast;
+    const snapshot::Snapshot* snap = nullptr;
+    if (sections) {
+        auto captured = timed([&] {
+            return collector::attempt([&]() -> const snapshot::Snapshot* {
+                // The agent skips the shell entirely; anything it cannot serve goes the usual way
+                if (agent_) {
+                    fast = agent_->capture(sections);
+                    if (fast) return &*fast;
+                }
+                return &capturer_.capture(device_, sections, script, &cost);
+            }, "sampler snapshot");
+        });
+        if (captured) snap = *captured;
+    }
+
+    if (snap && cpu_due) {
+        if (auto freq = collector::attempt([&] { return cpu_frequency_from(*snap); }, "cpu_frequency")) {
+            std::vector<std::pair<std::string, double>> points(freq->per_core.begin(), freq->per_core.end());
+            auto encoded = cpu_frequency_.record(std::move(*freq), points, config_.history_size);
+            notify("cpu_frequency", *encoded);
+            persist("cpu_frequency", points);
+            auto limits = parsers::scan_cpu_freq_limits(snap->cpu_freq_limits);
+            publish(detector_.freq_limits(wall_clock_ms(), limits));
+            adapt(cpu_frequency_, points, detector_.freq_capped());
+        }
+    }
+
+    if (snap && memory_due) {
+        if (auto memory = collector::attempt([&] { return memory_info_from(*snap); }, "memory")) {
+            std::vector<std::pair<std::string, double>> points = {
+                {"used_mb", memory->used_mb},
+                {"available_mb", memory->available_mb},
+                {"usage_percent", memory->usage_percent}
+            };
+            auto encoded = memory_.record(std::move(*memory), points, config_.history_size);
+            notify("memory", *encoded);
+            persist("memory", points);
+            adapt(memory_, points, false);
+        }
+    }
+
+    if (snap && rates_due) {
+        rates_engine_.update(now, snap->proc_stat, snap->cpu_idle, snap->cpu_time_in_state);
+        if (auto cpu_rates = rates_engine_.rates()) {
+            std::vector<std::pair<std::string, double>> points;
+            for (const auto& [core, core_rates] : cpu_rates->per_core) {
+                if (core_rates.utilization_percent) points.emplace_back(core, *core_rates.utilization_percent);
+            }
+            auto encoded = cpu_rates_.record(std::move(*cpu_rates), points, config_.history_size);
+            notify("cpu_rates", *encoded);
+            persist("cpu_rates", points);
+            adapt(cpu_rates_, points, detector_.freq_capped());
+        }
+    }
+
+    sources::SourceCache shared(device_, &cost);
+
+    if (thermal_due) {
+        if (auto thermal = timed([&] {
+                return collector::attempt([&] { return build_thermal_info(shared); }, "thermal");
+            })) {
+            std::vector<std::pair<std::string, double>> points(thermal->temperatures.begin(),
+                                                               thermal->temperatures.end());
+            auto encoded = thermal_.record(std::move(*thermal), points, config_.history_size);
+            notify("thermal", *encoded);
+            persist("thermal", points);
+            // Statuses come from the dumpsys output build_thermal_info already fetched
+            if (auto sensors = collector::attempt([&] { return shared.thermal(); }, "thermal events")) {
+                publish(detector_.thermal(wall_clock_ms(), *sensors));
+            }
+            adapt(thermal_, points, detector_.thermal_throttling());
+        }
+    }
+
+    if (battery_due) {
+        std::optional<adaptive::Points> battery_points;
+        if (auto battery = timed([&] {
+                return collector::attempt([&] { return build_battery_info(shared); }, "battery");
+            })) {
+            std::vector<std::pair<std::string, double>> points = {
+                {"level", static_cast<double>(battery->level)},
+                {"temperature_c", battery->temperature_c},
+                {"voltage_mv", static_cast<double>(battery->voltage_mv)}
+            };
+            auto encoded = battery_.record(std::move(*battery), points, config_.history_size);
+            notify("battery", *encoded);
+            persist("battery", points);
+            battery_points = std::move(points);
+        }
+        // dumpsys battery is already cached in shared; current goes to the drain rule and to disk
+        if (auto power = collector::attempt([&] { return build_power_info(shared); }, "power")) {
+            publish(detector_.power(wall_clock_ms(), *power));
+            persist("power", {{"current_ma", static_cast<double>(power->current_ma)}});
+        }
+        if (battery_points) adapt(battery_, *battery_points, detector_.discharge_spiking());
+    }
+
+    if (cost.round_trips > 0) {
+        std::lock_guard<std::mutex> lock(overhead_mutex_);
+        overhead_.last_cycle = cost;
+        overhead_.total += cost;
+        ++overhead_.cycles;
+    }
+
+    adb_duty_.store(budget_.duty(), std::memory_order_relaxed);
+    if (cpu_due) reschedule(cpu_frequency_, now);
+    if (thermal_due) reschedule(thermal_, now);
+    if (battery_due) reschedule(battery_, now);
+    if (memory_due) reschedule(memory_, now);
+    if (rates_due) reschedule(cpu_rates_, now);
+}
+
+} // namespace sampler
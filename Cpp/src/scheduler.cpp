@@ -0,0 +1,61 @@
+#include "scheduler.hpp"
+#include <stdexcept>
+
+namespace scheduler {
+
+Limit parse_limit(const std::string& spec, Limit base) {
+    size_t colon = spec.find(':');
+    int concurrency = std::stoi(spec.substr(0, colon));
+    if (concurrency <= 0) {
+        throw std::invalid_argument("concurrency must be positive: " + spec);
+    }
+    base.concurrency = static_cast<size_t>(concurrency);
+    if (colon != std::string::npos) {
+        int deadline_ms = std::stoi(spec.substr(colon + 1));
+        if (deadline_ms <= 0) {
+            throw std::invalid_argument("deadline must be positive: " + spec);
+        }
+        base.deadline = std::chrono::milliseconds(deadline_ms);
+    }
+    return base;
+}
+
+// ============ GATE ============
+
+Gate::Gate(size_t capacity) : capacity_(capacity == 0 ? 1 : capacity) {}
+
+bool Gate::try_acquire() {
+    size_t current = in_flight_.load(std::memory_order_relaxed);
+    while (current < capacity_) {
+        if (in_flight_.compare_exchange_weak(current, current + 1, std::memory_order_acquire,
+                                             std::memory_order_relaxed)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Gate::release() {
+    in_flight_.fetch_sub(1, std::memory_order_release);
+}
+
+// ============ ADMISSION ============
+
+Admission::Admission(std::initializer_list<Gate*> gates) {
+    for (Gate* gate : gates) {
+        if (!gate) continue;
+        if (!gate->try_acquire()) {
+            for (Gate* held : held_) held->release();
+            held_.clear();
+            return;
+        }
+        held_.push_back(gate);
+    }
+    admitted_ = true;
+}
+
+Admission::~Admission() {
+    for (Gate* gate : held_) gate->release();
+}
+
+} // namespace scheduler
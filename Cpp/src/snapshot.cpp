@@ -0,0 +1,152 @@
+#include "snapshot.hpp"
+#include <vector>
+
+namespace snapshot {
+
+namespace {
+
+constexpr size_t kMaxBatches = 16;
+
+struct SectionSource {
+    Section section;
+    const char* command;
+    // Same output using shell builtins only: nothing is forked per file
+    const char* lean;
+    std::string Snapshot::*field;
+};
+
+const SectionSource kSources[] = {
+    {CpuCurFreq,
+     "for f in /sys/devices/system/cpu/cpu*/cpufreq/scaling_cur_freq; "
+     "do echo $f: $(cat $f); done",
+     "for f in /sys/devices/system/cpu/cpu*/cpufreq/scaling_cur_freq; "
+     "do v=; read -r v < $f; echo $f: $v; done",
+     &Snapshot::cpu_cur_freq},
+    {CpuMinFreq,
+     "for f in /sys/devices/system/cpu/cpu*/cpufreq/cpuinfo_min_freq; "
+     "do cat $f; done",
+     "for f in /sys/devices/system/cpu/cpu*/cpufreq/cpuinfo_min_freq; "
+     "do read -r v < $f && echo $v; done",
+     &Snapshot::cpu_min_freq},
+    {CpuMaxFreq,
+     "for f in /sys/devices/system/cpu/cpu*/cpufreq/cpuinfo_max_freq; "
+     "do cat $f; done",
+     "for f in /sys/devices/system/cpu/cpu*/cpufreq/cpuinfo_max_freq; "
+     "do read -r v < $f && echo $v; done",
+     &Snapshot::cpu_max_freq},
+    {CpuAvailableGovernors,
+     "cat /sys/devices/system/cpu/cpu0/cpufreq/scaling_available_governors",
+     "read -r v < /sys/devices/system/cpu/cpu0/cpufreq/scaling_available_governors && echo $v",
+     &Snapshot::cpu_available_governors},
+    {CpuGovernors,
+     "for f in /sys/devices/system/cpu/cpu*/cpufreq/scaling_governor; "
+     "do echo $f: $(cat $f); done",
+     "for f in /sys/devices/system/cpu/cpu*/cpufreq/scaling_governor; "
+     "do v=; read -r v < $f; echo $f: $v; done",
+     &Snapshot::cpu_governors},
+    {CpuIdle,
+     "for cpu in /sys/devices/system/cpu/cpu[0-9]*; do "
+     "c=$(basename $cpu); "
+     "for s in $cpu/cpuidle/state*; do "
+     "st=$(basename $s); "
+     "name=$(cat $s/name 2>/dev/null); "
+     "time=$(cat $s/time 2>/dev/null); "
+     "usage=$(cat $s/usage 2>/dev/null); "
+     "echo $c $st $name $time $usage; "
+     "done; "
+     "done",
+     "for cpu in /sys/devices/system/cpu/cpu[0-9]*; do "
+     "for s in $cpu/cpuidle/state*; do "
+     "name=; time=; usage=; "
+     "{ read -r name < $s/name; read -r time < $s/time; read -r usage < $s/usage; } 2>/dev/null; "
+     "echo ${cpu##*/} ${s##*/} $name $time $usage; "
+     "done; "
+     "done",
+     &Snapshot::cpu_idle},
+    {MemInfo, "cat /proc/meminfo",
+     "while IFS= read -r l; do echo \"$l\"; done < /proc/meminfo",
+     &Snapshot::meminfo},
+    {Uptime, "cat /proc/uptime",
+     "while IFS= read -r l; do echo \"$l\"; done < /proc/uptime",
+     &Snapshot::uptime},
+    {ProcStat, "cat /proc/stat",
+     "while IFS= read -r l; do echo \"$l\"; done < /proc/stat",
+     &Snapshot::proc_stat},
+    {CpuTimeInState,
+     "for cpu in /sys/devices/system/cpu/cpu[0-9]*; do "
+     "f=$cpu/cpufreq/stats/time_in_state; "
+     "[ -r $f ] && sed \"s/^/$(basename $cpu) /\" $f; "
+     "done; true",
+     "for cpu in /sys/devices/system/cpu/cpu[0-9]*; do "
+     "f=$cpu/cpufreq/stats/time_in_state; "
+     "[ -r $f ] && while read -r l; do echo \"${cpu##*/} $l\"; done < $f; "
+     "done; true",
+     &Snapshot::cpu_time_in_state},
+    {CpuFreqLimits,
+     "for f in /sys/devices/system/cpu/cpu*/cpufreq/cpuinfo_max_freq "
+     "/sys/devices/system/cpu/cpu*/cpufreq/scaling_max_freq; "
+     "do echo $f: $(cat $f); done",
+     "for f in /sys/devices/system/cpu/cpu*/cpufreq/cpuinfo_max_freq "
+     "/sys/devices/system/cpu/cpu*/cpufreq/scaling_max_freq; "
+     "do v=; read -r v < $f; echo $f: $v; done",
+     &Snapshot::cpu_freq_limits},
+};
+
+// Commands for the requested sections and the fields their output goes to
+void select(unsigned sections, Script script, std::vector<std::string>& cmds,
+            std::vector<std::string Snapshot::*>& fields) {
+    cmds.clear();
+    fields.clear();
+    for (const auto& source : kSources) {
+        if (sections & source.section) {
+            cmds.push_back(script == Script::Lean ? source.lean : source.command);
+            fields.push_back(source.field);
+        }
+    }
+}
+
+} // namespace
+
+Snapshot capture(adb::Device& device, unsigned sections, Script script, adb::ShellCost* cost) {
+    std::vector<std::string> cmds;
+    std::vector<std::string Snapshot::*> fields;
+    select(sections, script, cmds, fields);
+
+    Snapshot snap;
+    auto results = device.shell_multi(cmds, true, cost);
+    for (size_t i = 0; i < fields.size(); ++i) {
+        snap.*fields[i] = std::move(results[i]);
+    }
+    return snap;
+}
+
+// ============ CAPTURER ============
+
+Capturer::Batch& Capturer::batch(unsigned sections, Script script) {
+    for (auto& batch : batches_) {
+        if (batch.sections == sections && batch.script == script) return batch;
+    }
+    // A sampler only ever combines a few section sets; anything else is not worth keeping
+    if (batches_.size() >= kMaxBatches) batches_.clear();
+    Batch& added = batches_.emplace_back();
+    added.sections = sections;
+    added.script = script;
+    select(sections, script, added.cmds, added.fields);
+    return added;
+}
+
+const Snapshot& Capturer::capture(adb::Device& device, unsigned sections, Script script, adb::ShellCost* cost) {
+    Batch& current = batch(sections, script);
+    // Cleared, not reset: each string keeps its capacity for a later cycle
+    for (const auto& source : kSources) (snapshot_.*source.field).clear();
+
+    device.shell_multi(current.cmds, current.buffer, true, cost);
+    auto& results = current.buffer.results();
+    for (size_t i = 0; i < current.fields.size(); ++i) {
+        // The previous cycle's string goes back to the batch to be reused
+        (snapshot_.*current.fields[i]).swap(results[i]);
+    }
+    return snapshot_;
+}
+
+} // namespace snapshot
@@ -0,0 +1,27 @@
+#include "sources.hpp"
+#include "parsers.hpp"
+
+namespace sources {
+
+std::string SourceCache::fetch(const std::string& cmd) {
+    if (!cost_) return device_.shell(cmd);
+    adb::ShellCost spent;
+    std::string output = device_.shell(cmd, spent);
+    std::lock_guard<std::mutex> lock(cost_mutex_);
+    *cost_ += spent;
+    return output;
+}
+
+const KeyValueMap& SourceCache::battery() {
+    return battery_.get([this] {
+        return parsers::parse_key_value_block(fetch("dumpsys battery"));
+    });
+}
+
+const ThermalMap& SourceCache::thermal() {
+    return thermal_.get([this] {
+        return parsers::parse_thermal_data(fetch("dumpsys thermalservice"));
+    });
+}
+
+} // namespace sources
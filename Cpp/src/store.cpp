@@ -0,0 +1,528 @@
+#include "store.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace store {
+
+namespace {
+
+namespace fs = std::filesystem;
+
+constexpr char kMagic[4] = {'A', 'I', 'S', '1'};
+constexpr uint32_t kVersion = 1;
+constexpr size_t kSegmentBytes = 1u << 20;
+constexpr uint32_t kMaxBlocks = 1024;
+constexpr uint32_t kBlockPoints = 256;
+constexpr size_t kMaxPointBytes = 20;  // two 10-byte varints
+constexpr double kScale = 1000.0;
+constexpr size_t kMaxBuckets = 100000;
+
+// Native byte order; segments are not meant to move between hosts
+struct SegmentHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t block_count;
+    uint32_t sealed;
+    uint64_t data_used;
+    int64_t first_t_ms;
+    int64_t last_t_ms;
+    uint64_t points;
+    uint8_t reserved[16];
+};
+
+struct BlockEntry {
+    int64_t first_t_ms;
+    int64_t last_t_ms;
+    int64_t first_value;  // milli-units
+    uint32_t offset;      // into the data region
+    uint32_t bytes;
+    uint32_t count;
+    uint32_t reserved;
+    double min;
+    double max;
+    double sum;
+};
+
+static_assert(sizeof(SegmentHeader) == 64, "segment header layout");
+static_assert(sizeof(BlockEntry) == 64, "block entry layout");
+
+constexpr size_t kIndexOffset = sizeof(SegmentHeader);
+constexpr size_t kDataOffset = kIndexOffset + kMaxBlocks * sizeof(BlockEntry);
+constexpr size_t kDataCapacity = kSegmentBytes - kDataOffset;
+
+uint64_t zigzag(int64_t v) {
+    return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+int64_t unzigzag(uint64_t v) {
+    return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+
+size_t put_varint(uint8_t* out, uint64_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        out[n++] = static_cast<uint8_t>(v | 0x80);
+        v >>= 7;
+    }
+    out[n++] = static_cast<uint8_t>(v);
+    return n;
+}
+
+uint64_t get_varint(const uint8_t*& p, const uint8_t* end) {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (p == end) break;
+        uint8_t byte = *p++;
+        v |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return v;
+    }
+    throw std::runtime_error("corrupt store block");
+}
+
+// Series names become directory names: keep [A-Za-z0-9._-], %XX the rest
+std::string escape(const std::string& name) {
+    static const char* hex = "0123456789ABCDEF";
+    std::string out;
+    for (unsigned char c : name) {
+        if (std::isalnum(c) || c == '_' || c == '-' || (c == '.' && !out.empty())) {
+            out += static_cast<char>(c);
+        } else {
+            out += '%';
+            out += hex[c >> 4];
+            out += hex[c & 15];
+        }
+    }
+    return out;
+}
+
+std::string unescape(const std::string& name) {
+    std::string out;
+    for (size_t i = 0; i < name.size(); ++i) {
+        if (name[i] == '%' && i + 2 < name.size() && std::isxdigit(static_cast<unsigned char>(name[i + 1])) &&
+            std::isxdigit(static_cast<unsigned char>(name[i + 2]))) {
+            out += static_cast<char>(std::stoi(name.substr(i + 1, 2), nullptr, 16));
+            i += 2;
+        } else {
+            out += name[i];
+        }
+    }
+    return out;
+}
+
+/**
+ * One mmapped segment file. Throws std::runtime_error if it cannot be
+ * mapped.
+ */
+class Mapping {
+public:
+    Mapping(const std::string& path, bool writable) {
+        fd_ = ::open(path.c_str(), (writable ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+        if (fd_ < 0) {
+            throw std::runtime_error("Cannot open segment " + path + ": " + std::strerror(errno));
+        }
+        struct stat st{};
+        if (fstat(fd_, &st) != 0 || static_cast<size_t>(st.st_size) < kDataOffset) {
+            ::close(fd_);
+            throw std::runtime_error("Truncated segment " + path);
+        }
+        size_ = static_cast<size_t>(st.st_size);
+        void* data = mmap(nullptr, size_, PROT_READ | (writable ? PROT_WRITE : 0), MAP_SHARED, fd_, 0);
+        if (data == MAP_FAILED) {
+            ::close(fd_);
+            throw std::runtime_error("Cannot map segment " + path + ": " + std::strerror(errno));
+        }
+        data_ = static_cast<uint8_t*>(data);
+        if (std::memcmp(header()->magic, kMagic, 4) != 0 || header()->version != kVersion) {
+            munmap(data_, size_);
+            ::close(fd_);
+            throw std::runtime_error("Not a store segment: " + path);
+        }
+    }
+
+    ~Mapping() {
+        munmap(data_, size_);
+        ::close(fd_);
+    }
+
+    Mapping(const Mapping&) = delete;
+    Mapping& operator=(const Mapping&) = delete;
+
+    SegmentHeader* header() const { return reinterpret_cast<SegmentHeader*>(data_); }
+    BlockEntry* block(uint32_t i) const { return reinterpret_cast<BlockEntry*>(data_ + kIndexOffset) + i; }
+    const uint8_t* data_region() const { return data_ + kDataOffset; }
+    uint8_t* data_region() { return data_ + kDataOffset; }
+    size_t data_size() const { return size_ - kDataOffset; }
+
+    void sync() { msync(data_, size_, MS_ASYNC); }
+
+private:
+    int fd_ = -1;
+    uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Every point of a block, in order
+template <typename F>
+void decode_block(const Mapping& segment, const BlockEntry& block, F&& fn) {
+    if (block.count == 0) return;
+    if (static_cast<size_t>(block.offset) + block.bytes > segment.data_size()) {
+        throw std::runtime_error("corrupt store block");
+    }
+    int64_t t = block.first_t_ms;
+    int64_t v = block.first_value;
+    fn(t, v / kScale);
+
+    const uint8_t* p = segment.data_region() + block.offset;
+    const uint8_t* end = p + block.bytes;
+    for (uint32_t i = 1; i < block.count; ++i) {
+        t += unzigzag(get_varint(p, end));
+        v += unzigzag(get_varint(p, end));
+        fn(t, v / kScale);
+    }
+}
+
+// Blocks overlapping [from_ms, to_ms), in order
+template <typename F>
+void each_block(const Mapping& segment, int64_t from_ms, int64_t to_ms, F&& fn) {
+    uint32_t count = std::min(segment.header()->block_count, kMaxBlocks);
+    for (uint32_t i = 0; i < count; ++i) {
+        const BlockEntry& block = *segment.block(i);
+        if (block.last_t_ms < from_ms) continue;
+        if (block.first_t_ms >= to_ms) break;
+        fn(block);
+    }
+}
+
+} // namespace
+
+// ============ COLUMN ============
+
+/**
+ * One series: its sealed segments plus the one being appended to.
+ * Queries hold the lock while they scan, which delays this column's
+ * next append by at most the query time.
+ */
+class Column {
+public:
+    Column(std::string dir, std::chrono::hours retention) : dir_(std::move(dir)), retention_(retention) {
+        fs::create_directories(dir_);
+        for (const auto& entry : fs::directory_iterator(dir_)) {
+            if (entry.path().extension() != ".seg") continue;
+            std::string path = entry.path().string();
+            try {
+                // Left open by a previous run: seal it where it stopped
+                {
+                    Mapping segment(path, true);
+                    if (!segment.header()->sealed) {
+                        segment.header()->sealed = 1;
+                        segment.sync();
+                    }
+                }
+                Mapping segment(path, false);
+                const SegmentHeader& header = *segment.header();
+                if (header.points == 0) {
+                    fs::remove(path);
+                    continue;
+                }
+                if (fs::file_size(path) > kDataOffset + header.data_used) {
+                    fs::resize_file(path, kDataOffset + header.data_used);
+                }
+                sealed_.push_back({path, header.first_t_ms, header.last_t_ms});
+            } catch (const std::exception& e) {
+                std::cerr << "Skipping store segment: " << e.what() << "\n";
+            }
+        }
+        std::sort(sealed_.begin(), sealed_.end(),
+                  [](const Sealed& a, const Sealed& b) { return a.first_t_ms < b.first_t_ms; });
+        if (!sealed_.empty()) last_t_ms_ = sealed_.back().last_t_ms;
+    }
+
+    ~Column() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        seal();
+    }
+
+    void append(int64_t t_ms, double value) {
+        if (!std::isfinite(value)) return;
+        int64_t v = std::llround(value * kScale);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        t_ms = std::max(t_ms, last_t_ms_);
+        if (!active_) open_segment(t_ms);
+
+        SegmentHeader* header = active_->header();
+        BlockEntry* block = header->block_count ? active_->block(header->block_count - 1) : nullptr;
+        bool new_block = !block || block->count >= kBlockPoints;
+        if ((new_block && header->block_count == kMaxBlocks) ||
+            (!new_block && header->data_used + kMaxPointBytes > kDataCapacity)) {
+            seal();
+            open_segment(t_ms);
+            header = active_->header();
+            new_block = true;
+        }
+
+        double rounded = v / kScale;
+        if (new_block) {
+            block = active_->block(header->block_count);
+            *block = BlockEntry{t_ms, t_ms, v, static_cast<uint32_t>(header->data_used), 0, 1, 0,
+                                rounded, rounded, rounded};
+            ++header->block_count;
+        } else {
+            uint8_t* out = active_->data_region() + header->data_used;
+            size_t n = put_varint(out, zigzag(t_ms - prev_t_ms_));
+            n += put_varint(out + n, zigzag(v - prev_value_));
+            header->data_used += n;
+            block->bytes += static_cast<uint32_t>(n);
+            block->last_t_ms = t_ms;
+            block->min = std::min(block->min, rounded);
+            block->max = std::max(block->max, rounded);
+            block->sum += rounded;
+            ++block->count;
+        }
+
+        if (header->points == 0) header->first_t_ms = t_ms;
+        header->last_t_ms = t_ms;
+        ++header->points;
+        prev_t_ms_ = t_ms;
+        prev_value_ = v;
+        last_t_ms_ = t_ms;
+    }
+
+    // fn(const Mapping&) for each segment overlapping [from_ms, to_ms), oldest first
+    template <typename F>
+    void visit(int64_t from_ms, int64_t to_ms, F&& fn) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& sealed : sealed_) {
+            if (sealed.last_t_ms < from_ms || sealed.first_t_ms >= to_ms) continue;
+            try {
+                Mapping segment(sealed.path, false);
+                fn(segment);
+            } catch (const std::runtime_error& e) {
+                std::cerr << "Skipping store segment: " << e.what() << "\n";
+            }
+        }
+        if (active_ && active_->header()->points > 0 &&
+            active_->header()->last_t_ms >= from_ms && active_->header()->first_t_ms < to_ms) {
+            fn(*active_);
+        }
+    }
+
+private:
+    struct Sealed {
+        std::string path;
+        int64_t first_t_ms;
+        int64_t last_t_ms;
+    };
+
+    // caller holds mutex_
+    void open_segment(int64_t t_ms) {
+        std::string path;
+        for (int suffix = 0;; ++suffix) {
+            path = dir_ + "/" + std::to_string(t_ms) + (suffix ? "-" + std::to_string(suffix) : "") + ".seg";
+            if (!fs::exists(path)) break;
+        }
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot create segment " + path + ": " + std::strerror(errno));
+        }
+        SegmentHeader header{};
+        std::memcpy(header.magic, kMagic, 4);
+        header.version = kVersion;
+        bool ok = ftruncate(fd, static_cast<off_t>(kSegmentBytes)) == 0 &&
+                  pwrite(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header));
+        ::close(fd);
+        if (!ok) {
+            fs::remove(path);
+            throw std::runtime_error("Cannot size segment " + path);
+        }
+        active_ = std::make_unique<Mapping>(path, true);
+        active_path_ = path;
+        expire(t_ms);
+    }
+
+    // caller holds mutex_
+    void seal() {
+        if (!active_) return;
+        SegmentHeader header = *active_->header();
+        active_->header()->sealed = 1;
+        active_->sync();
+        active_.reset();
+
+        if (header.points == 0) {
+            fs::remove(active_path_);
+            return;
+        }
+        // Drop the unused tail of the data region
+        fs::resize_file(active_path_, kDataOffset + header.data_used);
+        sealed_.push_back({active_path_, header.first_t_ms, header.last_t_ms});
+    }
+
+    // caller holds mutex_
+    void expire(int64_t now_ms) {
+        if (retention_.count() <= 0) return;
+        int64_t cutoff = now_ms - std::chrono::duration_cast<std::chrono::milliseconds>(retention_).count();
+        while (!sealed_.empty() && sealed_.front().last_t_ms < cutoff) {
+            std::error_code ignored;
+            fs::remove(sealed_.front().path, ignored);
+            sealed_.erase(sealed_.begin());
+        }
+    }
+
+    std::string dir_;
+    std::chrono::hours retention_;
+    mutable std::mutex mutex_;
+    std::vector<Sealed> sealed_;
+    std::unique_ptr<Mapping> active_;
+    std::string active_path_;
+    int64_t prev_t_ms_ = 0;
+    int64_t prev_value_ = 0;
+    int64_t last_t_ms_ = std::numeric_limits<int64_t>::min();
+};
+
+// ============ STORE ============
+
+Store::Store(Config config) : config_(std::move(config)) {
+    std::error_code error;
+    fs::create_directories(config_.dir, error);
+    if (error) {
+        throw std::runtime_error("Cannot create store " + config_.dir + ": " + error.message());
+    }
+    for (const auto& metric : fs::directory_iterator(config_.dir)) {
+        if (!metric.is_directory()) continue;
+        for (const auto& series : fs::directory_iterator(metric.path())) {
+            if (!series.is_directory()) continue;
+            std::string name = unescape(series.path().filename().string());
+            columns_[unescape(metric.path().filename().string())][name] =
+                std::make_unique<Column>(series.path().string(), config_.retention);
+        }
+    }
+}
+
+Store::~Store() = default;
+
+void Store::append(const std::string& metric, const std::vector<std::pair<std::string, double>>& points,
+                   int64_t t_ms) {
+    for (const auto& [name, value] : points) {
+        try {
+            get_or_create(metric, name).append(t_ms, value);
+        } catch (const std::exception& e) {
+            std::cerr << "Store append failed: " << metric << "/" << name << ": " << e.what() << "\n";
+        }
+    }
+}
+
+std::vector<std::string> Store::series(const std::string& metric) const {
+    std::vector<std::string> names;
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = columns_.find(metric);
+    if (it == columns_.end()) return names;
+    for (const auto& entry : it->second) names.push_back(entry.first);
+    return names;
+}
+
+std::vector<Point> Store::points(const std::string& metric, const std::string& series, int64_t from_ms,
+                                 int64_t to_ms, size_t limit, bool* truncated) const {
+    std::vector<Point> out;
+    if (truncated) *truncated = false;
+    Column* column = find(metric, series);
+    if (!column) return out;
+
+    bool full = false;
+    column->visit(from_ms, to_ms, [&](const Mapping& segment) {
+        if (full) return;
+        each_block(segment, from_ms, to_ms, [&](const BlockEntry& block) {
+            if (full) return;
+            decode_block(segment, block, [&](int64_t t, double v) {
+                if (full || t < from_ms || t >= to_ms) return;
+                if (out.size() == limit) {
+                    full = true;
+                    return;
+                }
+                out.push_back({t, v});
+            });
+        });
+    });
+    if (truncated) *truncated = full;
+    return out;
+}
+
+std::vector<Bucket> Store::downsample(const std::string& metric, const std::string& series, int64_t from_ms,
+                                      int64_t to_ms, int64_t step_ms) const {
+    if (step_ms <= 0 || to_ms <= from_ms) {
+        throw std::invalid_argument("step must be positive and to after from");
+    }
+    uint64_t buckets = static_cast<uint64_t>((to_ms - from_ms + step_ms - 1) / step_ms);
+    if (buckets > kMaxBuckets) {
+        throw std::invalid_argument("more than " + std::to_string(kMaxBuckets) + " buckets; raise step");
+    }
+
+    std::vector<Bucket> acc(buckets, Bucket{0, std::numeric_limits<double>::infinity(),
+                                             -std::numeric_limits<double>::infinity(), 0.0, 0});
+    Column* column = find(metric, series);
+    if (column) {
+        auto bucket_of = [&](int64_t t) { return static_cast<size_t>((t - from_ms) / step_ms); };
+        column->visit(from_ms, to_ms, [&](const Mapping& segment) {
+            each_block(segment, from_ms, to_ms, [&](const BlockEntry& block) {
+                // A block inside one bucket is folded from its summary, undecoded
+                if (block.first_t_ms >= from_ms && block.last_t_ms < to_ms &&
+                    bucket_of(block.first_t_ms) == bucket_of(block.last_t_ms)) {
+                    Bucket& b = acc[bucket_of(block.first_t_ms)];
+                    b.min = std::min(b.min, block.min);
+                    b.max = std::max(b.max, block.max);
+                    b.avg += block.sum;
+                    b.count += block.count;
+                    return;
+                }
+                decode_block(segment, block, [&](int64_t t, double v) {
+                    if (t < from_ms || t >= to_ms) return;
+                    Bucket& b = acc[bucket_of(t)];
+                    b.min = std::min(b.min, v);
+                    b.max = std::max(b.max, v);
+                    b.avg += v;
+                    ++b.count;
+                });
+            });
+        });
+    }
+
+    std::vector<Bucket> out;
+    for (size_t i = 0; i < acc.size(); ++i) {
+        if (acc[i].count == 0) continue;
+        Bucket b = acc[i];
+        b.t_ms = from_ms + static_cast<int64_t>(i) * step_ms;
+        b.avg /= static_cast<double>(b.count);
+        out.push_back(b);
+    }
+    return out;
+}
+
+Column* Store::find(const std::string& metric, const std::string& series) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = columns_.find(metric);
+    if (it == columns_.end()) return nullptr;
+    auto column = it->second.find(series);
+    return column == it->second.end() ? nullptr : column->second.get();
+}
+
+Column& Store::get_or_create(const std::string& metric, const std::string& series) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& column = columns_[metric][series];
+    if (!column) {
+        column = std::make_unique<Column>(config_.dir + "/" + escape(metric) + "/" + escape(series),
+                                          config_.retention);
+    }
+    return *column;
+}
+
+} // namespace store
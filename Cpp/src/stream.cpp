@@ -0,0 +1,86 @@
+#include "stream.hpp"
+#include <algorithm>
+
+namespace stream {
+
+// ============ SUBSCRIBER ============
+
+Subscriber::Subscriber(std::set<std::string> metrics) : metrics_(std::move(metrics)) {}
+
+bool Subscriber::wants(const std::string& metric) const {
+    return metrics_.empty() || metrics_.count(metric) > 0;
+}
+
+void Subscriber::push(Event event) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (closed_) return;
+        if (queue_.size() >= kMaxQueued) queue_.pop_front();
+        queue_.push_back(std::move(event));
+    }
+    cv_.notify_one();
+}
+
+Event Subscriber::next(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait_for(lock, timeout, [this] { return closed_ || !queue_.empty(); });
+    if (closed_ || queue_.empty()) return nullptr;
+    Event event = std::move(queue_.front());
+    queue_.pop_front();
+    return event;
+}
+
+void Subscriber::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        queue_.clear();
+    }
+    cv_.notify_all();
+}
+
+bool Subscriber::closed() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return closed_;
+}
+
+// ============ BROADCASTER ============
+
+std::shared_ptr<Subscriber> Broadcaster::subscribe(std::set<std::string> metrics) {
+    auto subscriber = std::make_shared<Subscriber>(std::move(metrics));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Start the client off with the current value of each metric
+    for (const auto& [metric, event] : last_event_) {
+        if (subscriber->wants(metric)) subscriber->push(event);
+    }
+    subscribers_.push_back(subscriber);
+    return subscriber;
+}
+
+void Broadcaster::publish(const std::string& metric, const std::string& payload) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto& last = last_payload_[metric];
+    if (last == payload) return;
+    last = payload;
+
+    auto event = std::make_shared<const std::string>("event: " + metric + "\ndata: " + payload + "\n\n");
+    last_event_[metric] = event;
+
+    subscribers_.erase(
+        std::remove_if(subscribers_.begin(), subscribers_.end(), [](const std::weak_ptr<Subscriber>& weak) {
+            auto subscriber = weak.lock();
+            return !subscriber || subscriber->closed();
+        }),
+        subscribers_.end()
+    );
+
+    for (const auto& weak : subscribers_) {
+        if (auto subscriber = weak.lock()) {
+            if (subscriber->wants(metric)) subscriber->push(event);
+        }
+    }
+}
+
+} // namespace stream
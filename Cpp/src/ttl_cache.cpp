@@ -0,0 +1,80 @@
+#include "ttl_cache.hpp"
+
+namespace cache {
+
+namespace {
+
+metrics::Counter& requests(const std::string& key, const char* result) {
+    return metrics::counter("adb_insight_cache_requests_total", "TTL cache lookups by key and outcome",
+                            "key=\"" + metrics::label_value(key) + "\",result=\"" + result + "\"");
+}
+
+} // namespace
+
+TtlCache::TtlCache(Policy default_policy) : default_policy_(default_policy) {}
+
+void TtlCache::configure(const std::string& key, Policy policy) {
+    policies_[key] = policy;
+}
+
+TtlCache::Shard& TtlCache::shard_for(const std::string& key) {
+    return shards_[std::hash<std::string>{}(key) % kShards];
+}
+
+Policy TtlCache::policy_for(const std::string& key) const {
+    auto it = policies_.find(key);
+    return it != policies_.end() ? it->second : default_policy_;
+}
+
+TtlCache::Value TtlCache::get_or_build(const std::string& key, const Builder& build) {
+    Policy policy = policy_for(key);
+    Shard& shard = shard_for(key);
+
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    while (true) {
+        Entry& entry = shard.entries[key];
+        if (!entry.hits) {
+            entry.hits = &requests(key, "hit");
+            entry.stale = &requests(key, "stale");
+            entry.misses = &requests(key, "miss");
+        }
+        auto age = clock::now() - entry.built_at;
+
+        if (entry.value && age < policy.ttl) {
+            entry.hits->inc();
+            return entry.value;
+        }
+        if (!entry.refreshing) {
+            // This caller rebuilds; everyone else waits or gets the stale value
+            entry.refreshing = true;
+            entry.misses->inc();
+            break;
+        }
+        if (entry.value && age < policy.ttl + policy.stale) {
+            entry.stale->inc();
+            return entry.value;
+        }
+        shard.cv.wait(lock);
+    }
+    lock.unlock();
+
+    Value fresh;
+    try {
+        fresh = build();
+    } catch (...) {
+        lock.lock();
+        shard.entries[key].refreshing = false;
+        shard.cv.notify_all();
+        throw;
+    }
+
+    lock.lock();
+    Entry& entry = shard.entries[key];
+    entry.value = fresh;
+    entry.built_at = clock::now();
+    entry.refreshing = false;
+    shard.cv.notify_all();
+    return fresh;
+}
+
+} // namespace cache
@@ -0,0 +1,156 @@
+#include "wire.hpp"
+#include <charconv>
+#include <cmath>
+#include <stdexcept>
+#include <nlohmann/json.hpp>
+
+namespace wire {
+
+namespace {
+
+// Length of the well-formed UTF-8 sequence at s[i], or 0 if malformed
+size_t utf8_sequence(std::string_view s, size_t i) {
+    auto c = static_cast<unsigned char>(s[i]);
+    if (c < 0x80) return 1;
+
+    size_t len;
+    unsigned char lo = 0x80, hi = 0xBF;
+    if (c >= 0xC2 && c <= 0xDF) len = 2;
+    else if (c == 0xE0) { len = 3; lo = 0xA0; }
+    else if (c == 0xED) { len = 3; hi = 0x9F; }
+    else if (c >= 0xE1 && c <= 0xEF) len = 3;
+    else if (c == 0xF0) { len = 4; lo = 0x90; }
+    else if (c == 0xF4) { len = 4; hi = 0x8F; }
+    else if (c >= 0xF1 && c <= 0xF3) len = 4;
+    else return 0;
+
+    if (i + len > s.size()) return 0;
+    auto c1 = static_cast<unsigned char>(s[i + 1]);
+    if (c1 < lo || c1 > hi) return 0;
+    for (size_t k = 2; k < len; ++k) {
+        if ((static_cast<unsigned char>(s[i + k]) & 0xC0) != 0x80) return 0;
+    }
+    return len;
+}
+
+} // namespace
+
+void Writer::separate() {
+    if (need_comma_) out_ += ',';
+}
+
+void Writer::null() {
+    separate();
+    out_ += "null";
+    need_comma_ = true;
+}
+
+void Writer::boolean(bool v) {
+    separate();
+    out_ += v ? "true" : "false";
+    need_comma_ = true;
+}
+
+void Writer::integer(int64_t v) {
+    separate();
+    char buf[24];
+    auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), v);
+    (void)ec;
+    out_.append(buf, end);
+    need_comma_ = true;
+}
+
+void Writer::number(double v) {
+    if (!std::isfinite(v)) {
+        null();
+        return;
+    }
+    separate();
+    // nlohmann's own shortest round-trip formatter, so output is identical
+    char buf[64];
+    char* end = nlohmann::detail::to_chars(buf, buf + sizeof(buf), v);
+    out_.append(buf, end);
+    need_comma_ = true;
+}
+
+void Writer::string(std::string_view v) {
+    static const char hex[] = "0123456789abcdef";
+    separate();
+    out_ += '"';
+
+    size_t run = 0;
+    size_t i = 0;
+    while (i < v.size()) {
+        auto c = static_cast<unsigned char>(v[i]);
+        const char* escape = nullptr;
+        switch (c) {
+            case '"': escape = "\\\""; break;
+            case '\\': escape = "\\\\"; break;
+            case '\b': escape = "\\b"; break;
+            case '\f': escape = "\\f"; break;
+            case '\n': escape = "\\n"; break;
+            case '\r': escape = "\\r"; break;
+            case '\t': escape = "\\t"; break;
+            default: break;
+        }
+
+        if (!escape && c >= 0x20) {
+            size_t len = utf8_sequence(v, i);
+            if (len == 0) {
+                throw std::runtime_error("invalid UTF-8 byte at index " + std::to_string(i));
+            }
+            i += len;
+            continue;
+        }
+
+        // Flush the plain run, then the escape
+        out_.append(v.data() + run, i - run);
+        if (escape) {
+            out_ += escape;
+        } else {
+            char u[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+            out_.append(u, sizeof(u));
+        }
+        run = ++i;
+    }
+    out_.append(v.data() + run, v.size() - run);
+
+    out_ += '"';
+    need_comma_ = true;
+}
+
+void Writer::raw(std::string_view encoded) {
+    separate();
+    out_.append(encoded.data(), encoded.size());
+    need_comma_ = true;
+}
+
+void Writer::begin_object() {
+    separate();
+    out_ += '{';
+    need_comma_ = false;
+}
+
+void Writer::key(std::string_view name) {
+    string(name);
+    out_ += ':';
+    need_comma_ = false;
+}
+
+void Writer::end_object() {
+    out_ += '}';
+    need_comma_ = true;
+}
+
+void Writer::begin_array() {
+    separate();
+    out_ += '[';
+    need_comma_ = false;
+}
+
+void Writer::end_array() {
+    out_ += ']';
+    need_comma_ = true;
+}
+
+} // namespace wire